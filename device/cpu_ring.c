@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ *	Mappable per-processor rings, see <device/cpu_ring.h>.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+
+#include <device/cpu_ring.h>
+#include <device/device_types.h>
+#include <kern/assert.h>
+#include <mach/machine.h>
+#include <machine/pmap.h>
+#include <vm/vm_kern.h>
+
+void
+cpu_ring_set_init (struct cpu_ring_set *set, unsigned int magic,
+		   unsigned int version, vm_size_t header_size,
+		   vm_size_t ring_size, unsigned int nslots,
+		   vm_size_t slot_size, boolean_t overwrite)
+{
+  assert ((nslots & (nslots - 1)) == 0);
+  assert (header_size >= sizeof (struct cpu_ring_area));
+  assert (ring_size == CPU_RING_HEADER_SIZE + nslots * slot_size);
+
+  kmutex_init (&set->lock);
+  memset (set->rings, 0, sizeof set->rings);
+  set->area = NULL;
+  set->header_size = round_page (header_size);
+  set->ring_size = round_page (ring_size);
+  set->size = 0;
+  set->slot_size = slot_size;
+  set->nslots = nslots;
+  set->magic = magic;
+  set->version = version;
+  set->overwrite = overwrite;
+}
+
+void
+cpu_ring_set_reset (struct cpu_ring_set *set)
+{
+  struct cpu_ring_area *area = set->area;
+
+  memset (area, 0, set->size);
+  area->magic = set->magic;
+  area->version = set->version;
+  area->ncpus = ncpu;
+  area->nslots = set->nslots;
+  area->ring_offset = set->header_size;
+  area->ring_size = set->ring_size;
+  area->size = set->size;
+}
+
+io_return_t
+cpu_ring_set_alloc (struct cpu_ring_set *set)
+{
+  vm_offset_t addr;
+  vm_size_t size;
+  int i;
+
+  if (set->area != NULL)
+    return D_SUCCESS;
+
+  size = set->header_size + ncpu * set->ring_size;
+  if (kmem_alloc_wired (kernel_map, &addr, size) != KERN_SUCCESS)
+    return D_NO_MEMORY;
+
+  set->area = (struct cpu_ring_area *) addr;
+  set->size = size;
+  cpu_ring_set_reset (set);
+
+  for (i = 0; i < ncpu; i++)
+    set->rings[i] = (struct cpu_ring *)
+      (addr + set->header_size + i * set->ring_size);
+
+  return D_SUCCESS;
+}
+
+void *
+cpu_ring_reserve (struct cpu_ring_set *set, int cpu, unsigned int *seq)
+{
+  struct cpu_ring *ring;
+  unsigned int head;
+  void *slot;
+
+  ring = set->rings[cpu];
+  if (ring == NULL)
+    return NULL;
+
+  head = __atomic_load_n (&ring->head, __ATOMIC_RELAXED);
+  do
+    {
+      if (!set->overwrite && head - ring->tail >= set->nslots)
+	{
+	  __atomic_add_fetch (&ring->drops, 1, __ATOMIC_RELAXED);
+	  return NULL;
+	}
+    }
+  while (!__atomic_compare_exchange_n (&ring->head, &head, head + 1, FALSE,
+				       __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+
+  slot = (char *) ring + CPU_RING_HEADER_SIZE
+	 + (head & (set->nslots - 1)) * set->slot_size;
+
+  /* The consumer may be reading the slot: invalidate it before
+     writing over it.  */
+  if (set->overwrite)
+    {
+      __atomic_store_n ((unsigned int *) slot, 0, __ATOMIC_RELAXED);
+      __atomic_thread_fence (__ATOMIC_RELEASE);
+    }
+
+  *seq = head + 1;
+  return slot;
+}
+
+io_return_t
+cpu_ring_set_get_status (struct cpu_ring_set *set, unsigned int status_count,
+			 dev_status_t data, mach_msg_type_number_t *count)
+{
+  if (*count < status_count)
+    return D_INVALID_OPERATION;
+  if (set->area == NULL)
+    return D_DEVICE_DOWN;
+
+  memcpy (data, set->area, status_count * sizeof (int));
+  *count = status_count;
+  return D_SUCCESS;
+}
+
+io_return_t
+cpu_ring_set_get_size (struct cpu_ring_set *set, dev_status_t data,
+		       mach_msg_type_number_t *count)
+{
+  data[DEV_GET_SIZE_DEVICE_SIZE] = set->size;
+  data[DEV_GET_SIZE_RECORD_SIZE] = set->slot_size;
+  *count = DEV_GET_SIZE_COUNT;
+  return D_SUCCESS;
+}
+
+vm_offset_t
+cpu_ring_set_mmap (struct cpu_ring_set *set, vm_offset_t off, vm_prot_t prot)
+{
+  /* Users only write the tails of rings that drop records.  */
+  if (set->area == NULL || off >= set->size
+      || (set->overwrite && (prot & VM_PROT_WRITE)))
+    return -1;
+
+  return pmap_phys_to_frame (kvtophys ((vm_offset_t) set->area + off));
+}
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _DEVICE_CPU_RING_H_
+#define _DEVICE_CPU_RING_H_
+
+#include <sys/types.h>
+
+#include <device/device_types.h>
+#include <kern/cpu_number.h>
+#include <kern/kmutex.h>
+#include <mach/boolean.h>
+#include <mach/machine/vm_types.h>
+#include <mach/vm_prot.h>
+
+/*
+ * Mappable per-processor rings.
+ *
+ * A ring set is a wired area, exported to users with device_map,
+ * holding a header followed by one ring per processor.  Code that
+ * may run at any interrupt level produces into the ring of its
+ * processor without taking any lock, and a user consumes from it.
+ *
+ * The header of the area starts with the fields of struct
+ * cpu_ring_area, and each ring with the fields of struct cpu_ring,
+ * padded to CPU_RING_HEADER_SIZE, followed by its slots.  Each slot
+ * starts with its sequence field, which holds its ring index plus
+ * one once complete.  See <device/prof_ring.h> and
+ * <device/trace_ring.h> for the two users of this layout.
+ *
+ * The producers of a ring either drop records when the ring is full,
+ * in which case the user advances the tail of the ring and may write
+ * into the area, or overwrite the oldest records, in which case the
+ * user keeps its own position and the area is mapped read-only.
+ */
+
+struct cpu_ring_area {
+	unsigned int	magic;
+	unsigned int	version;
+	unsigned int	ncpus;		/* number of rings */
+	unsigned int	nslots;		/* slots per ring */
+	unsigned int	ring_offset;	/* offset of ring 0 in the area */
+	unsigned int	ring_size;	/* distance between two rings */
+	unsigned int	size;		/* size of the whole area */
+};
+
+struct cpu_ring {
+	volatile unsigned int	head;	/* next slot to produce */
+	volatile unsigned int	tail;	/* next slot to consume, if dropping */
+	unsigned int	drops;		/* records dropped, if dropping */
+};
+
+#define CPU_RING_HEADER_SIZE	64
+
+struct cpu_ring_set {
+	struct kmutex	lock;		/* serializes open and control */
+	struct cpu_ring	*rings[NCPUS];
+	struct cpu_ring_area *area;	/* wired kernel mapping */
+	vm_size_t	size;
+	vm_size_t	header_size;
+	vm_size_t	ring_size;
+	vm_size_t	slot_size;
+	unsigned int	nslots;		/* power of 2 */
+	unsigned int	magic;
+	unsigned int	version;
+	boolean_t	overwrite;
+};
+
+/*
+ * Initialize a ring set, without allocating its area.
+ */
+void cpu_ring_set_init (struct cpu_ring_set *set, unsigned int magic,
+			unsigned int version, vm_size_t header_size,
+			vm_size_t ring_size, unsigned int nslots,
+			vm_size_t slot_size, boolean_t overwrite);
+
+/*
+ * Allocate and reset the area of a ring set, if not done yet.  The
+ * area is then kept for good, as it may still be mapped, and produced
+ * into.  The set must be locked.
+ */
+io_return_t cpu_ring_set_alloc (struct cpu_ring_set *set);
+
+/*
+ * Clear the area of a ring set, and fill the common fields of its
+ * header.  The set must be locked.
+ */
+void cpu_ring_set_reset (struct cpu_ring_set *set);
+
+/*
+ * Reserve the next slot of the ring of processor cpu, and return it
+ * with its sequence number, or return NULL if the ring is full and
+ * records are dropped.  This may interrupt, or be interrupted by,
+ * another producer on the same processor.
+ */
+void *cpu_ring_reserve (struct cpu_ring_set *set, int cpu,
+			unsigned int *seq);
+
+/*
+ * Mark a slot returned by cpu_ring_reserve complete.
+ */
+static inline void
+cpu_ring_commit (void *slot, unsigned int seq)
+{
+  __atomic_store_n ((unsigned int *) slot, seq, __ATOMIC_RELEASE);
+}
+
+/*
+ * Copy the first status_count fields of the header of a ring set, for
+ * the status flavor of its device.
+ */
+io_return_t cpu_ring_set_get_status (struct cpu_ring_set *set,
+				     unsigned int status_count,
+				     dev_status_t data,
+				     mach_msg_type_number_t *count);
+
+/*
+ * Report the size of the area of a ring set, and of its slots, for
+ * DEV_GET_SIZE.
+ */
+io_return_t cpu_ring_set_get_size (struct cpu_ring_set *set,
+				   dev_status_t data,
+				   mach_msg_type_number_t *count);
+
+/*
+ * Return the page frame mapping offset off of the area of a ring set.
+ */
+vm_offset_t cpu_ring_set_mmap (struct cpu_ring_set *set, vm_offset_t off,
+			       vm_prot_t prot);
+
+#endif /* _DEVICE_CPU_RING_H_ */
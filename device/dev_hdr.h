@@ -75,6 +75,17 @@ typedef struct device *device_t;
 
 #define DEVICE_NULL	((device_t) 0)
 
+/*
+ * Completion statistics, kept per processor so that completion
+ * threads can update them without locking.
+ */
+struct io_done_stats {
+	unsigned int	completions;	/* requests completed */
+	unsigned int	remote;		/* completed on another processor */
+	unsigned long long cycles;	/* total issue-to-completion time */
+	unsigned long long max_cycles;	/* longest completion time */
+};
+
 /*
  * Generic device header.  May be allocated with the device,
  * or built when the device is opened.
@@ -100,6 +111,9 @@ struct mach_device {
 	int		bsize;		/* replacement for DEV_BSIZE */
 	struct dev_ops	*dev_ops;	/* and operations vector */
 	struct device	dev;		/* the real device structure */
+	struct io_done_stats *io_stats;	/* completion statistics, one
+					   per completion queue, allocated
+					   on first open */
 };
 typedef	struct mach_device *mach_device_t;
 #define	MACH_DEVICE_NULL ((mach_device_t)0)
@@ -28,9 +28,11 @@
  *	Date: 	3/89
  */
 
+#include <string.h>
 #include <mach/port.h>
 #include <mach/vm_param.h>
 
+#include <kern/kalloc.h>
 #include <kern/queue.h>
 #include <kern/slab.h>
 
@@ -164,6 +166,7 @@ device_lookup(char *name)
 	    new_device->dev_ops = dev_ops;
 	    new_device->dev_number = dev_minor;
 	    new_device->bsize = DEV_BSIZE;	/* change later */
+	    new_device->io_stats = NULL;
 
 	    simple_lock(&dev_number_lock);
 	}
@@ -231,6 +234,9 @@ mach_device_deallocate(mach_device_t device)
 	simple_unlock(&device->ref_lock);
 	simple_unlock(&dev_number_lock);
 
+	if (device->io_stats != NULL)
+	    kfree((vm_offset_t)device->io_stats,
+		  io_done_nqueues * sizeof(struct io_done_stats));
 	kmem_cache_free(&dev_hdr_cache, (vm_offset_t)device);
 }
 
@@ -120,6 +120,9 @@ struct dev_pager {
 	/* char pager specifics */
 	int		prot;
 	vm_size_t	size;
+	boolean_t	write_combine;	/* map write-combining */
+	struct pmap_wc_set wc_set;	/* frames mapped write-combining */
+	boolean_t	revoked;	/* device_pager_revoke called */
 };
 typedef struct dev_pager *dev_pager_t;
 #define	DEV_PAGER_NULL	((dev_pager_t)0)
@@ -196,7 +199,12 @@ void dev_pager_hash_insert(
 	simple_unlock(&dev_pager_hash_lock);
 }
 
-void dev_pager_hash_delete(const ipc_port_t name_port)
+/*
+ * Remove the entry of name_port, if it still refers to pager_rec.
+ */
+void dev_pager_hash_delete(
+	const ipc_port_t	name_port,
+	const dev_pager_t	pager_rec)
 {
 	queue_t			bucket;
 	dev_pager_entry_t	entry;
@@ -207,14 +215,14 @@ void dev_pager_hash_delete(const ipc_port_t name_port)
 	for (entry = (dev_pager_entry_t)queue_first(bucket);
 	     !queue_end(bucket, &entry->links);
 	     entry = (dev_pager_entry_t)queue_next(&entry->links)) {
-	    if (entry->name == name_port) {
+	    if (entry->name == name_port && entry->pager_rec == pager_rec) {
 		queue_remove(bucket, entry, dev_pager_entry_t, links);
-		break;
+		simple_unlock(&dev_pager_hash_lock);
+		kmem_cache_free(&dev_pager_hash_cache, (vm_offset_t)entry);
+		return;
 	    }
 	}
 	simple_unlock(&dev_pager_hash_lock);
-	if (entry)
-	    kmem_cache_free(&dev_pager_hash_cache, (vm_offset_t)entry);
 }
 
 dev_pager_t dev_pager_hash_lookup(const ipc_port_t name_port)
@@ -288,7 +296,10 @@ kern_return_t	device_pager_setup(
 	d->pager_name = IP_NULL;
 	d->device = device;
 	mach_device_reference(device);
-	d->prot = prot;
+	d->prot = prot & VM_PROT_ALL;
+	d->write_combine = (prot & D_MAP_WRITE_COMBINE) != 0;
+	pmap_wc_set_init(&d->wc_set);
+	d->revoked = FALSE;
 	d->size = round_page(size);
 	if (device->dev_ops->d_mmap == block_io_mmap) {
 		d->type = DEV_PAGER_TYPE;
@@ -318,6 +329,63 @@ void	device_pager_release(memory_object_t	object)
 
 boolean_t	device_pager_debug = FALSE;
 
+/*
+ *	Most of the cost of touching a device page for the first time
+ *	is the round trip through this pager, so a data request maps
+ *	as many of the following pages as the device allows, up to
+ *	this many and up to the first one already there.  A frame
+ *	buffer is then mapped by its first fault.
+ */
+int		device_pager_prefault_pages = 4096;
+
+/*
+ *	The device is probed without the object lock, which is only
+ *	held to look this many pages up at a time.
+ */
+#define	DEVICE_PAGER_PREFAULT_BATCH	16
+
+/*
+ *	Return the end of the range to map for a request of
+ *	[offset, offset + length).
+ */
+static vm_offset_t
+device_pager_prefault_end(
+	dev_pager_t		ds,
+	vm_object_t		object,
+	vm_offset_t		offset,
+	vm_size_t		length)
+{
+	vm_offset_t		end, limit, batch, probe;
+
+	end = offset + length;
+	limit = offset + ptoa(device_pager_prefault_pages);
+	if (limit > ds->size || limit < offset)
+		limit = ds->size;
+
+	while (end < limit) {
+		batch = end + ptoa(DEVICE_PAGER_PREFAULT_BATCH);
+		if (batch > limit || batch < end)
+			batch = limit;
+
+		for (probe = end; probe < batch; probe += PAGE_SIZE)
+			if ((*(ds->device->dev_ops->d_mmap))
+				(ds->device->dev_number, probe, ds->prot)
+			    == (vm_offset_t) -1)
+				break;
+
+		vm_object_lock(object);
+		while (end < probe
+		       && vm_page_lookup(object, end) == VM_PAGE_NULL)
+			end += PAGE_SIZE;
+		vm_object_unlock(object);
+
+		if (end < batch)
+			break;
+	}
+
+	return end;
+}
+
 kern_return_t	device_pager_data_request(
 	const ipc_port_t	pager,
 	const ipc_port_t	pager_request,
@@ -338,7 +406,11 @@ kern_return_t	device_pager_data_request(
 	if (ds->pager_request != pager_request)
 		panic("(device_pager)data_request: bad pager_request");
 
-	if (ds->type == CHAR_PAGER_TYPE) {
+	if (ds->revoked) {
+	    (void) r_memory_object_data_error(pager_request,
+					      offset, length,
+					      KERN_FAILURE);
+	} else if (ds->type == CHAR_PAGER_TYPE) {
 	    vm_object_t			object;
 
 	    object = vm_object_lookup(pager_request);
@@ -351,7 +423,10 @@ kern_return_t	device_pager_data_request(
 	    }
 
 	    vm_object_page_map(object,
-			       offset, length,
+			       offset,
+			       device_pager_prefault_end(ds, object,
+							 offset, length)
+			       - offset,
 			       device_map_page, (void *)ds);
 
 	    vm_object_deallocate(object);
@@ -420,10 +495,14 @@ vm_offset_t device_map_page(
 	vm_offset_t	offset)
 {
 	dev_pager_t	ds = (dev_pager_t) dsp;
+	vm_offset_t	addr;
 
-	return pmap_phys_address(
+	addr = pmap_phys_address(
 		   (*(ds->device->dev_ops->d_mmap))
 			(ds->device->dev_number, offset, ds->prot));
+	if (ds->write_combine)
+		(void) pmap_write_combine(&ds->wc_set, addr, addr + PAGE_SIZE);
+	return addr;
 }
 
 kern_return_t device_pager_init_pager(
@@ -492,10 +571,13 @@ kern_return_t device_pager_terminate(
 	assert(ds->pager_request == pager_request);
 	assert(ds->pager_name == pager_name);
 
-	dev_pager_hash_delete(ds->pager);
-	dev_pager_hash_delete((ipc_port_t)ds->device);	/* HACK */
+	dev_pager_hash_delete(ds->pager, ds);
+	dev_pager_hash_delete((ipc_port_t)ds->device, ds);	/* HACK */
 	mach_device_deallocate(ds->device);
 
+	/* no mapping of the device is left */
+	pmap_write_combine_release(&ds->wc_set);
+
 	/* release the send rights we have saved from the init call */
 
 	ipc_port_release_send(pager_request);
@@ -517,6 +599,42 @@ kern_return_t device_pager_terminate(
 	return (KERN_SUCCESS);
 }
 
+/*
+ *	Routine:	device_pager_revoke
+ *	Purpose:
+ *		Cut the existing memory object of a device off from
+ *		the device.  Its resident pages are discarded and
+ *		later faults on it fail, while the next device_map
+ *		call creates a new memory object.  Mappings already
+ *		made in physical maps are left to the caller, which
+ *		must remove them before the device memory is used
+ *		again: the memory is no longer mapped write-combining
+ *		on behalf of this object.
+ */
+void device_pager_revoke(mach_device_t device)
+{
+	dev_pager_t	ds;
+	vm_object_t	object;
+
+	ds = dev_pager_hash_lookup((ipc_port_t)device);	/* HACK */
+	if (ds == DEV_PAGER_NULL)
+		return;
+
+	dev_pager_hash_delete((ipc_port_t)device, ds);	/* HACK */
+	ds->revoked = TRUE;
+
+	object = vm_object_lookup(ds->pager_request);
+	if (object != VM_OBJECT_NULL) {
+		vm_object_lock(object);
+		vm_object_page_remove(object, 0, ds->size);
+		vm_object_unlock(object);
+		vm_object_deallocate(object);
+	}
+	pmap_write_combine_release(&ds->wc_set);
+
+	dev_pager_deallocate(ds);
+}
+
 kern_return_t device_pager_data_unlock(
 	const ipc_port_t memory_object,
 	const ipc_port_t memory_control_port,
@@ -23,4 +23,6 @@ vm_offset_t device_map_page(void *dsp, vm_offset_t offset);
 
 boolean_t device_pager_data_request_done(io_req_t ior);
 
+void device_pager_revoke(mach_device_t device);
+
 #endif /* _DEVICE_DEV_PAGER_H_ */
@@ -59,6 +59,8 @@ struct device_emulation_ops
 			     recnum_t, vm_offset_t, vm_size_t);
   io_return_t (*writev_trap) (void *, dev_mode_t,
 			      recnum_t, io_buf_vec_t *, vm_size_t);
+  io_return_t (*read_into) (void *, ipc_port_t, mach_msg_type_name_t,
+			    dev_mode_t, recnum_t, vm_offset_t, int, int *);
 };
 
 #endif /* _I386AT_DEVICE_EMUL_H_ */
@@ -41,6 +41,8 @@
 #include <device/ds_routines.h>
 #include <device/net_io.h>
 #include <device/chario.h>
+#include <device/netring.h>
+#include <device/trace.h>
 
 
 ipc_port_t	master_device_port;
@@ -60,7 +62,9 @@ device_service_create(void)
 	net_io_init();
 	device_pager_init();
 	chario_init();
+	netring_init();
+	trace_init();
 
-	(void) kernel_thread(kernel_task, io_done_thread, 0);
-	(void) kernel_thread(kernel_task, net_thread, 0);
+	io_done_thread_create();
+	net_thread_create();
 }
@@ -58,6 +58,7 @@
 
 #include <mach/boolean.h>
 #include <mach/kern_return.h>
+#include <mach/machine.h>
 #include <mach/mig_errors.h>
 #include <mach/port.h>
 #include <mach/vm_param.h>
@@ -72,6 +73,7 @@
 #include <kern/counters.h>
 #include <kern/debug.h>
 #include <kern/printf.h>
+#include <kern/processor.h>
 #include <kern/queue.h>
 #include <kern/slab.h>
 #include <kern/thread.h>
@@ -81,6 +83,8 @@
 #include <vm/memory_object.h>
 #include <vm/vm_map.h>
 #include <vm/vm_kern.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
 #include <vm/vm_user.h>
 
 #include <device/device_types.h>
@@ -136,6 +140,46 @@ vm_map_t		device_io_map = &device_io_map_store;
 struct kmem_cache	io_inband_cache;
 
 #define NUM_EMULATION (sizeof (emulation_list) / sizeof (emulation_list[0]))
+
+/* Set while devices are still probed in the background.  Opens wait
+   for the probes to finish, so that every device can be found.  */
+static boolean_t ds_probing;
+decl_simple_lock_data (static, ds_probe_lock)
+
+void
+ds_probe_start (void)
+{
+  simple_lock (&ds_probe_lock);
+  ds_probing = TRUE;
+  simple_unlock (&ds_probe_lock);
+}
+
+void
+ds_probe_done (void)
+{
+  simple_lock (&ds_probe_lock);
+  ds_probing = FALSE;
+  simple_unlock (&ds_probe_lock);
+  thread_wakeup ((event_t) &ds_probing);
+}
+
+static void
+ds_probe_wait (void)
+{
+  /* Probes are never started again once done.  */
+  if (! ds_probing)
+    return;
+
+  simple_lock (&ds_probe_lock);
+  while (ds_probing)
+    {
+      assert_wait ((event_t) &ds_probing, FALSE);
+      simple_unlock (&ds_probe_lock);
+      thread_block (thread_no_continuation);
+      simple_lock (&ds_probe_lock);
+    }
+  simple_unlock (&ds_probe_lock);
+}
 
 io_return_t
 ds_device_open (ipc_port_t open_port, ipc_port_t reply_port,
@@ -157,6 +201,8 @@ ds_device_open (ipc_port_t open_port, ipc_port_t reply_port,
       return MIG_NO_REPLY;
     }
 
+  ds_probe_wait ();
+
   /* Call each emulation's open routine to find the device.  */
   for (i = 0; i < NUM_EMULATION; i++)
     {
@@ -260,6 +306,24 @@ ds_device_read_inband (device_t dev, ipc_port_t reply_port,
 					count, data, bytes_read);
 }
 
+io_return_t
+ds_device_read_into (device_t dev, ipc_port_t reply_port,
+		     mach_msg_type_name_t reply_port_type, dev_mode_t mode,
+		     recnum_t recnum, vm_offset_t address, int count,
+		     int *bytes_read)
+{
+  /* Refuse if device is dead or not completely open.  */
+  if (dev == DEVICE_NULL)
+    return D_NO_SUCH_DEVICE;
+
+  if (! dev->emul_ops->read_into)
+    return D_INVALID_OPERATION;
+
+  return (*dev->emul_ops->read_into) (dev->emul_data, reply_port,
+				      reply_port_type, mode, recnum,
+				      address, count, bytes_read);
+}
+
 io_return_t
 ds_device_set_status (device_t dev, dev_flavor_t flavor,
 		      dev_status_t status, mach_msg_type_number_t status_count)
@@ -547,6 +611,18 @@ device_open(const ipc_port_t	reply_port,
 	device->state = DEV_STATE_OPENING;
 	device_unlock(device);
 
+	/*
+	 * Devices only get completion statistics once they are opened.
+	 * Opening excludes other opens, so no lock is needed.
+	 */
+	if (device->io_stats == NULL) {
+	    vm_size_t size = io_done_nqueues * sizeof(struct io_done_stats);
+
+	    device->io_stats = (struct io_done_stats *) kalloc(size);
+	    if (device->io_stats != NULL)
+		memset(device->io_stats, 0, size);
+	}
+
 	/*
 	 * Allocate port, keeping a reference for it.
 	 */
@@ -1201,6 +1277,226 @@ device_read(void *dev,
 	return (MIG_NO_REPLY);	/* reply has already been sent. */
 }
 
+/*
+ * Map the pages backing [address, address + size) of map into
+ * device_io_map, so that a driver can read directly into them.
+ * The range must be page-aligned and wired writable, so that the
+ * pages are resident and not shared copy-on-write.  Each page is
+ * wired again, with a reference on its object, for the duration
+ * of the transfer: the caller may unwire or deallocate the range
+ * meanwhile without the pages being freed.
+ */
+io_return_t device_read_into_map(
+	vm_map_t		map,
+	vm_offset_t		address,
+	vm_size_t		size,
+	vm_offset_t		*kaddr)
+{
+	vm_map_entry_t		entry;
+	vm_object_t		object;
+	vm_page_t		m;
+	vm_offset_t		addr, o;
+	kern_return_t		kr;
+
+	if (size == 0 || !page_aligned(address) || !page_aligned(size))
+	    return (D_INVALID_OPERATION);
+
+	addr = vm_map_min(device_io_map);
+	kr = vm_map_enter(device_io_map, &addr, size, 0, TRUE,
+			  VM_OBJECT_NULL, 0, FALSE,
+			  VM_PROT_READ|VM_PROT_WRITE,
+			  VM_PROT_READ|VM_PROT_WRITE, VM_INHERIT_NONE);
+	if (kr != KERN_SUCCESS)
+	    return (D_NO_MEMORY);
+
+	vm_map_lock_read(map);
+	for (o = 0; o < size; o += PAGE_SIZE) {
+	    if (!vm_map_lookup_entry(map, address + o, &entry) ||
+		entry->is_sub_map ||
+		entry->wired_count == 0 ||
+		(entry->wired_access & VM_PROT_WRITE) == 0 ||
+		(object = entry->object.vm_object) == VM_OBJECT_NULL) {
+		kr = KERN_INVALID_ADDRESS;
+		break;
+	    }
+
+	    vm_object_lock(object);
+	    m = vm_page_lookup(object, entry->offset
+				       + (address + o - entry->vme_start));
+	    if (m == VM_PAGE_NULL || m->absent || m->error ||
+		m->fictitious) {
+		vm_object_unlock(object);
+		kr = KERN_INVALID_ADDRESS;
+		break;
+	    }
+	    vm_object_reference_locked(object);
+	    vm_page_lock_queues();
+	    vm_page_wire(m);
+	    vm_page_unlock_queues();
+	    vm_object_unlock(object);
+
+	    pmap_enter(vm_map_pmap(device_io_map), addr + o, m->phys_addr,
+		       VM_PROT_READ|VM_PROT_WRITE, TRUE);
+	}
+	vm_map_unlock_read(map);
+
+	if (kr != KERN_SUCCESS) {
+	    device_read_into_unmap(addr, o);
+	    (void) vm_map_remove(device_io_map, addr + o, addr + size);
+	    return (D_INVALID_OPERATION);
+	}
+
+	*kaddr = addr;
+	return (D_SUCCESS);
+}
+
+/*
+ * Undo device_read_into_map, releasing the wiring of the pages.
+ */
+void device_read_into_unmap(
+	vm_offset_t		kaddr,
+	vm_size_t		size)
+{
+	vm_object_t		object;
+	vm_page_t		m;
+	vm_offset_t		o;
+
+	for (o = 0; o < size; o += PAGE_SIZE) {
+	    m = vm_page_lookup_pa(pmap_extract(vm_map_pmap(device_io_map),
+					       kaddr + o));
+	    assert(m != VM_PAGE_NULL);
+	    object = m->object;
+
+	    /*
+	     * Mark the page dirty: if it was filled by DMA, the
+	     * pmap module may think that it is clean.
+	     */
+	    vm_object_lock(object);
+	    vm_page_lock_queues();
+	    m->dirty = TRUE;
+	    vm_page_unwire(m);
+	    vm_page_unlock_queues();
+	    vm_object_unlock(object);
+	    vm_object_deallocate(object);
+	}
+
+	pmap_remove(vm_map_pmap(device_io_map), kaddr, kaddr + size);
+	(void) vm_map_remove(device_io_map, kaddr, kaddr + size);
+}
+
+boolean_t ds_read_into_done(const io_req_t ior)
+{
+	vm_size_t		size_read;
+
+	if (ior->io_error)
+	    size_read = 0;
+	else
+	    size_read = ior->io_count - ior->io_residual;
+
+	device_read_into_unmap((vm_offset_t)ior->io_data,
+			       ior->io_alloc_size);
+
+	(void)ds_device_read_into_reply(ior->io_reply_port,
+					ior->io_reply_port_type,
+					ior->io_error,
+					size_read);
+
+	mach_device_deallocate(ior->io_device);
+
+	return (TRUE);
+}
+
+/*
+ * Read from a device directly into the caller's memory.
+ */
+static io_return_t
+device_read_into(void			*dev,
+		 const ipc_port_t	reply_port,
+		 mach_msg_type_name_t	reply_port_type,
+		 dev_mode_t		mode,
+		 recnum_t		recnum,
+		 vm_offset_t		address,
+		 int			bytes_wanted,
+		 int			*bytes_read)
+{
+	mach_device_t		device = dev;
+	io_req_t		ior;
+	io_return_t		result;
+	vm_offset_t		kaddr;
+	vm_size_t		size;
+
+	if (device->state != DEV_STATE_OPEN)
+	    return (D_NO_SUCH_DEVICE);
+
+	/* XXX note that a CLOSE may proceed at any point */
+
+	/*
+	 * There must be a reply port.
+	 */
+	if (!IP_VALID(reply_port)) {
+	    printf("ds_* invalid reply port\n");
+	    SoftDebugger("ds_* reply_port");
+	    return (MIG_NO_REPLY);	/* no sense in doing anything */
+	}
+
+	if (bytes_wanted <= 0)
+	    return (D_INVALID_SIZE);
+	if (bytes_wanted > DEVICE_READ_INTO_MAX)
+	    bytes_wanted = DEVICE_READ_INTO_MAX;
+
+	/*
+	 * Map the caller's pages for the driver.
+	 */
+	size = round_page(bytes_wanted);
+	result = device_read_into_map(current_map(), address, size, &kaddr);
+	if (result != D_SUCCESS)
+	    return (result);
+
+	/*
+	 * Package the read request for the device driver
+	 */
+	io_req_alloc(ior, 0);
+
+	ior->io_device		= device;
+	ior->io_unit		= device->dev_number;
+	ior->io_op		= IO_READ | IO_CALL | IO_PREMAPPED;
+	ior->io_mode		= mode;
+	ior->io_recnum		= recnum;
+	ior->io_data		= (io_buf_ptr_t) kaddr;
+	ior->io_count		= bytes_wanted;
+	ior->io_alloc_size	= size;
+	ior->io_residual	= 0;
+	ior->io_error		= 0;
+	ior->io_done		= ds_read_into_done;
+	ior->io_reply_port	= reply_port;
+	ior->io_reply_port_type	= reply_port_type;
+
+	/*
+	 * The ior keeps an extra reference for the device.
+	 */
+	mach_device_reference(device);
+
+	/*
+	 * And do the read.
+	 */
+	result = (*device->dev_ops->d_read)(device->dev_number, ior);
+
+	/*
+	 * If the IO was queued, delay reply until it is finished.
+	 */
+	if (result == D_IO_QUEUED)
+	    return (MIG_NO_REPLY);
+
+	/*
+	 * Return result via ds_read_into_done.
+	 */
+	ior->io_error = result;
+	(void) ds_read_into_done(ior);
+	io_req_free(ior);
+
+	return (MIG_NO_REPLY);	/* reply has already been sent. */
+}
+
 /*
  * Read from a device, but return the data 'inband.'
  */
@@ -1295,6 +1591,12 @@ kern_return_t device_read_alloc(
 	if (ior->io_count == 0)
 	    return (KERN_SUCCESS);
 
+	/*
+	 * Nor if the caller supplied the buffer.
+	 */
+	if (ior->io_op & IO_PREMAPPED)
+	    return (KERN_SUCCESS);
+
 	if (ior->io_op & IO_INBAND) {
 	    ior->io_data = (io_buf_ptr_t) kmem_cache_alloc(&io_inband_cache);
 	    ior->io_alloc_size = sizeof(io_buf_ptr_inband_t);
@@ -1424,6 +1726,41 @@ device_set_status(
 					      status_count));
 }
 
+/*
+ * Return the completion statistics of device.
+ */
+static io_return_t
+device_get_io_stats(
+	mach_device_t		device,
+	dev_status_t		status,
+	mach_msg_type_number_t	*status_count)
+{
+	int			i;
+
+	if (*status_count < DEV_GET_IO_STATS_COUNT(io_done_nqueues))
+	    return (D_INVALID_OPERATION);
+
+	status[DEV_GET_IO_STATS_NCPUS] = io_done_nqueues;
+	for (i = 0; i < io_done_nqueues; i++) {
+	    struct io_done_stats *stats = &device->io_stats[i];
+	    int *record = &status[1 + i * DEV_GET_IO_STATS_RECORD_SIZE];
+
+	    if (device->io_stats == NULL) {
+		memset(record, 0,
+		       DEV_GET_IO_STATS_RECORD_SIZE * sizeof(*record));
+		continue;
+	    }
+
+	    record[DEV_GET_IO_STATS_COMPLETIONS] = stats->completions;
+	    record[DEV_GET_IO_STATS_REMOTE] = stats->remote;
+	    record[DEV_GET_IO_STATS_AVG_CYCLES] = (stats->completions == 0)
+		? 0 : stats->cycles / stats->completions;
+	    record[DEV_GET_IO_STATS_MAX_CYCLES] = stats->max_cycles;
+	}
+	*status_count = DEV_GET_IO_STATS_COUNT(io_done_nqueues);
+	return (D_SUCCESS);
+}
+
 io_return_t
 mach_device_get_status(
 	void			*dev,
@@ -1437,6 +1774,9 @@ mach_device_get_status(
 
 	/* XXX note that a CLOSE may proceed at any point */
 
+	if (flavor == DEV_GET_IO_STATS)
+	    return (device_get_io_stats(device, status, status_count));
+
 	return ((*device->dev_ops->d_getstat)(device->dev_number,
 					      flavor,
 					      status,
@@ -1479,7 +1819,7 @@ device_map(
 	boolean_t		unmap)	/* ? */
 {
 	mach_device_t		device = dev;
-	if (protection & ~VM_PROT_ALL)
+	if (protection & ~(VM_PROT_ALL | D_MAP_WRITE_COMBINE))
 		return (KERN_INVALID_ARGUMENT);
 
 	if (device->state != DEV_STATE_OPEN)
@@ -1502,15 +1842,49 @@ ds_no_senders(mach_no_senders_notification_t *notification)
 	       notification->not_count);
 }
 
-queue_head_t		io_done_list;
-decl_simple_lock_data(,	io_done_list_lock)
+/*
+ * Completion queues.  Requests are completed by a pool of threads
+ * bound to the processor that issued them, so that reply messages
+ * and copies are built where the requesting thread's data is cached,
+ * and completions for different processors proceed in parallel.
+ */
+struct io_done_queue {
+	queue_head_t		list;		/* completed requests */
+	decl_simple_lock_data(,	lock)		/* lock for list */
+};
+
+struct io_done_queue	io_done_queues[NCPUS];
+int			io_done_nqueues = 1;
+
+/*
+ * Number of completion threads serving each queue.
+ */
+int			io_done_threads = 2;
 
 #define	splio	splsched	/* XXX must block ALL io devices */
 
+/*
+ * Return the queue on which to complete ior: that of the processor
+ * that issued it, if it has one.
+ */
+static inline struct io_done_queue *
+io_done_queue_for(io_req_t ior)
+{
+	unsigned int	cpu = ior->io_cpu;
+
+	if (cpu >= (unsigned int) io_done_nqueues)
+	    cpu = cpu_number();
+	if (cpu >= (unsigned int) io_done_nqueues)
+	    cpu = 0;
+	return &io_done_queues[cpu];
+}
+
 void iodone(io_req_t ior)
 {
 	spl_t			s;
 
+	TRACE(TRACE_IO_DONE, ior, ior->io_op, ior->io_count);
+
 	/*
 	 * If this ior was loaned to us, return it directly.
 	 */
@@ -1531,31 +1905,98 @@ void iodone(io_req_t ior)
 	    ior_unlock(ior);
 	    thread_wakeup((event_t)ior);
 	} else {
+	    struct io_done_queue *q = io_done_queue_for(ior);
+
 	    ior->io_op |= IO_DONE;
-	    simple_lock(&io_done_list_lock);
-	    enqueue_tail(&io_done_list, (queue_entry_t)ior);
-	    thread_wakeup((event_t)&io_done_list);
-	    simple_unlock(&io_done_list_lock);
+	    simple_lock(&q->lock);
+	    enqueue_tail(&q->list, (queue_entry_t)ior);
+	    thread_wakeup_one((event_t)&q->list);
+	    simple_unlock(&q->lock);
 	}
 	splx(s);
 }
 
+void io_req_stamp(io_req_t ior)
+{
+	ior->io_cpu = cpu_number();
+	ior->io_start = machine_cycles();
+	TRACE(TRACE_IO_START, ior, 0, 0);
+}
+
+/*
+ * Wake up a completion thread of the current processor, to process
+ * work that is not queued as an io_req (e.g. Linux sk_buffs).
+ */
+void io_done_wakeup(void)
+{
+	unsigned int	cpu = cpu_number();
+
+	if (cpu >= (unsigned int) io_done_nqueues)
+	    cpu = 0;
+	thread_wakeup_one((event_t)&io_done_queues[cpu].list);
+}
+
+/*
+ * Account a request started on processor io_cpu, and completed in
+ * cycles, to its device.  Only the completion threads of this
+ * processor update its statistics, and they do not preempt each
+ * other, so no lock is needed.
+ */
+static void io_done_account(
+	mach_device_t		device,
+	int			io_cpu,
+	unsigned long long	cycles)
+{
+	struct io_done_stats	*stats;
+	int			cpu = cpu_number();
+
+	if (device->io_stats == NULL)
+	    return;
+
+	stats = &device->io_stats[cpu];
+	stats->completions++;
+	if (io_cpu != cpu)
+	    stats->remote++;
+	stats->cycles += cycles;
+	if (cycles > stats->max_cycles)
+	    stats->max_cycles = cycles;
+}
+
 void  __attribute__ ((noreturn)) io_done_thread_continue(void)
 {
+	struct io_done_queue	*q = &io_done_queues[cpu_number()];
+
 	for (;;) {
 	    spl_t		s;
 	    io_req_t		ior;
+	    mach_device_t	device;
+	    unsigned long long	cycles;
+	    int			io_cpu;
 
 #if defined (LINUX_DEV) && defined (CONFIG_INET)
 	    free_skbuffs ();
 #endif
 	    s = splio();
-	    simple_lock(&io_done_list_lock);
-	    while ((ior = (io_req_t)dequeue_head(&io_done_list)) != 0) {
-		simple_unlock(&io_done_list_lock);
+	    simple_lock(&q->lock);
+	    while ((ior = (io_req_t)dequeue_head(&q->list)) != 0) {
+		simple_unlock(&q->lock);
 		(void) splx(s);
 
+		/*
+		 * Requests may be requeued, and the completion
+		 * routine may release the device: only account
+		 * the final completion, with a reference held.
+		 */
+		device = ior->io_device;
+		io_cpu = ior->io_cpu;
+		cycles = machine_cycles() - ior->io_start;
+		if (device != MACH_DEVICE_NULL)
+		    mach_device_reference(device);
+
 		if ((*ior->io_done)(ior)) {
+		    if (device != MACH_DEVICE_NULL)
+			io_done_account(device, io_cpu, cycles);
+
 		    /*
 		     * IO done - free io_req_elt
 		     */
@@ -1563,12 +2004,15 @@ void  __attribute__ ((noreturn)) io_done_thread_continue(void)
 		}
 		/* else routine has re-queued it somewhere */
 
+		if (device != MACH_DEVICE_NULL)
+		    mach_device_deallocate(device);
+
 		s = splio();
-		simple_lock(&io_done_list_lock);
+		simple_lock(&q->lock);
 	    }
 
-	    assert_wait(&io_done_list, FALSE);
-	    simple_unlock(&io_done_list_lock);
+	    assert_wait(&q->list, FALSE);
+	    simple_unlock(&q->lock);
 	    (void) splx(s);
 	    counter(c_io_done_thread_block++);
 	    thread_block(io_done_thread_continue);
@@ -1577,17 +2021,37 @@ void  __attribute__ ((noreturn)) io_done_thread_continue(void)
 
 void io_done_thread(void)
 {
+	int cpu = (int) (vm_offset_t) current_thread()->ith_other;
+
 	/*
-	 * Set thread privileges and highest priority.
+	 * Set thread privileges and highest priority, and
+	 * run on the processor of our queue.
 	 */
 	current_thread()->vm_privilege = 1;
 	stack_privilege(current_thread());
 	thread_set_own_priority(0);
+	thread_bind(current_thread(), cpu_to_processor(cpu));
 
-	io_done_thread_continue();
+	/*
+	 * Yield, so that we resume on our processor.
+	 */
+	thread_block(io_done_thread_continue);
 	/*NOTREACHED*/
 }
 
+/*
+ * Create the completion threads of every queue.
+ */
+void io_done_thread_create(void)
+{
+	int i, j;
+
+	for (i = 0; i < io_done_nqueues; i++)
+	    for (j = 0; j < io_done_threads; j++)
+		(void) kernel_thread(kernel_task, io_done_thread,
+				     (void *) (vm_offset_t) i);
+}
+
 #define	DEVICE_IO_MAP_SIZE	(16 * 1024 * 1024)
 
 static void mach_device_trap_init(void);		/* forward */
@@ -1595,9 +2059,17 @@ static void mach_device_trap_init(void);		/* forward */
 void mach_device_init(void)
 {
 	vm_offset_t	device_io_min, device_io_max;
+	int		i;
 
-	queue_init(&io_done_list);
-	simple_lock_init(&io_done_list_lock);
+	simple_lock_init(&ds_probe_lock);
+
+	io_done_nqueues = (ncpu < NCPUS) ? ncpu : NCPUS;
+	if (io_done_nqueues < 1)
+	    io_done_nqueues = 1;
+	for (i = 0; i < NCPUS; i++) {
+	    queue_init(&io_done_queues[i].list);
+	    simple_lock_init(&io_done_queues[i].lock);
+	}
 
 	kmem_submap(device_io_map, kernel_map, &device_io_min, &device_io_max,
 		    DEVICE_IO_MAP_SIZE);
@@ -1679,7 +2151,11 @@ mach_device_trap_init(void)
 io_req_t
 ds_trap_req_alloc(const mach_device_t device, vm_size_t data_size)
 {
-	return (io_req_t) kmem_cache_alloc(&io_trap_cache);
+	io_req_t	ior;
+
+	ior = (io_req_t) kmem_cache_alloc(&io_trap_cache);
+	io_req_stamp(ior);
+	return ior;
 }
 
 /*
@@ -1883,5 +2359,6 @@ struct device_emulation_ops mach_device_emulation_ops =
   device_map,
   ds_no_senders,
   (void*) device_write_trap,
-  (void*) device_writev_trap
+  (void*) device_writev_trap,
+  device_read_into
 };
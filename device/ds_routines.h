@@ -43,9 +43,20 @@
  */
 extern vm_map_t		device_io_map;
 
-extern queue_head_t	io_done_list;
+/*
+ * Number of completion queues, one per processor.
+ */
+extern int		io_done_nqueues;
+
+/*
+ * Largest transfer done by one device_read_into.
+ */
+#define	DEVICE_READ_INTO_MAX	(256 * 1024)
 
 kern_return_t	device_read_alloc(io_req_t, vm_size_t);
+io_return_t	device_read_into_map(vm_map_t, vm_offset_t, vm_size_t,
+				     vm_offset_t *);
+void		device_read_into_unmap(vm_offset_t, vm_size_t);
 kern_return_t	device_write_get(io_req_t, boolean_t *);
 boolean_t	device_write_dealloc(io_req_t);
 void		device_reference(device_t);
@@ -53,10 +64,19 @@ void		device_reference(device_t);
 boolean_t	ds_notify(mach_msg_header_t *msg);
 boolean_t	ds_open_done(io_req_t);
 boolean_t	ds_read_done(io_req_t);
+boolean_t	ds_read_into_done(io_req_t);
 boolean_t	ds_write_done(io_req_t);
 
 void		iowait (io_req_t ior);
 
+/*
+ * Devices probed in the background: device_open waits from
+ * ds_probe_start until ds_probe_done.
+ */
+void		ds_probe_start(void);
+void		ds_probe_done(void);
+void		io_done_wakeup(void);
+
 kern_return_t	device_pager_setup(
 	const mach_device_t	device,
 	int			prot,
@@ -68,6 +88,7 @@ extern void mach_device_init(void);
 extern void dev_lookup_init(void);
 extern void device_pager_init(void);
 extern void io_done_thread(void) __attribute__ ((noreturn));
+extern void io_done_thread_create(void);
 
 io_return_t ds_device_write_trap(
 	device_t 	dev,
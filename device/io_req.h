@@ -37,7 +37,10 @@
 #include <mach/vm_param.h>
 #include <kern/slab.h>
 #include <kern/kalloc.h>
+#include <kern/cpu_number.h>
 #include <kern/lock.h>
+#include <kern/time_stamp.h>
+#include <kern/trace.h>
 #include <vm/vm_page.h>
 #include <device/device_types.h>
 #include <device/dev_hdr.h>
@@ -85,6 +88,8 @@ struct io_req {
 	long            io_physrec;    /* mapping to the physical block
 					   number */
 	long            io_rectotal;   /* total number of blocks to move */
+	int		io_cpu;		/* processor that issued the request */
+	unsigned long long io_start;	/* cycle count when issued */
 };
 
 /*
@@ -116,14 +121,21 @@ struct io_req {
 #define IO_INBAND	0x00004000	/* mig call was inband */
 #define IO_INTERNAL	0x00008000	/* internal, device-driver specific */
 #define	IO_LOANED	0x00010000	/* ior loaned by another module */
+#define	IO_PREMAPPED	0x00020000	/* io_data supplied by caller */
 
-#define	IO_SPARE_START	0x00020000	/* start of spare flags */
+#define	IO_SPARE_START	0x00040000	/* start of spare flags */
 
 /*
  * Standard completion routine for io_requests.
  */
 void	iodone(io_req_t);
 
+/*
+ * Record the issuing processor and time, so that completion can be
+ * processed on that processor and its latency accounted.
+ */
+void	io_req_stamp(io_req_t);
+
 /*
  * Macros to allocate and free IORs - will convert to caches later.
  */
@@ -131,6 +143,7 @@ void	iodone(io_req_t);
 	MACRO_BEGIN						\
 	(ior) = (io_req_t)kalloc(sizeof(struct io_req));	\
 	simple_lock_init(&(ior)->io_req_lock);			\
+	io_req_stamp(ior);					\
 	MACRO_END
 
 #define	io_req_free(ior)					\
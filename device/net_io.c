@@ -49,6 +49,7 @@
 #include <device/ds_routines.h>
 
 #include <mach/boolean.h>
+#include <mach/machine.h>
 #include <mach/vm_param.h>
 
 #include <ipc/ipc_port.h>
@@ -56,12 +57,16 @@
 #include <ipc/ipc_mqueue.h>
 
 #include <kern/counters.h>
+#include <kern/cpu_number.h>
 #include <kern/debug.h>
 #include <kern/lock.h>
+#include <kern/mach_clock.h>
 #include <kern/printf.h>
+#include <kern/processor.h>
 #include <kern/queue.h>
 #include <kern/sched_prim.h>
 #include <kern/slab.h>
+#include <kern/task.h>
 #include <kern/thread.h>
 
 #include <machine/machspl.h>
@@ -79,118 +84,198 @@ int kttd_async_counter= 0;
  *	Packet Buffer Management
  *
  *	This module manages a private pool of kmsg buffers.
+ *
+ *	Received packets are spread over several receive queues,
+ *	one per processor.  Each queue has its own pool of free
+ *	buffers, its own lists of packets waiting to be filtered
+ *	and its own network thread, bound to the queue's processor.
+ *	Packets are assigned to a queue by hashing their flow
+ *	(addresses, protocol and ports), so that all the packets
+ *	of a flow are delivered in order by the same thread.
  */
 
 /*
- * List of net kmsgs queued to be sent to users.
- * Messages can be high priority or low priority.
- * The network thread processes high priority messages first.
+ * Packets for filters with the NETF_BATCH flag are coalesced into
+ * net_rcv_batch_msg messages.  A batch set holds the messages being
+ * filled by one delivery context.  The set of the network thread
+ * lives in its receive queue, so that it can hold messages back
+ * while it waits for more packets; the AST uses a set on its stack
+ * and sends everything before returning.
  */
-decl_simple_lock_data(,net_queue_lock)
-boolean_t	net_thread_awake = FALSE;
-struct ipc_kmsg_queue	net_queue_high;
-int		net_queue_high_size = 0;
-int		net_queue_high_max = 0;		/* for debugging */
-struct ipc_kmsg_queue	net_queue_low;
-int		net_queue_low_size = 0;
-int		net_queue_low_max = 0;		/* for debugging */
+#define NET_RCV_BATCH_SLOTS	4
+
+struct net_rcv_batch {
+	ipc_kmsg_t	kmsg;		/* message being filled, or IKM_NULL */
+	ipc_port_t	port;		/* its destination (send right) */
+	unsigned int	max;		/* packets per message */
+	unsigned int	delay;		/* ticks it may be held back */
+	unsigned long	start;		/* tick of its first packet */
+	vm_size_t	size;		/* bytes of data used */
+};
+
+struct net_rcv_batch_set {
+	struct net_rcv_batch	batch[NET_RCV_BATCH_SLOTS];
+};
+
+typedef struct net_rcv_batch_set *net_rcv_batch_set_t;
+
+#define net_rcv_batch_kmsg_size						\
+	ikm_plus_overhead(sizeof(struct net_rcv_batch_msg))
+
+struct net_rcv_queue {
+	decl_simple_lock_data(,lock)	/* lock for everything below */
+	boolean_t	thread_awake;	/* network thread is running */
+	boolean_t	thread_lingering; /* ... only waiting for more
+					     packets for its batches */
+
+	/*
+	 * List of net kmsgs queued to be sent to users.
+	 * Messages can be high priority or low priority.
+	 * The network thread processes high priority messages first.
+	 */
+	struct ipc_kmsg_queue	high;
+	int		high_size;
+	int		high_max;		/* for debugging */
+	struct ipc_kmsg_queue	low;
+	int		low_size;
+	int		low_max;		/* for debugging */
+
+	/*
+	 * List of net kmsgs that can be touched at interrupt level.
+	 * If it is empty, we will also steal low priority messages.
+	 */
+	struct ipc_kmsg_queue	free;
+	int		free_size;		/* on free list */
+	int		free_max;		/* for debugging */
+
+	int		free_hits;		/* for debugging */
+	int		free_steals;		/* for debugging */
+	int		free_misses;		/* for debugging */
+
+	int		send_high_hits;		/* for debugging */
+	int		send_low_hits;		/* for debugging */
+	int		send_high_misses;	/* for debugging */
+	int		send_low_misses;	/* for debugging */
+
+	/*
+	 * Preallocated batch messages, since the AST can't allocate.
+	 */
+	struct ipc_kmsg_queue	batch_free;
+	int		batch_free_size;
+	struct net_rcv_batch_set thread_batches; /* network thread only */
+
+	int		thread_awaken;		/* for debugging */
+	int		ast_taken;		/* for debugging */
+	int		packets;		/* for debugging */
+	int		batch_sent;		/* for debugging */
+	int		batch_misses;		/* for debugging */
+	int		batch_packets;		/* for debugging */
+	int		batch_no_buffer;	/* for debugging */
+} net_rcv_queues[NCPUS];
+
+typedef struct net_rcv_queue *net_rcv_queue_t;
 
 /*
- * List of net kmsgs that can be touched at interrupt level.
- * If it is empty, we will also steal low priority messages.
+ * Number of receive queues in use.  Queue N is served by
+ * processor N.
  */
-decl_simple_lock_data(,net_queue_free_lock)
-struct ipc_kmsg_queue	net_queue_free;
-int		net_queue_free_size = 0;	/* on free list */
-int		net_queue_free_max = 0;		/* for debugging */
+int		net_rcv_nqueues = 1;
+
+#define net_rcv_queue_cpu()	(&net_rcv_queues[cpu_number()])
 
 /*
  * This value is critical to network performance.
- * At least this many buffers should be sitting in net_queue_free.
+ * At least this many buffers should be sitting in each free queue.
  * If this is set too small, we will drop network packets.
  * Even a low drop rate (<1%) can cause severe network throughput problems.
  * We add one to net_queue_free_min for every filter.
  */
 int		net_queue_free_min = 3;
 
-int		net_queue_free_hits = 0;	/* for debugging */
-int		net_queue_free_steals = 0;	/* for debugging */
-int		net_queue_free_misses = 0;	/* for debugging */
-
-int		net_kmsg_send_high_hits = 0;	/* for debugging */
-int		net_kmsg_send_low_hits = 0;	/* for debugging */
-int		net_kmsg_send_high_misses = 0;	/* for debugging */
-int		net_kmsg_send_low_misses = 0;	/* for debugging */
-
-int		net_thread_awaken = 0;		/* for debugging */
-int		net_ast_taken = 0;		/* for debugging */
-
-decl_simple_lock_data(,net_kmsg_total_lock)
 int		net_kmsg_total = 0;		/* total allocated */
 int		net_kmsg_max;			/* initialized below */
 
+/*
+ * Number of filters with the NETF_BATCH flag.  Batch messages are
+ * only preallocated while there are any.
+ */
+int		net_rcv_batch_filters = 0;
+
+/*
+ * Default packets per batch message, and time in milliseconds
+ * the first packet of a batch may be held back.
+ */
+int		net_rcv_batch_max_default = 16;
+int		net_rcv_batch_delay_default = 0;
+
 vm_size_t	net_kmsg_size;			/* initialized below */
 
+/*
+ *	Buffers go back to the free queue they were allocated for,
+ *	rather than to the pool of the processor freeing them, usually
+ *	a receiver's, where the interrupt processor would never find
+ *	them again.  That queue is recorded after the message.
+ */
+static vm_size_t	net_kmsg_owner_offset;	/* initialized below */
+
+#define net_kmsg_owner(kmsg)							(*(net_rcv_queue_t *) ((char *) (kmsg) + net_kmsg_owner_offset))
+
 /*
  *	We want more buffers when there aren't enough in the free queue
  *	and the low priority queue.  However, we don't want to allocate
- *	more than net_kmsg_max.
+ *	more than net_kmsg_max, plus the free minimum of every
+ *	additional queue.  The totals are only updated atomically,
+ *	without a lock: misread values aren't critical.
  */
 
-#define net_kmsg_want_more()		\
-	(((net_queue_free_size + net_queue_low_size) < net_queue_free_min) && \
-	 (net_kmsg_total < net_kmsg_max))
+#define net_kmsg_limit()					\
+	(net_kmsg_max + (net_rcv_nqueues - 1) * net_queue_free_min)
+
+#define net_kmsg_want_more(q)						\
+	((((q)->free_size + (q)->low_size) < net_queue_free_min) &&	\
+	 (net_kmsg_total < net_kmsg_limit()))
 
 ipc_kmsg_t
 net_kmsg_get(void)
 {
+	net_rcv_queue_t q;
 	ipc_kmsg_t kmsg;
+	boolean_t awake;
 	spl_t s;
 
 	/*
-	 *	First check the list of free buffers.
+	 *	First check the list of free buffers of this
+	 *	processor, then try to steal from its low
+	 *	priority queue.
 	 */
 	s = splimp();
-	simple_lock(&net_queue_free_lock);
-	kmsg = ipc_kmsg_queue_first(&net_queue_free);
+	q = net_rcv_queue_cpu();
+	simple_lock(&q->lock);
+	kmsg = ipc_kmsg_queue_first(&q->free);
 	if (kmsg != IKM_NULL) {
-	    ipc_kmsg_rmqueue_first_macro(&net_queue_free, kmsg);
-	    net_queue_free_size--;
-	    net_queue_free_hits++;
-	}
-	simple_unlock(&net_queue_free_lock);
-
-	if (kmsg == IKM_NULL) {
-	    /*
-	     *	Try to steal from the low priority queue.
-	     */
-	    simple_lock(&net_queue_lock);
-	    kmsg = ipc_kmsg_queue_first(&net_queue_low);
+	    ipc_kmsg_rmqueue_first_macro(&q->free, kmsg);
+	    q->free_size--;
+	    q->free_hits++;
+	} else {
+	    kmsg = ipc_kmsg_queue_first(&q->low);
 	    if (kmsg != IKM_NULL) {
-		ipc_kmsg_rmqueue_first_macro(&net_queue_low, kmsg);
-		net_queue_low_size--;
-		net_queue_free_steals++;
-	    }
-	    simple_unlock(&net_queue_lock);
+		ipc_kmsg_rmqueue_first_macro(&q->low, kmsg);
+		q->low_size--;
+		q->free_steals++;
+	    } else
+		q->free_misses++;
 	}
 
-	if (kmsg == IKM_NULL)
-	    net_queue_free_misses++;
+	if (net_kmsg_want_more(q) || (kmsg == IKM_NULL)) {
+	    awake = q->thread_awake;
+	    q->thread_awake = TRUE;
+	} else
+	    awake = TRUE;
+	simple_unlock(&q->lock);
 	(void) splx(s);
 
-	if (net_kmsg_want_more() || (kmsg == IKM_NULL)) {
-	    boolean_t awake;
-
-	    s = splimp();
-	    simple_lock(&net_queue_lock);
-	    awake = net_thread_awake;
-	    net_thread_awake = TRUE;
-	    simple_unlock(&net_queue_lock);
-	    (void) splx(s);
-
-	    if (!awake)
-		thread_wakeup((event_t) &net_thread_awake);
-	}
+	if (!awake)
+	    thread_wakeup((event_t) &q->thread_awake);
 
 	return kmsg;
 }
@@ -198,70 +283,189 @@ net_kmsg_get(void)
 void
 net_kmsg_put(const ipc_kmsg_t kmsg)
 {
+	net_rcv_queue_t q;
 	spl_t s;
 
 	s = splimp();
-	simple_lock(&net_queue_free_lock);
-	ipc_kmsg_enqueue_macro(&net_queue_free, kmsg);
-	if (++net_queue_free_size > net_queue_free_max)
-	    net_queue_free_max = net_queue_free_size;
-	simple_unlock(&net_queue_free_lock);
+	q = net_kmsg_owner(kmsg);
+	simple_lock(&q->lock);
+	ipc_kmsg_enqueue_macro(&q->free, kmsg);
+	if (++q->free_size > q->free_max)
+	    q->free_max = q->free_size;
+	simple_unlock(&q->lock);
 	(void) splx(s);
 }
 
 void
 net_kmsg_collect(void)
 {
+	net_rcv_queue_t q;
 	ipc_kmsg_t kmsg;
 	spl_t s;
 
-	s = splimp();
-	simple_lock(&net_queue_free_lock);
-	while (net_queue_free_size > net_queue_free_min) {
-	    kmsg = ipc_kmsg_dequeue(&net_queue_free);
-	    net_queue_free_size--;
-	    simple_unlock(&net_queue_free_lock);
-	    (void) splx(s);
+	for (q = net_rcv_queues; q < &net_rcv_queues[net_rcv_nqueues]; q++) {
+	    s = splimp();
+	    simple_lock(&q->lock);
+	    while (q->free_size > net_queue_free_min) {
+		kmsg = ipc_kmsg_dequeue(&q->free);
+		q->free_size--;
+		simple_unlock(&q->lock);
+		(void) splx(s);
 
-	    net_kmsg_free(kmsg);
-	    simple_lock(&net_kmsg_total_lock);
-	    net_kmsg_total--;
-	    simple_unlock(&net_kmsg_total_lock);
+		net_kmsg_free(kmsg);
+		__atomic_sub_fetch(&net_kmsg_total, 1, __ATOMIC_RELAXED);
 
-	    s = splimp();
-	    simple_lock(&net_queue_free_lock);
+		s = splimp();
+		simple_lock(&q->lock);
+	    }
+	    while (net_rcv_batch_filters == 0 && q->batch_free_size > 0) {
+		kmsg = ipc_kmsg_dequeue(&q->batch_free);
+		q->batch_free_size--;
+		simple_unlock(&q->lock);
+		(void) splx(s);
+
+		kfree((vm_offset_t) kmsg, net_rcv_batch_kmsg_size);
+
+		s = splimp();
+		simple_lock(&q->lock);
+	    }
+	    simple_unlock(&q->lock);
+	    (void) splx(s);
 	}
-	simple_unlock(&net_queue_free_lock);
-	(void) splx(s);
 }
 
 void
-net_kmsg_more(void)
+net_kmsg_more(net_rcv_queue_t q)
 {
 	ipc_kmsg_t kmsg;
+	spl_t s;
 
 	/*
-	 * Replenish net kmsg pool if low.  We don't have the locks
-	 * necessary to look at these variables, but that's OK because
-	 * misread values aren't critical.  The danger in this code is
-	 * that while we allocate buffers, interrupts are happening
-	 * which take buffers out of the free list.  If we are not
-	 * careful, we will sit in the loop and allocate a zillion
-	 * buffers while a burst of packets arrives.  So we count
-	 * buffers in the low priority queue as available, because
-	 * net_kmsg_get will make use of them, and we cap the total
-	 * number of buffers we are willing to allocate.
+	 * Replenish the net kmsg pool of Q if low.  We don't have the
+	 * locks necessary to look at these variables, but that's OK
+	 * because misread values aren't critical.  The danger in this
+	 * code is that while we allocate buffers, interrupts are
+	 * happening which take buffers out of the free list.  If we
+	 * are not careful, we will sit in the loop and allocate a
+	 * zillion buffers while a burst of packets arrives.  So we
+	 * count buffers in the low priority queue as available,
+	 * because net_kmsg_get will make use of them, and we cap the
+	 * total number of buffers we are willing to allocate.
+	 *
+	 * Network threads are bound to the processor of their queue,
+	 * so the new buffers go straight to the pool they are
+	 * wanted in.
 	 */
 
-	while (net_kmsg_want_more()) {
-	    simple_lock(&net_kmsg_total_lock);
-	    net_kmsg_total++;
-	    simple_unlock(&net_kmsg_total_lock);
+	while (net_kmsg_want_more(q)) {
+	    __atomic_add_fetch(&net_kmsg_total, 1, __ATOMIC_RELAXED);
 	    kmsg = net_kmsg_alloc();
-	    net_kmsg_put(kmsg);
+	    net_kmsg_owner(kmsg) = q;
+
+	    s = splimp();
+	    simple_lock(&q->lock);
+	    ipc_kmsg_enqueue_macro(&q->free, kmsg);
+	    if (++q->free_size > q->free_max)
+		q->free_max = q->free_size;
+	    simple_unlock(&q->lock);
+	    (void) splx(s);
+	}
+
+	/*
+	 * Keep one batch message per slot ready for the AST.
+	 */
+	while (net_rcv_batch_filters > 0
+	       && q->batch_free_size < NET_RCV_BATCH_SLOTS) {
+	    kmsg = (ipc_kmsg_t) kalloc(net_rcv_batch_kmsg_size);
+	    if (kmsg == IKM_NULL)
+		break;
+	    ikm_init_special(kmsg, net_rcv_batch_kmsg_size);
+
+	    s = splimp();
+	    simple_lock(&q->lock);
+	    ipc_kmsg_enqueue_macro(&q->batch_free, kmsg);
+	    q->batch_free_size++;
+	    simple_unlock(&q->lock);
+	    (void) splx(s);
 	}
 }
 
+/*
+ *	net_flow_hash:
+ *
+ *	Compute a hash of the flow a received packet belongs to.
+ *	For IPv4 and IPv6 this covers the addresses, the protocol
+ *	and, for TCP and UDP, the ports.  Other packets are hashed
+ *	on their link level header.
+ */
+static unsigned int
+net_flow_hash(
+	const struct ifnet	*ifp,
+	const ipc_kmsg_t	kmsg,
+	unsigned int		count)
+{
+	const unsigned char *p, *end;
+	const struct packet_header *ph;
+	unsigned int hash, hlen;
+	unsigned char proto;
+
+	ph = (const struct packet_header *) net_kmsg(kmsg)->packet;
+	p = (const unsigned char *) (ph + 1);
+	end = (const unsigned char *) net_kmsg(kmsg)->packet + count;
+	hash = 0;
+
+#define NET_FLOW_MIX(h, v)	((h) = ((h) ^ (v)) * 0x9e3779b1)
+#define NET_FLOW_WORD(p)	(((p)[0] << 24) | ((p)[1] << 16) | \
+				 ((p)[2] << 8) | (p)[3])
+
+	if (count < sizeof(*ph))
+	    return 0;
+
+	switch (ntohs(ph->type)) {
+	case 0x0800:	/* IPv4 */
+	    if (end - p < 20)
+		break;
+	    hlen = (p[0] & 0xf) * 4;
+	    proto = p[9];
+	    NET_FLOW_MIX(hash, proto);
+	    NET_FLOW_MIX(hash, NET_FLOW_WORD(p + 12));
+	    NET_FLOW_MIX(hash, NET_FLOW_WORD(p + 16));
+	    /*
+	     * Only unfragmented datagrams are hashed on their ports,
+	     * so that all the fragments of one land on the same queue.
+	     */
+	    if ((proto == 6 || proto == 17)
+		&& ((p[6] & 0x3f) | p[7]) == 0
+		&& end - p >= hlen + 4)
+		NET_FLOW_MIX(hash, NET_FLOW_WORD(p + hlen));
+	    return hash;
+
+	case 0x86dd:	/* IPv6 */
+	    if (end - p < 40)
+		break;
+	    proto = p[6];
+	    NET_FLOW_MIX(hash, proto);
+	    for (hlen = 8; hlen < 40; hlen += 4)
+		NET_FLOW_MIX(hash, NET_FLOW_WORD(p + hlen));
+	    if ((proto == 6 || proto == 17) && end - p >= 44)
+		NET_FLOW_MIX(hash, NET_FLOW_WORD(p + 40));
+	    return hash;
+	}
+
+	/*
+	 *	Anything else: use the link level addresses.
+	 */
+	p = (const unsigned char *) net_kmsg(kmsg)->header;
+	for (hlen = 0; hlen + 4 <= ifp->if_header_size
+		       && hlen + 4 <= NET_HDW_HDR_MAX; hlen += 4)
+	    NET_FLOW_MIX(hash, NET_FLOW_WORD(p + hlen));
+
+#undef NET_FLOW_WORD
+#undef NET_FLOW_MIX
+
+	return hash;
+}
+
 /*
  *	Packet Filter Data Structures
  *
@@ -405,14 +609,262 @@ mach_msg_type_t packet_type = {
 	FALSE			/* deallocate */
 };
 
+/*
+ *	Batch parameters of a kmsg selected by a NETF_BATCH filter
+ *	are kept in its msgh_seqno between net_filter and net_deliver:
+ *	packets per message, hardware header size and delay in ticks.
+ */
+#define NET_BATCH_PARAMS(max, hsize, delay)			\
+	((max) | ((hsize) << 8) | ((delay) << 16))
+#define NET_BATCH_MAX(params)		((params) & 0xff)
+#define NET_BATCH_HSIZE(params)		(((params) >> 8) & 0xff)
+#define NET_BATCH_DELAY(params)		((params) >> 16)
+
+static unsigned int
+net_batch_params(
+	const struct ifnet	*ifp,
+	const net_rcv_port_t	infp)
+{
+	unsigned int max, delay, hsize;
+
+	max = net_rcv_batch_max_default;
+	delay = net_rcv_batch_delay_default;
+	if ((infp->filter[0] & NETF_TYPE_MASK) == NETF_BPF) {
+	    bpf_insn_t first = (bpf_insn_t) infp->filter;
+
+	    if (first->jt != 0)
+		max = first->jt;
+	    if (first->jf != 0)
+		delay = first->jf;
+	}
+	if (max > NET_RCV_BATCH_MAX)
+	    max = NET_RCV_BATCH_MAX;
+	if (max == 0)
+	    max = 1;
+	delay = (delay * hz + 999) / 1000;
+	if (delay > 0xffff)
+	    delay = 0xffff;
+	hsize = ifp->if_header_size;
+	if (hsize > NET_HDW_HDR_MAX)
+	    hsize = NET_HDW_HDR_MAX;
+
+	return NET_BATCH_PARAMS(max, hsize, delay);
+}
+
+mach_msg_type_t net_batch_count_type = {
+	MACH_MSG_TYPE_INTEGER_32,	/* name */
+	32,				/* size */
+	1,				/* number */
+	TRUE,				/* inline */
+	FALSE,				/* longform */
+	FALSE				/* deallocate */
+};
+
+mach_msg_type_t net_batch_desc_type = {
+	MACH_MSG_TYPE_INTEGER_32,	/* name */
+	32,				/* size */
+	NET_RCV_BATCH_MAX * sizeof(struct net_rcv_batch_desc)
+			  / sizeof(unsigned int), /* number */
+	TRUE,				/* inline */
+	FALSE,				/* longform */
+	FALSE				/* deallocate */
+};
+
+/*
+ *	net_batch_send:
+ *
+ *	Send the message of batch B to its destination.
+ *	Called at spl0 with nothing locked.
+ */
+static void
+net_batch_send(
+	net_rcv_queue_t		q,
+	struct net_rcv_batch	*b)
+{
+	ipc_kmsg_t kmsg = b->kmsg;
+	net_rcv_batch_msg_t msg = (net_rcv_batch_msg_t) &kmsg->ikm_header;
+	unsigned int count = msg->count;
+
+	kmsg->ikm_header.msgh_bits =
+		MACH_MSGH_BITS(MACH_MSG_TYPE_PORT_SEND, 0);
+	kmsg->ikm_header.msgh_size =
+		offsetof(struct net_rcv_batch_msg, data) + b->size;
+	kmsg->ikm_header.msgh_remote_port = (mach_port_t) b->port;
+	kmsg->ikm_header.msgh_local_port = MACH_PORT_NULL;
+	kmsg->ikm_header.msgh_kind = MACH_MSGH_KIND_NORMAL;
+	kmsg->ikm_header.msgh_id = NET_RCV_BATCH_MSG_ID;
+
+	msg->count_type = net_batch_count_type;
+	msg->desc_type = net_batch_desc_type;
+	msg->data_type.msgtl_header.msgt_name = 0;
+	msg->data_type.msgtl_header.msgt_size = 0;
+	msg->data_type.msgtl_header.msgt_number = 0;
+	msg->data_type.msgtl_header.msgt_inline = TRUE;
+	msg->data_type.msgtl_header.msgt_longform = TRUE;
+	msg->data_type.msgtl_header.msgt_deallocate = FALSE;
+	msg->data_type.msgtl_header.msgt_unused = 0;
+	msg->data_type.msgtl_name = MACH_MSG_TYPE_BYTE;
+	msg->data_type.msgtl_size = 8;
+	msg->data_type.msgtl_number = b->size;
+
+	b->kmsg = IKM_NULL;
+	b->port = IP_NULL;
+
+	if (ipc_mqueue_send(kmsg, MACH_SEND_TIMEOUT, 0) == MACH_MSG_SUCCESS) {
+	    q->batch_sent++;
+	    q->batch_packets += count;
+	} else {
+	    q->batch_misses++;
+	    ipc_kmsg_destroy(kmsg);
+	}
+}
+
+/*
+ *	net_batch_add:
+ *
+ *	Append the packet in KMSG, selected by a NETF_BATCH filter, to
+ *	the batch message for its destination in BS, and recycle KMSG.
+ *	Returns FALSE if no batch message is available, in which case
+ *	the caller must send KMSG by itself.
+ *	Called at spl0 with nothing locked.
+ */
+static boolean_t
+net_batch_add(
+	net_rcv_queue_t		q,
+	net_rcv_batch_set_t	bs,
+	ipc_kmsg_t		kmsg)
+{
+	struct net_rcv_batch *b, *slot;
+	struct net_rcv_batch_desc *desc;
+	net_rcv_batch_msg_t msg;
+	ipc_port_t dest;
+	unsigned int params, hsize, count;
+	vm_size_t needed;
+	spl_t s;
+
+	dest = (ipc_port_t) kmsg->ikm_header.msgh_remote_port;
+	params = kmsg->ikm_header.msgh_seqno;
+	hsize = NET_BATCH_HSIZE(params);
+	count = net_kmsg(kmsg)->net_rcv_msg_packet_count;
+	needed = ((hsize + 3) & ~3) + ((count + 3) & ~3);
+
+	/*
+	 *	Look for the message of this destination, or
+	 *	a free slot, or else the oldest message.
+	 */
+	slot = 0;
+	for (b = bs->batch; b < &bs->batch[NET_RCV_BATCH_SLOTS]; b++) {
+	    if (b->kmsg == IKM_NULL) {
+		if (slot == 0 || slot->kmsg != IKM_NULL)
+		    slot = b;
+	    } else if (b->port == dest) {
+		break;
+	    } else if (slot == 0
+		       || (slot->kmsg != IKM_NULL && b->start < slot->start)) {
+		slot = b;
+	    }
+	}
+
+	if (b < &bs->batch[NET_RCV_BATCH_SLOTS]) {
+	    if (b->size + needed <= NET_RCV_BATCH_DATA_MAX) {
+		/* The message already holds a send right. */
+		ipc_port_release_send(dest);
+		goto append;
+	    }
+	    net_batch_send(q, b);
+	    slot = b;
+	} else if (slot->kmsg != IKM_NULL)
+	    net_batch_send(q, slot);
+
+	b = slot;
+	s = splimp();
+	simple_lock(&q->lock);
+	b->kmsg = ipc_kmsg_dequeue(&q->batch_free);
+	if (b->kmsg != IKM_NULL)
+	    q->batch_free_size--;
+	else
+	    q->batch_no_buffer++;
+	simple_unlock(&q->lock);
+	(void) splx(s);
+	if (b->kmsg == IKM_NULL)
+	    return FALSE;
+
+	msg = (net_rcv_batch_msg_t) &b->kmsg->ikm_header;
+	msg->count = 0;
+	memset(msg->desc, 0, sizeof msg->desc);
+	b->port = dest;
+	b->max = NET_BATCH_MAX(params);
+	b->delay = NET_BATCH_DELAY(params);
+	b->start = elapsed_ticks;
+	b->size = 0;
+
+    append:
+	msg = (net_rcv_batch_msg_t) &b->kmsg->ikm_header;
+	desc = &msg->desc[msg->count++];
+
+	memset(&msg->data[b->size], 0, needed);
+	desc->header_offset = b->size;
+	desc->header_size = hsize;
+	memcpy(&msg->data[b->size], net_kmsg(kmsg)->header, hsize);
+	b->size += (hsize + 3) & ~3;
+	desc->packet_offset = b->size;
+	desc->packet_size = count;
+	memcpy(&msg->data[b->size], net_kmsg(kmsg)->packet, count);
+	b->size += (count + 3) & ~3;
+
+	net_kmsg_put(kmsg);
+
+	if (msg->count >= b->max)
+	    net_batch_send(q, b);
+	return TRUE;
+}
+
+/*
+ *	net_batch_flush:
+ *
+ *	Send the messages of BS that can't be held back any longer,
+ *	or all of them if ALL.  Returns the number of ticks until the
+ *	next message of BS is due, or zero if none is left.
+ *	Called at spl0 with nothing locked.
+ */
+static unsigned int
+net_batch_flush(
+	net_rcv_queue_t		q,
+	net_rcv_batch_set_t	bs,
+	boolean_t		all)
+{
+	struct net_rcv_batch *b;
+	unsigned long elapsed;
+	unsigned int wait, left;
+
+	wait = 0;
+	for (b = bs->batch; b < &bs->batch[NET_RCV_BATCH_SLOTS]; b++) {
+	    if (b->kmsg == IKM_NULL)
+		continue;
+	    elapsed = elapsed_ticks - b->start;
+	    if (all || elapsed >= b->delay) {
+		net_batch_send(q, b);
+		continue;
+	    }
+	    left = b->delay - elapsed;
+	    if (wait == 0 || left < wait)
+		wait = left;
+	}
+	return wait;
+}
+
 /*
  *	net_deliver:
  *
- *	Called and returns holding net_queue_lock, at splimp.
- *	Dequeues a message and delivers it at spl0.
+ *	Called and returns holding the lock of Q, at splimp.
+ *	Dequeues a message and delivers it at spl0.  Packets for
+ *	batching filters are added to the messages of BS instead.
  *	Returns FALSE if no messages.
  */
-boolean_t net_deliver(boolean_t nonblocking)
+boolean_t net_deliver(
+	net_rcv_queue_t		q,
+	net_rcv_batch_set_t	bs,
+	boolean_t		nonblocking)
 {
 	ipc_kmsg_t kmsg;
 	boolean_t high_priority;
@@ -423,15 +875,15 @@ boolean_t net_deliver(boolean_t nonblocking)
 	 * Deliver high priority messages before low priority.
 	 */
 
-	if ((kmsg = ipc_kmsg_dequeue(&net_queue_high)) != IKM_NULL) {
-	    net_queue_high_size--;
+	if ((kmsg = ipc_kmsg_dequeue(&q->high)) != IKM_NULL) {
+	    q->high_size--;
 	    high_priority = TRUE;
-	} else if ((kmsg = ipc_kmsg_dequeue(&net_queue_low)) != IKM_NULL) {
-	    net_queue_low_size--;
+	} else if ((kmsg = ipc_kmsg_dequeue(&q->low)) != IKM_NULL) {
+	    q->low_size--;
 	    high_priority = FALSE;
 	} else
 	    return FALSE;
-	simple_unlock(&net_queue_lock);
+	simple_unlock(&q->lock);
 	(void) spl0();
 
 	/*
@@ -449,12 +901,16 @@ boolean_t net_deliver(boolean_t nonblocking)
 	     * buffers out of the low priority queue.  But we can only
 	     * allocate if we are allowed to block.
 	     */
-	    net_kmsg_more();
+	    net_kmsg_more(q);
 	}
 
 	while ((kmsg = ipc_kmsg_dequeue(&send_list)) != IKM_NULL) {
 	    int count;
 
+	    if (kmsg->ikm_header.msgh_id == NET_RCV_BATCH_MSG_ID
+		&& net_batch_add(q, bs, kmsg))
+		continue;
+
 	    /*
 	     * Fill in the rest of the kmsg.
 	     */
@@ -485,21 +941,21 @@ boolean_t net_deliver(boolean_t nonblocking)
 	    if (ipc_mqueue_send(kmsg, MACH_SEND_TIMEOUT, 0) ==
 						    MACH_MSG_SUCCESS) {
 		if (high_priority)
-		    net_kmsg_send_high_hits++;
+		    q->send_high_hits++;
 		else
-		    net_kmsg_send_low_hits++;
+		    q->send_low_hits++;
 		/* the receiver is responsible for the message now */
 	    } else {
 		if (high_priority)
-		    net_kmsg_send_high_misses++;
+		    q->send_high_misses++;
 		else
-		    net_kmsg_send_low_misses++;
+		    q->send_low_misses++;
 		ipc_kmsg_destroy(kmsg);
 	    }
 	}
 
 	(void) splimp();
-	simple_lock(&net_queue_lock);
+	simple_lock(&q->lock);
 	return TRUE;
 }
 
@@ -508,33 +964,41 @@ boolean_t net_deliver(boolean_t nonblocking)
  *	thread_wakeup/thread_block needed to get to the network
  *	thread.  However, we can't allocate memory in the AST handler,
  *	because memory allocation might block.  Hence we have the
- *	network thread to allocate memory.  The network thread also
+ *	network threads to allocate memory.  A network thread also
  *	delivers packets, so it can be allocating and delivering for a
- *	burst.  net_thread_awake is protected by net_queue_lock
- *	(instead of net_queue_free_lock) so that net_packet and
- *	net_ast can safely determine if the network thread is running.
- *	This prevents a race that might leave a packet sitting without
- *	being delivered.  It is possible for net_kmsg_get to think
- *	the network thread is awake, and so avoid a wakeup, and then
- *	have the network thread sleep without allocating.  The next
+ *	burst.  The thread_awake flag of a queue is protected by the
+ *	queue lock so that net_packet and net_ast can safely determine
+ *	if the network thread of the queue is running.  This prevents
+ *	a race that might leave a packet sitting without being
+ *	delivered.  It is possible for net_kmsg_get to think the
+ *	network thread is awake, and so avoid a wakeup, and then have
+ *	the network thread sleep without allocating.  The next
  *	net_kmsg_get will do a wakeup.
+ *
+ *	The AST only ever delivers from the queue of the processor
+ *	taking it; packets hashed to another queue wake up the
+ *	network thread of that queue instead.
  */
 
 void net_ast(void)
 {
+	net_rcv_queue_t q;
 	spl_t s;
 
-	net_ast_taken++;
-
 	/*
 	 *	If the network thread is awake, then we would
 	 *	rather deliver messages from it, because
 	 *	it can also allocate memory.
 	 */
 
+	struct net_rcv_batch_set batches;
+
 	s = splimp();
-	simple_lock(&net_queue_lock);
-	while (!net_thread_awake && net_deliver(TRUE))
+	q = net_rcv_queue_cpu();
+	q->ast_taken++;
+	memset(&batches, 0, sizeof batches);
+	simple_lock(&q->lock);
+	while (!q->thread_awake && net_deliver(q, &batches, TRUE))
 		continue;
 
 	/*
@@ -543,7 +1007,9 @@ void net_ast(void)
 	 *	no messages left to deliver.
 	 */
 
-	simple_unlock(&net_queue_lock);
+	simple_unlock(&q->lock);
+	(void) spl0();
+	(void) net_batch_flush(q, &batches, TRUE);
 	(void) splsched();
 	ast_off(cpu_number(), AST_NETWORK);
 	(void) splx(s);
@@ -551,25 +1017,57 @@ void net_ast(void)
 
 void __attribute__ ((noreturn)) net_thread_continue(void)
 {
+	/*
+	 *	The network thread is bound to the
+	 *	processor of its queue.
+	 */
+	net_rcv_queue_t q = net_rcv_queue_cpu();
+
 	for (;;) {
+		unsigned int wait;
 		spl_t s;
 
-		net_thread_awaken++;
+		q->thread_awaken++;
 
 		/*
 		 *	First get more buffers.
 		 */
-		net_kmsg_more();
+		net_kmsg_more(q);
 
 		s = splimp();
-		simple_lock(&net_queue_lock);
-		while (net_deliver(FALSE))
+		simple_lock(&q->lock);
+		q->thread_lingering = FALSE;
+		while (net_deliver(q, &q->thread_batches, FALSE))
 			continue;
+		simple_unlock(&q->lock);
+		(void) spl0();
 
-		net_thread_awake = FALSE;
-		assert_wait(&net_thread_awake, FALSE);
-		simple_unlock(&net_queue_lock);
+		/*
+		 *	Send the batch messages that are due.  While
+		 *	some are held back, we stay awake for the AST
+		 *	not to overtake them, and only wait for more
+		 *	packets or for the first message to be due.
+		 */
+		wait = net_batch_flush(q, &q->thread_batches, FALSE);
+
+		(void) splimp();
+		simple_lock(&q->lock);
+		if (!ipc_kmsg_queue_empty(&q->high)
+		    || !ipc_kmsg_queue_empty(&q->low)) {
+			simple_unlock(&q->lock);
+			(void) splx(s);
+			continue;
+		}
+
+		if (wait != 0)
+			q->thread_lingering = TRUE;
+		else
+			q->thread_awake = FALSE;
+		assert_wait(&q->thread_awake, FALSE);
+		simple_unlock(&q->lock);
 		(void) splx(s);
+		if (wait != 0)
+			thread_set_timeout(wait);
 		counter(c_net_thread_block++);
 		thread_block(net_thread_continue);
 	}
@@ -577,24 +1075,32 @@ void __attribute__ ((noreturn)) net_thread_continue(void)
 
 void net_thread(void)
 {
+	net_rcv_queue_t q;
+	int cpu;
 	spl_t s;
 
+	cpu = (int) (vm_offset_t) current_thread()->ith_other;
+	q = &net_rcv_queues[cpu];
+
 	/*
-	 *	We should be very high priority.
+	 *	We should be very high priority, and
+	 *	run on the processor of our queue.
 	 */
 
 	thread_set_own_priority(0);
+	thread_bind(current_thread(), cpu_to_processor(cpu));
 
 	/*
 	 *	We sleep initially, so that we don't allocate any buffers
 	 *	unless the network is really in use and they are needed.
+	 *	When we are woken up, we run on our processor.
 	 */
 
 	s = splimp();
-	simple_lock(&net_queue_lock);
-	net_thread_awake = FALSE;
-	assert_wait(&net_thread_awake, FALSE);
-	simple_unlock(&net_queue_lock);
+	simple_lock(&q->lock);
+	q->thread_awake = FALSE;
+	assert_wait(&q->thread_awake, FALSE);
+	simple_unlock(&q->lock);
 	(void) splx(s);
 	counter(c_net_thread_block++);
 	thread_block(net_thread_continue);
@@ -602,6 +1108,19 @@ void net_thread(void)
 	/*NOTREACHED*/
 }
 
+/*
+ *	net_thread_create:
+ *
+ *	Create the network thread of every receive queue.
+ */
+void net_thread_create(void)
+{
+	int i;
+
+	for (i = 0; i < net_rcv_nqueues; i++)
+	    (void) kernel_thread(kernel_task, net_thread,
+				 (void *) (vm_offset_t) i);
+}
 void
 reorder_queue(
 	queue_t		first, 
@@ -633,6 +1152,8 @@ net_packet(
 	unsigned int		count,
 	boolean_t		priority)
 {
+	net_rcv_queue_t q;
+	unsigned int qi;
 	boolean_t awake;
 
 #if	MACH_TTD
@@ -658,28 +1179,52 @@ net_packet(
 	kmsg->ikm_header.msgh_remote_port = (mach_port_t) ifp;
 	net_kmsg(kmsg)->net_rcv_msg_packet_count = count;
 
-	simple_lock(&net_queue_lock);
+	/*
+	 *	Pick the queue of the packet's flow.  Locally
+	 *	generated (sent) packets stay on this processor.
+	 */
+	if (net_rcv_nqueues > 1 && !net_kmsg(kmsg)->sent) {
+	    qi = net_flow_hash(ifp, kmsg, count);
+	    qi = (qi ^ (qi >> 16)) % net_rcv_nqueues;
+	} else
+	    qi = cpu_number();
+	q = &net_rcv_queues[qi];
+
+	simple_lock(&q->lock);
+	q->packets++;
 	if (priority) {
-	    ipc_kmsg_enqueue(&net_queue_high, kmsg);
-	    if (++net_queue_high_size > net_queue_high_max)
-		net_queue_high_max = net_queue_high_size;
+	    ipc_kmsg_enqueue(&q->high, kmsg);
+	    if (++q->high_size > q->high_max)
+		q->high_max = q->high_size;
 	} else {
-	    ipc_kmsg_enqueue(&net_queue_low, kmsg);
-	    if (++net_queue_low_size > net_queue_low_max)
-		net_queue_low_max = net_queue_low_size;
+	    ipc_kmsg_enqueue(&q->low, kmsg);
+	    if (++q->low_size > q->low_max)
+		q->low_max = q->low_size;
 	}
 	/*
 	 *	If the network thread is awake, then we don't
 	 *	need to take an AST, because the thread will
-	 *	deliver the packet.
+	 *	deliver the packet.  The AST can only be used
+	 *	for the queue of this processor, packets for
+	 *	other queues wake up their network thread.
 	 */
-	awake = net_thread_awake;
-	simple_unlock(&net_queue_lock);
+	awake = q->thread_awake;
+	if (!awake && qi != cpu_number())
+	    q->thread_awake = TRUE;
+	if (q->thread_lingering) {
+	    /* It is awake, but waiting for this very packet. */
+	    q->thread_lingering = FALSE;
+	    thread_wakeup((event_t) &q->thread_awake);
+	}
+	simple_unlock(&q->lock);
 
 	if (!awake) {
-	    spl_t s = splsched();
-	    ast_on(cpu_number(), AST_NETWORK);
-	    (void) splx(s);
+	    if (qi == cpu_number()) {
+		spl_t s = splsched();
+		ast_on(cpu_number(), AST_NETWORK);
+		(void) splx(s);
+	    } else
+		thread_wakeup((event_t) &q->thread_awake);
 	}
 }
 
@@ -813,6 +1358,12 @@ net_filter(kmsg, send_list)
 		}
  		net_kmsg(new_kmsg)->net_rcv_msg_packet_count = ret_count;
 		new_kmsg->ikm_header.msgh_remote_port = (mach_port_t) dest;
+		if (infp->filter[0] & NETF_BATCH) {
+		    new_kmsg->ikm_header.msgh_id = NET_RCV_BATCH_MSG_ID;
+		    new_kmsg->ikm_header.msgh_seqno =
+			net_batch_params(ifp, infp);
+		} else
+		    new_kmsg->ikm_header.msgh_id = NET_RCV_MSG_ID;
 		ipc_kmsg_enqueue(send_list, new_kmsg);
 
 	    {
@@ -1300,6 +1851,8 @@ net_set_filter(
     if (is_new_infp) {
 	my_infp->priority = priority;
 	my_infp->rcv_count = 0;
+	if (filter[0] & NETF_BATCH)
+	    __atomic_add_fetch(&net_rcv_batch_filters, 1, __ATOMIC_RELAXED);
 
 	/* Copy filter program. */
 	memcpy (my_infp->filter, filter, filter_bytes);
@@ -1492,6 +2045,7 @@ void
 net_io_init(void)
 {
 	vm_size_t		size;
+	int			i;
 
 	size = sizeof(struct net_rcv_port);
 	kmem_cache_init(&net_rcv_cache, "net_rcv_port", size, 0,
@@ -1502,6 +2056,9 @@ net_io_init(void)
 			NULL, 0);
 
 	size = ikm_plus_overhead(sizeof(struct net_rcv_msg));
+	net_kmsg_owner_offset = (size + sizeof(net_rcv_queue_t) - 1)
+				& ~(sizeof(net_rcv_queue_t) - 1);
+	size = net_kmsg_owner_offset + sizeof(net_rcv_queue_t);
 	net_kmsg_size = round_page(size);
 
 	/*
@@ -1512,16 +2069,26 @@ net_io_init(void)
 	 *	(Added as the filters are added.)
 	 */
 
-	simple_lock_init(&net_kmsg_total_lock);
 	if (net_kmsg_max == 0)
 	    net_kmsg_max = net_queue_free_min;
 
-	simple_lock_init(&net_queue_free_lock);
-	ipc_kmsg_queue_init(&net_queue_free);
-
-	simple_lock_init(&net_queue_lock);
-	ipc_kmsg_queue_init(&net_queue_high);
-	ipc_kmsg_queue_init(&net_queue_low);
+	/*
+	 *	One receive queue per processor.
+	 */
+	net_rcv_nqueues = (ncpu < NCPUS) ? ncpu : NCPUS;
+	if (net_rcv_nqueues < 1)
+	    net_rcv_nqueues = 1;
+
+	for (i = 0; i < NCPUS; i++) {
+	    net_rcv_queue_t q = &net_rcv_queues[i];
+
+	    simple_lock_init(&q->lock);
+	    q->thread_awake = FALSE;
+	    ipc_kmsg_queue_init(&q->high);
+	    ipc_kmsg_queue_init(&q->low);
+	    ipc_kmsg_queue_init(&q->free);
+	    ipc_kmsg_queue_init(&q->batch_free);
+	}
 
  	simple_lock_init(&net_hash_header_lock);
 }
@@ -2061,6 +2628,9 @@ hash_ent_remove(
 					queue_remove(&ifp->if_snd_port_list,
 						     (net_rcv_port_t)hp,
 						     net_rcv_port_t, output);
+				if (((net_rcv_port_t)hp)->filter[0] & NETF_BATCH)
+					__atomic_sub_fetch(&net_rcv_batch_filters,
+							   1, __ATOMIC_RELAXED);
 				hp->n_keys = 0;
 				return TRUE;
 			}
@@ -2092,10 +2662,8 @@ net_add_q_info(ipc_port_t rcv_port)
 		ip_unlock(rcv_port);
 	}
 	    
-	simple_lock(&net_kmsg_total_lock);
-	net_queue_free_min++;
-	net_kmsg_max += qlimit + 1;
-	simple_unlock(&net_kmsg_total_lock);
+	__atomic_add_fetch(&net_queue_free_min, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&net_kmsg_max, qlimit + 1, __ATOMIC_RELAXED);
 
 	return (int)qlimit;
 }
@@ -2103,10 +2671,8 @@ net_add_q_info(ipc_port_t rcv_port)
 void
 net_del_q_info(int qlimit)
 {
-	simple_lock(&net_kmsg_total_lock);
-	net_queue_free_min--;
-	net_kmsg_max -= qlimit + 1;
-	simple_unlock(&net_kmsg_total_lock);
+	__atomic_sub_fetch(&net_queue_free_min, 1, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&net_kmsg_max, qlimit + 1, __ATOMIC_RELAXED);
 }
 
 
@@ -2127,6 +2693,9 @@ net_free_dead_infp(queue_entry_t dead_infp)
 		nextfp = (net_rcv_port_t) queue_next(&infp->input);
 		ipc_port_release_send(infp->rcv_port);
 		net_del_q_info(infp->rcv_qlimit);
+		if (infp->filter[0] & NETF_BATCH)
+		    __atomic_sub_fetch(&net_rcv_batch_filters, 1,
+				       __ATOMIC_RELAXED);
 		kmem_cache_free(&net_rcv_cache, (vm_offset_t) infp);
 	}	    
 }
@@ -91,6 +91,7 @@ extern void net_kmsg_collect (void);
 
 extern void net_io_init(void);
 extern void net_thread(void) __attribute__ ((noreturn));
+extern void net_thread_create(void);
 
 #define net_kmsg_alloc()	((ipc_kmsg_t) kalloc(net_kmsg_size))
 #define net_kmsg_free(kmsg)	kfree((vm_offset_t) (kmsg), net_kmsg_size)
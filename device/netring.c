@@ -0,0 +1,390 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ *	Shared packet rings, with a loopback backend.
+ *
+ *	See <device/net_ring.h> for the layout of the shared area.
+ *	Transmitted packets are moved to the receive ring of the same
+ *	unit by exchanging the buffers of the two slots, so that no
+ *	packet data is ever copied.
+ *
+ *	Each open gets a fresh area.  On close, the memory object the
+ *	device was mapped with is revoked and the mappings of the area
+ *	are removed before it is freed, so that nothing a user left
+ *	mapped can see the packets of the next one.  The area pointer
+ *	is cleared under the unit lock first, and every path checks it
+ *	under that lock.
+ *
+ *	No network interface driver is attached to the rings yet; the
+ *	loopback backend is the only one.
+ */
+
+#include <sys/types.h>
+#include <string.h>
+
+#include <device/conf.h>
+#include <device/dev_hdr.h>
+#include <device/dev_pager.h>
+#include <device/ds_routines.h>
+#include <device/io_req.h>
+#include <device/net_ring.h>
+#include <device/netring.h>
+#include <kern/lock.h>
+#include <kern/queue.h>
+#include <mach/boolean.h>
+#include <machine/pmap.h>
+#include <vm/pmap.h>
+#include <vm/vm_page.h>
+
+struct netring_softc {
+	decl_simple_lock_data(, lock)
+	boolean_t		in_use;
+	mach_device_t		device;		/* for device_pager_revoke */
+	struct vm_page		*pages;		/* physical area */
+	struct net_ring_area	*area;		/* its direct mapping */
+	vm_size_t		size;
+	queue_head_t		read_queue;	/* waiting device_reads */
+	unsigned int		packets;	/* for debugging */
+};
+
+static struct netring_softc netring_softc[NNETRING];
+
+#define netring_area_size()						\
+	(round_page(sizeof(struct net_ring_area))			\
+	 + round_page(NET_RING_NBUFS * NET_RING_BUF_SIZE))
+
+void
+netring_init (void)
+{
+  int i;
+
+  for (i = 0; i < NNETRING; i++)
+    {
+      simple_lock_init (&netring_softc[i].lock);
+      queue_init (&netring_softc[i].read_queue);
+      netring_softc[i].in_use = FALSE;
+      netring_softc[i].pages = NULL;
+      netring_softc[i].area = NULL;
+    }
+}
+
+static void
+netring_reset (struct net_ring_area *area, vm_size_t size)
+{
+  unsigned int i;
+
+  memset (area, 0, size);
+  area->magic = NET_RING_MAGIC;
+  area->version = NET_RING_VERSION;
+  area->nslots = NET_RING_SLOTS;
+  area->buf_size = NET_RING_BUF_SIZE;
+  area->nbufs = NET_RING_NBUFS;
+  area->buf_offset = round_page (sizeof (struct net_ring_area));
+  area->size = size;
+
+  for (i = 0; i < NET_RING_SLOTS; i++)
+    {
+      area->rx.slot[i].buf = i;
+      area->tx.slot[i].buf = NET_RING_SLOTS + i;
+    }
+}
+
+io_return_t
+netringopen (dev_t dev, int flag, io_req_t ior)
+{
+  struct netring_softc *sc;
+  struct vm_page *pages;
+  vm_size_t size;
+  int unit = minor (dev);
+
+  if (unit >= NNETRING)
+    return D_NO_SUCH_DEVICE;
+
+  sc = &netring_softc[unit];
+  simple_lock (&sc->lock);
+  if (sc->in_use)
+    {
+      simple_unlock (&sc->lock);
+      return D_ALREADY_OPEN;
+    }
+  sc->in_use = TRUE;
+  simple_unlock (&sc->lock);
+
+  /* The area is accessed through the direct mapping, so that the
+     only mappings of its pages are those of users.  */
+  size = netring_area_size ();
+  pages = vm_page_grab_contig (size, VM_PAGE_SEL_DIRECTMAP);
+  if (pages == NULL)
+    {
+      simple_lock (&sc->lock);
+      sc->in_use = FALSE;
+      simple_unlock (&sc->lock);
+      return D_NO_MEMORY;
+    }
+
+  netring_reset ((struct net_ring_area *) phystokv (vm_page_to_pa (pages)),
+		 size);
+
+  simple_lock (&sc->lock);
+  sc->device = ior->io_device;
+  sc->pages = pages;
+  sc->area = (struct net_ring_area *) phystokv (vm_page_to_pa (pages));
+  sc->size = size;
+  simple_unlock (&sc->lock);
+  return D_SUCCESS;
+}
+
+void
+netringclose (dev_t dev, int flag)
+{
+  struct netring_softc *sc = &netring_softc[minor (dev)];
+  struct vm_page *pages;
+  queue_head_t reads;
+  phys_addr_t pa;
+  vm_size_t size, off;
+  io_req_t ior;
+
+  queue_init (&reads);
+
+  simple_lock (&sc->lock);
+  while ((ior = (io_req_t) dequeue_head (&sc->read_queue)) != NULL)
+    enqueue_tail (&reads, (queue_entry_t) ior);
+  pages = sc->pages;
+  size = sc->size;
+  sc->pages = NULL;
+  sc->area = NULL;
+  simple_unlock (&sc->lock);
+
+  while ((ior = (io_req_t) dequeue_head (&reads)) != NULL)
+    {
+      ior->io_error = D_DEVICE_DOWN;
+      iodone (ior);
+    }
+
+  /* Cut users off the area before it can be reused.  */
+  device_pager_revoke (sc->device);
+  pa = vm_page_to_pa (pages);
+  for (off = 0; off < size; off += PAGE_SIZE)
+    pmap_page_protect (pa + off, VM_PROT_NONE);
+  vm_page_free_contig (pages, size);
+
+  simple_lock (&sc->lock);
+  sc->device = MACH_DEVICE_NULL;
+  sc->in_use = FALSE;
+  simple_unlock (&sc->lock);
+}
+
+/* Complete a read with the current receive ring head.
+   Called with the unit locked.  */
+static void
+netring_read_fill (struct netring_softc *sc, io_req_t ior)
+{
+  unsigned int head = sc->area->rx.head;
+  vm_size_t amt;
+
+  amt = ior->io_count;
+  if (amt > sizeof head)
+    amt = sizeof head;
+  if (amt > 0)
+    memcpy (ior->io_data, &head, amt);
+  ior->io_residual = ior->io_count - amt;
+}
+
+static boolean_t netring_read_done (io_req_t ior);
+
+io_return_t
+netringread (dev_t dev, io_req_t ior)
+{
+  struct netring_softc *sc = &netring_softc[minor (dev)];
+  struct net_ring_area *area;
+  int err;
+
+  err = device_read_alloc (ior, ior->io_count);
+  if (err != KERN_SUCCESS)
+    return err;
+
+  simple_lock (&sc->lock);
+  area = sc->area;
+  if (area == NULL)
+    {
+      simple_unlock (&sc->lock);
+      return D_DEVICE_DOWN;
+    }
+
+  if (area->rx.head == area->rx.tail)
+    {
+      /* The receive ring is empty.  */
+      if (ior->io_mode & D_NOWAIT)
+	{
+	  simple_unlock (&sc->lock);
+	  return D_WOULD_BLOCK;
+	}
+
+      ior->io_done = netring_read_done;
+      enqueue_tail (&sc->read_queue, (queue_entry_t) ior);
+      simple_unlock (&sc->lock);
+      return D_IO_QUEUED;
+    }
+
+  netring_read_fill (sc, ior);
+  simple_unlock (&sc->lock);
+  return D_SUCCESS;
+}
+
+static boolean_t
+netring_read_done (io_req_t ior)
+{
+  struct netring_softc *sc = &netring_softc[minor (ior->io_unit)];
+
+  simple_lock (&sc->lock);
+  if (sc->area == NULL)
+    ior->io_error = D_DEVICE_DOWN;
+  else if (ior->io_error == D_SUCCESS)
+    netring_read_fill (sc, ior);
+  simple_unlock (&sc->lock);
+  ds_read_done (ior);
+
+  return TRUE;
+}
+
+/* Move the packets of the transmit ring to the receive ring.
+   A packet that doesn't fit in the receive ring is dropped.
+   Called with the unit locked.  */
+static unsigned int
+netring_loopback (struct net_ring_area *area)
+{
+  struct net_ring_slot *tx, *rx;
+  unsigned int tx_head, tx_tail, rx_head, buf, length, n;
+
+  /* The user may change the indices at any time: read them once.  */
+  tx_head = area->tx.head;
+  tx_tail = area->tx.tail;
+  rx_head = area->rx.head;
+  if (tx_head - tx_tail > NET_RING_SLOTS)
+    tx_tail = tx_head - NET_RING_SLOTS;
+
+  n = 0;
+  for (; tx_tail != tx_head; tx_tail++)
+    {
+      tx = &area->tx.slot[tx_tail % NET_RING_SLOTS];
+      buf = tx->buf;
+      length = tx->length;
+      if (buf >= NET_RING_NBUFS || length > NET_RING_BUF_SIZE)
+	continue;
+
+      if (rx_head - area->rx.tail >= NET_RING_SLOTS)
+	{
+	  area->drops++;
+	  continue;
+	}
+
+      rx = &area->rx.slot[rx_head % NET_RING_SLOTS];
+      tx->buf = rx->buf;
+      rx->buf = buf;
+      rx->length = length;
+      rx_head++;
+      n++;
+    }
+
+  /* Make the slots visible before the indices.  */
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+  area->rx.head = rx_head;
+  area->tx.tail = tx_tail;
+  return n;
+}
+
+io_return_t
+netringsetstat (dev_t dev, dev_flavor_t flavor, dev_status_t data,
+		mach_msg_type_number_t count)
+{
+  struct netring_softc *sc = &netring_softc[minor (dev)];
+  io_req_t ior;
+
+  switch (flavor)
+    {
+    case NET_RING_KICK:
+      simple_lock (&sc->lock);
+      if (sc->area == NULL)
+	{
+	  simple_unlock (&sc->lock);
+	  return D_DEVICE_DOWN;
+	}
+      sc->packets += netring_loopback (sc->area);
+      if (sc->area->rx.head != sc->area->rx.tail)
+	while ((ior = (io_req_t) dequeue_head (&sc->read_queue)) != NULL)
+	  iodone (ior);
+      simple_unlock (&sc->lock);
+      break;
+
+    default:
+      return D_INVALID_OPERATION;
+    }
+
+  return D_SUCCESS;
+}
+
+io_return_t
+netringgetstat (dev_t dev, dev_flavor_t flavor, dev_status_t data,
+		mach_msg_type_number_t *count)
+{
+  struct netring_softc *sc = &netring_softc[minor (dev)];
+
+  switch (flavor)
+    {
+    case NET_RING_STATUS:
+      if (*count < NET_RING_STATUS_COUNT)
+	return D_INVALID_OPERATION;
+      simple_lock (&sc->lock);
+      if (sc->area == NULL)
+	{
+	  simple_unlock (&sc->lock);
+	  return D_DEVICE_DOWN;
+	}
+      memcpy (data, sc->area, NET_RING_STATUS_COUNT * sizeof (int));
+      simple_unlock (&sc->lock);
+      *count = NET_RING_STATUS_COUNT;
+      break;
+
+    case DEV_GET_SIZE:
+      data[DEV_GET_SIZE_DEVICE_SIZE] = netring_area_size ();
+      data[DEV_GET_SIZE_RECORD_SIZE] = NET_RING_BUF_SIZE;
+      *count = DEV_GET_SIZE_COUNT;
+      break;
+
+    default:
+      return D_INVALID_OPERATION;
+    }
+
+  return D_SUCCESS;
+}
+
+vm_offset_t
+netringmmap (dev_t dev, vm_offset_t off, vm_prot_t prot)
+{
+  struct netring_softc *sc = &netring_softc[minor (dev)];
+  vm_offset_t frame;
+
+  simple_lock (&sc->lock);
+  if (sc->pages == NULL || off >= sc->size)
+    frame = -1;
+  else
+    frame = pmap_phys_to_frame (vm_page_to_pa (sc->pages) + off);
+  simple_unlock (&sc->lock);
+  return frame;
+}
@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _DEVICE_NETRING_H_
+#define _DEVICE_NETRING_H_
+
+#include <sys/types.h>
+
+#include <device/device_types.h>
+#include <device/io_req.h>
+
+/*
+ * Loopback packet ring device: packets transmitted on a unit
+ * are received on the same unit.
+ */
+
+#define NNETRING	4
+
+void netring_init (void);
+
+io_return_t netringopen (dev_t dev, int flag, io_req_t ior);
+void netringclose (dev_t dev, int flag);
+io_return_t netringread (dev_t dev, io_req_t ior);
+io_return_t netringgetstat (dev_t dev, dev_flavor_t flavor,
+			    dev_status_t data, mach_msg_type_number_t *count);
+io_return_t netringsetstat (dev_t dev, dev_flavor_t flavor,
+			    dev_status_t data, mach_msg_type_number_t count);
+vm_offset_t netringmmap (dev_t dev, vm_offset_t off, vm_prot_t prot);
+
+#endif /* _DEVICE_NETRING_H_ */
@@ -0,0 +1,176 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ *	Kernel event trace device.
+ *
+ *	See <device/trace_ring.h> for the layout of the shared area.
+ *	Tracepoints may be hit at any interrupt level, with locks held,
+ *	so they take no lock: each processor produces into its own ring
+ *	of a set of mappable per-processor rings, which overwrite the
+ *	oldest records.
+ *
+ *	The area is allocated on the first open and kept for good, as
+ *	tracepoints may still be recording into it while tracing stops.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <device/cpu_ring.h>
+#include <device/ds_routines.h>
+#include <device/io_req.h>
+#include <device/trace.h>
+#include <device/trace_ring.h>
+#include <kern/cpu_number.h>
+#include <kern/thread.h>
+#include <kern/time_stamp.h>
+#include <kern/trace.h>
+#include <mach/machine.h>
+
+/* The rings follow the layout of the mappable per-processor rings.  */
+_Static_assert (offsetof (struct trace_area, size)
+		== offsetof (struct cpu_ring_area, size), "trace_area");
+_Static_assert (offsetof (struct trace_ring, head)
+		== offsetof (struct cpu_ring, head), "trace_ring");
+_Static_assert (offsetof (struct trace_ring, slot) == CPU_RING_HEADER_SIZE,
+		"trace_ring");
+_Static_assert (offsetof (struct trace_record, seq) == 0, "trace_record");
+
+unsigned int		trace_events;
+
+static struct cpu_ring_set trace_rings;
+static struct trace_area *trace_area;	/* header of trace_rings */
+static unsigned int	trace_nopens;
+
+void
+trace_emit (unsigned int event, unsigned long arg0, unsigned long arg1,
+	    unsigned long arg2)
+{
+  struct trace_record *record;
+  unsigned int seq;
+  int cpu;
+
+  cpu = cpu_number ();
+  record = cpu_ring_reserve (&trace_rings, cpu, &seq);
+  if (record == NULL)
+    return;
+
+  record->event = event;
+  record->cpu = cpu;
+  record->tsc = machine_cycles ();
+  record->thread = (vm_offset_t) active_threads[cpu];
+  record->arg[0] = arg0;
+  record->arg[1] = arg1;
+  record->arg[2] = arg2;
+
+  cpu_ring_commit (record, seq);
+}
+
+static void
+trace_set_events (unsigned int events)
+{
+  events &= (1U << TRACE_NEVENTS) - 1;
+  trace_area->events = events;
+  __atomic_store_n (&trace_events, events, __ATOMIC_RELEASE);
+}
+
+void
+trace_init (void)
+{
+  cpu_ring_set_init (&trace_rings, TRACE_MAGIC, TRACE_VERSION,
+		     sizeof (struct trace_area), sizeof (struct trace_ring),
+		     TRACE_RING_SLOTS, sizeof (struct trace_record), TRUE);
+}
+
+io_return_t
+traceopen (dev_t dev, int flag, io_req_t ior)
+{
+  io_return_t err;
+
+  if (minor (dev) != 0)
+    return D_NO_SUCH_DEVICE;
+
+  kmutex_lock (&trace_rings.lock, FALSE);
+  err = cpu_ring_set_alloc (&trace_rings);
+  if (err != D_SUCCESS)
+    {
+      kmutex_unlock (&trace_rings.lock);
+      return err;
+    }
+
+  trace_area = (struct trace_area *) trace_rings.area;
+  trace_nopens++;
+  kmutex_unlock (&trace_rings.lock);
+  return D_SUCCESS;
+}
+
+void
+traceclose (dev_t dev, int flag)
+{
+  kmutex_lock (&trace_rings.lock, FALSE);
+  if (--trace_nopens == 0)
+    trace_set_events (0);
+  kmutex_unlock (&trace_rings.lock);
+}
+
+io_return_t
+tracesetstat (dev_t dev, dev_flavor_t flavor, dev_status_t data,
+	      mach_msg_type_number_t count)
+{
+  switch (flavor)
+    {
+    case TRACE_SET_EVENTS:
+      if (count < TRACE_SET_EVENTS_COUNT)
+	return D_INVALID_OPERATION;
+      kmutex_lock (&trace_rings.lock, FALSE);
+      trace_set_events (data[0]);
+      kmutex_unlock (&trace_rings.lock);
+      break;
+
+    default:
+      return D_INVALID_OPERATION;
+    }
+
+  return D_SUCCESS;
+}
+
+io_return_t
+tracegetstat (dev_t dev, dev_flavor_t flavor, dev_status_t data,
+	      mach_msg_type_number_t *count)
+{
+  switch (flavor)
+    {
+    case TRACE_STATUS:
+      return cpu_ring_set_get_status (&trace_rings, TRACE_STATUS_COUNT,
+				      data, count);
+
+    case DEV_GET_SIZE:
+      return cpu_ring_set_get_size (&trace_rings, data, count);
+
+    default:
+      return D_INVALID_OPERATION;
+    }
+}
+
+vm_offset_t
+tracemmap (dev_t dev, vm_offset_t off, vm_prot_t prot)
+{
+  /* Only the kernel writes into the rings.  */
+  return cpu_ring_set_mmap (&trace_rings, off, prot);
+}
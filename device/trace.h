@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _DEVICE_TRACE_H_
+#define _DEVICE_TRACE_H_
+
+#include <sys/types.h>
+
+#include <device/device_types.h>
+#include <device/io_req.h>
+
+/*
+ * Kernel event trace device, see <kern/trace.h>.
+ */
+
+void trace_init (void);
+
+io_return_t traceopen (dev_t dev, int flag, io_req_t ior);
+void traceclose (dev_t dev, int flag);
+io_return_t tracegetstat (dev_t dev, dev_flavor_t flavor,
+			  dev_status_t data, mach_msg_type_number_t *count);
+io_return_t tracesetstat (dev_t dev, dev_flavor_t flavor,
+			  dev_status_t data, mach_msg_type_number_t count);
+vm_offset_t tracemmap (dev_t dev, vm_offset_t off, vm_prot_t prot);
+
+#endif /* _DEVICE_TRACE_H_ */
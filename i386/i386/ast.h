@@ -37,7 +37,13 @@
 
 #define	AST_I386_FP	0x80000000
 
-#define MACHINE_AST_PER_THREAD		AST_I386_FP
+/*
+ * AST_I386_PROF has the profiler sample the user stack of a thread
+ * interrupted in user mode, as it may fault.
+ */
+#define	AST_I386_PROF	0x40000000
+
+#define MACHINE_AST_PER_THREAD		(AST_I386_FP | AST_I386_PROF)
 
 
 /* Chain to the machine-independent header.  */
@@ -36,6 +36,7 @@
  * Support for 80387 floating point or FP emulator.
  */
 
+#include <stddef.h>
 #include <string.h>
 
 #include <mach/exception.h>
@@ -69,8 +70,17 @@
 #define ASSERT_IPL(L)
 #endif
 
+/* CPUID bits for XSAVE.  */
+#define	CPUID_ECX_XSAVE		(1 << 26)	/* leaf 1 */
+#define	CPUID_D1_EAX_XSAVEOPT	(1 << 0)	/* leaf 0xd, subleaf 1 */
+#define	CPUID_D1_EAX_XSAVEC	(1 << 1)
+
 int		fp_kind = FP_387;	/* 80387 present */
+enum fp_save_kind	fp_save_kind = FP_FNSAVE;
+unsigned long long	fp_xsave_support;	/* XSAVE components used */
+static unsigned int	fp_xsave_size;	/* size of the XSAVE area */
 struct kmem_cache	ifps_cache;	/* cache for FPU save area */
+static vm_size_t	ifps_size;	/* size of FPU save areas */
 static unsigned long	mxcsr_feature_mask = 0xffffffff;	/* Always AND user-provided mxcsr with this security mask */
 
 #if	NCPUS == 1
@@ -96,9 +106,51 @@ volatile thread_t	fp_intr_thread = THREAD_NULL;
 #endif
 
 
+#ifndef MACH_RING1
+/*
+ * Use XSAVE if the processor has it, so that user mode may use AVX.
+ * Pick the variant that writes the least, and size the save area
+ * for the components we enable.
+ */
+static void
+init_xsave(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	unsigned long long supported;
+
+	cpuid_count(1, 0, &eax, &ebx, &ecx, &edx);
+	if (!(ecx & CPUID_ECX_XSAVE))
+	    return;
+
+	set_cr4(get_cr4() | CR4_OSXSAVE);
+
+	cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx);
+	supported = ((unsigned long long) edx << 32) | eax;
+	fp_xsave_support = supported & (XSTATE_X87|XSTATE_SSE|XSTATE_AVX);
+	if ((supported & XSTATE_AVX512) == XSTATE_AVX512
+	    && (fp_xsave_support & XSTATE_AVX))
+	    fp_xsave_support |= XSTATE_AVX512;
+	set_xcr(0, fp_xsave_support);
+
+	/* Now that XCR0 is set, this is the size of the standard format.  */
+	cpuid_count(0xd, 0, &eax, &ebx, &ecx, &edx);
+	fp_xsave_size = ebx;
+
+	cpuid_count(0xd, 1, &eax, &ebx, &ecx, &edx);
+	if (eax & CPUID_D1_EAX_XSAVEOPT)
+	    fp_save_kind = FP_XSAVEOPT;
+	else if (eax & CPUID_D1_EAX_XSAVEC)
+	    fp_save_kind = FP_XSAVEC;
+	else
+	    fp_save_kind = FP_XSAVE;
+	fp_kind = FP_387X;
+}
+#endif /* MACH_RING1 */
+
 /*
  * Look for FPU and initialize it.
- * Called on each CPU.
+ * Called on the boot processor: this sets the global FPU parameters,
+ * which the other processors then only program, see init_fpu_cpu.
  */
 void
 init_fpu(void)
@@ -152,7 +204,6 @@ init_fpu(void)
 		    static /* because we _need_ alignment */
 		    struct i386_xfp_save save;
 		    unsigned long mask;
-		    fp_kind = FP_387X;
 #ifndef MACH_RING1
 		    set_cr4(get_cr4() | CR4_OSFXSR);
 #endif /* MACH_RING1 */
@@ -161,6 +212,11 @@ init_fpu(void)
 		    if (!mask)
 			mask = 0x0000ffbf;
 		    mxcsr_feature_mask &= mask;
+		    fp_kind = FP_387FX;
+		    fp_save_kind = FP_FXSAVE;
+#ifndef MACH_RING1
+		    init_xsave();
+#endif /* MACH_RING1 */
 		} else
 		    fp_kind = FP_387;
 	    }
@@ -181,15 +237,68 @@ init_fpu(void)
 	}
 }
 
+/*
+ * Program the FPU of the current processor the same way init_fpu
+ * did on the boot processor, without probing it again.
+ */
+void
+init_fpu_cpu(void)
+{
+#ifdef	MACH_RING1
+	clear_ts();
+	fninit();
+	set_ts();
+#else	/* MACH_RING1 */
+	unsigned int native = 0;
+
+	if (machine_slot[cpu_number()].cpu_type >= CPU_TYPE_I486)
+		native = CR0_NE;
+
+	set_cr0((get_cr0() & ~(CR0_EM|CR0_TS)) | native);
+
+	if (fp_kind >= FP_387FX)
+	    set_cr4(get_cr4() | CR4_OSFXSR);
+	if (fp_kind == FP_387X) {
+	    set_cr4(get_cr4() | CR4_OSXSAVE);
+	    set_xcr(0, fp_xsave_support);
+	}
+
+	fninit();
+	set_cr0(get_cr0() | CR0_TS | CR0_MP);
+#endif	/* MACH_RING1 */
+}
+
 /*
  * Initialize FP handling.
  */
 void
 fpu_module_init(void)
 {
+	ifps_size = sizeof(struct i386_fpsave_state);
+	if (fp_kind == FP_387X) {
+	    vm_size_t size = offsetof(struct i386_fpsave_state, xfp_save_state)
+			     + fp_xsave_size;
+	    if (size > ifps_size)
+		ifps_size = size;
+	}
+
+	/* XSAVE needs 64-byte alignment.  */
 	kmem_cache_init(&ifps_cache, "i386_fpsave_state",
-			sizeof(struct i386_fpsave_state), 16,
-			NULL, 0);
+			ifps_size, 64, NULL, 0);
+}
+
+/*
+ * Allocate a cleared FPU save area.  With XSAVE, this has all
+ * components in their initial state.
+ */
+static struct i386_fpsave_state *
+fp_alloc(void)
+{
+	struct i386_fpsave_state *ifps;
+
+	ifps = (struct i386_fpsave_state *) kmem_cache_alloc(&ifps_cache);
+	memset(ifps, 0, ifps_size);
+	return ifps;
 }
 
 /*
@@ -348,7 +457,7 @@ ASSERT_IPL(SPL0);
 	    if (ifps == 0) {
 		if (new_ifps == 0) {
 		    simple_unlock(&pcb->lock);
-		    new_ifps = (struct i386_fpsave_state *) kmem_cache_alloc(&ifps_cache);
+		    new_ifps = fp_alloc();
 		    goto Retry;
 		}
 		ifps = new_ifps;
@@ -361,7 +470,7 @@ ASSERT_IPL(SPL0);
 	     */
 	    memset(&ifps->fp_save_state, 0, sizeof(struct i386_fp_save));
 
-	    if (fp_kind == FP_387X) {
+	    if (fp_kind >= FP_387FX) {
 		int i;
 
 		ifps->xfp_save_state.fp_control = user_fp_state->fp_control;
@@ -374,6 +483,8 @@ ASSERT_IPL(SPL0);
 		ifps->xfp_save_state.fp_ds      = user_fp_state->fp_ds;
 		for (i=0; i<8; i++)
 		    memcpy(&ifps->xfp_save_state.fp_reg_word[i], &user_fp_regs->fp_reg_word[i], sizeof(user_fp_regs->fp_reg_word[i]));
+		/* Have XRSTOR load the x87 state rather than reset it.  */
+		ifps->xfp_save_state.fp_xstate_bv |= XSTATE_X87;
 	    } else {
 		ifps->fp_save_state.fp_control = user_fp_state->fp_control;
 		ifps->fp_save_state.fp_status  = user_fp_state->fp_status;
@@ -385,6 +496,7 @@ ASSERT_IPL(SPL0);
 		ifps->fp_save_state.fp_ds      = user_fp_state->fp_ds;
 		ifps->fp_regs = *user_fp_regs;
 	    }
+	    ifps->fp_valid = TRUE;
 
 	    simple_unlock(&pcb->lock);
 	    if (new_ifps != 0)
@@ -454,7 +566,16 @@ ASSERT_IPL(SPL0);
 	     */
 	    memset(user_fp_state,  0, sizeof(struct i386_fp_save));
 
-	    if (fp_kind == FP_387X) {
+	    if (fp_kind == FP_387X
+		&& !(ifps->xfp_save_state.fp_xstate_bv & XSTATE_X87)) {
+		/*
+		 * The x87 state is in its initial configuration,
+		 * which XSAVEOPT and XSAVEC don't write out.
+		 */
+		user_fp_state->fp_control = 0x037f;
+		user_fp_state->fp_tag     = 0xffff;	/* all empty */
+		memset(user_fp_regs, 0, sizeof *user_fp_regs);
+	    } else if (fp_kind >= FP_387FX) {
 		int i;
 
 		user_fp_state->fp_control = ifps->xfp_save_state.fp_control;
@@ -532,7 +653,10 @@ void fpinherit(thread_t parent_thread, thread_t thread)
 	if (ifps) {
 		/* Parent does have a state, inherit it */
 		if (ifps->fp_valid == TRUE)
-			thread->pcb->init_control = ifps->fp_save_state.fp_control;
+			thread->pcb->init_control =
+			    (fp_kind == FP_387X
+			     && !(ifps->xfp_save_state.fp_xstate_bv & XSTATE_X87))
+			    ? 0x037f : ifps->fp_save_state.fp_control;
 		else
 			/* State is in the FPU, fetch from there */
 			fnstcw(&thread->pcb->init_control);
@@ -697,7 +821,7 @@ fpexterrflt(void)
 	 */
 	i386_exception(EXC_ARITHMETIC,
 		       EXC_I386_EXTERR,
-		       fp_kind == FP_387X ?
+		       fp_kind >= FP_387FX ?
 		           thread->pcb->ims.ifps->xfp_save_state.fp_status :
 		           thread->pcb->ims.ifps->fp_save_state.fp_status);
 	/*NOTREACHED*/
@@ -755,7 +879,7 @@ ASSERT_IPL(SPL0);
 	 */
 	i386_exception(EXC_ARITHMETIC,
 		       EXC_I386_EXTERR,
-		       fp_kind == FP_387X ?
+		       fp_kind >= FP_387FX ?
 		           thread->pcb->ims.ifps->xfp_save_state.fp_status :
 		           thread->pcb->ims.ifps->fp_save_state.fp_status);
 	/*NOTREACHED*/
@@ -779,10 +903,7 @@ fp_save(thread_t thread)
 	if (ifps != 0 && !ifps->fp_valid) {
 	    /* registers are in FPU */
 	    ifps->fp_valid = TRUE;
-	    if (fp_kind == FP_387X)
-	    	fxsave(&ifps->xfp_save_state);
-	    else
-	    	fnsave(&ifps->fp_save_state);
+	    fp_save_regs(ifps);
 	}
 }
 
@@ -800,9 +921,13 @@ fp_load(thread_t thread)
 ASSERT_IPL(SPL0);
 	ifps = pcb->ims.ifps;
 	if (ifps == 0) {
-	    ifps = (struct i386_fpsave_state *) kmem_cache_alloc(&ifps_cache);
-	    memset(ifps, 0, sizeof *ifps);
+	    ifps = fp_alloc();
 	    pcb->ims.ifps = ifps;
+	    if (fp_kind == FP_387X) {
+		/* Reset all components, not only the x87 ones.  */
+		clear_ts();
+		xrstor(ifps->xfp_save_state, fp_xsave_support);
+	    }
 	    fpinit(thread);
 #if 1
 /* 
@@ -822,7 +947,7 @@ ASSERT_IPL(SPL0);
 		 */
 		i386_exception(EXC_ARITHMETIC,
 			       EXC_I386_EXTERR,
-			       fp_kind == FP_387X ?
+			       fp_kind >= FP_387FX ?
 			           thread->pcb->ims.ifps->xfp_save_state.fp_status :
 			           thread->pcb->ims.ifps->fp_save_state.fp_status);
 		/*NOTREACHED*/
@@ -831,10 +956,7 @@ ASSERT_IPL(SPL0);
 		printf("fp_load: invalid FPU state!\n");
 		fninit ();
 	} else {
-	    if (fp_kind == FP_387X)
-		fxrstor(ifps->xfp_save_state);
-	    else
-		frstor(ifps->fp_save_state);
+	    fp_restore_regs(ifps);
 	}
 	ifps->fp_valid = FALSE;		/* in FPU */
 }
@@ -851,13 +973,12 @@ fp_state_alloc(void)
 	pcb_t	pcb = current_thread()->pcb;
 	struct i386_fpsave_state *ifps;
 
-	ifps = (struct i386_fpsave_state *)kmem_cache_alloc(&ifps_cache);
-	memset(ifps, 0, sizeof *ifps);
+	ifps = fp_alloc();
 	pcb->ims.ifps = ifps;
 
 	ifps->fp_valid = TRUE;
 
-	if (fp_kind == FP_387X) {
+	if (fp_kind >= FP_387FX) {
 		ifps->xfp_save_state.fp_control = (0x037f
 				& ~(FPC_IM|FPC_ZM|FPC_OM|FPC_PC))
 				| (FPC_PC_64|FPC_IC_AFF);
@@ -865,6 +986,9 @@ fp_state_alloc(void)
 		ifps->xfp_save_state.fp_tag = 0xffff;	/* all empty */
 		if (CPU_HAS_FEATURE(CPU_FEATURE_SSE))
 			ifps->xfp_save_state.fp_mxcsr = 0x1f80;
+		/* The other components start in their initial state.  */
+		ifps->xfp_save_state.fp_xstate_bv =
+			fp_xsave_support & (XSTATE_X87|XSTATE_SSE);
 	} else {
 		ifps->fp_save_state.fp_control = (0x037f
 				& ~(FPC_IM|FPC_ZM|FPC_OM|FPC_PC))
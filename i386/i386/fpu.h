@@ -73,9 +73,86 @@
 #define	fxrstor(state) \
 	asm volatile("fxrstor %0" : : "m" (state))
 
+#define	xsave(state, mask) \
+	asm volatile("xsave %0" : "=m" (*state) \
+		     : "a" ((unsigned) (mask)), "d" ((unsigned) ((mask) >> 32)) \
+		     : "memory")
+
+#define	xsaveopt(state, mask) \
+	asm volatile("xsaveopt %0" : "=m" (*state) \
+		     : "a" ((unsigned) (mask)), "d" ((unsigned) ((mask) >> 32)) \
+		     : "memory")
+
+#define	xsavec(state, mask) \
+	asm volatile("xsavec %0" : "=m" (*state) \
+		     : "a" ((unsigned) (mask)), "d" ((unsigned) ((mask) >> 32)) \
+		     : "memory")
+
+#define	xrstor(state, mask) \
+	asm volatile("xrstor %0" : : "m" (state), \
+		     "a" ((unsigned) (mask)), "d" ((unsigned) ((mask) >> 32)) \
+		     : "memory")
+
 #define fwait() \
     	asm("fwait");
 
+/*
+ * Instruction used to save and restore the FPU state.  XSAVEOPT
+ * skips the components which are in their initial state or have not
+ * been modified since they were restored from the same area; XSAVEC
+ * skips the former and packs the others.
+ */
+enum fp_save_kind {
+	FP_FNSAVE,
+	FP_FXSAVE,
+	FP_XSAVE,
+	FP_XSAVEOPT,
+	FP_XSAVEC,
+};
+
+extern enum fp_save_kind	fp_save_kind;
+extern unsigned long long	fp_xsave_support;	/* enabled in XCR0 */
+
+static inline void
+fp_save_regs(struct i386_fpsave_state *ifps)
+{
+	switch (fp_save_kind) {
+	case FP_XSAVEOPT:
+		xsaveopt(&ifps->xfp_save_state, fp_xsave_support);
+		break;
+	case FP_XSAVEC:
+		xsavec(&ifps->xfp_save_state, fp_xsave_support);
+		break;
+	case FP_XSAVE:
+		xsave(&ifps->xfp_save_state, fp_xsave_support);
+		break;
+	case FP_FXSAVE:
+		fxsave(&ifps->xfp_save_state);
+		break;
+	default:
+		fnsave(&ifps->fp_save_state);
+		break;
+	}
+}
+
+static inline void
+fp_restore_regs(struct i386_fpsave_state *ifps)
+{
+	switch (fp_save_kind) {
+	case FP_XSAVEOPT:
+	case FP_XSAVEC:
+	case FP_XSAVE:
+		xrstor(ifps->xfp_save_state, fp_xsave_support);
+		break;
+	case FP_FXSAVE:
+		fxrstor(ifps->xfp_save_state);
+		break;
+	default:
+		frstor(ifps->fp_save_state);
+		break;
+	}
+}
+
 #define	fpu_load_context(pcb)
 
 /*
@@ -92,10 +169,7 @@
 	if (ifps != 0 && !ifps->fp_valid) { \
 	    /* registers are in FPU - save to memory */ \
 	    ifps->fp_valid = TRUE; \
-	    if (fp_kind == FP_387X) \
-		fxsave(&ifps->xfp_save_state); \
-	    else \
-		fnsave(&ifps->fp_save_state); \
+	    fp_save_regs(ifps); \
 	    set_ts(); \
 	} \
     }
@@ -124,6 +198,7 @@ extern void fpextovrflt(void);
 extern void fpexterrflt(void);
 extern void fpastintr(void);
 extern void init_fpu(void);
+extern void init_fpu_cpu(void);
 extern void fpintr(int unit);
 extern void fpinherit(thread_t parent_thread, thread_t thread);
 
@@ -35,10 +35,35 @@
 #include "seg.h"
 #include "gdt.h"
 #include "ktss.h"
+#include "locore.h"
+#include "proc_reg.h"
 
 /* A kernel TSS with a complete I/O bitmap.  */
 struct task_tss ktss;
 
+#ifdef	MACH_SYSENTER
+struct sysenter_stack sysenter_stacks[NCPUS];
+
+/*
+ * Let user mode enter Mach traps with SYSENTER.  The processor
+ * loads flat segments, so this only works if the kernel ones are.
+ */
+static void
+sysenter_init(void)
+{
+	int mycpu = cpu_number();
+
+	if (!CPU_HAS_FEATURE(CPU_FEATURE_SEP)
+	    || LINEAR_MIN_KERNEL_ADDRESS != VM_MIN_KERNEL_ADDRESS)
+		return;
+
+	sysenter_stacks[mycpu].esp0 = ktss.tss.esp0;
+	set_msr(MSR_SYSENTER_CS, KERNEL_CS);
+	set_msr(MSR_SYSENTER_ESP, (unsigned long) &sysenter_stacks[mycpu].esp0);
+	set_msr(MSR_SYSENTER_EIP, (unsigned long) &sysenter);
+}
+#endif	/* MACH_SYSENTER */
+
 void
 ktss_init(void)
 {
@@ -66,5 +91,9 @@ ktss_init(void)
 	/* Load the TSS.  */
 	ltr(KERNEL_TSS);
 #endif	/* MACH_RING1 */
+
+#ifdef	MACH_SYSENTER
+	sysenter_init();
+#endif	/* MACH_SYSENTER */
 }
 
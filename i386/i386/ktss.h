@@ -29,4 +29,25 @@ extern struct task_tss ktss;
 
 extern void ktss_init(void);
 
+/*
+ * Fast system call entry.  SYSENTER loads a fixed stack pointer,
+ * so each processor points it at a copy of its TSS esp0, from which
+ * the entry code loads the real one.  The words below it take the
+ * frame of a debug trap at the entry point.
+ */
+#if	!defined(__x86_64__) && !defined(MACH_RING1)
+#define	MACH_SYSENTER	1
+
+#include <kern/cpu_number.h>
+
+#define	SYSENTER_STACK_WORDS	256
+
+struct sysenter_stack {
+	unsigned long	stack[SYSENTER_STACK_WORDS];
+	unsigned long	esp0;		/* copy of ktss.tss.esp0 */
+};
+
+extern struct sysenter_stack sysenter_stacks[NCPUS];
+#endif	/* !__x86_64__ && !MACH_RING1 */
+
 #endif /* _I386_KTSS_ */
@@ -61,6 +61,7 @@ extern int inst_fetch (int eip, int cs);
 extern void cpu_shutdown (void);
 
 extern int syscall (void);
+extern int sysenter (void);
 
 extern unsigned int cpu_features[1];
 
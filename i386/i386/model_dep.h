@@ -33,6 +33,12 @@
  */
 extern void machine_init (void);
 
+/*
+ * Start the device probes left by machine_init, once the other
+ * processors are up.
+ */
+extern void machine_start_probes (void);
+
 /* Conserve power on processor CPU.  */
 extern void machine_idle (int cpu);
 
@@ -34,6 +34,7 @@
 #include <mach/machine.h>
 #include <mach/xen.h>
 #include <vm/vm_kern.h>
+#include <vm/pmap.h>
 #include <kern/kmutex.h>
 #include <kern/printf.h>
 #include <i386/loose_ends.h>
@@ -52,6 +53,7 @@
 #include <include/stdint.h> //uint16_t, uint32_t_t...
 #include <imps/apic.h>
 #include <i386/locore.h>
+#include <i386/fpu.h>
 
 /*
  * The i386 needs an interrupt stack to keep the PCB stack from being
@@ -354,6 +356,9 @@ cpu_setup()
     ldt_init();
     ktss_init();
 
+    /* Enable the same FPU state components as on the boot processor.  */
+    init_fpu_cpu();
+
     /* Add cpu to the kernel */
     slave_main();
 
@@ -383,6 +388,7 @@ void paging_setup(){
 
     if (CPU_HAS_FEATURE(CPU_FEATURE_PGE))
         set_cr4(get_cr4() | CR4_PGE);
+    pmap_pat_init();
 
 #endif	/* MACH_HYP */
 
@@ -154,6 +154,9 @@ void switch_ktss(pcb_t pcb)
 		panic("stack_switch");
 #else	/* MACH_RING1 */
 	curr_ktss(mycpu)->tss.esp0 = pcb_stack_top;
+#ifdef	MACH_SYSENTER
+	sysenter_stacks[mycpu].esp0 = pcb_stack_top;
+#endif	/* MACH_SYSENTER */
 #endif	/* MACH_RING1 */
     }
 
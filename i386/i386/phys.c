@@ -68,6 +68,39 @@ pmap_zero_page(phys_addr_t p)
 		pmap_put_mapwindow(map);
 }
 
+/*
+ *	pmap_is_zero_page tells whether the specified (machine independent)
+ *	page is filled with zeroes.
+ */
+boolean_t
+pmap_is_zero_page(phys_addr_t p)
+{
+	assert(p != vm_page_fictitious_addr);
+	vm_offset_t v;
+	pmap_mapwindow_t *map;
+	boolean_t mapped = p >= VM_PAGE_DIRECTMAP_LIMIT;
+	const unsigned long *word, *end;
+
+	if (mapped)
+	{
+		map = pmap_get_mapwindow(INTEL_PTE_R(p));
+		v = map->vaddr;
+	}
+	else
+		v = phystokv(p);
+
+	word = (const unsigned long *) v;
+	end = (const unsigned long *) (v + PAGE_SIZE);
+
+	while (word < end && *word == 0)
+		word++;
+
+	if (mapped)
+		pmap_put_mapwindow(map);
+
+	return word == end;
+}
+
 /*
  *	pmap_copy_page copies the specified (machine independent) pages.
  */
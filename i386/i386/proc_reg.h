@@ -68,6 +68,43 @@
 					 * and FXRSTOR instructions */
 #define	CR4_OSXMMEXCPT	0x0400		/* Operating System Support for Unmasked
 					 * SIMD Floating-Point Exceptions */
+#define	CR4_OSXSAVE	0x40000		/* Operating System Support for XSAVE
+					 * and processor extended states */
+
+/*
+ * Model-specific registers
+ */
+#define	MSR_SYSENTER_CS		0x174	/* SYSENTER code segment */
+#define	MSR_SYSENTER_ESP	0x175	/* SYSENTER stack pointer */
+#define	MSR_SYSENTER_EIP	0x176	/* SYSENTER entry point */
+#define	MSR_PMC0		0x0c1	/* general-purpose counter 0 */
+#define	MSR_PERFEVTSEL0		0x186	/* event select for counter 0 */
+#define	MSR_PERF_GLOBAL_CTRL	0x38f	/* counter enables, version 2 */
+#define	MSR_PERF_GLOBAL_OVF_CTRL 0x390	/* overflow status reset, version 2 */
+#define	MSR_PAT			0x277	/* page attribute table */
+
+/*
+ * Performance event select register
+ */
+#define	PERFEVTSEL_USR		0x00010000	/* count in user mode */
+#define	PERFEVTSEL_OS		0x00020000	/* count in kernel mode */
+#define	PERFEVTSEL_INT		0x00100000	/* interrupt on overflow */
+#define	PERFEVTSEL_EN		0x00400000	/* enable the counter */
+
+/*
+ * Page attribute table.  Entry 5 (PAT and PWT pte bits) is
+ * write-combining; the others have their power-on types.
+ */
+#define	PAT_UC		0x00		/* uncacheable */
+#define	PAT_WC		0x01		/* write-combining */
+#define	PAT_WT		0x04		/* write-through */
+#define	PAT_WB		0x06		/* write-back */
+#define	PAT_UCMINUS	0x07		/* uncacheable, overridden by MTRRs */
+#define	PAT_ENTRY(i, type)	((unsigned long long) (type) << ((i) * 8))
+#define	PAT_VALUE	(PAT_ENTRY(0, PAT_WB) | PAT_ENTRY(1, PAT_WT)	\
+			 | PAT_ENTRY(2, PAT_UCMINUS) | PAT_ENTRY(3, PAT_UC) \
+			 | PAT_ENTRY(4, PAT_WB) | PAT_ENTRY(5, PAT_WC)	\
+			 | PAT_ENTRY(6, PAT_UCMINUS) | PAT_ENTRY(7, PAT_UC))
 
 #ifndef	__ASSEMBLER__
 #ifdef	__GNUC__
@@ -167,6 +204,9 @@ extern unsigned long cr3;
 
 #define flush_tlb() set_cr3(get_cr3())
 
+#define	wbinvd() \
+	asm volatile("wbinvd" : : : "memory")
+
 #ifndef	MACH_PV_PAGETABLES
 #define invlpg(addr) \
     ({ \
@@ -377,6 +417,59 @@ extern unsigned long cr3;
     })
 #endif
 
+static inline unsigned long long
+get_tsc(void)
+{
+	unsigned int lo, hi;
+
+	asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long) hi << 32) | lo;
+}
+
+static inline void
+cpuid_count(unsigned int leaf, unsigned int subleaf,
+	    unsigned int *eax, unsigned int *ebx,
+	    unsigned int *ecx, unsigned int *edx)
+{
+	asm volatile("cpuid"
+		     : "=a" (*eax), "=b" (*ebx), "=c" (*ecx), "=d" (*edx)
+		     : "a" (leaf), "c" (subleaf));
+}
+
+static inline unsigned long long
+get_xcr(unsigned int xcr)
+{
+	unsigned int lo, hi;
+
+	asm volatile("xgetbv" : "=a" (lo), "=d" (hi) : "c" (xcr));
+	return ((unsigned long long) hi << 32) | lo;
+}
+
+static inline void
+set_xcr(unsigned int xcr, unsigned long long value)
+{
+	asm volatile("xsetbv"
+		     : : "c" (xcr), "a" ((unsigned int) value),
+			 "d" ((unsigned int) (value >> 32)));
+}
+
+static inline unsigned long long
+get_msr(unsigned int msr)
+{
+	unsigned int lo, hi;
+
+	asm volatile("rdmsr" : "=a" (lo), "=d" (hi) : "c" (msr));
+	return ((unsigned long long) hi << 32) | lo;
+}
+
+static inline void
+set_msr(unsigned int msr, unsigned long long value)
+{
+	asm volatile("wrmsr"
+		     : : "c" (msr), "a" ((unsigned int) value),
+			 "d" ((unsigned int) (value >> 32)));
+}
+
 #endif	/* __GNUC__ */
 #endif	/* __ASSEMBLER__ */
 
@@ -129,14 +129,14 @@ struct i386_kernel_state {
  */
 
 struct i386_fpsave_state {
+	boolean_t		fp_valid;
 	union {
 		struct {
 			struct i386_fp_save	fp_save_state;
 			struct i386_fp_regs	fp_regs;
 		};
-		struct i386_xfp_save	xfp_save_state;
-	};
-	boolean_t		fp_valid;
+		struct i386_xfp_save	xfp_save_state;	/* last, the XSAVE */
+	};					/* area may be larger */
 };
 
 /*
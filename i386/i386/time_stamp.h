@@ -28,3 +28,17 @@
  *	need to do anything here.
  */
 
+#ifndef	_I386_TIME_STAMP_H_
+#define	_I386_TIME_STAMP_H_
+
+#include <i386/proc_reg.h>
+
+/*
+ *	Free-running cycle counter, for measuring short intervals.
+ *	Older processors do not keep the counters of different
+ *	processors in step.
+ */
+#define	machine_cycles()	get_tsc()
+
+#endif	/* _I386_TIME_STAMP_H_ */
+
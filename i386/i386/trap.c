@@ -38,6 +38,7 @@
 #include <intel/read_fault.h>
 #include <machine/machspl.h>	/* for spl_t */
 #include <machine/db_interface.h>
+#include <i386at/prof.h>
 
 #include <mach/exception.h>
 #include <mach/kern_return.h>
@@ -589,6 +590,17 @@ i386_astintr(void)
 	    fpastintr();
 	}
 	else
+#ifdef	MACH_SYSPROF
+	if (need_ast[mycpu] & AST_I386_PROF) {
+	    /*
+	     * AST was for the profiler, which interrupted the
+	     * thread in user mode.  Take the user stack sample.
+	     */
+	    ast_off(mycpu, AST_I386_PROF);
+	    prof_ast();
+	}
+	else
+#endif	/* MACH_SYSPROF */
 #endif	/* MACH_RING1 */
 	{
 	    /*
@@ -599,6 +611,21 @@ i386_astintr(void)
 	}
 }
 
+#ifdef	MACH_SYSPROF
+/*
+ * Handle an NMI.  It may interrupt any code, even with locks
+ * held, so only the profiler, which needs none, may claim it.
+ */
+void
+i386_nmi(struct i386_interrupt_state *is, unsigned long ebp)
+{
+	if (prof_nmi(is, ebp))
+	    return;
+
+	printf("NMI received, ignoring\n");
+}
+#endif	/* MACH_SYSPROF */
+
 /*
  * Handle exceptions for i386.
  *
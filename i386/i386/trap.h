@@ -45,6 +45,11 @@ i386_exception(
 extern void
 thread_kdb_return(void);
 
+struct i386_interrupt_state;
+
+extern void
+i386_nmi(struct i386_interrupt_state *is, unsigned long ebp);
+
 #endif /* !__ASSEMBLER__ */
 
 #endif	/* _I386_TRAP_H_ */
@@ -22,6 +22,7 @@
 #include <mach/machine.h> //machine_slot
 #include <i386/vm_param.h> //phystokv
 #include <vm/vm_map_physical.h>
+#include <vm/vm_page.h> //vm_page_load_node...
 #include <kern/debug.h>
 
 volatile ApicLocalUnit* lapic = (void*) 0;
@@ -33,6 +34,12 @@ struct acpi_rsdp *rsdp;
 struct acpi_rsdt *rsdt;
 int acpi_rsdt_n;
 struct acpi_apic *apic;
+struct acpi_srat *srat;
+struct acpi_slit *slit;
+
+/* Proximity domains of NUMA nodes, in order of appearance in the SRAT */
+static uint32_t acpi_numa_domains[VM_PAGE_MAX_NODES];
+static int acpi_numa_ndomains;
 
 static int acpi_get_rsdp();
 
@@ -40,6 +47,8 @@ static int acpi_check_rsdt(struct acpi_rsdt *);
 static int acpi_get_rsdt();
 
 static int acpi_apic_setup();
+static int acpi_srat_setup();
+static int acpi_slit_setup();
 
 extern struct machine_slot	machine_slot[NCPUS];
 int apic2kernel[256];
@@ -81,11 +90,24 @@ acpi_setup()
             apic = (struct acpi_apic*) phystokv(rsdt->entry[i]);
 
         }
+
+        //Check if the entry contains the NUMA tables
+        if(memcmp(descr_header->signature, ACPI_SRAT_SIG,
+                    sizeof(descr_header->signature)) == 0)
+            srat = (struct acpi_srat*) phystokv(rsdt->entry[i]);
+
+        if(memcmp(descr_header->signature, ACPI_SLIT_SIG,
+                    sizeof(descr_header->signature)) == 0)
+            slit = (struct acpi_slit*) phystokv(rsdt->entry[i]);
     }
 
     if(acpi_apic_setup())
         return -1;
 
+    //NUMA tables are optional, without them all memory is in one node
+    if(acpi_srat_setup() == 0)
+        acpi_slit_setup();
+
     return 0;
 }
 
@@ -301,6 +323,157 @@ acpi_apic_setup(){
 }
 
 
+/* Return the NUMA node of a proximity domain, or -1 if unknown.
+ * If create is set, allocate a node for unknown domains if possible. */
+static int
+acpi_numa_node(uint32_t domain, int create){
+
+    int i;
+
+    for(i = 0; i < acpi_numa_ndomains; i++){
+        if(acpi_numa_domains[i] == domain)
+            return i;
+    }
+
+    if(!create || acpi_numa_ndomains == VM_PAGE_MAX_NODES)
+        return -1;
+
+    acpi_numa_domains[acpi_numa_ndomains] = domain;
+    return acpi_numa_ndomains++;
+}
+
+static int
+acpi_srat_setup(){
+
+    if(srat == 0)
+        return -1;
+
+    //Check the checksum of the SRAT
+    if(acpi_checksum(srat, srat->header.length))
+        return -1;
+
+    struct acpi_apic_dhdr *srat_entry = srat->entry;
+    uint32_t end = (uint32_t) srat + srat->header.length;
+
+    //Search in SRAT entry
+    while((uint32_t)srat_entry < end){
+        struct acpi_srat_cpu *cpu_entry;
+        struct acpi_srat_mem *mem_entry;
+        struct acpi_srat_x2apic *x2apic_entry;
+        uint64_t base, length;
+        uint32_t domain;
+        int node, cpu;
+
+        if(srat_entry->length == 0)
+            break;
+
+        switch(srat_entry->type){
+
+            //If SRAT entry is a CPU lapic
+            case ACPI_SRAT_ENTRY_CPU:
+
+                cpu_entry = (struct acpi_srat_cpu*) srat_entry;
+
+                if(!(cpu_entry->flags & ACPI_SRAT_ENABLED))
+                    break;
+
+                domain = cpu_entry->domain_lo
+                         | (cpu_entry->domain_hi[0] << 8)
+                         | (cpu_entry->domain_hi[1] << 16)
+                         | (cpu_entry->domain_hi[2] << 24);
+                node = acpi_numa_node(domain, 1);
+                cpu = apic2kernel[cpu_entry->apic_id];
+
+                if(node >= 0 && cpu >= 0)
+                    vm_page_load_cpu_node(cpu, node);
+                break;
+
+            //If SRAT entry is a CPU x2apic, only xAPIC ids are enumerated
+            case ACPI_SRAT_ENTRY_X2APIC:
+
+                x2apic_entry = (struct acpi_srat_x2apic*) srat_entry;
+
+                if(!(x2apic_entry->flags & ACPI_SRAT_ENABLED)
+                   || x2apic_entry->x2apic_id > 255)
+                    break;
+
+                node = acpi_numa_node(x2apic_entry->domain, 1);
+                cpu = apic2kernel[x2apic_entry->x2apic_id];
+
+                if(node >= 0 && cpu >= 0)
+                    vm_page_load_cpu_node(cpu, node);
+                break;
+
+            //If SRAT entry is a memory range
+            case ACPI_SRAT_ENTRY_MEM:
+
+                mem_entry = (struct acpi_srat_mem*) srat_entry;
+                base = ((uint64_t) mem_entry->base_hi << 32)
+                       | mem_entry->base_lo;
+                length = ((uint64_t) mem_entry->length_hi << 32)
+                         | mem_entry->length_lo;
+
+                if(!(mem_entry->flags & ACPI_SRAT_ENABLED) || length == 0)
+                    break;
+
+                node = acpi_numa_node(mem_entry->domain, 1);
+
+                if(node >= 0)
+                    vm_page_load_node(node, base, base + length);
+                break;
+        }
+
+        //Get next SRAT entry
+        srat_entry = (struct acpi_apic_dhdr*)((uint32_t) srat_entry
+                + srat_entry->length);
+    }
+
+    if(acpi_numa_ndomains == 0)
+        return -1;
+
+    printf("acpi found %d NUMA nodes\n", acpi_numa_ndomains);
+    return 0;
+}
+
+static int
+acpi_slit_setup(){
+
+    uint32_t n, i, j;
+    int from, to;
+
+    if(slit == 0)
+        return -1;
+
+    //Check the checksum of the SLIT
+    if(acpi_checksum(slit, slit->header.length))
+        return -1;
+
+    n = slit->nr_localities_lo;
+
+    //Check the distance matrix fits in the table
+    if(slit->nr_localities_hi != 0
+       || sizeof(*slit) + (uint64_t) n * n > slit->header.length)
+        return -1;
+
+    //Localities are proximity domains
+    for(i = 0; i < n; i++){
+        from = acpi_numa_node(i, 0);
+
+        if(from < 0)
+            continue;
+
+        for(j = 0; j < n; j++){
+            to = acpi_numa_node(j, 0);
+
+            if(to >= 0)
+                vm_page_load_node_distance(from, to, slit->entry[i * n + j]);
+        }
+    }
+
+    return 0;
+}
+
+
 int extra_setup()
 {
   if (lapic_addr == 0)
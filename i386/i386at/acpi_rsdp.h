@@ -122,7 +122,86 @@ struct acpi_apic_ioapic
     uint32_t base;
 } __attribute__((__packed__));
 
+//SRAT table signature
+#define ACPI_SRAT_SIG "SRAT"
 
+//Types value for SRAT's affinity structures
+#define ACPI_SRAT_ENTRY_CPU    0
+#define ACPI_SRAT_ENTRY_MEM    1
+#define ACPI_SRAT_ENTRY_X2APIC 2
+
+#define ACPI_SRAT_ENABLED      0x1
+
+/* System Resource Affinity Table (SRAT)
+ *
+ * Associates processors and memory ranges with proximity domains,
+ * i.e. NUMA nodes
+ *
+ * Entry field stores the affinity structures, with the same header
+ * as APIC structures
+ */
+struct acpi_srat
+{
+    struct acpi_dhdr header;
+    uint32_t reserved1;
+    uint32_t reserved2[2];
+    struct acpi_apic_dhdr entry[0];
+} __attribute__((__packed__));
+
+/* Processor Local APIC Affinity Structure */
+struct acpi_srat_cpu
+{
+    struct acpi_apic_dhdr header;
+    uint8_t domain_lo; //Bits 0-7 of the proximity domain
+    uint8_t apic_id;
+    uint32_t flags;
+    uint8_t sapic_eid;
+    uint8_t domain_hi[3]; //Bits 8-31 of the proximity domain
+    uint32_t clock_domain;
+} __attribute__((__packed__));
+
+/* Memory Affinity Structure */
+struct acpi_srat_mem
+{
+    struct acpi_apic_dhdr header;
+    uint32_t domain;
+    uint16_t reserved1;
+    uint32_t base_lo;
+    uint32_t base_hi;
+    uint32_t length_lo;
+    uint32_t length_hi;
+    uint32_t reserved2;
+    uint32_t flags;
+    uint32_t reserved3[2];
+} __attribute__((__packed__));
+
+/* Processor Local x2APIC Affinity Structure */
+struct acpi_srat_x2apic
+{
+    struct acpi_apic_dhdr header;
+    uint16_t reserved1;
+    uint32_t domain;
+    uint32_t x2apic_id;
+    uint32_t flags;
+    uint32_t clock_domain;
+    uint32_t reserved2;
+} __attribute__((__packed__));
+
+//SLIT table signature
+#define ACPI_SLIT_SIG "SLIT"
+
+/* System Locality Information Table (SLIT)
+ *
+ * Stores the relative distances between proximity domains, as a
+ * matrix of localities * localities bytes, 10 meaning local
+ */
+struct acpi_slit
+{
+    struct acpi_dhdr header;
+    uint32_t nr_localities_lo;
+    uint32_t nr_localities_hi;
+    uint8_t entry[0];
+} __attribute__((__packed__));
 
 
 int acpi_setup();
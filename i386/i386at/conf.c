@@ -60,9 +60,17 @@
 #define	memname			"mem"
 #endif	/* MACH_HYP */
 
+#include <i386at/prof.h>
+#ifdef	MACH_SYSPROF
+#define	profname		"prof"
+#endif	/* MACH_SYSPROF */
+
 #include <device/kmsg.h>
 #define kmsgname		"kmsg"
 
+#include <device/trace.h>
+#define tracename		"trace"
+
 #ifdef	MACH_HYP
 #include <xen/console.h>
 #define hypcnname		"hyp"
@@ -71,6 +79,9 @@
 #include <device/intr.h>
 #define irqname			"irq"
 
+#include <device/netring.h>
+#define netringname		"netring"
+
 /*
  * List of devices - console must be at slot 0
  */
@@ -138,6 +149,18 @@ struct dev_ops	dev_name_list[] =
 	  nodev },
 #endif	/* MACH_HYP */
 
+#ifdef	MACH_SYSPROF
+	{ profname,	profopen,	profclose,	nulldev_read,
+	  nulldev_write,	profgetstat,	profsetstat,	profmmap,
+	  nodev,	nulldev,	nulldev_portdeath,	0,
+	  nodev },
+#endif	/* MACH_SYSPROF */
+
+	{ tracename,	traceopen,	traceclose,	nulldev_read,
+	  nulldev_write,	tracegetstat,	tracesetstat,	tracemmap,
+	  nodev,	nulldev,	nulldev_portdeath,	0,
+	  nodev },
+
 #ifdef	MACH_KMSG
         { kmsgname,     kmsgopen,       kmsgclose,       kmsgread,
           nulldev_write,        kmsggetstat,    nulldev_setstat,           nomap,
@@ -157,6 +180,11 @@ struct dev_ops	dev_name_list[] =
           nodev,        nulldev,        nulldev_portdeath,0,
           nodev },
 
+	{ netringname,	netringopen,	netringclose,	netringread,
+	  nulldev_write,	netringgetstat,	netringsetstat,	netringmmap,
+	  nodev,	nulldev,	nulldev_portdeath,	0,
+	  nodev },
+
 };
 int	dev_name_count = sizeof(dev_name_list)/sizeof(dev_name_list[0]);
 
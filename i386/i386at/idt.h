@@ -28,10 +28,14 @@
    because that's all the PIC hardware supports.  */
 /* XX But for some reason we program the PIC
    to use vectors 0x40-0x4f rather than 0x20-0x2f.  Fix.  */
-#define IDTSZ (0x20+0x20+0x10)
+/* The local APIC interrupts come right after them.  */
+#define IDTSZ (0x20+0x20+0x20)
 
 #define PIC_INT_BASE 0x40
 
+#define LAPIC_TIMER_VECTOR	(PIC_INT_BASE + 0x10)
+#define LAPIC_SPURIOUS_VECTOR	(PIC_INT_BASE + 0x1f)	/* low bits all set */
+
 #include <i386/idt-gen.h>
 
 #ifndef __ASSEMBLER__
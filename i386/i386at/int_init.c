@@ -21,19 +21,59 @@
  *      Author: Bryan Ford, University of Utah CSL
  */
 
+#include <sys/types.h>
+#include <kern/debug.h>
+#include <mach/machine.h>
 #include <i386at/idt.h>
+#include <i386at/model_dep.h>
+#include <i386at/prof.h>
 #include <i386/gdt.h>
+#include <i386/trap.h>
+#include <i386/vm_param.h>
 
 /* defined in locore.S */
 extern vm_offset_t int_entry_table[];
 
+#ifdef	MACH_SYSPROF
+extern void nmi_intr (void);
+extern void lapic_timer_intr (void);
+extern void lapic_spurious_intr (void);
+
+/* Stacks for NMIs and local APIC interrupts, see locore.S.  */
+vm_offset_t nmi_stack_top[NCPUS];
+vm_offset_t lapic_stack_top[NCPUS];
+#endif	/* MACH_SYSPROF */
+
 void int_init(void)
 {
+#ifdef	MACH_SYSPROF
+	vm_offset_t stack_start;
+#endif	/* MACH_SYSPROF */
 	int i;
 
 	for (i = 0; i < 16; i++)
 		fill_idt_gate(PIC_INT_BASE + i,
 			      int_entry_table[i], KERNEL_CS,
 			      ACC_PL_K|ACC_INTR_GATE, 0);
+
+#ifdef	MACH_SYSPROF
+	if (!init_alloc_aligned(2 * KERNEL_STACK_SIZE * ncpu, &stack_start))
+		panic("not enough memory for NMI stacks");
+	stack_start = phystokv(stack_start);
+
+	for (i = 0; i < ncpu; i++) {
+		stack_start += KERNEL_STACK_SIZE;
+		nmi_stack_top[i] = stack_start;
+		stack_start += KERNEL_STACK_SIZE;
+		lapic_stack_top[i] = stack_start;
+	}
+
+	fill_idt_gate(T_NMI, (vm_offset_t) nmi_intr, KERNEL_CS,
+		      ACC_PL_K|ACC_INTR_GATE, 0);
+	fill_idt_gate(LAPIC_TIMER_VECTOR, (vm_offset_t) lapic_timer_intr,
+		      KERNEL_CS, ACC_PL_K|ACC_INTR_GATE, 0);
+	fill_idt_gate(LAPIC_SPURIOUS_VECTOR, (vm_offset_t) lapic_spurious_intr,
+		      KERNEL_CS, ACC_PL_K|ACC_INTR_GATE, 0);
+#endif	/* MACH_SYSPROF */
 }
 
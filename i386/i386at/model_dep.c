@@ -35,6 +35,7 @@
 #include <string.h>
 
 #include <device/cons.h>
+#include <device/ds_routines.h>
 
 #include <mach/vm_param.h>
 #include <mach/vm_prot.h>
@@ -44,12 +45,16 @@
 
 #include <i386/vm_param.h>
 #include <kern/assert.h>
+#include <kern/boot_trace.h>
 #include <kern/cpu_number.h>
 #include <kern/debug.h>
 #include <kern/mach_clock.h>
 #include <kern/macros.h>
 #include <kern/printf.h>
+#include <kern/sched_prim.h>
 #include <kern/startup.h>
+#include <kern/task.h>
+#include <kern/thread.h>
 #include <sys/time.h>
 #include <sys/types.h>
 #include <vm/vm_page.h>
@@ -72,6 +77,7 @@
 #include <i386at/kd.h>
 #include <i386at/rtc.h>
 #include <i386at/model_dep.h>
+#include <i386at/prof.h>
 #include <i386/mp_desc.h>
 
 #include <i386at/acpi_rsdp.h>
@@ -138,13 +144,61 @@ static char int_stack[KERNEL_STACK_SIZE] __aligned(KERNEL_STACK_SIZE);
 vm_offset_t int_stack_top, int_stack_base;
 
 #ifdef LINUX_DEV
-extern void linux_init(void);
+extern void linux_init(int defer_probes);
+extern void linux_probe(void);
+
+/*
+ * With probe=parallel on the command line, the Linux driver probes
+ * are left to a secondary processor, while the master goes on with
+ * the boot.  The drivers are not safe to probe concurrently, so they
+ * still run one after the other.
+ */
+#define PROBE_PARALLEL_PARAMETER " probe=parallel"
+static boolean_t linux_probe_deferred;
 #endif
 
 unsigned kernel_page_dir_addr = 0;
 unsigned pdpbase_addr = 0;
 int nb_direct_value = 0;
 
+#if defined(LINUX_DEV) && NCPUS > 1
+static void
+linux_probe_thread(void)
+{
+    int cpu;
+
+    for (cpu = 0; cpu < ncpu; cpu++)
+	if (cpu != master_cpu && machine_slot[cpu].running) {
+	    thread_bind(current_thread(), cpu_to_processor(cpu));
+	    thread_block(thread_no_continuation);
+	    break;
+	}
+
+    boot_trace_begin("linux_probe");
+    linux_probe();
+    boot_trace_end("linux_probe");
+    ds_probe_done();
+
+    thread_terminate(current_thread());
+    thread_halt_self(thread_no_continuation);
+    /*NOTREACHED*/
+}
+#endif	/* LINUX_DEV && NCPUS > 1 */
+
+/*
+ * Start the device probes left by machine_init, now that the
+ * other processors are up.
+ */
+void machine_start_probes(void)
+{
+#if defined(LINUX_DEV) && NCPUS > 1
+    if (linux_probe_deferred) {
+	ds_probe_start();
+	(void) kernel_thread(kernel_task, linux_probe_thread, (char *) 0);
+    }
+#endif	/* LINUX_DEV && NCPUS > 1 */
+}
+
 /*
  * Find devices.  The system is alive.
  */
@@ -175,15 +229,27 @@ void machine_init(void)
     /*
      * Initialize Linux drivers.
      */
-    linux_init();
+#if NCPUS > 1
+    linux_probe_deferred = ncpu > 1
+	&& strstr(kernel_cmdline, PROBE_PARALLEL_PARAMETER) != NULL;
+#endif
+    boot_trace_begin("linux_init");
+    linux_init(linux_probe_deferred);
+    boot_trace_end("linux_init");
 #endif
 
     /*
      * Find the devices
      */
+    boot_trace_begin("probeio");
     probeio();
+    boot_trace_end("probeio");
 #endif	/* MACH_HYP */
 
+#ifdef	MACH_SYSPROF
+    prof_init();
+#endif	/* MACH_SYSPROF */
+
     /*
      * Get the time
      */
@@ -505,6 +571,7 @@ i386at_init(void)
     set_cr0(get_cr0() & ~(CR0_CD | CR0_NW));
     if (CPU_HAS_FEATURE(CPU_FEATURE_PGE))
         set_cr4(get_cr4() | CR4_PGE);
+    pmap_pat_init();
 #endif	/* MACH_HYP */
     flush_instr_queue();
 #ifdef	MACH_PV_PAGETABLES
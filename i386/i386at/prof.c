@@ -0,0 +1,584 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ *	System-wide sampling profiler.
+ *
+ *	See <device/prof_ring.h> for the layout of the shared area.
+ *	Hardware events are counted by the first general-purpose
+ *	performance counter, whose overflow raises an NMI through the
+ *	local APIC.  The timer event uses the local APIC timer instead,
+ *	in periodic mode.  Both handlers may interrupt the kernel with
+ *	locks held, so they take no lock: each processor produces into
+ *	its own ring of a set of mappable per-processor rings, which
+ *	drop samples when full.
+ *
+ *	Kernel stacks are walked right away, within the bounds of the
+ *	interrupted stack.  Walking a user stack may fault, so a thread
+ *	interrupted in user mode is sent an AST instead, and its stack
+ *	walked with copyin before it returns to user mode.  Such samples
+ *	are also handed to the PC sampling of the thread and its task,
+ *	as SAMPLED_PC_PROFILER.
+ */
+
+#include <stddef.h>
+#include <sys/types.h>
+#include <string.h>
+
+#include <device/cpu_ring.h>
+#include <device/ds_routines.h>
+#include <device/io_req.h>
+#include <device/prof_ring.h>
+#include <i386/locore.h>
+#include <i386/proc_reg.h>
+#include <i386/seg.h>
+#include <i386/thread.h>
+#include <i386at/idt.h>
+#include <i386at/model_dep.h>
+#include <i386at/prof.h>
+#include <imps/apic.h>
+#include <kern/ast.h>
+#include <kern/cpu_number.h>
+#include <kern/mach_clock.h>
+#include <kern/pc_sample.h>
+#include <kern/processor.h>
+#include <kern/sched_prim.h>
+#include <kern/task.h>
+#include <kern/thread.h>
+#include <mach/boolean.h>
+#include <mach/machine.h>
+#include <mach/machine/eflags.h>
+#include <machine/machspl.h>
+
+/* Smallest periods, to keep the processors doing useful work.  */
+#define PROF_MIN_PERIOD		10000		/* events */
+#define PROF_MIN_TIMER_PERIOD	50		/* microseconds */
+#define PROF_MAX_TIMER_PERIOD	1000000
+
+/* Clock ticks to measure the local APIC timer frequency.  */
+#define PROF_CALIBRATION_TICKS	5
+
+/* Architectural performance events.  */
+static const struct prof_event {
+	unsigned int	evtsel;		/* unit mask and event select */
+	unsigned int	bit;		/* availability, in CPUID.0AH:EBX */
+} prof_events[PROF_NEVENTS] = {
+	[PROF_EVENT_CYCLES]		= { 0x003c, 0 },
+	[PROF_EVENT_LLC_MISSES]		= { 0x412e, 4 },
+	[PROF_EVENT_BRANCH_MISSES]	= { 0x00c5, 6 },
+};
+
+/* The rings follow the layout of the mappable per-processor rings.  */
+_Static_assert (offsetof (struct prof_area, size)
+		== offsetof (struct cpu_ring_area, size), "prof_area");
+_Static_assert (offsetof (struct prof_ring, drops)
+		== offsetof (struct cpu_ring, drops), "prof_ring");
+_Static_assert (offsetof (struct prof_ring, slot) == CPU_RING_HEADER_SIZE,
+		"prof_ring");
+_Static_assert (offsetof (struct prof_sample, seq) == 0, "prof_sample");
+
+struct prof_cpu {
+	boolean_t		armed;		/* sampling started here */
+	unsigned int		user_event;	/* pending user sample */
+	unsigned long long	user_tsc;
+};
+
+static struct prof_cpu prof_cpus[NCPUS];
+
+static struct cpu_ring_set prof_rings;
+static struct prof_area	*prof_area;	/* header of prof_rings */
+static boolean_t	prof_in_use;
+
+/* What the interrupt handlers use: the area is writable by the user.  */
+static unsigned int	prof_event;
+static unsigned int	prof_period;
+static unsigned int	prof_timer_count;
+
+static unsigned int	prof_pmu_version;	/* 0 if no usable counter */
+static unsigned int	prof_pmu_width;		/* counter width in bits */
+static unsigned int	prof_lapic_rate;	/* timer counts per second */
+
+/* Probe the architectural performance monitoring, and return the
+   mask of the events it can count.  */
+static unsigned int
+prof_pmu_probe (void)
+{
+  unsigned int eax, ebx, ecx, edx, len, events, i;
+
+  events = 1 << PROF_EVENT_TIMER;
+
+  cpuid_count (0, 0, &eax, &ebx, &ecx, &edx);
+  if (eax < 0xa)
+    return events;
+
+  cpuid_count (0xa, 0, &eax, &ebx, &ecx, &edx);
+  if ((eax & 0xff) == 0 || ((eax >> 8) & 0xff) == 0)
+    return events;
+
+  prof_pmu_version = eax & 0xff;
+  prof_pmu_width = (eax >> 16) & 0xff;
+  len = eax >> 24;
+
+  for (i = 0; i < PROF_NEVENTS; i++)
+    if (i != PROF_EVENT_TIMER
+	&& prof_events[i].bit < len
+	&& (ebx & (1 << prof_events[i].bit)) == 0)
+      events |= 1 << i;
+
+  return events;
+}
+
+static void
+prof_lapic_enable (void)
+{
+  unsigned int svr = lapic->spurious_vector.r;
+
+  lapic->spurious_vector.r = (svr & ~LAPIC_LVT_VECTOR)
+			     | LAPIC_ENABLE | LAPIC_SPURIOUS_VECTOR;
+}
+
+/* Measure the local APIC timer frequency against the clock.  The
+   timers of all processors run at the same frequency.  */
+static unsigned int
+prof_lapic_calibrate (void)
+{
+  volatile unsigned long *ticks = &elapsed_ticks;
+  unsigned long t;
+  unsigned int count;
+
+  thread_bind (current_thread (), master_processor);
+  if (current_processor () != master_processor)
+    thread_block ((void (*)) 0);
+
+  prof_lapic_enable ();
+  lapic->divider_config.r = LAPIC_TIMER_DIV_16;
+  lapic->lvt_timer.r = LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR;
+  lapic->init_count.r = 0xffffffff;
+
+  /* Start on a clock tick.  */
+  t = *ticks;
+  while (*ticks == t)
+    continue;
+  count = lapic->cur_count.r;
+
+  t += 1 + PROF_CALIBRATION_TICKS;
+  while ((long) (*ticks - t) < 0)
+    continue;
+  count -= lapic->cur_count.r;
+
+  lapic->init_count.r = 0;
+  thread_bind (current_thread (), PROCESSOR_NULL);
+
+  return count / PROF_CALIBRATION_TICKS * hz;
+}
+
+static void
+prof_arm (int cpu)
+{
+  prof_lapic_enable ();
+  prof_cpus[cpu].armed = TRUE;
+
+  if (prof_event == PROF_EVENT_TIMER)
+    {
+      lapic->divider_config.r = LAPIC_TIMER_DIV_16;
+      lapic->lvt_timer.r = LAPIC_LVT_PERIODIC | LAPIC_TIMER_VECTOR;
+      lapic->init_count.r = prof_timer_count;
+    }
+  else
+    {
+      set_msr (MSR_PERFEVTSEL0, 0);
+      set_msr (MSR_PMC0, - (long long) prof_period);
+      lapic->lvt_performance_monitor.r = LAPIC_LVT_NMI;
+      if (prof_pmu_version >= 2)
+	set_msr (MSR_PERF_GLOBAL_CTRL, get_msr (MSR_PERF_GLOBAL_CTRL) | 1);
+      set_msr (MSR_PERFEVTSEL0, prof_events[prof_event].evtsel
+			       | PERFEVTSEL_USR | PERFEVTSEL_OS
+			       | PERFEVTSEL_INT | PERFEVTSEL_EN);
+    }
+}
+
+static void
+prof_disarm (int cpu)
+{
+  if (prof_event == PROF_EVENT_TIMER)
+    {
+      lapic->lvt_timer.r = LAPIC_LVT_MASKED | LAPIC_TIMER_VECTOR;
+      lapic->init_count.r = 0;
+    }
+  else
+    {
+      set_msr (MSR_PERFEVTSEL0, 0);
+      lapic->lvt_performance_monitor.r = LAPIC_LVT_MASKED | LAPIC_LVT_NMI;
+    }
+
+  prof_cpus[cpu].armed = FALSE;
+}
+
+/* Call FN on every running processor, moving the current thread
+   from one to the next, as the local APIC and the counters can only
+   be programmed from their own processor.  */
+static void
+prof_foreach_cpu (void (*fn) (int))
+{
+  processor_t processor;
+  spl_t s;
+  int i;
+
+  for (i = 0; i < ncpu; i++)
+    {
+      if (!machine_slot[i].running)
+	continue;
+
+      processor = cpu_to_processor (i);
+      thread_bind (current_thread (), processor);
+      if (current_processor () != processor)
+	thread_block ((void (*)) 0);
+
+      s = splhigh ();
+      fn (i);
+      splx (s);
+    }
+
+  thread_bind (current_thread (), PROCESSOR_NULL);
+}
+
+static void
+prof_fill (struct prof_sample *sample, unsigned int event, int cpu,
+	   unsigned long long tsc, thread_t thread)
+{
+  sample->event = event;
+  sample->cpu = cpu;
+  sample->tsc = tsc;
+  sample->thread = (vm_offset_t) thread;
+  if (thread != THREAD_NULL && thread->task != TASK_NULL)
+    {
+      sample->task = (vm_offset_t) thread->task;
+      memcpy (sample->name, thread->task->name, PROF_NAME_SIZE);
+      sample->name[PROF_NAME_SIZE - 1] = '\0';
+    }
+  else
+    {
+      sample->task = 0;
+      sample->name[0] = '\0';
+    }
+}
+
+/* Walk the frame pointers of the kernel stack the processor was
+   interrupted on, and return the number of frames.  Only the stack
+   of the current thread and the interrupt stack are walked, as any
+   other may be left at any time.  */
+static unsigned int
+prof_kernel_frames (int cpu, unsigned int *frames,
+		    const struct i386_interrupt_state *is, vm_offset_t fp)
+{
+  vm_offset_t sp, base, top, *link;
+  unsigned int n;
+
+  n = 0;
+  frames[n++] = is->eip;
+
+  /* Nothing was pushed before the interrupted state.  */
+  sp = (vm_offset_t) (is + 1);
+  base = sp & ~(KERNEL_STACK_SIZE - 1);
+  if (base != active_stacks[cpu] && !ON_INT_STACK (sp))
+    return n;
+  top = base + KERNEL_STACK_SIZE;
+
+  while (n < PROF_MAX_FRAMES
+	 && fp >= sp && fp + 2 * sizeof (vm_offset_t) <= top
+	 && (fp & (sizeof (vm_offset_t) - 1)) == 0)
+    {
+      link = (vm_offset_t *) fp;
+      frames[n++] = link[1];
+      if (link[0] <= fp)
+	break;
+      fp = link[0];
+    }
+
+  return n;
+}
+
+/* Take a sample of the interrupted state.  */
+static void
+prof_sample (int cpu, const struct i386_interrupt_state *is,
+	     unsigned long ebp)
+{
+  struct prof_sample *sample;
+  unsigned long long tsc;
+  unsigned int seq;
+
+  tsc = get_tsc ();
+
+  if (is->efl & EFL_VM)
+    return;
+
+  if ((is->cs & SEL_PL) == SEL_PL_U)
+    {
+      /* See prof_ast.  The AST is taken before returning to user
+	 mode, so the thread still has the same user state then.  */
+      prof_cpus[cpu].user_event = prof_event;
+      prof_cpus[cpu].user_tsc = tsc;
+      __atomic_or_fetch (&need_ast[cpu], AST_I386_PROF, __ATOMIC_RELAXED);
+      return;
+    }
+
+  sample = cpu_ring_reserve (&prof_rings, cpu, &seq);
+  if (sample == NULL)
+    return;
+
+  prof_fill (sample, prof_event, cpu, tsc, active_threads[cpu]);
+  sample->nkframes = prof_kernel_frames (cpu, sample->frames, is, ebp);
+  sample->nuframes = 0;
+  cpu_ring_commit (sample, seq);
+}
+
+boolean_t
+prof_nmi (struct i386_interrupt_state *is, unsigned long ebp)
+{
+  int cpu = cpu_number ();
+
+  if (!prof_cpus[cpu].armed || prof_event == PROF_EVENT_TIMER)
+    return FALSE;
+
+  /* The counter counts up from minus the period, so it overflowed
+     if its sign bit is clear.  */
+  if (get_msr (MSR_PMC0) & (1ULL << (prof_pmu_width - 1)))
+    return FALSE;
+
+  prof_sample (cpu, is, ebp);
+
+  set_msr (MSR_PMC0, - (long long) prof_period);
+  if (prof_pmu_version >= 2)
+    set_msr (MSR_PERF_GLOBAL_OVF_CTRL, 1);
+
+  /* Delivering the NMI masked the entry.  */
+  lapic->lvt_performance_monitor.r = LAPIC_LVT_NMI;
+  return TRUE;
+}
+
+void
+prof_timer_intr (struct i386_interrupt_state *is, unsigned long ebp)
+{
+  int cpu = cpu_number ();
+
+  if (prof_cpus[cpu].armed)
+    prof_sample (cpu, is, ebp);
+
+  lapic->eoi.r = 0;
+}
+
+void
+prof_ast (void)
+{
+  thread_t thread = current_thread ();
+  struct i386_saved_state *regs = USER_REGS (thread);
+  struct prof_sample *sample;
+  unsigned int frames[PROF_MAX_FRAMES];
+  unsigned long long tsc;
+  unsigned int event, n, seq;
+  vm_offset_t fp, link[2];
+  int cpu;
+
+  cpu = cpu_number ();
+  event = prof_cpus[cpu].user_event;
+  tsc = prof_cpus[cpu].user_tsc;
+  (void) spl0 ();
+
+  take_pc_sample_macro (thread, SAMPLED_PC_PROFILER, TRUE, 0);
+
+  n = 0;
+  frames[n++] = regs->eip;
+  fp = regs->ebp;
+  while (n < PROF_MAX_FRAMES
+	 && fp != 0 && (fp & (sizeof (vm_offset_t) - 1)) == 0)
+    {
+      if (copyin ((void *) fp, link, sizeof link))
+	break;
+      frames[n++] = link[1];
+      if (link[0] <= fp)
+	break;
+      fp = link[0];
+    }
+
+  /* Copying in may have blocked: use the ring of the processor we
+     are on now, as only its own producers may interrupt us.  */
+  sample = cpu_ring_reserve (&prof_rings, cpu_number (), &seq);
+  if (sample == NULL)
+    return;
+
+  prof_fill (sample, event, cpu, tsc, thread);
+  sample->nkframes = 0;
+  sample->nuframes = n;
+  memcpy (sample->frames, frames, n * sizeof frames[0]);
+  cpu_ring_commit (sample, seq);
+}
+
+static void
+prof_reset (void)
+{
+  cpu_ring_set_reset (&prof_rings);
+  prof_area->events = prof_pmu_probe ();
+}
+
+static void
+prof_stop (void)
+{
+  if (!prof_area->running)
+    return;
+
+  prof_foreach_cpu (prof_disarm);
+  prof_area->running = FALSE;
+}
+
+static io_return_t
+prof_start (unsigned int event, unsigned int period)
+{
+  unsigned int rate;
+
+  if (event >= PROF_NEVENTS || (prof_area->events & (1 << event)) == 0)
+    return D_INVALID_OPERATION;
+
+  if (event == PROF_EVENT_TIMER
+      ? period < PROF_MIN_TIMER_PERIOD || period > PROF_MAX_TIMER_PERIOD
+      : period < PROF_MIN_PERIOD || period > 0x7fffffff)
+    return D_INVALID_SIZE;
+
+  prof_stop ();
+
+  if (event == PROF_EVENT_TIMER)
+    {
+      if (prof_lapic_rate == 0)
+	prof_lapic_rate = prof_lapic_calibrate ();
+
+      /* Keep the product within 32 bits.  */
+      rate = prof_lapic_rate / 1000;
+      prof_timer_count = rate * (period / 1000)
+			 + rate * (period % 1000) / 1000;
+      if (prof_timer_count == 0)
+	prof_timer_count = 1;
+    }
+
+  prof_event = event;
+  prof_period = period;
+  prof_area->event = event;
+  prof_area->period = period;
+  prof_foreach_cpu (prof_arm);
+  prof_area->running = TRUE;
+  return D_SUCCESS;
+}
+
+void
+prof_init (void)
+{
+  cpu_ring_set_init (&prof_rings, PROF_MAGIC, PROF_VERSION,
+		     sizeof (struct prof_area), sizeof (struct prof_ring),
+		     PROF_RING_SLOTS, sizeof (struct prof_sample), FALSE);
+}
+
+io_return_t
+profopen (dev_t dev, int flag, io_req_t ior)
+{
+  io_return_t err;
+
+  if (minor (dev) != 0 || lapic == NULL)
+    return D_NO_SUCH_DEVICE;
+
+  kmutex_lock (&prof_rings.lock, FALSE);
+  if (prof_in_use)
+    {
+      kmutex_unlock (&prof_rings.lock);
+      return D_ALREADY_OPEN;
+    }
+
+  /* The area is kept until the next open, as it may still be
+     mapped by the previous user.  */
+  err = cpu_ring_set_alloc (&prof_rings);
+  if (err != D_SUCCESS)
+    {
+      kmutex_unlock (&prof_rings.lock);
+      return err;
+    }
+
+  prof_area = (struct prof_area *) prof_rings.area;
+  prof_reset ();
+  prof_in_use = TRUE;
+  kmutex_unlock (&prof_rings.lock);
+  return D_SUCCESS;
+}
+
+void
+profclose (dev_t dev, int flag)
+{
+  kmutex_lock (&prof_rings.lock, FALSE);
+  prof_stop ();
+  prof_in_use = FALSE;
+  kmutex_unlock (&prof_rings.lock);
+}
+
+io_return_t
+profsetstat (dev_t dev, dev_flavor_t flavor, dev_status_t data,
+	     mach_msg_type_number_t count)
+{
+  io_return_t err;
+
+  switch (flavor)
+    {
+    case PROF_START:
+      if (count < PROF_START_COUNT)
+	return D_INVALID_OPERATION;
+      kmutex_lock (&prof_rings.lock, FALSE);
+      err = prof_start (data[0], data[1]);
+      kmutex_unlock (&prof_rings.lock);
+      return err;
+
+    case PROF_STOP:
+      kmutex_lock (&prof_rings.lock, FALSE);
+      prof_stop ();
+      kmutex_unlock (&prof_rings.lock);
+      break;
+
+    default:
+      return D_INVALID_OPERATION;
+    }
+
+  return D_SUCCESS;
+}
+
+io_return_t
+profgetstat (dev_t dev, dev_flavor_t flavor, dev_status_t data,
+	     mach_msg_type_number_t *count)
+{
+  switch (flavor)
+    {
+    case PROF_STATUS:
+      return cpu_ring_set_get_status (&prof_rings, PROF_STATUS_COUNT,
+				      data, count);
+
+    case DEV_GET_SIZE:
+      return cpu_ring_set_get_size (&prof_rings, data, count);
+
+    default:
+      return D_INVALID_OPERATION;
+    }
+}
+
+vm_offset_t
+profmmap (dev_t dev, vm_offset_t off, vm_prot_t prot)
+{
+  return cpu_ring_set_mmap (&prof_rings, off, prot);
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef _I386AT_PROF_H_
+#define _I386AT_PROF_H_
+
+#include <sys/types.h>
+
+#include <device/device_types.h>
+#include <device/io_req.h>
+
+/*
+ * The profiler needs the local APIC, and the NMI and local APIC
+ * interrupt entry points of the i386 locore.
+ */
+#if	!defined(MACH_HYP) && !defined(__x86_64__)
+#define	MACH_SYSPROF	1
+#endif
+
+/*
+ * System-wide sampling profiler, driven by the performance
+ * counters or the local APIC timer.
+ */
+
+void prof_init (void);
+
+io_return_t profopen (dev_t dev, int flag, io_req_t ior);
+void profclose (dev_t dev, int flag);
+io_return_t profgetstat (dev_t dev, dev_flavor_t flavor,
+			 dev_status_t data, mach_msg_type_number_t *count);
+io_return_t profsetstat (dev_t dev, dev_flavor_t flavor,
+			 dev_status_t data, mach_msg_type_number_t count);
+vm_offset_t profmmap (dev_t dev, vm_offset_t off, vm_prot_t prot);
+
+struct i386_interrupt_state;
+
+/* Claim a performance counter NMI.  */
+boolean_t prof_nmi (struct i386_interrupt_state *is, unsigned long ebp);
+
+/* Local APIC timer interrupt, see locore.S.  */
+void prof_timer_intr (struct i386_interrupt_state *is, unsigned long ebp);
+
+/* Take the pending user sample of the current thread, at splsched.  */
+void prof_ast (void);
+
+#endif /* _I386AT_PROF_H_ */
@@ -68,7 +68,25 @@ struct i386_xfp_save {
 	unsigned char	fp_xreg_word[8][16];
 					/* space for 8 128-bit XMM registers */
 	unsigned int	padding[56];
-} __attribute__((aligned(16)));
+	/* XSAVE header, followed by the extended state components.  */
+	unsigned long long fp_xstate_bv;	/* components saved */
+	unsigned long long fp_xcomp_bv;		/* compacted format */
+	unsigned long long fp_xheader_reserved[6];
+	unsigned char	fp_xstate[0];
+} __attribute__((aligned(64)));
+
+/*
+ * XSAVE state components
+ */
+#define	XSTATE_X87	0x01		/* x87 registers */
+#define	XSTATE_SSE	0x02		/* XMM registers and MXCSR */
+#define	XSTATE_AVX	0x04		/* upper halves of YMM registers */
+#define	XSTATE_OPMASK	0x20		/* AVX-512 opmask registers */
+#define	XSTATE_ZMM_HI256 0x40		/* upper halves of ZMM0-15 */
+#define	XSTATE_HI16_ZMM	0x80		/* ZMM16-31 */
+#define	XSTATE_AVX512	(XSTATE_OPMASK|XSTATE_ZMM_HI256|XSTATE_HI16_ZMM)
+
+#define	XSTATE_XCOMP_COMPACT	0x8000000000000000ULL
 
 /*
  * Control register
@@ -124,6 +142,7 @@ struct i386_xfp_save {
 #define	FP_SOFT		1		/* software FP emulator */
 #define	FP_287		2		/* 80287 */
 #define	FP_387		3		/* 80387 or 80486 */
-#define	FP_387X		4		/* FXSAVE/RSTOR-capable */
+#define	FP_387FX	4		/* FXSAVE/RSTOR-capable */
+#define	FP_387X		5		/* XSAVE/RSTOR-capable */
 
 #endif	/* _MACH_I386_FP_REG_H_ */
@@ -46,4 +46,21 @@ ENTRY(trap_name) \
 END(trap_name)
 #endif
 
+/*
+ * Same, entering the kernel through SYSENTER, which is much cheaper
+ * than the call gate.  Only for processors that have it (CPUID reports
+ * SEP), and native kernels.  The kernel returns to the address in edx
+ * with the stack pointer in ecx, which both get clobbered.
+ */
+#define kernel_trap_sysenter(trap_name,trap_number,number_args) \
+ENTRY(trap_name) \
+	movl	$ trap_number,%eax; \
+	call	0f; \
+0:	popl	%edx; \
+	addl	$(1f-0b),%edx; \
+	movl	%esp,%ecx; \
+	sysenter; \
+1:	ret; \
+END(trap_name)
+
 #endif	/* _MACH_I386_SYSCALL_SW_H_ */
@@ -79,6 +79,7 @@
 #include <mach/machine/vm_param.h>
 #include <mach/xen.h>
 #include <machine/thread.h>
+#include <i386/cpu.h>
 #include <i386/cpu_number.h>
 #include <i386/proc_reg.h>
 #include <i386/locore.h>
@@ -118,8 +119,8 @@ typedef struct pv_entry {
 pv_entry_t	pv_head_table;		/* array of entries, one per page */
 
 /*
- *	pv_list entries are kept on a list that can only be accessed
- *	with the pmap system locked (at SPLVM, not in the cpus_active set).
+ *	Free pv_list entries are kept on a list that can only be accessed
+ *	with pv_free_list_lock held (at SPLVM, not in the cpus_active set).
  *	The list is refilled from the pv_list_cache if it becomes empty.
  */
 pv_entry_t	pv_free_list;		/* free list at SPLVM */
@@ -151,6 +152,28 @@ struct kmem_cache	pv_list_cache;		/* cache of pv_entry structures */
 char	*pv_lock_table;		/* pointer to array of bits */
 #define pv_lock_table_size(n)	(((n)+BYTE_SIZE-1)/BYTE_SIZE)
 
+/*
+ *	Device memory is mapped uncached, except the physical ranges
+ *	held by a registered set, which are mapped write-combining.
+ *	The memory type belongs to the physical range rather than to a
+ *	mapping, as mapping a frame with two different types is
+ *	undefined, so a range stays write-combining as long as any set
+ *	holds it.  Each user, e.g. a device pager, owns its set and
+ *	releases it when it drops its mappings.
+ */
+queue_head_t		pmap_wc_sets;
+decl_simple_lock_data(, pmap_wc_lock)
+
+/*
+ *	User physical maps, for pmap_scan_references, which resumes
+ *	its sweep at the cursor.  The list lock is taken before the
+ *	lock of a pmap.
+ */
+queue_head_t		pmap_list;
+pmap_t			pmap_scan_pmap;		/* PMAP_NULL: sweep start */
+vm_offset_t		pmap_scan_va;
+decl_simple_lock_data(, pmap_list_lock)
+
 /* Has pmap_init completed? */
 boolean_t	pmap_initialized = FALSE;
 
@@ -208,29 +231,35 @@ vm_object_t	pmap_object = VM_OBJECT_NULL;
  *	by locking the pv_lock_table entry that corresponds to the pv_head
  *	for the list in question.)  Most routines want to lock a pmap and
  *	then do operations in it that require pv_list locking -- however
- *	pmap_remove_all and pmap_copy_on_write operate on a physical page
- *	basis and want to do the locking in the reverse order, i.e. lock
- *	a pv_list and then go through all the pmaps referenced by that list.
- *	To protect against deadlock between these two cases, the pmap_lock
- *	is used.  There are three different locking protocols as a result:
+ *	pmap_page_protect and phys_attribute_clear operate on a physical
+ *	page basis and want to do the locking in the reverse order, i.e.
+ *	lock a pv_list and then go through all the pmaps referenced by
+ *	that list.  There are three different locking protocols as a
+ *	result:
  *
  *  1.  pmap operations only (pmap_extract, pmap_access, ...)  Lock only
  *		the pmap.
  *
- *  2.  pmap-based operations (pmap_enter, pmap_remove, ...)  Get a read
- *		lock on the pmap_lock (shared read), then lock the pmap
- *		and finally the pv_lists as needed [i.e. pmap lock before
- *		pv_list lock.]
+ *  2.  pmap-based operations (pmap_enter, pmap_remove, ...)  Lock the
+ *		pmap and then the pv_lists as needed [i.e. pmap lock
+ *		before pv_list lock.]
  *
- *  3.  pv_list-based operations (pmap_remove_all, pmap_copy_on_write, ...)
- *		Get a write lock on the pmap_lock (exclusive write); this
- *		also guaranteees exclusive access to the pv_lists.  Lock the
- *		pmaps as needed.
+ *  3.  pv_list-based operations (pmap_page_protect, ...)  Lock the
+ *		pv_list, and only try to lock the pmaps on it.  If a
+ *		pmap is busy, release the pv_list, let the pmap-based
+ *		operation holding the pmap finish, and start over.
+ *		Operations that start over must leave the pv_list
+ *		consistent when they release it, and must not mind
+ *		redoing part of their work.
  *
  *	At no time may any routine hold more than one pmap lock or more than
- *	one pv_list lock.  Because interrupt level routines can allocate
- *	mbufs and cause pmap_enter's, the pmap_lock and the lock on the
- *	kernel_pmap can only be held at splvm.
+ *	one pv_list lock, pmap_copy excepted (see there).  Because interrupt level routines can allocate
+ *	mbufs and cause pmap_enter's, the lock on the kernel_pmap can only
+ *	be held at splvm.
+ *
+ *	A mapping stays on its pv_list until the TLBs no longer hold it,
+ *	see pmap_remove_range: a pv_list-based operation that finds a
+ *	page unmapped must be able to assume no processor can access it.
  */
 
 #if	NCPUS > 1
@@ -249,42 +278,35 @@ vm_object_t	pmap_object = VM_OBJECT_NULL;
 	splx(spl); \
 }
 
-/*
- *	Lock on pmap system
- */
-lock_data_t	pmap_system_lock;
-
-#define PMAP_READ_LOCK(pmap, spl) { \
+#define PMAP_LOCK(pmap, spl) { \
 	SPLVM(spl); \
-	lock_read(&pmap_system_lock); \
 	simple_lock(&(pmap)->lock); \
 }
 
-#define PMAP_WRITE_LOCK(spl) { \
-	SPLVM(spl); \
-	lock_write(&pmap_system_lock); \
-}
-
-#define PMAP_READ_UNLOCK(pmap, spl) { \
+#define PMAP_UNLOCK(pmap, spl) { \
 	simple_unlock(&(pmap)->lock); \
-	lock_read_done(&pmap_system_lock); \
-	SPLX(spl); \
-}
-
-#define PMAP_WRITE_UNLOCK(spl) { \
-	lock_write_done(&pmap_system_lock); \
 	SPLX(spl); \
 }
 
-#define PMAP_WRITE_TO_READ_LOCK(pmap) { \
-	simple_lock(&(pmap)->lock); \
-	lock_write_to_read(&pmap_system_lock); \
-}
-
 #define LOCK_PVH(index)		(lock_pvh_pai(index))
 
 #define UNLOCK_PVH(index)	(unlock_pvh_pai(index))
 
+/*
+ *	Try to lock a pmap while holding a pv_list lock.
+ */
+#define PMAP_LOCK_TRY(pmap)	(simple_lock_try(&(pmap)->lock))
+
+/*
+ *	Give way to the pmap-based operation holding a pmap that a
+ *	pv_list-based operation failed to lock.
+ */
+#define PMAP_PV_BACKOFF(index) { \
+	UNLOCK_PVH(index); \
+	machine_relax(); \
+	LOCK_PVH(index); \
+}
+
 #define PMAP_UPDATE_TLBS(pmap, s, e) \
 { \
 	cpu_set	cpu_mask = 1 << cpu_number(); \
@@ -314,15 +336,15 @@ lock_data_t	pmap_system_lock;
 #define SPLVM(spl) ((void)(spl))
 #define SPLX(spl) ((void)(spl))
 
-#define PMAP_READ_LOCK(pmap, spl)	SPLVM(spl)
-#define PMAP_WRITE_LOCK(spl)		SPLVM(spl)
-#define PMAP_READ_UNLOCK(pmap, spl)	SPLX(spl)
-#define PMAP_WRITE_UNLOCK(spl)		SPLX(spl)
-#define PMAP_WRITE_TO_READ_LOCK(pmap)
+#define PMAP_LOCK(pmap, spl)		SPLVM(spl)
+#define PMAP_UNLOCK(pmap, spl)		SPLX(spl)
 
 #define LOCK_PVH(index)
 #define UNLOCK_PVH(index)
 
+#define PMAP_LOCK_TRY(pmap)		TRUE
+#define PMAP_PV_BACKOFF(index)
+
 #define PMAP_UPDATE_TLBS(pmap, s, e) { \
 	/* invalidate our own TLB if pmap is in use */ \
 	if ((pmap)->cpus_using) { \
@@ -548,7 +570,7 @@ vm_offset_t pmap_map_bd(
 	if (prot & VM_PROT_WRITE)
 	    template |= INTEL_PTE_WRITE;
 
-	PMAP_READ_LOCK(kernel_pmap, spl);
+	PMAP_LOCK(kernel_pmap, spl);
 	while (start < end) {
 		pte = pmap_pte(kernel_pmap, virt);
 		if (pte == PT_ENTRY_NULL)
@@ -577,7 +599,7 @@ vm_offset_t pmap_map_bd(
 	if (n != i)
 		panic("couldn't pmap_map_bd\n");
 #endif	/* MACH_PV_PAGETABLES */
-	PMAP_READ_UNLOCK(kernel_pmap, spl);
+	PMAP_UNLOCK(kernel_pmap, spl);
 	return(virt);
 }
 
@@ -609,11 +631,11 @@ void pmap_bootstrap(void)
 
 	kernel_pmap = &kernel_pmap_store;
 
-#if	NCPUS > 1
-	lock_init(&pmap_system_lock, FALSE);	/* NOT a sleep lock */
-#endif	/* NCPUS > 1 */
-
 	simple_lock_init(&kernel_pmap->lock);
+	simple_lock_init(&pmap_wc_lock);
+	queue_init(&pmap_wc_sets);
+	simple_lock_init(&pmap_list_lock);
+	queue_init(&pmap_list);
 
 	kernel_pmap->ref_count = 1;
 
@@ -1221,7 +1243,7 @@ pmap_page_table_page_dealloc(vm_offset_t pa)
 pmap_t pmap_create(vm_size_t size)
 {
 	pt_entry_t		*page_dir[PDPNUM];
-	int			i;
+	int			i, s;
 	pmap_t			p;
 	pmap_statistics_t	stats;
 
@@ -1353,6 +1375,12 @@ pmap_t pmap_create(vm_size_t size)
 	stats->resident_count = 0;
 	stats->wired_count = 0;
 
+	SPLVM(s);
+	simple_lock(&pmap_list_lock);
+	queue_enter(&pmap_list, p, pmap_t, link);
+	simple_unlock(&pmap_list_lock);
+	SPLX(s);
+
 	return(p);
 }
 
@@ -1387,6 +1415,18 @@ void pmap_destroy(pmap_t p)
 	    return;	/* still in use */
 	}
 
+	SPLVM(s);
+	simple_lock(&pmap_list_lock);
+	if (pmap_scan_pmap == p) {
+	    pmap_scan_pmap = queue_end(&pmap_list, queue_next(&p->link))
+			     ? PMAP_NULL
+			     : (pmap_t) queue_next(&p->link);
+	    pmap_scan_va = VM_MIN_ADDRESS;
+	}
+	queue_remove(&pmap_list, p, pmap_t, link);
+	simple_unlock(&pmap_list_lock);
+	SPLX(s);
+
 #if PAE
 	for (i = 0; i <= lin2pdpnum(LINEAR_MIN_KERNEL_ADDRESS); i++) {
 	    free_all = i < lin2pdpnum(LINEAR_MIN_KERNEL_ADDRESS);
@@ -1475,23 +1515,64 @@ void pmap_reference(pmap_t p)
  *	and last (exclusive) entries for the VM pages.
  *	The virtual address is the va for the first pte.
  *
+ *	The mappings of managed pages are first invalidated, keeping
+ *	their physical address, and the TLBs flushed.  Only then are
+ *	they taken off their pv_lists: a pv_list-based operation must
+ *	not find a page unmapped while another processor may still
+ *	use a stale translation.  Those operations can't see the
+ *	invalid entries, since they need the pmap lock.
+ *
+ *	pmap_remove_range does all three steps.  pmap_remove calls
+ *	the two passes itself, so that it flushes the TLBs only once
+ *	for its whole range.
+ *
  *	The pmap must be locked.
  *	If the pmap is not the kernel pmap, the range must lie
  *	entirely within one pte-page.  This is NOT checked.
  *	Assumes that the pte-page exists.
  */
 
+#ifdef	MACH_PV_PAGETABLES
+#define PMAP_BATCH_UPDATE(lpte, v) { \
+	update[ii].ptr = kv_to_ma(lpte); \
+	update[ii].val = (v); \
+	ii++; \
+	if (ii == HYP_BATCH_MMU_UPDATES) { \
+		hyp_mmu_update(kvtolin(&update), ii, kvtolin(&n), DOMID_SELF); \
+		if (n != ii) \
+			panic("couldn't pmap_remove_range\n"); \
+		ii = 0; \
+	} \
+}
+
+#define PMAP_BATCH_FLUSH() { \
+	if (ii > HYP_BATCH_MMU_UPDATES) \
+		panic("overflowed array in pmap_remove_range"); \
+	hyp_mmu_update(kvtolin(&update), ii, kvtolin(&n), DOMID_SELF); \
+	if (n != ii) \
+		panic("couldn't pmap_remove_range\n"); \
+	ii = 0; \
+}
+#else	/* MACH_PV_PAGETABLES */
+#define PMAP_BATCH_UPDATE(lpte, v)	(*(lpte) = (v))
+#define PMAP_BATCH_FLUSH()
+#endif	/* MACH_PV_PAGETABLES */
+
+/*
+ *	First pass: invalidate the mappings, and update the counts.
+ *	Returns whether any mapping was removed, in which case the
+ *	TLBs must be flushed before pmap_remove_range_unlink.
+ */
 static
-void pmap_remove_range(
+boolean_t pmap_remove_range_invalidate(
 	pmap_t			pmap,
-	vm_offset_t		va,
 	pt_entry_t		*spte,
 	pt_entry_t		*epte)
 {
-	pt_entry_t		*cpte;
+	pt_entry_t		*cpte, *lpte;
 	unsigned long		num_removed, num_unwired;
-	unsigned long		pai;
 	phys_addr_t		pa;
+	int			i;
 #ifdef	MACH_PV_PAGETABLES
 	int n, ii = 0;
 	struct mmu_update update[HYP_BATCH_MMU_UPDATES];
@@ -1504,8 +1585,7 @@ void pmap_remove_range(
 	num_removed = 0;
 	num_unwired = 0;
 
-	for (cpte = spte; cpte < epte;
-	     cpte += ptes_per_vm_page, va += PAGE_SIZE) {
+	for (cpte = spte; cpte < epte; cpte += ptes_per_vm_page) {
 
 	    if (*cpte == 0)
 		continue;
@@ -1515,64 +1595,77 @@ void pmap_remove_range(
 	    if (*cpte & INTEL_PTE_WIRED)
 		num_unwired++;
 
+	    i = ptes_per_vm_page;
+	    lpte = cpte;
+
 	    if (!valid_page(pa)) {
 
 		/*
 		 *	Outside range of managed physical memory.
 		 *	Just remove the mappings.
 		 */
-		int		i = ptes_per_vm_page;
-		pt_entry_t	*lpte = cpte;
 		do {
-#ifdef	MACH_PV_PAGETABLES
-		    update[ii].ptr = kv_to_ma(lpte);
-		    update[ii].val = 0;
-		    ii++;
-		    if (ii == HYP_BATCH_MMU_UPDATES) {
-			hyp_mmu_update(kvtolin(&update), ii, kvtolin(&n), DOMID_SELF);
-			if (n != ii)
-				panic("couldn't pmap_remove_range\n");
-			ii = 0;
-		    }
-#else	/* MACH_PV_PAGETABLES */
-		    *lpte = 0;
-#endif	/* MACH_PV_PAGETABLES */
+		    PMAP_BATCH_UPDATE(lpte, 0);
 		    lpte++;
 		} while (--i > 0);
 		continue;
 	    }
 
+	    do {
+		PMAP_BATCH_UPDATE(lpte, *lpte & ~INTEL_PTE_VALID);
+		lpte++;
+	    } while (--i > 0);
+	}
+	PMAP_BATCH_FLUSH();
+
+	pmap->stats.resident_count -= num_removed;
+	pmap->stats.wired_count -= num_unwired;
+	return num_removed != 0;
+}
+
+/*
+ *	Second pass: remove the invalidated mappings from the pv_lists,
+ *	collecting their modify and reference bits.
+ */
+static
+void pmap_remove_range_unlink(
+	pmap_t			pmap,
+	vm_offset_t		va,
+	pt_entry_t		*spte,
+	pt_entry_t		*epte)
+{
+	pt_entry_t		*cpte, *lpte;
+	unsigned long		pai;
+	phys_addr_t		pa;
+	vm_offset_t		cva;
+	int			i;
+#ifdef	MACH_PV_PAGETABLES
+	int n, ii = 0;
+	struct mmu_update update[HYP_BATCH_MMU_UPDATES];
+#endif	/* MACH_PV_PAGETABLES */
+
+	for (cpte = spte, cva = va;
+	     cpte < epte;
+	     cpte += ptes_per_vm_page, cva += PAGE_SIZE) {
+
+	    if (*cpte == 0)
+		continue;
+	    pa = pte_to_pa(*cpte);
+
 	    pai = pa_index(pa);
 	    LOCK_PVH(pai);
 
 	    /*
 	     *	Get the modify and reference bits.
 	     */
-	    {
-		int		i;
-		pt_entry_t	*lpte;
-
-		i = ptes_per_vm_page;
-		lpte = cpte;
-		do {
-		    pmap_phys_attributes[pai] |=
-			*lpte & (PHYS_MODIFIED|PHYS_REFERENCED);
-#ifdef	MACH_PV_PAGETABLES
-		    update[ii].ptr = kv_to_ma(lpte);
-		    update[ii].val = 0;
-		    ii++;
-		    if (ii == HYP_BATCH_MMU_UPDATES) {
-			hyp_mmu_update(kvtolin(&update), ii, kvtolin(&n), DOMID_SELF);
-			if (n != ii)
-				panic("couldn't pmap_remove_range\n");
-			ii = 0;
-		    }
-#else	/* MACH_PV_PAGETABLES */
-		    *lpte = 0;
-#endif	/* MACH_PV_PAGETABLES */
-		    lpte++;
-		} while (--i > 0);
-	    }
+	    i = ptes_per_vm_page;
+	    lpte = cpte;
+	    do {
+		pmap_phys_attributes[pai] |=
+		    *lpte & (PHYS_MODIFIED|PHYS_REFERENCED);
+		PMAP_BATCH_UPDATE(lpte, 0);
+		lpte++;
+	    } while (--i > 0);
 
 	    /*
 	     *	Remove the mapping from the pvlist for
@@ -1585,7 +1678,7 @@ void pmap_remove_range(
 		if (pv_h->pmap == PMAP_NULL) {
 		    panic("pmap_remove: null pv_list!");
 		}
-		if (pv_h->va == va && pv_h->pmap == pmap) {
+		if (pv_h->va == cva && pv_h->pmap == pmap) {
 		    /*
 		     * Header is the pv_entry.  Copy the next one
 		     * to header and free the next one (we cannot
@@ -1607,27 +1700,27 @@ void pmap_remove_range(
 			if ((cur = prev->next) == PV_ENTRY_NULL) {
 			    panic("pmap-remove: mapping not in pv_list!");
 			}
-		    } while (cur->va != va || cur->pmap != pmap);
+		    } while (cur->va != cva || cur->pmap != pmap);
 		    prev->next = cur->next;
 		    PV_FREE(cur);
 		}
 		UNLOCK_PVH(pai);
 	    }
 	}
+	PMAP_BATCH_FLUSH();
+}
 
-#ifdef	MACH_PV_PAGETABLES
-	if (ii > HYP_BATCH_MMU_UPDATES)
-		panic("overflowed array in pmap_remove_range");
-	hyp_mmu_update(kvtolin(&update), ii, kvtolin(&n), DOMID_SELF);
-	if (n != ii)
-		panic("couldn't pmap_remove_range\n");
-#endif	/* MACH_PV_PAGETABLES */
-
-	/*
-	 *	Update the counts
-	 */
-	pmap->stats.resident_count -= num_removed;
-	pmap->stats.wired_count -= num_unwired;
+static
+void pmap_remove_range(
+	pmap_t			pmap,
+	vm_offset_t		va,
+	pt_entry_t		*spte,
+	pt_entry_t		*epte)
+{
+	if (pmap_remove_range_invalidate(pmap, spte, epte)) {
+	    PMAP_UPDATE_TLBS(pmap, va, va + intel_ptob(epte - spte));
+	    pmap_remove_range_unlink(pmap, va, spte, epte);
+	}
 }
 
 /*
@@ -1645,31 +1738,53 @@ void pmap_remove(
 {
 	int			spl;
 	pt_entry_t		*spte, *epte;
-	vm_offset_t		l;
-	vm_offset_t		_s = s;
+	vm_offset_t		l, v;
+	boolean_t		flush;
 
 	if (map == PMAP_NULL)
 		return;
 
-	PMAP_READ_LOCK(map, spl);
+	PMAP_LOCK(map, spl);
 
-	while (s < e) {
-	    pt_entry_t *pde = pmap_pde(map, s);
+	/*
+	 *	Invalidate the whole range, flush the TLBs once,
+	 *	then take the mappings off their pv_lists.
+	 */
+	flush = FALSE;
+	for (v = s; v < e; v = l) {
+	    pt_entry_t *pde = pmap_pde(map, v);
 
-	    l = (s + PDE_MAPPED_SIZE) & ~(PDE_MAPPED_SIZE-1);
+	    l = (v + PDE_MAPPED_SIZE) & ~(PDE_MAPPED_SIZE-1);
 	    if (l > e)
 		l = e;
 	    if (*pde & INTEL_PTE_VALID) {
 		spte = (pt_entry_t *)ptetokv(*pde);
-		spte = &spte[ptenum(s)];
-		epte = &spte[intel_btop(l-s)];
-		pmap_remove_range(map, s, spte, epte);
+		spte = &spte[ptenum(v)];
+		epte = &spte[intel_btop(l-v)];
+		if (pmap_remove_range_invalidate(map, spte, epte))
+		    flush = TRUE;
+	    }
+	}
+
+	if (flush) {
+	    PMAP_UPDATE_TLBS(map, s, e);
+
+	    for (v = s; v < e; v = l) {
+		pt_entry_t *pde = pmap_pde(map, v);
+
+		l = (v + PDE_MAPPED_SIZE) & ~(PDE_MAPPED_SIZE-1);
+		if (l > e)
+		    l = e;
+		if (*pde & INTEL_PTE_VALID) {
+		    spte = (pt_entry_t *)ptetokv(*pde);
+		    spte = &spte[ptenum(v)];
+		    epte = &spte[intel_btop(l-v)];
+		    pmap_remove_range_unlink(map, v, spte, epte);
+		}
 	    }
-	    s = l;
 	}
-	PMAP_UPDATE_TLBS(map, _s, e);
 
-	PMAP_READ_UNLOCK(map, spl);
+	PMAP_UNLOCK(map, spl);
 }
 
 /*
@@ -1714,21 +1829,16 @@ void pmap_page_protect(
 		break;
 	}
 
-	/*
-	 *	Lock the pmap system first, since we will be changing
-	 *	several pmaps.
-	 */
-
-	PMAP_WRITE_LOCK(spl);
+	SPLVM(spl);
 
 	pai = pa_index(phys);
 	pv_h = pai_to_pvh(pai);
+	LOCK_PVH(pai);
 
 	/*
 	 * Walk down PV list, changing or removing all mappings.
-	 * We do not have to lock the pv_list because we have
-	 * the entire pmap system locked.
 	 */
+    Retry:
 	if (pv_h->pmap != PMAP_NULL) {
 
 	    prev = pv_e = pv_h;
@@ -1739,7 +1849,19 @@ void pmap_page_protect(
 		/*
 		 * Lock the pmap to block pmap_extract and similar routines.
 		 */
-		simple_lock(&pmap->lock);
+		if (!PMAP_LOCK_TRY(pmap)) {
+		    /*
+		     * Fix up the head, as below, and start over.
+		     */
+		    if (pv_h->pmap == PMAP_NULL) {
+			pv_e = pv_h->next;
+			assert(pv_e != PV_ENTRY_NULL);
+			*pv_h = *pv_e;
+			PV_FREE(pv_e);
+		    }
+		    PMAP_PV_BACKOFF(pai);
+		    goto Retry;
+		}
 
 		va = pv_e->va;
 		pte = pmap_pte(pmap, va);
@@ -1836,7 +1958,8 @@ void pmap_page_protect(
 	    }
 	}
 
-	PMAP_WRITE_UNLOCK(spl);
+	UNLOCK_PVH(pai);
+	SPLX(spl);
 }
 
 /*
@@ -1939,6 +2062,189 @@ void pmap_protect(
 	SPLX(spl);
 }
 
+/*
+ *	Program the page attribute table of the current processor,
+ *	making the entry selected by the PAT and PWT pte bits
+ *	write-combining instead of write-through.  The other entries
+ *	keep their power-on types, so the PCD and PWT bits mean what
+ *	they always did.  Called on each processor before it maps
+ *	any device memory.
+ *
+ *	No line may be cached with a stale type across the change, so
+ *	the caches are disabled and flushed around the write, with
+ *	interrupts off, as the processor manuals require.
+ */
+void pmap_pat_init(void)
+{
+#ifndef	MACH_HYP
+	unsigned long	flags, cr0;
+
+	if (!CPU_HAS_FEATURE(CPU_FEATURE_PAT))
+		return;
+
+	cpu_intr_save(&flags);
+	cr0 = get_cr0();
+	set_cr0((cr0 | CR0_CD) & ~CR0_NW);
+	wbinvd();
+	flush_tlb();
+
+	set_msr(MSR_PAT, PAT_VALUE);
+
+	wbinvd();
+	flush_tlb();
+	set_cr0(cr0);
+	cpu_intr_restore(flags);
+#endif	/* MACH_HYP */
+}
+
+/*
+ *	Initialize an empty set of write-combining ranges.
+ */
+void pmap_wc_set_init(struct pmap_wc_set *set)
+{
+	set->nranges = 0;
+	set->registered = FALSE;
+}
+
+/*
+ *	Map the physical range [start, end) write-combining from now
+ *	on, on behalf of set.  Returns FALSE if the processor can't,
+ *	or if there is no room left in set for the range.
+ */
+boolean_t pmap_write_combine(
+	struct pmap_wc_set	*set,
+	phys_addr_t		start,
+	phys_addr_t		end)
+{
+	struct pmap_wc_range	*r;
+	spl_t			spl;
+	int			i;
+
+#ifdef	MACH_HYP
+	return FALSE;
+#endif	/* MACH_HYP */
+	if (!CPU_HAS_FEATURE(CPU_FEATURE_PAT))
+		return FALSE;
+
+	spl = splvm();
+	simple_lock(&pmap_wc_lock);
+
+	/*
+	 *	Device memory is mostly mapped one page after the
+	 *	other, so try to extend an existing range first.
+	 */
+	for (i = 0; i < set->nranges; i++) {
+	    r = &set->ranges[i];
+	    if (start >= r->start && end <= r->end)
+		goto out;
+	    if (start == r->end) {
+		r->end = end;
+		goto out;
+	    }
+	}
+
+	if (set->nranges == PMAP_WC_RANGES) {
+	    simple_unlock(&pmap_wc_lock);
+	    splx(spl);
+	    return FALSE;
+	}
+
+	r = &set->ranges[set->nranges++];
+	r->start = start;
+	r->end = end;
+
+	if (!set->registered) {
+	    queue_enter(&pmap_wc_sets, set, struct pmap_wc_set *, link);
+	    set->registered = TRUE;
+	}
+
+out:
+	simple_unlock(&pmap_wc_lock);
+	splx(spl);
+	return TRUE;
+}
+
+/*
+ *	Drop the ranges of set.  They are mapped uncached again
+ *	unless another set still holds them.  The caller must have
+ *	removed its mappings of them.
+ */
+void pmap_write_combine_release(struct pmap_wc_set *set)
+{
+	spl_t	spl;
+
+	spl = splvm();
+	simple_lock(&pmap_wc_lock);
+
+	if (set->registered) {
+	    queue_remove(&pmap_wc_sets, set, struct pmap_wc_set *, link);
+	    set->registered = FALSE;
+	}
+	set->nranges = 0;
+
+	simple_unlock(&pmap_wc_lock);
+	splx(spl);
+}
+
+/*
+ *	Cache control bits of a pte mapping device memory at pa.
+ *	Called at splvm.
+ */
+static pt_entry_t pmap_io_cache_bits(phys_addr_t pa)
+{
+	struct pmap_wc_set	*set;
+	pt_entry_t		bits;
+	int			i;
+
+	bits = INTEL_PTE_NCACHE|INTEL_PTE_WTHRU;
+
+	simple_lock(&pmap_wc_lock);
+	queue_iterate(&pmap_wc_sets, set, struct pmap_wc_set *, link) {
+	    for (i = 0; i < set->nranges; i++)
+		if (pa >= set->ranges[i].start && pa < set->ranges[i].end) {
+		    bits = INTEL_PTE_PAT|INTEL_PTE_WTHRU;
+		    goto out;
+		}
+	}
+out:
+	simple_unlock(&pmap_wc_lock);
+	return bits;
+}
+
+/*
+ *	Enter the new page-table page ptp in the page directory of
+ *	pmap, to map v.  The pmap is locked.
+ */
+static void pmap_enter_ptp(
+	pmap_t		pmap,
+	vm_offset_t	v,
+	vm_offset_t	ptp)
+{
+	pt_entry_t	*pdp;
+	int		i;
+
+	i = ptes_per_vm_page;
+	pdp = pmap_pde(pmap, v);
+	do {
+#ifdef	MACH_PV_PAGETABLES
+	    pmap_set_page_readonly((void *) ptp);
+	    if (!hyp_mmuext_op_mfn (MMUEXT_PIN_L1_TABLE, kv_to_mfn(ptp)))
+		panic("couldn't pin page %lx(%lx)\n",ptp,(vm_offset_t) kv_to_ma(ptp));
+	    if (!hyp_mmu_update_pte(pa_to_ma(kvtophys((vm_offset_t)pdp)),
+		pa_to_pte(pa_to_ma(kvtophys(ptp))) | INTEL_PTE_VALID
+					      | INTEL_PTE_USER
+					      | INTEL_PTE_WRITE))
+		panic("%s:%d could not set pde %p(%llx,%lx) to %lx(%llx,%lx) %lx\n",__FILE__,__LINE__, pdp, kvtophys((vm_offset_t)pdp), (vm_offset_t) pa_to_ma(kvtophys((vm_offset_t)pdp)), ptp, kvtophys(ptp), (vm_offset_t) pa_to_ma(kvtophys(ptp)), (vm_offset_t) pa_to_pte(kv_to_ma(ptp)));
+#else	/* MACH_PV_PAGETABLES */
+	    *pdp = pa_to_pte(kvtophys(ptp)) | INTEL_PTE_VALID
+					    | INTEL_PTE_USER
+					    | INTEL_PTE_WRITE;
+#endif	/* MACH_PV_PAGETABLES */
+	    pdp++;	/* Note: This is safe b/c we stay in one page.  */
+	    ptp += INTEL_PGBYTES;
+	} while (--i > 0);
+}
+
 /*
  *	Insert the given physical page (p) at
  *	the specified virtual address (v) in the
@@ -1985,7 +2291,7 @@ void pmap_enter(
 	     *
 	     *  XXX should be #if'd for i386
 	     */
-	    PMAP_READ_LOCK(pmap, spl);
+	    PMAP_LOCK(pmap, spl);
 
 	    pte = pmap_pte(pmap, v);
 	    if (pte != PT_ENTRY_NULL && *pte != 0) {
@@ -1995,9 +2301,8 @@ void pmap_enter(
 		 */
 		pmap_remove_range(pmap, v, pte,
 				  pte + ptes_per_vm_page);
-		PMAP_UPDATE_TLBS(pmap, v, v + PAGE_SIZE);
 	    }
-	    PMAP_READ_UNLOCK(pmap, spl);
+	    PMAP_UNLOCK(pmap, spl);
 	    return;
 	}
 
@@ -2010,7 +2315,7 @@ void pmap_enter(
 	 */
 	pv_e = PV_ENTRY_NULL;
 Retry:
-	PMAP_READ_LOCK(pmap, spl);
+	PMAP_LOCK(pmap, spl);
 
 	/*
 	 *	Expand pmap to include this pte.  Assume that
@@ -2023,8 +2328,6 @@ Retry:
 	     * Need to allocate a new page-table page.
 	     */
 	    vm_offset_t	ptp;
-	    pt_entry_t	*pdp;
-	    int		i;
 
 	    if (pmap == kernel_pmap) {
 		/*
@@ -2037,7 +2340,7 @@ Retry:
 	    /*
 	     * Unlock the pmap and allocate a new page-table page.
 	     */
-	    PMAP_READ_UNLOCK(pmap, spl);
+	    PMAP_UNLOCK(pmap, spl);
 
 	    ptp = phystokv(pmap_page_table_page_alloc());
 
@@ -2047,41 +2350,19 @@ Retry:
 	     * has, discard the new page-table page (and try
 	     * again to make sure).
 	     */
-	    PMAP_READ_LOCK(pmap, spl);
+	    PMAP_LOCK(pmap, spl);
 
 	    if (pmap_pte(pmap, v) != PT_ENTRY_NULL) {
 		/*
 		 * Oops...
 		 */
-		PMAP_READ_UNLOCK(pmap, spl);
+		PMAP_UNLOCK(pmap, spl);
 		pmap_page_table_page_dealloc(kvtophys(ptp));
-		PMAP_READ_LOCK(pmap, spl);
+		PMAP_LOCK(pmap, spl);
 		continue;
 	    }
 
-	    /*
-	     * Enter the new page table page in the page directory.
-	     */
-	    i = ptes_per_vm_page;
-	    pdp = pmap_pde(pmap, v);
-	    do {
-#ifdef	MACH_PV_PAGETABLES
-		pmap_set_page_readonly((void *) ptp);
-		if (!hyp_mmuext_op_mfn (MMUEXT_PIN_L1_TABLE, kv_to_mfn(ptp)))
-			panic("couldn't pin page %lx(%lx)\n",ptp,(vm_offset_t) kv_to_ma(ptp));
-		if (!hyp_mmu_update_pte(pa_to_ma(kvtophys((vm_offset_t)pdp)),
-			pa_to_pte(pa_to_ma(kvtophys(ptp))) | INTEL_PTE_VALID
-					      | INTEL_PTE_USER
-					      | INTEL_PTE_WRITE))
-			panic("%s:%d could not set pde %p(%llx,%lx) to %lx(%llx,%lx) %lx\n",__FILE__,__LINE__, pdp, kvtophys((vm_offset_t)pdp), (vm_offset_t) pa_to_ma(kvtophys((vm_offset_t)pdp)), ptp, kvtophys(ptp), (vm_offset_t) pa_to_ma(kvtophys(ptp)), (vm_offset_t) pa_to_pte(kv_to_ma(ptp)));
-#else	/* MACH_PV_PAGETABLES */
-		*pdp = pa_to_pte(kvtophys(ptp)) | INTEL_PTE_VALID
-					        | INTEL_PTE_USER
-					        | INTEL_PTE_WRITE;
-#endif	/* MACH_PV_PAGETABLES */
-		pdp++;	/* Note: This is safe b/c we stay in one page.  */
-		ptp += INTEL_PGBYTES;
-	    } while (--i > 0);
+	    pmap_enter_ptp(pmap, v, ptp);
 
 	    /*
 	     * Now, get the address of the page-table entry.
@@ -2116,7 +2397,7 @@ Retry:
 		template |= INTEL_PTE_WRITE;
 	    if (machine_slot[cpu_number()].cpu_type >= CPU_TYPE_I486
 		&& !is_physmem)
-		template |= INTEL_PTE_NCACHE|INTEL_PTE_WTHRU;
+		template |= pmap_io_cache_bits(pa);
 	    if (wired)
 		template |= INTEL_PTE_WIRED;
 	    i = ptes_per_vm_page;
@@ -2146,7 +2427,6 @@ Retry:
 		 */
 		pmap_remove_range(pmap, v, pte,
 				  pte + ptes_per_vm_page);
-		PMAP_UPDATE_TLBS(pmap, v, v + PAGE_SIZE);
 	    }
 
 	    if (valid_page(pa)) {
@@ -2188,7 +2468,7 @@ Retry:
 			PV_ALLOC(pv_e);
 			if (pv_e == PV_ENTRY_NULL) {
 			    UNLOCK_PVH(pai);
-			    PMAP_READ_UNLOCK(pmap, spl);
+			    PMAP_UNLOCK(pmap, spl);
 
 			    /*
 			     * Refill from cache.
@@ -2228,7 +2508,7 @@ Retry:
 		template |= INTEL_PTE_WRITE;
 	    if (machine_slot[cpu_number()].cpu_type >= CPU_TYPE_I486
 		&& !is_physmem)
-		template |= INTEL_PTE_NCACHE|INTEL_PTE_WTHRU;
+		template |= pmap_io_cache_bits(pa);
 	    if (wired)
 		template |= INTEL_PTE_WIRED;
 	    i = ptes_per_vm_page;
@@ -2248,7 +2528,138 @@ Retry:
 	    PV_FREE(pv_e);
 	}
 
-	PMAP_READ_UNLOCK(pmap, spl);
+	PMAP_UNLOCK(pmap, spl);
+}
+
+/*
+ *	Routine:	pmap_copy
+ *	Function:	Copy the valid mappings of src_pmap in
+ *			[src_addr, src_addr + len) into dst_pmap,
+ *			read-only.
+ *
+ *	Used at fork, so that the child starts with the resident pages
+ *	of the parent mapped instead of faulting them in one by one.
+ *	The mappings are read-only, so that the first write still
+ *	faults and resolves copy-on-write.  Only the address range the
+ *	mapping came from is supported, and dst_pmap must not be in use
+ *	yet, as it is locked after src_pmap.
+ *
+ *	This is an optimization.  It may block to allocate the page
+ *	tables of dst_pmap, with no lock held, but stops copying when
+ *	it runs out of pv_list entries.  The mappings of src_pmap
+ *	can't go away while it is locked, pmap_page_protect backing
+ *	off from it, so neither can the pages they map.
+ */
+void pmap_copy(
+	pmap_t		dst_pmap,
+	pmap_t		src_pmap,
+	vm_offset_t	dst_addr,
+	vm_size_t	len,
+	vm_offset_t	src_addr)
+{
+	pt_entry_t	*spte, *epte, *dpte;
+	pt_entry_t	template;
+	vm_offset_t	s, e, l, v, ptp;
+	phys_addr_t	pa;
+	pv_entry_t	pv_h, pv_e;
+	unsigned long	pai;
+	int		spl;
+
+	if (dst_pmap == PMAP_NULL || src_pmap == PMAP_NULL
+	    || dst_pmap == kernel_pmap || src_pmap == kernel_pmap
+	    || dst_addr != src_addr)
+		return;
+
+	s = src_addr;
+	e = src_addr + len;
+	for (; s < e; s = l) {
+	    l = (s + PDE_MAPPED_SIZE) & ~(PDE_MAPPED_SIZE-1);
+	    if (l > e || l == 0)
+		l = e;
+
+	    /*
+	     *	Skip what the source maps no page table for, and
+	     *	give the destination the page table it lacks.
+	     */
+	    PMAP_LOCK(src_pmap, spl);
+	    spte = pmap_pte(src_pmap, s);
+	    PMAP_UNLOCK(src_pmap, spl);
+	    if (spte == PT_ENTRY_NULL)
+		continue;
+
+	    if (pmap_pte(dst_pmap, s) == PT_ENTRY_NULL) {
+		ptp = phystokv(pmap_page_table_page_alloc());
+		PMAP_LOCK(dst_pmap, spl);
+		if (pmap_pte(dst_pmap, s) == PT_ENTRY_NULL) {
+		    pmap_enter_ptp(dst_pmap, s, ptp);
+		    ptp = 0;
+		}
+		PMAP_UNLOCK(dst_pmap, spl);
+		if (ptp != 0)
+		    pmap_page_table_page_dealloc(kvtophys(ptp));
+	    }
+
+	    /*
+	     *	Hold both pmaps, against the one pmap lock rule.
+	     *	This can't deadlock: no other processor uses dst_pmap
+	     *	yet, so only pv_list-based operations can want its
+	     *	lock, and those only try to take it.
+	     */
+	    PMAP_LOCK(src_pmap, spl);
+	    simple_lock(&dst_pmap->lock);
+
+	    spte = pmap_pte(src_pmap, s);
+	    if (spte == PT_ENTRY_NULL)
+		goto next;
+	    epte = spte + intel_btop(l - s);
+	    dpte = pmap_pte(dst_pmap, s);
+
+	    for (v = s; spte < epte; v += PAGE_SIZE,
+				     spte += ptes_per_vm_page,
+				     dpte += ptes_per_vm_page) {
+		if (!(*spte & INTEL_PTE_VALID) || *dpte != 0)
+		    continue;
+
+		pa = pte_to_pa(*spte);
+		if (valid_page(pa)) {
+		    pai = pa_index(pa);
+		    LOCK_PVH(pai);
+		    pv_h = pai_to_pvh(pai);
+		    if (pv_h->pmap == PMAP_NULL) {
+			pv_h->va = v;
+			pv_h->pmap = dst_pmap;
+			pv_h->next = PV_ENTRY_NULL;
+		    } else {
+			PV_ALLOC(pv_e);
+			if (pv_e == PV_ENTRY_NULL) {
+			    UNLOCK_PVH(pai);
+			    simple_unlock(&dst_pmap->lock);
+			    PMAP_UNLOCK(src_pmap, spl);
+			    return;
+			}
+			pv_e->va = v;
+			pv_e->pmap = dst_pmap;
+			pv_e->next = pv_h->next;
+			pv_h->next = pv_e;
+		    }
+		    UNLOCK_PVH(pai);
+		}
+
+		template = *spte & ~(INTEL_PTE_WRITE | INTEL_PTE_WIRED
+				     | INTEL_PTE_MOD | INTEL_PTE_REF);
+#ifdef	MACH_PV_PAGETABLES
+		if (!hyp_mmu_update_pte(kv_to_ma(dpte), template))
+		    panic("%s:%d could not set pte %p to %llx\n",__FILE__,__LINE__,dpte,template);
+#else	/* MACH_PV_PAGETABLES */
+		WRITE_PTE(dpte, template)
+#endif	/* MACH_PV_PAGETABLES */
+		dst_pmap->stats.resident_count++;
+	    }
+
+next:
+	    simple_unlock(&dst_pmap->lock);
+	    PMAP_UNLOCK(src_pmap, spl);
+	}
 }
 
 /*
@@ -2271,7 +2682,7 @@ void pmap_change_wiring(
 	 *	We must grab the pmap system lock because we may
 	 *	change a pte_page queue.
 	 */
-	PMAP_READ_LOCK(map, spl);
+	PMAP_LOCK(map, spl);
 
 	if ((pte = pmap_pte(map, v)) == PT_ENTRY_NULL)
 		panic("pmap_change_wiring: pte missing");
@@ -2303,7 +2714,7 @@ void pmap_change_wiring(
 	    } while (--i > 0);
 	}
 
-	PMAP_READ_UNLOCK(map, spl);
+	PMAP_UNLOCK(map, spl);
 }
 
 /*
@@ -2392,7 +2803,7 @@ void pmap_collect(pmap_t p)
 	    /*
 	     *	Garbage collect map.
 	     */
-	    PMAP_READ_LOCK(p, spl);
+	    PMAP_LOCK(p, spl);
 	    for (pdp = page_dir;
 		 (free_all
 		  || pdp < &page_dir[lin2pdenum(LINEAR_MIN_KERNEL_ADDRESS)])
@@ -2454,7 +2865,7 @@ void pmap_collect(pmap_t p)
 			    } while (--i > 0);
 			}
 
-			PMAP_READ_UNLOCK(p, spl);
+			PMAP_UNLOCK(p, spl);
 
 			/*
 			 * And free the pte page itself.
@@ -2473,7 +2884,7 @@ void pmap_collect(pmap_t p)
 			    vm_object_unlock(pmap_object);
 			}
 
-			PMAP_READ_LOCK(p, spl);
+			PMAP_LOCK(p, spl);
 		    }
 		}
 	    }
@@ -2482,7 +2893,7 @@ void pmap_collect(pmap_t p)
 #endif
 	PMAP_UPDATE_TLBS(p, VM_MIN_ADDRESS, VM_MAX_ADDRESS);
 
-	PMAP_READ_UNLOCK(p, spl);
+	PMAP_UNLOCK(p, spl);
 	return;
 
 }
@@ -2619,21 +3030,16 @@ phys_attribute_clear(
 	    return;
 	}
 
-	/*
-	 *	Lock the pmap system first, since we will be changing
-	 *	several pmaps.
-	 */
-
-	PMAP_WRITE_LOCK(spl);
+	SPLVM(spl);
 
 	pai = pa_index(phys);
 	pv_h = pai_to_pvh(pai);
+	LOCK_PVH(pai);
 
 	/*
 	 * Walk down PV list, clearing all modify or reference bits.
-	 * We do not have to lock the pv_list because we have
-	 * the entire pmap system locked.
 	 */
+    Retry:
 	if (pv_h->pmap != PMAP_NULL) {
 	    /*
 	     * There are some mappings.
@@ -2645,7 +3051,10 @@ phys_attribute_clear(
 		/*
 		 * Lock the pmap to block pmap_extract and similar routines.
 		 */
-		simple_lock(&pmap->lock);
+		if (!PMAP_LOCK_TRY(pmap)) {
+		    PMAP_PV_BACKOFF(pai);
+		    goto Retry;
+		}
 
 		va = pv_e->va;
 		pte = pmap_pte(pmap, va);
@@ -2677,7 +3086,8 @@ phys_attribute_clear(
 
 	pmap_phys_attributes[pai] &= ~bits;
 
-	PMAP_WRITE_UNLOCK(spl);
+	UNLOCK_PVH(pai);
+	SPLX(spl);
 }
 
 /*
@@ -2703,26 +3113,22 @@ phys_attribute_test(
 	    return (FALSE);
 	}
 
-	/*
-	 *	Lock the pmap system first, since we will be checking
-	 *	several pmaps.
-	 */
-
-	PMAP_WRITE_LOCK(spl);
+	SPLVM(spl);
 
 	pai = pa_index(phys);
 	pv_h = pai_to_pvh(pai);
+	LOCK_PVH(pai);
 
 	if (pmap_phys_attributes[pai] & bits) {
-	    PMAP_WRITE_UNLOCK(spl);
+	    UNLOCK_PVH(pai);
+	    SPLX(spl);
 	    return (TRUE);
 	}
 
 	/*
 	 * Walk down PV list, checking all mappings.
-	 * We do not have to lock the pv_list because we have
-	 * the entire pmap system locked.
 	 */
+    Retry:
 	if (pv_h->pmap != PMAP_NULL) {
 	    /*
 	     * There are some mappings.
@@ -2733,7 +3139,10 @@ phys_attribute_test(
 		/*
 		 * Lock the pmap to block pmap_extract and similar routines.
 		 */
-		simple_lock(&pmap->lock);
+		if (!PMAP_LOCK_TRY(pmap)) {
+		    PMAP_PV_BACKOFF(pai);
+		    goto Retry;
+		}
 
 		{
 		    vm_offset_t va;
@@ -2757,7 +3166,8 @@ phys_attribute_test(
 		    do {
 			if (*pte & bits) {
 			    simple_unlock(&pmap->lock);
-			    PMAP_WRITE_UNLOCK(spl);
+			    UNLOCK_PVH(pai);
+			    SPLX(spl);
 			    return (TRUE);
 			}
 		    } while (--i > 0);
@@ -2765,7 +3175,8 @@ phys_attribute_test(
 		simple_unlock(&pmap->lock);
 	    }
 	}
-	PMAP_WRITE_UNLOCK(spl);
+	UNLOCK_PVH(pai);
+	SPLX(spl);
 	return (FALSE);
 }
 
@@ -2813,6 +3224,112 @@ boolean_t pmap_is_referenced(phys_addr_t phys)
 	return (phys_attribute_test(phys, PHYS_REFERENCED));
 }
 
+/*
+ *	Sweep the user mappings of all pmaps, a batch of about max
+ *	ptes at a time, moving their reference bits to the attributes
+ *	of the managed pages they map: pmap_is_referenced then finds
+ *	them without walking the pv_lists.  Returns TRUE when the
+ *	sweep completes, the next call starting another one.
+ *
+ *	The TLBs are not flushed, so a processor with the translation
+ *	cached may not set a cleared bit again until it drops it.  A
+ *	reference is then missed, which is only a hint, as when the
+ *	bit is cleared by pmap_clear_reference.
+ */
+boolean_t pmap_scan_references(unsigned int max)
+{
+	pmap_t		pmap;
+	pt_entry_t	*pde, *spte, *epte;
+	vm_offset_t	s, l;
+	unsigned long	pai;
+	phys_addr_t	pa;
+	queue_entry_t	next;
+	boolean_t	swept;
+	int		spl;
+
+	swept = FALSE;
+
+	SPLVM(spl);
+	simple_lock(&pmap_list_lock);
+
+	while (max > 0) {
+	    if (pmap_scan_pmap == PMAP_NULL) {
+		if (queue_empty(&pmap_list)) {
+		    swept = TRUE;
+		    break;
+		}
+		pmap_scan_pmap = (pmap_t) queue_first(&pmap_list);
+		pmap_scan_va = VM_MIN_ADDRESS;
+	    }
+
+	    pmap = pmap_scan_pmap;
+	    simple_lock(&pmap->lock);
+
+	    for (s = pmap_scan_va; s < VM_MAX_ADDRESS && max > 0; s = l) {
+		l = (s + PDE_MAPPED_SIZE) & ~(PDE_MAPPED_SIZE-1);
+		if (l > VM_MAX_ADDRESS)
+		    l = VM_MAX_ADDRESS;
+
+		/*
+		 *	An empty page directory entry counts as one
+		 *	pte, so that sparse maps are swept quickly.
+		 */
+		pde = pmap_pde(pmap, s);
+		if (!(*pde & INTEL_PTE_VALID)) {
+		    max--;
+		    continue;
+		}
+
+		spte = (pt_entry_t *) ptetokv(*pde);
+		spte = &spte[ptenum(s)];
+		epte = &spte[intel_btop(l-s)];
+		max = (epte - spte < max) ? max - (epte - spte) : 0;
+
+		for (; spte < epte; spte++) {
+		    if ((*spte & (INTEL_PTE_VALID|INTEL_PTE_REF))
+			!= (INTEL_PTE_VALID|INTEL_PTE_REF))
+			continue;
+
+		    pa = pte_to_pa(*spte);
+		    if (!valid_page(pa))
+			continue;
+
+		    pai = pa_index(pa);
+		    LOCK_PVH(pai);
+		    pmap_phys_attributes[pai] |= PHYS_REFERENCED;
+#ifdef	MACH_PV_PAGETABLES
+		    if (!hyp_mmu_update_pte(kv_to_ma(spte),
+					    *spte & ~INTEL_PTE_REF))
+			panic("pmap_scan_references: could not clear pte %p\n",
+			      spte);
+#else	/* MACH_PV_PAGETABLES */
+		    *spte &= ~INTEL_PTE_REF;
+#endif	/* MACH_PV_PAGETABLES */
+		    UNLOCK_PVH(pai);
+		}
+	    }
+
+	    pmap_scan_va = s;
+	    simple_unlock(&pmap->lock);
+
+	    if (s >= VM_MAX_ADDRESS) {
+		next = queue_next(&pmap->link);
+		pmap_scan_va = VM_MIN_ADDRESS;
+		if (queue_end(&pmap_list, next)) {
+		    pmap_scan_pmap = PMAP_NULL;
+		    swept = TRUE;
+		    break;
+		}
+		pmap_scan_pmap = (pmap_t) next;
+	    }
+	}
+
+	simple_unlock(&pmap_list_lock);
+	SPLX(spl);
+
+	return swept;
+}
+
 #if	NCPUS > 1
 /*
 *	    TLB Coherence Code (TLB "shootdown" code)
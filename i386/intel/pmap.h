@@ -38,6 +38,7 @@
 #ifndef	__ASSEMBLER__
 
 #include <kern/lock.h>
+#include <kern/queue.h>
 #include <mach/machine/vm_param.h>
 #include <mach/vm_statistics.h>
 #include <mach/kern_return.h>
@@ -148,6 +149,7 @@ typedef phys_addr_t pt_entry_t;
 #define INTEL_PTE_NCACHE 	0x00000010
 #define INTEL_PTE_REF		0x00000020
 #define INTEL_PTE_MOD		0x00000040
+#define INTEL_PTE_PAT		0x00000080	/* in a 4K pte */
 #ifdef	MACH_PV_PAGETABLES
 /* Not supported */
 #define INTEL_PTE_GLOBAL	0x00000000
@@ -196,6 +198,7 @@ struct pmap {
 					/* lock on map */
 	struct pmap_statistics	stats;	/* map statistics */
 	cpu_set		cpus_using;	/* bitmap of cpus using pmap */
+	queue_chain_t	link;		/* user pmaps, for reference scans */
 };
 
 typedef struct pmap	*pmap_t;
@@ -468,7 +471,6 @@ pt_entry_t *pmap_pte(const pmap_t pmap, vm_offset_t addr);
 #define pmap_resident_count(pmap)	((pmap)->stats.resident_count)
 #define pmap_phys_address(frame)	((vm_offset_t) (intel_ptob(frame)))
 #define pmap_phys_to_frame(phys)	((int) (intel_btop(phys)))
-#define	pmap_copy(dst_pmap,src_pmap,dst_addr,len,src_addr)
 #define	pmap_attribute(pmap,addr,size,attr,value) \
 					(KERN_INVALID_ADDRESS)
 
@@ -482,11 +484,50 @@ extern void pmap_bootstrap(void);
 
 extern void pmap_unmap_page_zero (void);
 
+/*
+ *  Program the page attribute table of the current processor.
+ */
+extern void pmap_pat_init(void);
+
+/*
+ *  Physical ranges of device memory mapped write-combining on behalf
+ *  of one user, e.g. a device pager.
+ */
+#define	PMAP_WC_RANGES	8
+
+struct pmap_wc_range {
+	phys_addr_t	start;
+	phys_addr_t	end;
+};
+
+struct pmap_wc_set {
+	queue_chain_t		link;		/* sets holding ranges */
+	boolean_t		registered;	/* on the list of sets */
+	int			nranges;
+	struct pmap_wc_range	ranges[PMAP_WC_RANGES];
+};
+
+extern void pmap_wc_set_init(struct pmap_wc_set *set);
+
+/*
+ *  Map device memory in [start, end) write-combining, until set is
+ *  released.
+ */
+extern boolean_t pmap_write_combine(struct pmap_wc_set *set,
+				    phys_addr_t start, phys_addr_t end);
+
+extern void pmap_write_combine_release(struct pmap_wc_set *set);
+
 /*
  *  pmap_zero_page zeros the specified (machine independent) page.
  */
 extern void pmap_zero_page (phys_addr_t);
 
+/*
+ *  pmap_is_zero_page tells whether the specified page is filled with zeroes.
+ */
+extern boolean_t pmap_is_zero_page (phys_addr_t);
+
 /*
  *  pmap_copy_page copies the specified (machine independent) pages.
  */
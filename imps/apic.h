@@ -137,6 +137,18 @@ extern volatile ApicLocalUnit* lapic;
 
 #endif
 
+/* Spurious vector register.  */
+#define LAPIC_ENABLE			0x100
+
+/* Local vector table entries.  */
+#define LAPIC_LVT_VECTOR		0xff
+#define LAPIC_LVT_NMI			0x400	/* delivery mode */
+#define LAPIC_LVT_MASKED		0x10000
+#define LAPIC_LVT_PERIODIC		0x20000	/* timer mode */
+
+/* Timer divide configuration register.  */
+#define LAPIC_TIMER_DIV_16		0x3
+
 #define APIC_IO_UNIT_ID			0x00
 #define APIC_IO_VERSION			0x01
 #define APIC_IO_REDIR_LOW(int_pin)	(0x10+(int_pin)*2)
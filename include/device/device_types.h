@@ -64,6 +64,14 @@ typedef unsigned int	dev_mode_t;
 #define	D_NODELAY	0x4		/* no delay on open */
 #define	D_NOWAIT	0x8		/* do not wait if data not available */
 
+/*
+ * Flag ored into the protection given to device_map, to map the
+ * device memory write-combining where the processor allows it,
+ * e.g. for a frame buffer.  The first device_map of a device
+ * decides how it is mapped.
+ */
+#define	D_MAP_WRITE_COMBINE	0x100
+
 /*
  * IO buffer - out-of-line array of characters.
  */
@@ -115,6 +123,16 @@ typedef int		dev_status_data_t[DEV_STATUS_MAX];
 #	define	DEV_GET_RECORDS_DEVICE_RECORDS	0	/* 0 if unknown */
 #	define	DEV_GET_RECORDS_RECORD_SIZE	1	/* 1 if sequential */
 #define	DEV_GET_RECORDS_COUNT		2
+/* completion statistics: processor count, then one record per processor */
+#define	DEV_GET_IO_STATS		2
+#	define	DEV_GET_IO_STATS_NCPUS		0
+#	define	DEV_GET_IO_STATS_COMPLETIONS	0	/* record indexes */
+#	define	DEV_GET_IO_STATS_REMOTE		1
+#	define	DEV_GET_IO_STATS_AVG_CYCLES	2
+#	define	DEV_GET_IO_STATS_MAX_CYCLES	3
+#	define	DEV_GET_IO_STATS_RECORD_SIZE	4
+#define	DEV_GET_IO_STATS_COUNT(ncpus)	\
+	(1 + (ncpus) * DEV_GET_IO_STATS_RECORD_SIZE)
 
 /*
  * Device error codes
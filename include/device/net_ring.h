@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ *	Shared packet rings.
+ *
+ *	A packet ring device exports, through device_map, an area
+ *	holding a receive ring, a transmit ring and a set of packet
+ *	buffers.  Each ring slot owns one buffer, designated by its
+ *	index in the buffer array.
+ *
+ *	The kernel produces into the receive ring: it fills the slot
+ *	at rx.head and advances rx.head.  The user consumes from
+ *	rx.tail up to rx.head and advances rx.tail.  Before advancing
+ *	rx.tail, the user may exchange the buffer of a slot with one
+ *	it owns, to keep the packet data without copying it.
+ *
+ *	The user produces into the transmit ring: it fills the slot
+ *	at tx.head (buffer and length) and advances tx.head, then
+ *	rings the doorbell with device_set_status (NET_RING_KICK).
+ *	The kernel consumes from tx.tail and advances tx.tail.
+ *
+ *	Ring indices increase freely; the slot of index I is
+ *	I % NET_RING_SLOTS.  A device_read on the device completes
+ *	as soon as the receive ring is not empty, so that the user
+ *	can wait for packets on the reply port instead of polling.
+ */
+
+#ifndef	_DEVICE_NET_RING_H_
+#define	_DEVICE_NET_RING_H_
+
+#define	NET_RING_MAGIC		0x4e52494e	/* "NRIN" */
+#define	NET_RING_VERSION	1
+
+#define	NET_RING_SLOTS		256		/* per ring, power of 2 */
+#define	NET_RING_BUF_SIZE	2048		/* bytes per buffer */
+#define	NET_RING_NBUFS		(3 * NET_RING_SLOTS)
+
+struct net_ring_slot {
+	unsigned int	buf;		/* index of the buffer */
+	unsigned int	length;		/* bytes of packet data */
+};
+
+struct net_ring {
+	volatile unsigned int	head;	/* next slot to produce */
+	volatile unsigned int	tail;	/* next slot to consume */
+	struct net_ring_slot	slot[NET_RING_SLOTS];
+};
+
+struct net_ring_area {
+	unsigned int	magic;
+	unsigned int	version;
+	unsigned int	nslots;		/* slots per ring */
+	unsigned int	buf_size;	/* bytes per buffer */
+	unsigned int	nbufs;		/* number of buffers */
+	unsigned int	buf_offset;	/* offset of buffer 0 in the area */
+	unsigned int	size;		/* size of the whole area */
+	unsigned int	drops;		/* packets dropped, receive ring full */
+	struct net_ring	rx;
+	struct net_ring	tx;
+};
+
+/*
+ * Buffers owned by the user at open time: those not initially
+ * assigned to a ring slot.
+ */
+#define	NET_RING_USER_BUF_FIRST	(2 * NET_RING_SLOTS)
+
+/*
+ * device_set_status: process the transmit ring.
+ */
+#define	NET_RING_KICK		(('r'<<16) + 1)
+
+/*
+ * device_get_status: ring geometry, as the first fields of
+ * struct net_ring_area.
+ */
+#define	NET_RING_STATUS		(('r'<<16) + 2)
+#define	NET_RING_STATUS_COUNT	7
+
+#endif	/* _DEVICE_NET_RING_H_ */
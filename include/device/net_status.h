@@ -125,6 +125,7 @@ typedef filter_t	*filter_array_t;
 /*  flags  */
 #define NETF_IN		0x1
 #define NETF_OUT	0x2
+#define NETF_BATCH	0x4	/* coalesce packets, see net_rcv_batch_msg */
 
 /*  binary operators  */
 #define NETF_NOP	(0<<NETF_NBPA)
@@ -196,6 +197,44 @@ struct net_rcv_msg {
 typedef struct net_rcv_msg 	*net_rcv_msg_t;
 #define	net_rcv_msg_packet_count packet_type.msgt_number
 
+/*
+ * Batched receive message format.
+ *
+ * Filters with the NETF_BATCH flag get several packets per message.
+ * For BPF filters, the jt and jf fields of the first instruction give
+ * the maximum number of packets per message and the maximum time, in
+ * milliseconds, the first packet of a message may be held back waiting
+ * for more.  Zero selects the defaults.  Native NETF filters always use
+ * the defaults.  A delay of zero sends the message as soon as the
+ * kernel has no more packets queued for the interface.
+ *
+ * Each packet is described by a net_rcv_batch_desc giving the position
+ * of its hardware header and of its data (starting with the
+ * packet_header) within the data array of the message.
+ */
+#define	NET_RCV_BATCH_MAX	32
+#define	NET_RCV_BATCH_DATA_MAX	65536
+
+#define	NET_RCV_BATCH_MSG_ID	2998	/* in device.defs reply range */
+
+struct net_rcv_batch_desc {
+	unsigned int	header_offset;
+	unsigned int	header_size;
+	unsigned int	packet_offset;
+	unsigned int	packet_size;
+};
+
+struct net_rcv_batch_msg {
+	mach_msg_header_t msg_hdr;
+	mach_msg_type_t	count_type;
+	unsigned int	count;		/* number of packets */
+	mach_msg_type_t	desc_type;
+	struct net_rcv_batch_desc desc[NET_RCV_BATCH_MAX];
+	mach_msg_type_long_t data_type;
+	char		data[NET_RCV_BATCH_DATA_MAX];
+};
+typedef struct net_rcv_batch_msg *net_rcv_batch_msg_t;
+
 
 
 #endif	/* _DEVICE_NET_STATUS_H_ */
@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ *	System-wide sampling profiler.
+ *
+ *	The profiler device exports, through device_map, an area
+ *	holding one sample ring per processor.  Sampling is started
+ *	with device_set_status (PROF_START), giving an event and a
+ *	period, and stopped with device_set_status (PROF_STOP).
+ *
+ *	Each sample holds the call stack of the interrupted thread,
+ *	innermost frame first: the kernel frames if the thread was
+ *	in the kernel, then the user frames.  A profiling tool turns
+ *	a sample into a line of the folded stack format used to draw
+ *	flame graphs, "name;outermost;...;innermost 1", by resolving
+ *	the frames against the kernel and task symbol tables.
+ *
+ *	The kernel produces into a ring: it fills the slot at head
+ *	and advances head.  Samples may be produced out of order, so a
+ *	slot is only complete once its seq field holds its ring index
+ *	plus one.  The user consumes from tail up to the first slot
+ *	not complete, and advances tail.  Ring indices increase
+ *	freely; the slot of index I is I % PROF_RING_SLOTS.  Samples
+ *	that find their ring full are dropped, and counted.
+ */
+
+#ifndef	_DEVICE_PROF_RING_H_
+#define	_DEVICE_PROF_RING_H_
+
+#define	PROF_MAGIC		0x464f5250	/* "PROF" */
+#define	PROF_VERSION		1
+
+#define	PROF_RING_SLOTS		2048		/* per ring, power of 2 */
+#define	PROF_MAX_FRAMES		48
+#define	PROF_NAME_SIZE		32
+
+/*
+ * Sampling events.  The hardware events are counted by the
+ * architectural performance counters, and the period is a number
+ * of events.  The timer event uses the local APIC timer, for
+ * processors or virtual machines without usable counters, and
+ * the period is in microseconds.
+ */
+#define	PROF_EVENT_TIMER	0
+#define	PROF_EVENT_CYCLES	1	/* unhalted core cycles */
+#define	PROF_EVENT_LLC_MISSES	2	/* last level cache misses */
+#define	PROF_EVENT_BRANCH_MISSES 3	/* mispredicted branches */
+#define	PROF_NEVENTS		4
+
+struct prof_sample {
+	volatile unsigned int	seq;	/* ring index + 1, once complete */
+	unsigned short	event;
+	unsigned short	cpu;
+	unsigned long long tsc;		/* time stamp counter */
+	unsigned int	task;		/* task identifier */
+	unsigned int	thread;		/* thread identifier */
+	unsigned short	nkframes;	/* kernel frames */
+	unsigned short	nuframes;	/* user frames, after them */
+	unsigned int	reserved;
+	char		name[PROF_NAME_SIZE];	/* task name */
+	unsigned int	frames[PROF_MAX_FRAMES];
+};
+
+struct prof_ring {
+	volatile unsigned int	head;	/* next slot to produce */
+	volatile unsigned int	tail;	/* next slot to consume */
+	unsigned int	drops;		/* samples dropped, ring full */
+	unsigned int	reserved[13];
+	struct prof_sample	slot[PROF_RING_SLOTS];
+};
+
+struct prof_area {
+	unsigned int	magic;
+	unsigned int	version;
+	unsigned int	ncpus;		/* number of rings */
+	unsigned int	nslots;		/* slots per ring */
+	unsigned int	ring_offset;	/* offset of ring 0 in the area */
+	unsigned int	ring_size;	/* distance between two rings */
+	unsigned int	size;		/* size of the whole area */
+	unsigned int	events;		/* mask of the available events */
+	unsigned int	event;		/* current event */
+	unsigned int	period;		/* current period */
+	volatile unsigned int running;	/* sampling is started */
+};
+
+/*
+ * device_set_status: start sampling.  data[0] is the event,
+ * data[1] the period.
+ */
+#define	PROF_START		(('p'<<16) + 1)
+#define	PROF_START_COUNT	2
+
+/*
+ * device_set_status: stop sampling.
+ */
+#define	PROF_STOP		(('p'<<16) + 2)
+
+/*
+ * device_get_status: profiler state, as the first fields of
+ * struct prof_area.
+ */
+#define	PROF_STATUS		(('p'<<16) + 3)
+#define	PROF_STATUS_COUNT	11
+
+#endif	/* _DEVICE_PROF_RING_H_ */
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+/*
+ *	Kernel event tracing.
+ *
+ *	The trace device exports, through device_map, a read-only area
+ *	holding one record ring per processor.  The events to record
+ *	are chosen with device_set_status (TRACE_SET_EVENTS), giving a
+ *	mask of (1 << event type); an empty mask stops tracing.
+ *
+ *	The kernel produces into a ring without ever waiting for the
+ *	consumer: it fills the slot at head and advances head, writing
+ *	over the oldest records.  A slot holds a complete record once
+ *	its seq field holds its ring index plus one.  The consumer keeps
+ *	its own position: it reads records from there up to head, and
+ *	keeps a record only if its seq field is right both before and
+ *	after the record is copied.  If head moved more than nslots past
+ *	its position, the records in between were lost.  Ring indices
+ *	increase freely; the slot of index I is I % TRACE_RING_SLOTS.
+ */
+
+#ifndef	_DEVICE_TRACE_RING_H_
+#define	_DEVICE_TRACE_RING_H_
+
+#define	TRACE_MAGIC		0x45435254	/* "TRCE" */
+#define	TRACE_VERSION		1
+
+#define	TRACE_RING_SLOTS	4096		/* per ring, power of 2 */
+
+/*
+ * Event types, and their arguments.
+ */
+#define	TRACE_THREAD_INVOKE	0	/* old thread, new thread */
+#define	TRACE_THREAD_SETRUN	1	/* thread, may preempt */
+#define	TRACE_IPC_SEND		2	/* port, message id, size */
+#define	TRACE_IPC_RECEIVE	3	/* port, message id, size */
+#define	TRACE_VM_FAULT		4	/* map, address, fault type */
+#define	TRACE_IO_START		5	/* request */
+#define	TRACE_IO_DONE		6	/* request, operation, count */
+#define	TRACE_NEVENTS		7
+
+struct trace_record {
+	volatile unsigned int	seq;	/* ring index + 1, once complete */
+	unsigned short	event;
+	unsigned short	cpu;
+	unsigned long long tsc;		/* time stamp counter */
+	unsigned long long thread;	/* current thread */
+	unsigned long long arg[3];
+};
+
+struct trace_ring {
+	volatile unsigned int	head;	/* next slot to produce */
+	unsigned int	reserved[15];
+	struct trace_record	slot[TRACE_RING_SLOTS];
+};
+
+struct trace_area {
+	unsigned int	magic;
+	unsigned int	version;
+	unsigned int	ncpus;		/* number of rings */
+	unsigned int	nslots;		/* slots per ring */
+	unsigned int	ring_offset;	/* offset of ring 0 in the area */
+	unsigned int	ring_size;	/* distance between two rings */
+	unsigned int	size;		/* size of the whole area */
+	volatile unsigned int events;	/* mask of the recorded events */
+};
+
+/*
+ * device_set_status: record the events of the mask data[0].
+ */
+#define	TRACE_SET_EVENTS	(('t'<<16) + 1)
+#define	TRACE_SET_EVENTS_COUNT	1
+
+/*
+ * device_get_status: tracer state, as struct trace_area.
+ */
+#define	TRACE_STATUS		(('t'<<16) + 2)
+#define	TRACE_STATUS_COUNT	8
+
+#endif	/* _DEVICE_TRACE_RING_H_ */
@@ -56,6 +56,13 @@ typedef char	kernel_boot_info_t[KERNEL_BOOT_INFO_MAX];
 #define HOST_PROCESSOR_SLOTS	2	/* processor slot numbers */
 #define HOST_SCHED_INFO		3	/* scheduling info */
 #define	HOST_LOAD_INFO		4	/* avenrun/mach_factor info */
+#define	HOST_IPC_INFO		5	/* mach_msg_trap path counters */
+#define	HOST_VM_SHADOW_INFO	6	/* shadow chain statistics */
+#define	HOST_VM_FRAG_INFO	7	/* physical memory fragmentation */
+#define	HOST_VM_NUMA_INFO	8	/* NUMA nodes */
+#define	HOST_VM_MERGE_INFO	9	/* zero page merging */
+#define	HOST_VM_ZCACHE_INFO	10	/* compressed page cache */
+#define	HOST_VM_FAULT_WAIT_INFO	11	/* threads blocked in page faults */
 
 struct host_basic_info {
 	integer_t	max_cpus;	/* max number of cpus possible */
@@ -90,4 +97,166 @@ typedef struct host_load_info	*host_load_info_t;
 #define	HOST_LOAD_INFO_COUNT \
 		(sizeof(host_load_info_data_t)/sizeof(integer_t))
 
+/*
+ *	Paths taken by the send and receive calls of mach_msg_trap,
+ *	and outcome of the thread handoffs they try, summed over all
+ *	processors.  The counters wrap.
+ */
+struct host_ipc_info {
+	integer_t	trap_block_fast;	/* handoff, fast receive */
+	integer_t	trap_block_slow;	/* handoff, receiver continuation */
+	integer_t	trap_block_exc;		/* handoff, exception reply */
+	integer_t	trap_slow_send;		/* no handoff, message queued */
+	integer_t	handoff_hits;
+	integer_t	handoff_remote;		/* receivers waited for while
+						   blocking on another
+						   processor */
+	integer_t	handoff_misses;
+};
+
+typedef struct host_ipc_info	host_ipc_info_data_t;
+typedef struct host_ipc_info	*host_ipc_info_t;
+#define	HOST_IPC_INFO_COUNT \
+		(sizeof(host_ipc_info_data_t)/sizeof(integer_t))
+
+/*
+ *	Shadow chains: how far down the chain page faults found their
+ *	page, and the work of the thread collapsing chains deeper than
+ *	depth_limit.  The counters wrap.
+ */
+#define	HOST_VM_SHADOW_DEPTHS	8
+
+struct host_vm_shadow_info {
+	integer_t	fault_depth[HOST_VM_SHADOW_DEPTHS];
+					/* faults that walked N objects,
+					   the last for N or more */
+	integer_t	depth_limit;
+	integer_t	collapse_queued;	/* chains queued for collapse */
+	integer_t	collapse_dropped;	/* not queued, queue full */
+	integer_t	collapse_walks;		/* chains walked */
+	integer_t	collapses;		/* objects merged, by anyone */
+	integer_t	bypasses;		/* objects skipped, by anyone */
+};
+
+typedef struct host_vm_shadow_info	host_vm_shadow_info_data_t;
+typedef struct host_vm_shadow_info	*host_vm_shadow_info_t;
+#define	HOST_VM_SHADOW_INFO_COUNT \
+		(sizeof(host_vm_shadow_info_data_t)/sizeof(integer_t))
+
+/*
+ *	Physical memory fragmentation: the free blocks of 2^N pages of
+ *	each segment, and the work of memory compaction, which moves
+ *	pages to make contiguous allocations succeed.
+ *
+ *	The fragmentation index of order N is -1 if a block of 2^N pages
+ *	is free.  Otherwise, it tells whether allocating one fails for
+ *	lack of memory, close to 0, or because of fragmentation, close
+ *	to 1000.  The counters wrap.
+ */
+#define	HOST_VM_FRAG_SEGS	4
+#define	HOST_VM_FRAG_ORDERS	11
+
+struct host_vm_frag_seg {
+	integer_t	free_pages;
+	integer_t	free_blocks[HOST_VM_FRAG_ORDERS];
+	integer_t	frag_index[HOST_VM_FRAG_ORDERS];
+};
+
+struct host_vm_frag_info {
+	integer_t	nsegs;
+	struct host_vm_frag_seg seg[HOST_VM_FRAG_SEGS];
+					/* lowest priority first:
+					   DMA, DMA32, DIRECTMAP, HIGHMEM */
+	integer_t	compact_stalls;		/* compactions by allocating
+						   threads */
+	integer_t	compact_success;	/* blocks emptied */
+	integer_t	compact_fail;		/* blocks not emptied */
+	integer_t	compact_migrated;	/* pages moved */
+};
+
+typedef struct host_vm_frag_info	host_vm_frag_info_data_t;
+typedef struct host_vm_frag_info	*host_vm_frag_info_t;
+#define	HOST_VM_FRAG_INFO_COUNT \
+		(sizeof(host_vm_frag_info_data_t)/sizeof(integer_t))
+
+/*
+ *	NUMA nodes: their free pages, the allocations served by the
+ *	preferred node or by another one, and the relative distances
+ *	between nodes, 10 meaning local.  The counters wrap.
+ */
+#define	HOST_VM_NUMA_NODES	8
+
+struct host_vm_numa_info {
+	integer_t	nnodes;
+	integer_t	free_pages[HOST_VM_NUMA_NODES];
+	integer_t	local_allocs[HOST_VM_NUMA_NODES];
+	integer_t	remote_allocs[HOST_VM_NUMA_NODES];
+	integer_t	distances[HOST_VM_NUMA_NODES][HOST_VM_NUMA_NODES];
+};
+
+typedef struct host_vm_numa_info	host_vm_numa_info_data_t;
+typedef struct host_vm_numa_info	*host_vm_numa_info_t;
+#define	HOST_VM_NUMA_INFO_COUNT \
+		(sizeof(host_vm_numa_info_data_t)/sizeof(integer_t))
+
+/*
+ *	Zero page merging: the current scan rate, scan_pages physical
+ *	pages every scan_interval milliseconds, 0 pages meaning merging
+ *	is disabled, and the pages scanned and merged so far.  The
+ *	counters wrap.
+ */
+struct host_vm_merge_info {
+	integer_t	scan_pages;
+	integer_t	scan_interval;
+	integer_t	full_scans;	/* scans of the whole memory */
+	integer_t	scanned;
+	integer_t	merged;
+};
+
+typedef struct host_vm_merge_info	host_vm_merge_info_data_t;
+typedef struct host_vm_merge_info	*host_vm_merge_info_t;
+#define	HOST_VM_MERGE_INFO_COUNT \
+		(sizeof(host_vm_merge_info_data_t)/sizeof(integer_t))
+
+/*
+ *	Compressed page cache: its size limit and the memory it uses,
+ *	in pages, the number of pages it holds, and the pages stored,
+ *	loaded back, rejected as incompressible, paged out because the
+ *	cache was full, and discarded with their object.  The counters
+ *	wrap.
+ */
+struct host_vm_zcache_info {
+	integer_t	max_pages;
+	integer_t	pool_pages;
+	integer_t	nr_pages;
+	integer_t	stores;
+	integer_t	loads;
+	integer_t	rejects;
+	integer_t	overflows;
+	integer_t	discards;
+};
+
+typedef struct host_vm_zcache_info	host_vm_zcache_info_data_t;
+typedef struct host_vm_zcache_info	*host_vm_zcache_info_t;
+#define	HOST_VM_ZCACHE_INFO_COUNT \
+		(sizeof(host_vm_zcache_info_data_t)/sizeof(integer_t))
+
+/*
+ *	Threads blocked in page faults, waiting for a page being brought
+ *	in or for its pager.  User faults wait with a continuation and
+ *	don't hold a kernel stack.  Faults taken in kernel mode keep
+ *	theirs.  The wait counters wrap.
+ */
+struct host_vm_fault_wait_info {
+	integer_t	blocked_stackless;	/* blocked now, without stack */
+	integer_t	blocked_stack;		/* blocked now, with a stack */
+	integer_t	waits_stackless;
+	integer_t	waits_stack;
+};
+
+typedef struct host_vm_fault_wait_info	host_vm_fault_wait_info_data_t;
+typedef struct host_vm_fault_wait_info	*host_vm_fault_wait_info_t;
+#define	HOST_VM_FAULT_WAIT_INFO_COUNT \
+		(sizeof(host_vm_fault_wait_info_data_t)/sizeof(integer_t))
+
 #endif	/* _MACH_HOST_INFO_H_ */
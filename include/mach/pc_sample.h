@@ -33,6 +33,7 @@ typedef natural_t	sampled_pc_flavor_t;
 
 
 #define SAMPLED_PC_PERIODIC			0x1	/* default */
+#define SAMPLED_PC_PROFILER			0x2	/* system profiler */
 
 
 #define SAMPLED_PC_VM_ZFILL_FAULTS		0x10
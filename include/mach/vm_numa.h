@@ -0,0 +1,33 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ */
+
+#ifndef _MACH_VM_NUMA_H_
+#define _MACH_VM_NUMA_H_
+
+/*
+ * NUMA memory policies, deciding which node the pages of a task are
+ * allocated from first. Other nodes are used, nearest first, once the
+ * chosen node has no free pages.
+ */
+typedef int vm_numa_policy_t;
+
+#define VM_NUMA_POLICY_LOCAL      0   /* node of the faulting processor */
+#define VM_NUMA_POLICY_PREFERRED  1   /* the given node */
+#define VM_NUMA_POLICY_INTERLEAVE 2   /* all nodes in turn */
+
+#endif /* _MACH_VM_NUMA_H_ */
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ */
+
+#ifndef	_MACH_DEBUG_BOOT_TRACE_H_
+#define _MACH_DEBUG_BOOT_TRACE_H_
+
+/*
+ *	Remember to update the mig type definitions
+ *	in mach_debug_types.defs when adding/removing fields.
+ */
+
+#define BOOT_TRACE_NAME_MAX	24
+
+/*
+ *	Kinds of boot tracepoints.  A phase of the kernel startup
+ *	is traced by a begin and an end event of the same name, on
+ *	the same processor.
+ */
+#define BOOT_TRACE_BEGIN	0
+#define BOOT_TRACE_END		1
+
+typedef struct boot_trace_event {
+	unsigned long long	bte_cycles;	/* time stamp counter */
+	unsigned int		bte_ticks;	/* clock ticks, 0 before
+						   the clock runs */
+	unsigned short		bte_cpu;
+	unsigned short		bte_kind;	/* BOOT_TRACE_BEGIN or END */
+	char			bte_name[BOOT_TRACE_NAME_MAX];
+} boot_trace_event_t;
+
+typedef boot_trace_event_t *boot_trace_event_array_t;
+
+#endif	/* _MACH_DEBUG_BOOT_TRACE_H_ */
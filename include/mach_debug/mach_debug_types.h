@@ -34,6 +34,7 @@
 #include <mach_debug/vm_info.h>
 #include <mach_debug/slab_info.h>
 #include <mach_debug/hash_info.h>
+#include <mach_debug/boot_trace.h>
 
 typedef	char	symtab_name_t[32];
 
@@ -87,6 +87,14 @@ ipc_entry_alloc(
 		return KERN_RESOURCE_SHORTAGE;
 	}
 
+	/*
+	 *	Initialize the entry before it is published, for
+	 *	lockless lookups.
+	 */
+	entry->ie_bits = 0;
+	entry->ie_object = IO_NULL;
+	entry->ie_request = 0;
+
 	kr = rdxtree_insert_alloc(&space->is_map, entry, &key);
 	if (kr) {
 		ie_free(entry);
@@ -94,9 +102,6 @@ ipc_entry_alloc(
 	}
 	space->is_size += 1;
 
-	entry->ie_bits = 0;
-	entry->ie_object = IO_NULL;
-	entry->ie_request = 0;
 	entry->ie_name = (mach_port_t) key;
 
 	*entryp = entry;
@@ -104,6 +109,26 @@ ipc_entry_alloc(
 	return KERN_SUCCESS;
 }
 
+static void
+ipc_entry_free_deferred(struct llsync_work *work)
+{
+	ie_free(structof(work, struct ipc_entry, ie_work));
+}
+
+/*
+ *	Routine:	ipc_entry_free
+ *	Purpose:
+ *		Frees an entry removed from its space.  Lockless
+ *		lookups may still be looking at it, so the memory
+ *		is only released after they are done.
+ */
+
+void
+ipc_entry_free(ipc_entry_t entry)
+{
+	llsync_defer(&entry->ie_work, ipc_entry_free_deferred);
+}
+
 /*
  *	Routine:	ipc_entry_alloc_name
  *	Purpose:
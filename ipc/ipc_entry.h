@@ -41,6 +41,7 @@
 #include <mach/mach_types.h>
 #include <mach/port.h>
 #include <mach/kern_return.h>
+#include <kern/llsync.h>
 #include <kern/slab.h>
 #include <ipc/port.h>
 #include <ipc/ipc_table.h>
@@ -62,6 +63,7 @@ typedef struct ipc_entry {
 		struct ipc_entry *next_free;
 		/*XXX ipc_port_request_index_t request;*/
 		unsigned int request;
+		struct llsync_work work;	/* deferred free */
 	} index;
 } *ipc_entry_t;
 
@@ -69,6 +71,7 @@ typedef struct ipc_entry {
 
 #define	ie_request	index.request
 #define	ie_next_free	index.next_free
+#define	ie_work		index.work
 
 #define	IE_BITS_UREFS_MASK	0x0000ffff	/* 16 bits of user-reference */
 #define	IE_BITS_UREFS(bits)	((bits) & IE_BITS_UREFS_MASK)
@@ -96,6 +99,9 @@ extern struct kmem_cache ipc_entry_cache;
 #define ie_alloc()	((ipc_entry_t) kmem_cache_alloc(&ipc_entry_cache))
 #define	ie_free(e)	kmem_cache_free(&ipc_entry_cache, (vm_offset_t) (e))
 
+extern void
+ipc_entry_free(ipc_entry_t entry);
+
 extern kern_return_t
 ipc_entry_alloc(ipc_space_t space, mach_port_t *namep, ipc_entry_t *entryp);
 
@@ -42,6 +42,7 @@
 #include <kern/sched_prim.h>
 #include <kern/ipc_sched.h>
 #include <kern/ipc_kobject.h>
+#include <kern/trace.h>
 #include <ipc/ipc_mqueue.h>
 #include <ipc/ipc_thread.h>
 #include <ipc/ipc_kmsg.h>
@@ -181,6 +182,9 @@ ipc_mqueue_send(
 	port = (ipc_port_t) kmsg->ikm_header.msgh_remote_port;
 	assert(IP_VALID(port));
 
+	TRACE(TRACE_IPC_SEND, port, kmsg->ikm_header.msgh_id,
+	      kmsg->ikm_header.msgh_size);
+
 	ip_lock(port);
 
 	if (port->ip_receiver == ipc_space_kernel) {
@@ -408,33 +412,53 @@ ipc_mqueue_copyin(
 	ipc_object_t object;
 	ipc_mqueue_t mqueue;
 
-	is_read_lock(space);
-	if (!space->is_active) {
-		is_read_unlock(space);
-		return MACH_RCV_INVALID_NAME;
-	}
+	/*
+	 *	Receive rights and port sets can be found without
+	 *	the space lock.  Fall back on the locked lookup if
+	 *	the name denotes anything else, or is changing.
+	 */
+
+	object = ipc_object_lookup_lockless(space, name,
+					    MACH_PORT_TYPE_RECEIVE |
+					    MACH_PORT_TYPE_PORT_SET);
+	if (object != IO_NULL) {
+		bits = (io_otype(object) == IOT_PORT) ?
+			MACH_PORT_TYPE_RECEIVE : MACH_PORT_TYPE_PORT_SET;
+	} else {
+		is_read_lock(space);
+		if (!space->is_active) {
+			is_read_unlock(space);
+			return MACH_RCV_INVALID_NAME;
+		}
+
+		entry = ipc_entry_lookup(space, name);
+		if (entry == IE_NULL) {
+			is_read_unlock(space);
+			return MACH_RCV_INVALID_NAME;
+		}
+
+		bits = entry->ie_bits;
+		object = entry->ie_object;
 
-	entry = ipc_entry_lookup(space, name);
-	if (entry == IE_NULL) {
+		if ((bits & (MACH_PORT_TYPE_RECEIVE |
+			     MACH_PORT_TYPE_PORT_SET)) == 0) {
+			is_read_unlock(space);
+			return MACH_RCV_INVALID_NAME;
+		}
+
+		assert(object != IO_NULL);
+		io_lock(object);
 		is_read_unlock(space);
-		return MACH_RCV_INVALID_NAME;
 	}
 
-	bits = entry->ie_bits;
-	object = entry->ie_object;
-
 	if (bits & MACH_PORT_TYPE_RECEIVE) {
 		ipc_port_t port;
 		ipc_pset_t pset;
 
 		port = (ipc_port_t) object;
-		assert(port != IP_NULL);
-
-		ip_lock(port);
 		assert(ip_active(port));
 		assert(port->ip_receiver_name == name);
 		assert(port->ip_receiver == space);
-		is_read_unlock(space);
 
 		pset = port->ip_pset;
 		if (pset != IPS_NULL) {
@@ -451,21 +475,14 @@ ipc_mqueue_copyin(
 		}
 
 		mqueue = &port->ip_messages;
-	} else if (bits & MACH_PORT_TYPE_PORT_SET) {
+	} else {
 		ipc_pset_t pset;
 
 		pset = (ipc_pset_t) object;
-		assert(pset != IPS_NULL);
-
-		ips_lock(pset);
 		assert(ips_active(pset));
 		assert(pset->ips_local_name == name);
-		is_read_unlock(space);
 
 		mqueue = &pset->ips_messages;
-	} else {
-		is_read_unlock(space);
-		return MACH_RCV_INVALID_NAME;
 	}
 
 	/*
@@ -688,6 +705,9 @@ ipc_mqueue_receive(
 
 	current_task()->messages_received++;
 
+	TRACE(TRACE_IPC_RECEIVE, port, kmsg->ikm_header.msgh_id,
+	      kmsg->ikm_header.msgh_size);
+
 	*kmsgp = kmsg;
 	*seqnop = seqno;
 	return MACH_MSG_SUCCESS;
@@ -45,6 +45,7 @@
 #include <ipc/ipc_notify.h>
 #include <ipc/ipc_pset.h>
 #include <kern/debug.h>
+#include <kern/llsync.h>
 #include <kern/printf.h>
 #include <kern/slab.h>
 
@@ -57,6 +58,30 @@ struct kmem_cache ipc_object_caches[IOT_NUMBER];
 
 
 
+/*
+ *	Routine:	ipc_object_free
+ *	Purpose:
+ *		Free an object once it has lost its last reference.
+ *		The memory is reclaimed after an llsync grace period,
+ *		since lockless lookups may still be about to lock it.
+ */
+
+static void
+ipc_object_free_deferred(struct llsync_work *work)
+{
+	ipc_object_t object;
+
+	object = structof(work, struct ipc_object, io_work);
+	io_free(io_otype(object), object);
+}
+
+void
+ipc_object_free(
+	ipc_object_t	object)
+{
+	llsync_defer(&object->io_work, ipc_object_free_deferred);
+}
+
 /*
  *	Routine:	ipc_object_reference
  *	Purpose:
@@ -89,6 +114,75 @@ ipc_object_release(
 	io_check_unlock(object);
 }
 
+/*
+ *	Routine:	ipc_object_lookup_lockless
+ *	Purpose:
+ *		Look up a receive right or port set in a space,
+ *		without locking the space.  TYPE says which of
+ *		MACH_PORT_TYPE_RECEIVE and MACH_PORT_TYPE_PORT_SET
+ *		are acceptable.
+ *
+ *		Both kinds of object record the name they have in
+ *		their space, so what the entry said can be checked
+ *		again once the object is locked.  Entries and objects
+ *		are only freed after an llsync grace period, so they
+ *		can be safely locked even if they went away.
+ *	Conditions:
+ *		Nothing locked.  If successful, the object is
+ *		returned locked and active.  The caller doesn't
+ *		get a ref.  IO_NULL means the caller should use
+ *		the locked lookup instead.
+ */
+
+ipc_object_t
+ipc_object_lookup_lockless(
+	ipc_space_t		space,
+	mach_port_t		name,
+	mach_port_type_t	type)
+{
+	ipc_entry_t entry;
+	ipc_object_t object;
+
+	llsync_read_enter();
+
+	entry = ipc_entry_lookup_lockless(space, name);
+	if ((entry == IE_NULL) || ((entry->ie_bits & type) == 0))
+		goto fail;
+
+	object = llsync_read_ptr(entry->ie_object);
+	if (!IO_VALID(object))
+		goto fail;
+
+	io_lock(object);
+	if (!io_active(object) || !space->is_active)
+		goto fail_unlock;
+
+	if (io_otype(object) == IOT_PORT) {
+		ipc_port_t port = (ipc_port_t) object;
+
+		if (!(type & MACH_PORT_TYPE_RECEIVE) ||
+		    (port->ip_receiver != space) ||
+		    (port->ip_receiver_name != name))
+			goto fail_unlock;
+	} else {
+		ipc_pset_t pset = (ipc_pset_t) object;
+
+		if (!(type & MACH_PORT_TYPE_PORT_SET) ||
+		    (entry->ie_object != object) ||
+		    (pset->ips_local_name != name))
+			goto fail_unlock;
+	}
+
+	llsync_read_exit();
+	return object;
+
+    fail_unlock:
+	io_unlock(object);
+    fail:
+	llsync_read_exit();
+	return IO_NULL;
+}
+
 /*
  *	Routine:	ipc_object_translate
  *	Purpose:
@@ -114,6 +208,16 @@ ipc_object_translate(
 	ipc_object_t object;
 	kern_return_t kr;
 
+	if ((right == MACH_PORT_RIGHT_RECEIVE) ||
+	    (right == MACH_PORT_RIGHT_PORT_SET)) {
+		object = ipc_object_lookup_lockless(space, name,
+						    MACH_PORT_TYPE(right));
+		if (object != IO_NULL) {
+			*objectp = object;
+			return KERN_SUCCESS;
+		}
+	}
+
 	kr = ipc_right_lookup_read(space, name, &entry);
 	if (kr != KERN_SUCCESS)
 		return kr;
@@ -264,11 +368,12 @@ ipc_object_alloc(
 		return kr;
 	}
 
-	entry->ie_bits |= type | urefs;
-	entry->ie_object = object;
-
+	/* lockless lookups may find the object as soon as it is entered */
 	io_lock_init(object);
 	io_lock(object);
+
+	entry->ie_bits |= type | urefs;
+	llsync_assign_ptr(entry->ie_object, object);
 	is_write_unlock(space);
 
 	object->io_references = 1; /* for entry, not caller */
@@ -337,11 +442,12 @@ ipc_object_alloc_name(
 		return KERN_NAME_EXISTS;
 	}
 
-	entry->ie_bits |= type | urefs;
-	entry->ie_object = object;
-
+	/* lockless lookups may find the object as soon as it is entered */
 	io_lock_init(object);
 	io_lock(object);
+
+	entry->ie_bits |= type | urefs;
+	llsync_assign_ptr(entry->ie_object, object);
 	is_write_unlock(space);
 
 	object->io_references = 1; /* for entry, not caller */
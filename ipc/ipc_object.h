@@ -37,6 +37,7 @@
 #include <mach/kern_return.h>
 #include <mach/message.h>
 #include <ipc/ipc_types.h>
+#include <kern/llsync.h>
 #include <kern/lock.h>
 #include <kern/macros.h>
 #include <kern/slab.h>
@@ -49,6 +50,7 @@ typedef struct ipc_object {
 	decl_simple_lock_data(,io_lock_data)
 	ipc_object_refs_t io_references;
 	ipc_object_bits_t io_bits;
+	struct llsync_work io_work;	/* deferred free, see below */
 } *ipc_object_t;
 
 #define	IO_NULL			((ipc_object_t) 0)
@@ -90,13 +92,20 @@ extern struct kmem_cache ipc_object_caches[IOT_NUMBER];
 #define	io_lock_try(io)		simple_lock_try(&(io)->io_lock_data)
 #define	io_unlock(io)		simple_unlock(&(io)->io_lock_data)
 
+/*
+ *	Objects may be found without the space lock through
+ *	ipc_entry_lookup_lockless, so the final free is deferred
+ *	until those lookups are done (see kern/llsync.h).
+ *	io_free is only for objects that were never entered.
+ */
+
 #define io_check_unlock(io) 						\
 MACRO_BEGIN								\
 	ipc_object_refs_t _refs = (io)->io_references;			\
 									\
 	io_unlock(io);							\
 	if (_refs == 0)							\
-		io_free(io_otype(io), io);				\
+		ipc_object_free(io);					\
 MACRO_END
 
 #define	io_reference(io)						\
@@ -109,12 +118,18 @@ MACRO_BEGIN								\
 	(io)->io_references--;						\
 MACRO_END
 
+extern void
+ipc_object_free(ipc_object_t);
+
 extern void
 ipc_object_reference(ipc_object_t);
 
 extern void
 ipc_object_release(ipc_object_t);
 
+extern ipc_object_t
+ipc_object_lookup_lockless(ipc_space_t, mach_port_t, mach_port_type_t);
+
 extern kern_return_t
 ipc_object_translate(ipc_space_t, mach_port_t,
 		     mach_port_right_t, ipc_object_t *);
@@ -200,7 +200,7 @@ ipc_space_destroy(
 			ipc_right_clean(space, name, entry);
 		}
 
-		ie_free(entry);
+		ipc_entry_free(entry);
 	}
 	rdxtree_remove_all(&space->is_map);
 	rdxtree_remove_all(&space->is_reverse_map);
@@ -155,6 +155,32 @@ ipc_entry_lookup(
 	return entry;
 }
 
+/*
+ *	Routine:	ipc_entry_lookup_lockless
+ *	Purpose:
+ *		Searches for an entry, given its name, without
+ *		locking the space.
+ *	Conditions:
+ *		Within an llsync read-side section.  The entry
+ *		may be changed or removed concurrently, so what
+ *		it denotes must be revalidated under the lock of
+ *		its object.
+ */
+
+static inline ipc_entry_t
+ipc_entry_lookup_lockless(
+	ipc_space_t space,
+	mach_port_t name)
+{
+	ipc_entry_t entry;
+
+	entry = rdxtree_lookup(&space->is_map, (rdxtree_key_t) name);
+	if (entry != IE_NULL
+	    && IE_BITS_TYPE(entry->ie_bits) == MACH_PORT_TYPE_NONE)
+		entry = NULL;
+	return entry;
+}
+
 /*
  *	Routine:	ipc_entry_get
  *	Purpose:
@@ -243,7 +269,7 @@ ipc_entry_dealloc(
 		space->is_free_list = entry;
 	} else {
 		rdxtree_remove(&space->is_map, (rdxtree_key_t) name);
-		ie_free(entry);
+		ipc_entry_free(entry);
 	}
 	space->is_size -= 1;
 }
@@ -791,6 +791,8 @@ mach_msg_trap(
 		self->ith_object = rcv_object;
 		self->ith_mqueue = rcv_mqueue;
 
+		thread_handoff_wait(receiver);
+
 		if ((receiver->swap_func == (void (*)()) mach_msg_continue) &&
 		    thread_handoff(self, mach_msg_continue, receiver)) {
 			assert(current_thread() == receiver);
@@ -802,7 +804,7 @@ mach_msg_trap(
 		} else if ((receiver->swap_func ==
 				(void (*)()) exception_raise_continue) &&
 			   thread_handoff(self, mach_msg_continue, receiver)) {
-			counter(c_mach_msg_trap_block_exc++);
+			ipc_sched_count(trap_block_exc);
 			assert(current_thread() == receiver);
 
 			/*
@@ -838,7 +840,7 @@ mach_msg_trap(
 				 *	We can still use the optimized code.
 				 */
 			} else {
-				counter(c_mach_msg_trap_block_slow++);
+				ipc_sched_count(trap_block_slow);
 				/*
 				 *	We are running as the receiver,
 				 *	but we can't use the optimized code.
@@ -879,7 +881,7 @@ mach_msg_trap(
 			imq_unlock(dest_mqueue);
 			goto abort_send_receive;
 		}
-		counter(c_mach_msg_trap_block_fast++);
+		ipc_sched_count(trap_block_fast);
 
 		/*
 		 *	Safe to unlock dest_port now that we are
@@ -1383,6 +1385,8 @@ mach_msg_trap(
 		 *	we still need to send it and receive a reply.
 		 */
 
+		ipc_sched_count(trap_slow_send);
+
 		mr = ipc_mqueue_send(kmsg, MACH_MSG_OPTION_NONE,
 				     MACH_MSG_TIMEOUT_NONE);
 		if (mr != MACH_MSG_SUCCESS) {
@@ -0,0 +1,124 @@
+/* Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 2 of the license, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+#include <string.h>
+
+#include <mach/kern_return.h>
+#include <mach/vm_param.h>
+#include <kern/assert.h>
+#include <kern/boot_trace.h>
+#include <kern/cpu_number.h>
+#include <kern/host.h>
+#include <kern/mach_clock.h>
+#include <kern/time_stamp.h>
+#include <vm/vm_kern.h>
+#include <vm/vm_map.h>
+
+static boot_trace_event_t boot_trace_events[BOOT_TRACE_MAX];
+static unsigned int boot_trace_nr_events;
+
+void
+boot_trace (const char *name, unsigned int kind)
+{
+  boot_trace_event_t *event;
+  unsigned int i;
+
+  /* Tracepoints may be hit by several processors once they are up.  */
+  i = __atomic_fetch_add (&boot_trace_nr_events, 1, __ATOMIC_RELAXED);
+  if (i >= BOOT_TRACE_MAX)
+    return;
+
+  event = &boot_trace_events[i];
+  event->bte_cycles = machine_cycles ();
+  event->bte_ticks = elapsed_ticks;
+  event->bte_cpu = cpu_number ();
+  event->bte_kind = kind;
+  strncpy (event->bte_name, name, sizeof event->bte_name);
+  event->bte_name[sizeof event->bte_name - 1] = '\0';
+}
+
+#if MACH_DEBUG
+/* Measure the time stamp counter rate against the clock, from the
+   first event stamped after the clock started.  */
+static unsigned long long
+boot_trace_cycles_per_sec (unsigned int nr_events)
+{
+  unsigned long long cycles;
+  unsigned long ticks;
+  unsigned int i;
+
+  cycles = machine_cycles ();
+  ticks = elapsed_ticks;
+
+  for (i = 0; i < nr_events; i++)
+    {
+      const boot_trace_event_t *event = &boot_trace_events[i];
+
+      if (event->bte_ticks != 0 && ticks > event->bte_ticks)
+	return (cycles - event->bte_cycles) * hz
+	       / (ticks - event->bte_ticks);
+    }
+
+  return 0;
+}
+
+kern_return_t
+host_boot_trace (host_t host, boot_trace_event_array_t *tracep,
+		 unsigned int *traceCntp, uint64_t *cycles_per_secp)
+{
+  unsigned int nr_events;
+  vm_size_t trace_size;
+  kern_return_t kr;
+
+  if (host == HOST_NULL)
+    return KERN_INVALID_HOST;
+
+  nr_events = __atomic_load_n (&boot_trace_nr_events, __ATOMIC_RELAXED);
+  if (nr_events > BOOT_TRACE_MAX)
+    nr_events = BOOT_TRACE_MAX;
+  trace_size = nr_events * sizeof (boot_trace_event_t);
+
+  if (nr_events <= *traceCntp)
+    memcpy (*tracep, boot_trace_events, trace_size);
+  else
+    {
+      vm_offset_t trace_addr;
+      vm_size_t total_size;
+      vm_map_copy_t copy;
+
+      kr = kmem_alloc_pageable (ipc_kernel_map, &trace_addr, trace_size);
+      if (kr != KERN_SUCCESS)
+	return kr;
+
+      memcpy ((char *) trace_addr, boot_trace_events, trace_size);
+      total_size = round_page (trace_size);
+
+      if (trace_size < total_size)
+	memset ((char *) (trace_addr + trace_size), 0,
+		total_size - trace_size);
+
+      kr = vm_map_copyin (ipc_kernel_map, trace_addr, trace_size, TRUE,
+			  &copy);
+      assert (kr == KERN_SUCCESS);
+      *tracep = (boot_trace_event_t *) copy;
+    }
+
+  *traceCntp = nr_events;
+  *cycles_per_secp = boot_trace_cycles_per_sec (nr_events);
+  return KERN_SUCCESS;
+}
+#endif /* MACH_DEBUG */
@@ -0,0 +1,49 @@
+/* Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 2 of the license, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Boot tracepoints.
+ *
+ * The phases of the kernel startup are bracketed by boot_trace_begin
+ * and boot_trace_end, which stamp them with the time stamp counter
+ * into a small static buffer.  The buffer is kept for the life of the
+ * system, and read with host_boot_trace.  Tracepoints past the end
+ * of the buffer are dropped.
+ */
+
+#ifndef _KERN_BOOT_TRACE_H_
+#define _KERN_BOOT_TRACE_H_	1
+
+#include <mach_debug/boot_trace.h>
+
+#define BOOT_TRACE_MAX	128
+
+void boot_trace (const char *name, unsigned int kind);
+
+static inline void
+boot_trace_begin (const char *name)
+{
+  boot_trace (name, BOOT_TRACE_BEGIN);
+}
+
+static inline void
+boot_trace_end (const char *name)
+{
+  boot_trace (name, BOOT_TRACE_END);
+}
+
+#endif /* _KERN_BOOT_TRACE_H_ */
@@ -48,6 +48,9 @@
 #include <kern/thread.h>
 #include <kern/lock.h>
 #include <vm/vm_kern.h>
+#include <vm/vm_map.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
 #include <vm/vm_user.h>
 #include <vm/pmap.h>
 #include <device/device_port.h>
@@ -80,8 +83,30 @@ extern struct multiboot_info boot_info;	/* XXX put this in a header! */
 static mach_port_t	boot_device_port;	/* local name */
 static mach_port_t	boot_host_port;		/* local name */
 
+/*
+ * Page aligned module segments are mapped copy-on-write from an
+ * object holding the module pages, created on first use.
+ */
+static struct multiboot_module *boot_mods;
+static vm_object_t	*boot_mod_objects;
+static unsigned int	boot_pages_mapped;
+static vm_size_t	boot_bytes_copied;
+
 extern char *kernel_cmdline;
 
+/*
+ * Passed to the first thread of a boot task.  The thread loading the
+ * module sets done once it no longer needs it, nor the module pages:
+ * until then, the thread that started it must not free them.
+ */
+struct user_bootstrap_info
+{
+  struct multiboot_module *mod;
+  char **argv;
+  int done;
+  decl_simple_lock_data(,lock)
+};
+
 static void user_bootstrap(void);	/* forward */
 static void user_bootstrap_compat(void);	/* forward */
 static void bootstrap_exec_compat(void *exec_data); /* forward */
@@ -116,7 +141,9 @@ free_bootstrap_pages(phys_addr_t start, phys_addr_t end)
     {
       page = vm_page_lookup_pa(start);
       assert(page != NULL);
-      vm_page_manage(page);
+      /* Pages given to a module object are freed with it.  */
+      if (page->type == VM_PT_RESERVED)
+	vm_page_manage(page);
       start += PAGE_SIZE;
     }
 }
@@ -163,6 +190,12 @@ void bootstrap_create(void)
       || (boot_info.mods_count == 0))
     panic ("No bootstrap code loaded with the kernel!");
 
+  boot_mods = bmods;
+  boot_mod_objects = (vm_object_t *)
+    kalloc(boot_info.mods_count * sizeof(vm_object_t));
+  for (n = 0; n < boot_info.mods_count; n++)
+    boot_mod_objects[n] = VM_OBJECT_NULL;
+
   compat = boot_info.mods_count == 1;
   if (compat)
     {
@@ -301,10 +334,19 @@ void bootstrap_create(void)
 	panic ("ERROR in executing boot script: %s",
 	       boot_script_error_string (losers));
     }
+  printf ("%u module pages mapped, %lu bytes copied\n",
+	  boot_pages_mapped, (unsigned long) boot_bytes_copied);
+
   /* XXX we could free the memory used
      by the boot loader's descriptors and such.  */
   for (n = 0; n < boot_info.mods_count; n++)
-    free_bootstrap_pages(bmods[n].mod_start, bmods[n].mod_end);
+    {
+      if (boot_mod_objects[n] != VM_OBJECT_NULL)
+	vm_object_deallocate(boot_mod_objects[n]);
+      free_bootstrap_pages(bmods[n].mod_start, bmods[n].mod_end);
+    }
+  kfree((vm_offset_t) boot_mod_objects,
+	boot_info.mods_count * sizeof(vm_object_t));
 }
 
 static void
@@ -312,6 +354,7 @@ bootstrap_exec_compat(void *e)
 {
 	task_t		bootstrap_task;
 	thread_t	bootstrap_thread;
+	struct user_bootstrap_info info = { e, 0, 0, };
 
 	/*
 	 * Create the bootstrap task.
@@ -333,11 +376,21 @@ bootstrap_exec_compat(void *e)
 			ipc_port_make_send(master_device_port));
 
 	/*
-	 * Start the bootstrap thread.
+	 * Start the bootstrap thread, and wait until it has loaded
+	 * the module: the caller frees the module pages on return.
 	 */
-	bootstrap_thread->saved.other = e;
+	simple_lock_init(&info.lock);
+	simple_lock(&info.lock);
+	bootstrap_thread->saved.other = &info;
 	thread_start(bootstrap_thread, user_bootstrap_compat);
 	(void) thread_resume(bootstrap_thread);
+
+	while (! info.done) {
+		thread_sleep((event_t) &info,
+			     simple_lock_addr(info.lock), FALSE);
+		simple_lock(&info.lock);
+	}
+	simple_unlock(&info.lock);
 }
 
 /*
@@ -460,6 +513,46 @@ boot_read(void *handle, vm_offset_t file_ofs, void *buf, vm_size_t size,
   return 0;
 }
 
+/*
+ * Return the object of module MOD, holding the module pages from
+ * START to END, page aligned physical addresses.  Pages are moved
+ * into the object the first time they are asked for; the others
+ * stay reserved until the modules are freed.
+ */
+static vm_object_t
+boot_mod_object(struct multiboot_module *mod, phys_addr_t start,
+		phys_addr_t end)
+{
+  vm_object_t *objectp = &boot_mod_objects[mod - boot_mods];
+  phys_addr_t base = trunc_page(mod->mod_start);
+  struct vm_page *page;
+
+  if (*objectp == VM_OBJECT_NULL)
+    *objectp = vm_object_allocate(round_page(mod->mod_end) - base);
+
+  vm_object_lock(*objectp);
+  for (; start < end; start += PAGE_SIZE)
+    {
+      page = vm_page_lookup_pa(start);
+      assert(page != NULL);
+      if (page->type != VM_PT_RESERVED)
+	continue;
+
+      vm_page_claim(page);
+      vm_page_lock_queues();
+      vm_page_insert(page, *objectp, start - base);
+      vm_page_activate(page);
+      vm_page_unlock_queues();
+
+      /* The object has no pager yet, this is the only copy.  */
+      page->dirty = TRUE;
+      page->busy = FALSE;
+    }
+  vm_object_unlock(*objectp);
+
+  return *objectp;
+}
+
 static int
 read_exec(void *handle, vm_offset_t file_ofs, vm_size_t file_size,
 		     vm_offset_t mem_addr, vm_size_t mem_size,
@@ -468,8 +561,11 @@ read_exec(void *handle, vm_offset_t file_ofs, vm_size_t file_size,
   struct multiboot_module *mod = handle;
 
 	vm_map_t user_map = current_task()->map;
-	vm_offset_t start_page, end_page;
+	vm_offset_t start_page, end_page, map_start, map_end;
+	vm_offset_t src = phystokv (mod->mod_start) + file_ofs;
+	phys_addr_t src_pa = mod->mod_start + file_ofs;
 	vm_prot_t mem_prot = sec_type & EXEC_SECTYPE_PROT_MASK;
+	vm_object_t object;
 	int err;
 
 	if (mod->mod_start + file_ofs + file_size > mod->mod_end)
@@ -489,15 +585,72 @@ read_exec(void *handle, vm_offset_t file_ofs, vm_size_t file_size,
 		mem_addr, mem_addr+file_size, mem_addr+mem_size, mem_prot, start_page, end_page);
 #endif
 
-	err = vm_allocate(user_map, &start_page, end_page - start_page, FALSE);
-	assert(err == 0);
-	assert(start_page == trunc_page(mem_addr));
+	/*
+	 * If the section has the same offset in its pages in the module
+	 * and in memory, map its whole pages from the module object.
+	 * Only the partial pages at its ends are copied, and the BSS
+	 * is zero filled.
+	 */
+	map_start = round_page(mem_addr);
+	map_end = trunc_page(mem_addr + file_size);
+	if ((src_pa & PAGE_MASK) != (mem_addr & PAGE_MASK)
+	    || map_start >= map_end)
+		map_start = map_end = end_page;
+
+	if (start_page < map_start)
+	{
+		vm_offset_t addr = start_page;
+		vm_size_t size = (map_start < mem_addr + file_size
+				  ? map_start : mem_addr + file_size)
+				 - mem_addr;
+
+		err = vm_allocate(user_map, &addr, map_start - start_page,
+				  FALSE);
+		assert(err == 0);
+		assert(addr == start_page);
+
+		if (size > 0)
+		{
+			err = copyout((void *)src, (void *)mem_addr, size);
+			assert(err == 0);
+			boot_bytes_copied += size;
+		}
+	}
 
-	if (file_size > 0)
+	if (map_start < map_end)
 	{
-		err = copyout((char *)phystokv (mod->mod_start) + file_ofs,
-			      (void *)mem_addr, file_size);
+		vm_offset_t addr = map_start;
+
+		object = boot_mod_object(mod, src_pa + (map_start - mem_addr),
+					 src_pa + (map_end - mem_addr));
+		vm_object_reference(object);
+		err = vm_map_enter(user_map, &addr, map_end - map_start, 0,
+				   FALSE, object,
+				   src_pa + (map_start - mem_addr)
+				   - trunc_page(mod->mod_start),
+				   TRUE, VM_PROT_ALL, VM_PROT_ALL,
+				   VM_INHERIT_DEFAULT);
 		assert(err == 0);
+		assert(addr == map_start);
+		boot_pages_mapped += atop(map_end - map_start);
+	}
+
+	if (map_end < end_page)
+	{
+		vm_offset_t addr = map_end;
+
+		err = vm_allocate(user_map, &addr, end_page - map_end, FALSE);
+		assert(err == 0);
+		assert(addr == map_end);
+
+		if (map_end < mem_addr + file_size)
+		{
+			err = copyout((void *)(src + (map_end - mem_addr)),
+				      (void *)map_end,
+				      mem_addr + file_size - map_end);
+			assert(err == 0);
+			boot_bytes_copied += mem_addr + file_size - map_end;
+		}
 	}
 
 	if (mem_prot != VM_PROT_ALL)
@@ -679,6 +832,7 @@ build_args_and_stack(struct exec_info *boot_exec_info,
 static void
 user_bootstrap_compat(void)
 {
+	struct user_bootstrap_info *info = current_thread()->saved.other;
 	exec_info_t boot_exec_info;
 
 	char	host_string[12];
@@ -689,7 +843,17 @@ user_bootstrap_compat(void)
 	/*
 	 * Copy the bootstrap code from boot_exec into the user task.
 	 */
-	copy_bootstrap(current_thread()->saved.other, &boot_exec_info);
+	copy_bootstrap(info->mod, &boot_exec_info);
+
+	/*
+	 * Tell the thread running bootstrap_exec_compat that we
+	 * are done with the module.
+	 */
+	simple_lock(&info->lock);
+	assert(!info->done);
+	info->done = 1;
+	simple_unlock(&info->lock);
+	thread_wakeup((event_t) info);
 
 	/*
 	 * Convert the host and device ports to strings,
@@ -737,14 +901,6 @@ $0 ${boot-args} ${host-port} ${device-port} ${root-device} $(task-create) $(task
 }
 
 
-struct user_bootstrap_info
-{
-  struct multiboot_module *mod;
-  char **argv;
-  int done;
-  decl_simple_lock_data(,lock)
-};
-
 int
 boot_script_exec_cmd (void *hook, task_t task, char *path, int argc,
 		      char **argv, char *strings, int stringlen)
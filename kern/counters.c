@@ -36,8 +36,6 @@
 mach_counter_t c_thread_invoke_hits = 0;
 mach_counter_t c_thread_invoke_misses = 0;
 mach_counter_t c_thread_invoke_csw = 0;
-mach_counter_t c_thread_handoff_hits = 0;
-mach_counter_t c_thread_handoff_misses = 0;
 mach_counter_t c_threads_current = 0;
 mach_counter_t c_threads_max = 0;
 mach_counter_t c_threads_min = 0;
@@ -53,9 +51,6 @@ mach_counter_t c_clock_ticks = 0;
 mach_counter_t c_ipc_mqueue_send_block = 0;
 mach_counter_t c_ipc_mqueue_receive_block_user = 0;
 mach_counter_t c_ipc_mqueue_receive_block_kernel = 0;
-mach_counter_t c_mach_msg_trap_block_fast = 0;
-mach_counter_t c_mach_msg_trap_block_slow = 0;
-mach_counter_t c_mach_msg_trap_block_exc = 0;
 mach_counter_t c_exception_raise_block = 0;
 mach_counter_t c_swtch_block = 0;
 mach_counter_t c_swtch_pri_block = 0;
@@ -76,6 +71,7 @@ mach_counter_t c_idle_thread_handoff = 0;
 mach_counter_t c_sched_thread_block = 0;
 mach_counter_t c_io_done_thread_block = 0;
 mach_counter_t c_net_thread_block = 0;
+mach_counter_t c_llsync_thread_block = 0;
 mach_counter_t c_reaper_thread_block = 0;
 mach_counter_t c_swapin_thread_block = 0;
 mach_counter_t c_action_thread_block = 0;
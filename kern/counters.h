@@ -59,8 +59,6 @@ typedef unsigned int mach_counter_t;
 extern mach_counter_t c_thread_invoke_hits;
 extern mach_counter_t c_thread_invoke_misses;
 extern mach_counter_t c_thread_invoke_csw;
-extern mach_counter_t c_thread_handoff_hits;
-extern mach_counter_t c_thread_handoff_misses;
 extern mach_counter_t c_threads_current;
 extern mach_counter_t c_threads_max;
 extern mach_counter_t c_threads_min;
@@ -76,9 +74,6 @@ extern mach_counter_t c_clock_ticks;
 extern mach_counter_t c_ipc_mqueue_send_block;
 extern mach_counter_t c_ipc_mqueue_receive_block_user;
 extern mach_counter_t c_ipc_mqueue_receive_block_kernel;
-extern mach_counter_t c_mach_msg_trap_block_fast;
-extern mach_counter_t c_mach_msg_trap_block_slow;
-extern mach_counter_t c_mach_msg_trap_block_exc;
 extern mach_counter_t c_exception_raise_block;
 extern mach_counter_t c_swtch_block;
 extern mach_counter_t c_swtch_pri_block;
@@ -99,6 +94,7 @@ extern mach_counter_t c_idle_thread_handoff;
 extern mach_counter_t c_sched_thread_block;
 extern mach_counter_t c_io_done_thread_block;
 extern mach_counter_t c_net_thread_block;
+extern mach_counter_t c_llsync_thread_block;
 extern mach_counter_t c_reaper_thread_block;
 extern mach_counter_t c_swapin_thread_block;
 extern mach_counter_t c_action_thread_block;
@@ -16,20 +16,25 @@
    <http://www.gnu.org/licenses/>.
 */
 
+#include <cache.h>
+#include <mach/machine.h>
 #include <kern/gsync.h>
 #include <kern/kmutex.h>
+#include <kern/log2.h>
 #include <kern/sched_prim.h>
 #include <kern/thread.h>
 #include <kern/list.h>
 #include <vm/vm_map.h>
 #include <vm/vm_kern.h>
+#include <machine/machspl.h>
 
-/* An entry in the global hash table. */
+/* An entry in the global hash table. Buckets are padded to a cache
+ * line, so that waiters on unrelated addresses don't contend. */
 struct gsync_hbucket
 {
   struct list entries;
   struct kmutex lock;
-};
+} __cacheline_aligned;
 
 /* A key used to uniquely identify an address that a thread is
  * waiting on. Its members' values depend on whether said
@@ -57,12 +62,20 @@ union gsync_key
     } any;
 };
 
-/* A thread that is blocked on an address with 'gsync_wait'. */
+/* A thread that is blocked on an address with 'gsync_wait'. The key
+ * and bucket change when the waiter is requeued; both are protected
+ * by the lock of the bucket the waiter is in. A waiter from
+ * 'gsync_wait_pi' also lends its priority to the owner of the lock;
+ * the owner and the link in its list of waiters are protected by
+ * gsync_pi_lock. */
 struct gsync_waiter
 {
   struct list link;
   union gsync_key key;
+  struct gsync_hbucket *bucket;
   thread_t waiter;
+  thread_t owner;
+  struct list pi_link;
 };
 
 /* Needed data for temporary mappings. */
@@ -72,17 +85,50 @@ struct vm_args
   vm_offset_t off;
 };
 
-#define GSYNC_NBUCKETS   512
-static struct gsync_hbucket gsync_buckets[GSYNC_NBUCKETS];
+/* The hash table is sized at boot, with GSYNC_CPU_BUCKETS buckets
+ * per processor, and at least GSYNC_MIN_BUCKETS. */
+#define GSYNC_MIN_BUCKETS   512
+#define GSYNC_CPU_BUCKETS   256
+#define GSYNC_MAX_BUCKETS   65536
+
+static struct gsync_hbucket *gsync_buckets;
+static unsigned int gsync_nbuckets;
+
+/* Priority inheritance. An owner inherits the highest priority of the
+ * threads waiting for it, and so on along a chain of owners waiting
+ * for other owners, up to GSYNC_PI_MAX_DEPTH threads, which also
+ * bounds the walk if user space made a cycle. */
+#define GSYNC_PI_MAX_DEPTH   16
+
+decl_simple_lock_data (static, gsync_pi_lock)
 
 void gsync_setup (void)
 {
-  int i;
-  for (i = 0; i < GSYNC_NBUCKETS; ++i)
+  unsigned int i, n;
+  vm_offset_t addr;
+  vm_size_t size;
+
+  n = GSYNC_CPU_BUCKETS * (ncpu > 0 ? ncpu : 1);
+  if (n < GSYNC_MIN_BUCKETS)
+    n = GSYNC_MIN_BUCKETS;
+  else if (n > GSYNC_MAX_BUCKETS)
+    n = GSYNC_MAX_BUCKETS;
+  n = 1U << iorder2 (n);
+
+  size = round_page (n * sizeof (*gsync_buckets));
+  if (kmem_alloc_wired (kernel_map, &addr, size) != KERN_SUCCESS)
+    panic ("gsync: unable to allocate the hash table");
+
+  gsync_buckets = (struct gsync_hbucket *)addr;
+  gsync_nbuckets = n;
+
+  for (i = 0; i < n; ++i)
     {
       list_init (&gsync_buckets[i].entries);
       kmutex_init (&gsync_buckets[i].lock);
     }
+
+  simple_lock_init (&gsync_pi_lock);
 }
 
 /* Convenience comparison functions for gsync_key's. */
@@ -102,21 +148,44 @@ gsync_key_lt (const union gsync_key *lp,
     (lp->any.u == rp->any.u && lp->any.v < rp->any.v));
 }
 
-#define MIX2_LL(x, y)   ((((x) << 5) | ((x) >> 27)) ^ (y))
+/* The keys are pointers and addresses, often page-aligned, so the
+ * low bits carry little entropy. Hash them with the MurmurHash3
+ * mixing steps, which spread every input bit over the result. */
+
+#define ROTL32(x, r)   (((x) << (r)) | ((x) >> (32 - (r))))
+
+static inline unsigned int
+gsync_hash_mix (unsigned int h, unsigned int k)
+{
+  k *= 0xcc9e2d51;
+  k = ROTL32 (k, 15);
+  k *= 0x1b873593;
+
+  h ^= k;
+  h = ROTL32 (h, 13);
+  return (h * 5 + 0xe6546b64);
+}
 
 static inline unsigned int
 gsync_key_hash (const union gsync_key *keyp)
 {
   unsigned int ret = sizeof (void *);
 #ifndef __LP64__
-  ret = MIX2_LL (ret, keyp->any.u);
-  ret = MIX2_LL (ret, keyp->any.v);
+  ret = gsync_hash_mix (ret, keyp->any.u);
+  ret = gsync_hash_mix (ret, keyp->any.v);
 #else
-  ret = MIX2_LL (ret, keyp->any.u & ~0U);
-  ret = MIX2_LL (ret, keyp->any.u >> 32);
-  ret = MIX2_LL (ret, keyp->any.v & ~0U);
-  ret = MIX2_LL (ret, keyp->any.v >> 32);
+  ret = gsync_hash_mix (ret, keyp->any.u & ~0U);
+  ret = gsync_hash_mix (ret, keyp->any.u >> 32);
+  ret = gsync_hash_mix (ret, keyp->any.v & ~0U);
+  ret = gsync_hash_mix (ret, keyp->any.v >> 32);
 #endif
+
+  /* Final avalanche. */
+  ret ^= ret >> 16;
+  ret *= 0x85ebca6b;
+  ret ^= ret >> 13;
+  ret *= 0xc2b2ae35;
+  ret ^= ret >> 16;
   return (ret);
 }
 
@@ -170,7 +239,7 @@ gsync_prepare_key (task_t task, vm_offset_t addr, int flags,
       keyp->local.addr = addr;
     }
 
-  return ((int)(gsync_key_hash (keyp) % GSYNC_NBUCKETS));
+  return ((int)(gsync_key_hash (keyp) & (gsync_nbuckets - 1)));
 }
 
 static inline struct gsync_waiter*
@@ -203,6 +272,150 @@ gsync_find_key (const struct list *entries,
   return (runp);
 }
 
+/* Recompute the priority THREAD inherits, then that of the thread it
+ * waits for, and so on. The PI lock is held, at splsched. */
+static void
+gsync_pi_update (thread_t thread)
+{
+  unsigned int depth;
+
+  for (depth = 0;
+      thread != THREAD_NULL && depth < GSYNC_PI_MAX_DEPTH;
+      depth++)
+    {
+      struct list *nodep;
+      int pri = NRQS;
+
+      list_for_each (&thread->pi_waiters, nodep)
+        {
+          struct gsync_waiter *wp =
+            list_entry (nodep, struct gsync_waiter, pi_link);
+          if (wp->waiter->sched_pri < pri)
+            pri = wp->waiter->sched_pri;
+        }
+
+      thread_lock (thread);
+      if (pri == thread->pi_priority)
+        {
+          thread_unlock (thread);
+          break;
+        }
+
+      thread->pi_priority = pri;
+      if (thread->depress_priority < 0)
+        compute_priority (thread, TRUE);
+      else
+        /* A depressed thread runs at the lowest priority, unless
+         * it holds a lock wanted by others. */
+        set_pri (thread, pri < NRQS - 1 ? pri : NRQS - 1, TRUE);
+      thread_unlock (thread);
+
+      thread = thread->pi_blocked != NULL
+        ? thread->pi_blocked->owner : THREAD_NULL;
+    }
+}
+
+/* Make the current thread, about to sleep as waiter WP, lend its
+ * priority to OWNER. */
+static void
+gsync_pi_attach (struct gsync_waiter *wp, thread_t owner)
+{
+  spl_t s;
+
+  s = splsched ();
+  simple_lock (&gsync_pi_lock);
+  wp->owner = owner;
+  list_insert_tail (&owner->pi_waiters, &wp->pi_link);
+  wp->waiter->pi_blocked = wp;
+  gsync_pi_update (owner);
+  simple_unlock (&gsync_pi_lock);
+  splx (s);
+}
+
+/* Stop waiter WP from lending its priority, once it is awake. */
+static void
+gsync_pi_detach (struct gsync_waiter *wp)
+{
+  spl_t s;
+
+  s = splsched ();
+  simple_lock (&gsync_pi_lock);
+  wp->waiter->pi_blocked = NULL;
+  if (wp->owner != THREAD_NULL)
+    {
+      thread_t owner = wp->owner;
+      list_remove (&wp->pi_link);
+      wp->owner = THREAD_NULL;
+      gsync_pi_update (owner);
+    }
+  simple_unlock (&gsync_pi_lock);
+  splx (s);
+}
+
+/* Waiter WP is being woken up to take the lock. Pass the priority
+ * lent by the waiters on the same key, from NEXTP on, from the owner
+ * to WP's thread, the likely next owner, and stop WP from lending its
+ * own. The bucket lock is held. */
+static void
+gsync_pi_handoff (struct gsync_waiter *wp, struct list *nextp)
+{
+  thread_t owner, next_owner;
+  spl_t s;
+
+  s = splsched ();
+  simple_lock (&gsync_pi_lock);
+
+  owner = wp->owner;
+  next_owner = wp->waiter;
+
+  if (owner != THREAD_NULL)
+    {
+      for (; !list_end (&wp->bucket->entries, nextp);
+          nextp = list_next (nextp))
+        {
+          struct gsync_waiter *np = list_entry (nextp,
+            struct gsync_waiter, link);
+
+          if (! gsync_key_eq (&np->key, &wp->key))
+            break;
+          else if (np->owner != owner)
+            continue;
+
+          list_remove (&np->pi_link);
+          np->owner = next_owner;
+          list_insert_tail (&next_owner->pi_waiters, &np->pi_link);
+        }
+
+      list_remove (&wp->pi_link);
+      wp->owner = THREAD_NULL;
+      next_owner->pi_blocked = NULL;
+
+      gsync_pi_update (owner);
+      gsync_pi_update (next_owner);
+    }
+
+  simple_unlock (&gsync_pi_lock);
+  splx (s);
+}
+
+void
+gsync_pi_thread_destroy (thread_t thread)
+{
+  spl_t s;
+
+  s = splsched ();
+  simple_lock (&gsync_pi_lock);
+  while (! list_empty (&thread->pi_waiters))
+    {
+      struct gsync_waiter *wp = list_first_entry (&thread->pi_waiters,
+        struct gsync_waiter, pi_link);
+      list_remove (&wp->pi_link);
+      wp->owner = THREAD_NULL;
+    }
+  simple_unlock (&gsync_pi_lock);
+  splx (s);
+}
+
 /* Create a temporary mapping in the kernel.*/
 static inline vm_offset_t
 temp_mapping (struct vm_args *vap, vm_offset_t addr, vm_prot_t prot)
@@ -219,7 +432,8 @@ temp_mapping (struct vm_args *vap, vm_offset_t addr, vm_prot_t prot)
   return (paddr);
 }
 
-kern_return_t gsync_wait (task_t task, vm_offset_t addr,
+static kern_return_t
+gsync_wait_common (task_t task, vm_offset_t addr, thread_t owner,
   unsigned int lo, unsigned int hi, natural_t msec, int flags)
 {
   if (task == 0)
@@ -305,7 +519,12 @@ kern_return_t gsync_wait (task_t task, vm_offset_t addr,
 
   /* Finally, add ourselves to the list and go to sleep. */
   list_add (runp->prev, runp, &w.link);
+  w.bucket = hbp;
   w.waiter = current_thread ();
+  w.owner = THREAD_NULL;
+
+  if (owner != THREAD_NULL && owner != w.waiter)
+    gsync_pi_attach (&w, owner);
 
   if (flags & GSYNC_TIMED)
     thread_will_wait_with_timeout (w.waiter, msec);
@@ -319,8 +538,17 @@ kern_return_t gsync_wait (task_t task, vm_offset_t addr,
   kern_return_t ret = KERN_SUCCESS;
   if (current_thread()->wait_result != THREAD_AWAKENED)
     {
-      /* We were interrupted or timed out. */
-      kmutex_lock (&hbp->lock, FALSE);
+      /* We were interrupted or timed out. We may have been
+       * requeued meanwhile, so lock the bucket we are in now. */
+      for (;;)
+        {
+          hbp = __atomic_load_n (&w.bucket, __ATOMIC_RELAXED);
+          kmutex_lock (&hbp->lock, FALSE);
+          if (hbp == w.bucket)
+            break;
+          kmutex_unlock (&hbp->lock);
+        }
+
       if (!list_node_unlinked (&w.link))
         list_remove (&w.link);
       kmutex_unlock (&hbp->lock);
@@ -330,19 +558,45 @@ kern_return_t gsync_wait (task_t task, vm_offset_t addr,
         KERN_INTERRUPTED : KERN_TIMEDOUT;
     }
 
+  if (owner != THREAD_NULL && owner != w.waiter)
+    gsync_pi_detach (&w);
+
   return (ret);
 }
 
+kern_return_t gsync_wait (task_t task, vm_offset_t addr,
+  unsigned int lo, unsigned int hi, natural_t msec, int flags)
+{
+  return (gsync_wait_common (task, addr, THREAD_NULL, lo, hi, msec, flags));
+}
+
+kern_return_t gsync_wait_pi (task_t task, vm_offset_t addr,
+  thread_t owner, unsigned int lo, unsigned int hi,
+  natural_t msec, int flags)
+{
+  if (owner == THREAD_NULL)
+    return (KERN_INVALID_ARGUMENT);
+
+  return (gsync_wait_common (task, addr, owner, lo, hi, msec, flags));
+}
+
 /* Remove a waiter from the queue, wake it up, and
  * return the next node. */
 static inline struct list*
 dequeue_waiter (struct list *nodep)
 {
   struct list *nextp = list_next (nodep);
+  struct gsync_waiter *wp = node_to_waiter (nodep);
+
   list_remove (nodep);
   list_node_init (nodep);
-  clear_wait (node_to_waiter(nodep)->waiter,
-    THREAD_AWAKENED, FALSE);
+
+  /* The owner of a PI waiter only changes under the bucket lock,
+   * which we hold, or once the waiter is awake. */
+  if (wp->owner != THREAD_NULL)
+    gsync_pi_handoff (wp, nextp);
+
+  clear_wait (wp->waiter, THREAD_AWAKENED, FALSE);
   return (nextp);
 }
 
@@ -449,9 +703,6 @@ kern_return_t gsync_requeue (task_t task, vm_offset_t src,
    * can unlock the VM object right now. */
   vm_object_unlock (va.obj);
 
-  /* If we're asked to unconditionally wake up a waiter, then
-   * we need to remove a maximum of two threads from the queue. */
-  unsigned int nw = 1 + wake_one;
   struct gsync_hbucket *bp1 = gsync_buckets + src_bkt;
   struct gsync_hbucket *bp2 = gsync_buckets + dst_bkt;
 
@@ -470,7 +721,7 @@ kern_return_t gsync_requeue (task_t task, vm_offset_t src,
     }
 
   kern_return_t ret = KERN_SUCCESS;
-  int exact;
+  int exact = 0;
   struct list *inp = gsync_find_key (&bp1->entries, &src_k, &exact);
 
   if (! exact)
@@ -478,33 +729,44 @@ kern_return_t gsync_requeue (task_t task, vm_offset_t src,
     ret = KERN_INVALID_ARGUMENT;
   else
     {
-      struct list *outp = gsync_find_key (&bp2->entries, &dst_k, 0);
+      /* Wake the first waiter if asked to, and move the next one,
+       * or all of them for a broadcast, to the destination queue
+       * without waking them. This turns a condition variable
+       * broadcast into a single wakeup, the other waiters being
+       * woken one at a time as the mutex is released. */
+      struct list moved;
 
-      /* We're going to need a node that points one past the
-       * end of the waiters in the source queue. */
-      struct list *endp = inp;
+      if (wake_one)
+        inp = dequeue_waiter (inp);
 
-      do
+      list_init (&moved);
+      while (!list_end (&bp1->entries, inp) &&
+        gsync_key_eq (&node_to_waiter(inp)->key, &src_k))
         {
-          /* Modify the keys while iterating. */
-          node_to_waiter(endp)->key = dst_k;
-          endp = list_next (endp);
-        }
-      while (((flags & GSYNC_BROADCAST) || --nw != 0) &&
-        !list_end (&bp1->entries, endp) &&
-        gsync_key_eq (&node_to_waiter(endp)->key, &src_k));
+          struct list *nextp = list_next (inp);
+          list_remove (inp);
+          list_insert_tail (&moved, inp);
+          inp = nextp;
 
-      /* Splice the list by removing waiters from the source queue
-       * and inserting them into the destination queue. */
-      inp->prev->next = endp;
-      endp->prev->next = outp->next;
-      endp->prev = inp->prev;
+          if (! (flags & GSYNC_BROADCAST))
+            break;
+        }
 
-      outp->next = inp;
-      inp->prev = outp;
+      /* Insert the waiters after the ones already waiting on the
+       * destination, in order. */
+      struct list *outp;
+      list_for_each (&bp2->entries, outp)
+        if (gsync_key_lt (&dst_k, &node_to_waiter(outp)->key))
+          break;
 
-      if (wake_one)
-        (void)dequeue_waiter (inp);
+      while (!list_empty (&moved))
+        {
+          struct gsync_waiter *wp = node_to_waiter (list_first (&moved));
+          list_remove (&wp->link);
+          wp->key = dst_k;
+          wp->bucket = bp2;
+          list_insert_before (outp, &wp->link);
+        }
     }
 
   /* Release the locks and we're done.*/
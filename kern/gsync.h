@@ -32,10 +32,17 @@ void gsync_setup (void);
 kern_return_t gsync_wait (task_t task, vm_offset_t addr,
   unsigned int lo, unsigned int hi, natural_t msec, int flags);
 
+kern_return_t gsync_wait_pi (task_t task, vm_offset_t addr,
+  thread_t owner, unsigned int lo, unsigned int hi,
+  natural_t msec, int flags);
+
 kern_return_t gsync_wake (task_t task,
   vm_offset_t addr, unsigned int val, int flags);
 
 kern_return_t gsync_requeue (task_t task, vm_offset_t src_addr,
   vm_offset_t dst_addr, boolean_t wake_one, int flags);
 
+/* Called when THREAD is destroyed. */
+void gsync_pi_thread_destroy (thread_t thread);
+
 #endif
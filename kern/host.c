@@ -41,8 +41,13 @@
 #include <mach/port.h>
 #include <kern/processor.h>
 #include <kern/ipc_host.h>
+#include <kern/ipc_sched.h>
 #include <kern/mach_clock.h>
 #include <mach/vm_param.h>
+#include <vm/vm_fault.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+#include <vm/vm_zcache.h>
 
 host_data_t	realhost;
 
@@ -194,6 +199,69 @@ kern_return_t	host_info(
 		return KERN_SUCCESS;
 	    }
 
+	case HOST_IPC_INFO:
+		if (*count < HOST_IPC_INFO_COUNT)
+			return KERN_FAILURE;
+
+		ipc_sched_info((host_ipc_info_t) info);
+
+		*count = HOST_IPC_INFO_COUNT;
+		return KERN_SUCCESS;
+
+	case HOST_VM_SHADOW_INFO:
+		if (*count < HOST_VM_SHADOW_INFO_COUNT)
+			return KERN_FAILURE;
+
+		vm_object_shadow_info((host_vm_shadow_info_t) info);
+
+		*count = HOST_VM_SHADOW_INFO_COUNT;
+		return KERN_SUCCESS;
+
+	case HOST_VM_FRAG_INFO:
+		if (*count < HOST_VM_FRAG_INFO_COUNT)
+			return KERN_FAILURE;
+
+		vm_page_frag_info((host_vm_frag_info_t) info);
+
+		*count = HOST_VM_FRAG_INFO_COUNT;
+		return KERN_SUCCESS;
+
+	case HOST_VM_NUMA_INFO:
+		if (*count < HOST_VM_NUMA_INFO_COUNT)
+			return KERN_FAILURE;
+
+		vm_page_numa_info((host_vm_numa_info_t) info);
+
+		*count = HOST_VM_NUMA_INFO_COUNT;
+		return KERN_SUCCESS;
+
+	case HOST_VM_MERGE_INFO:
+		if (*count < HOST_VM_MERGE_INFO_COUNT)
+			return KERN_FAILURE;
+
+		vm_page_merge_info((host_vm_merge_info_t) info);
+
+		*count = HOST_VM_MERGE_INFO_COUNT;
+		return KERN_SUCCESS;
+
+	case HOST_VM_ZCACHE_INFO:
+		if (*count < HOST_VM_ZCACHE_INFO_COUNT)
+			return KERN_FAILURE;
+
+		vm_zcache_info((host_vm_zcache_info_t) info);
+
+		*count = HOST_VM_ZCACHE_INFO_COUNT;
+		return KERN_SUCCESS;
+
+	case HOST_VM_FAULT_WAIT_INFO:
+		if (*count < HOST_VM_FAULT_WAIT_INFO_COUNT)
+			return KERN_FAILURE;
+
+		vm_fault_wait_info((host_vm_fault_wait_info_t) info);
+
+		*count = HOST_VM_FAULT_WAIT_INFO_COUNT;
+		return KERN_SUCCESS;
+
 	default:
 		return KERN_INVALID_ARGUMENT;
 	}
@@ -24,6 +24,8 @@
  * the rights to redistribute these changes.
  */
 
+#include <string.h>
+
 #include <mach/message.h>
 #include <kern/counters.h>
 #include "cpu_number.h"
@@ -35,6 +37,7 @@
 #include <kern/processor.h>
 #include <kern/thread_swap.h>
 #include <kern/ipc_sched.h>
+#include <machine/model_dep.h>
 #include <machine/machspl.h>	/* for splsched/splx */
 #include <machine/pmap.h>
 
@@ -151,6 +154,40 @@ thread_will_wait_with_timeout(
 	splx(s);
 }
 
+struct ipc_sched_stats ipc_sched_stats[NCPUS];
+
+#if	NCPUS > 1
+/*
+ *	How long thread_handoff waits for a receiver to finish
+ *	blocking on another processor, in pauses.  Blocking takes
+ *	well under this; the bound only matters if the receiver is
+ *	interrupted on its way.
+ */
+int thread_handoff_spin = 200;
+#endif	/* NCPUS > 1 */
+
+/*
+ *	Sum the per-processor counters for host_info.
+ */
+void
+ipc_sched_info(host_ipc_info_t info)
+{
+	int	i;
+
+	memset(info, 0, sizeof *info);
+	for (i = 0; i < NCPUS; i++) {
+		struct ipc_sched_stats *stats = &ipc_sched_stats[i];
+
+		info->trap_block_fast += stats->trap_block_fast;
+		info->trap_block_slow += stats->trap_block_slow;
+		info->trap_block_exc += stats->trap_block_exc;
+		info->trap_slow_send += stats->trap_slow_send;
+		info->handoff_hits += stats->handoff_hits;
+		info->handoff_remote += stats->handoff_remote;
+		info->handoff_misses += stats->handoff_misses;
+	}
+}
+
 #if	MACH_HOST
 #define check_processor_set(thread)	\
 	    (current_processor()->processor_set == (thread)->processor_set)
@@ -166,6 +203,49 @@ thread_will_wait_with_timeout(
 #define	check_bound_processor(thread)	TRUE
 #endif	/* NCPUS > 1 */
 
+/*
+ *	Routine:	thread_handoff_wait
+ *	Purpose:
+ *		On a multiprocessor, a receiver found queued on a
+ *		message queue may still be blocking on another
+ *		processor: it stays TH_RUN|TH_WAIT until it is off its
+ *		stack, and its continuation isn't set yet.  A handoff
+ *		would fail, and the message would wake it up through
+ *		a run queue of the other processor.  Wait a little
+ *		for it to finish blocking instead, so that it can be
+ *		handed off, and so migrated, to this processor.
+ *
+ *		Call before looking at the continuation of thread.
+ */
+
+void
+thread_handoff_wait(
+	thread_t thread)
+{
+#if	NCPUS > 1
+	int	spin;
+	spl_t	s;
+
+	if (thread->state != (TH_RUN|TH_WAIT))
+		return;
+
+	s = splsched();
+	thread_lock(thread);
+	for (spin = 0;
+	     (thread->state == (TH_RUN|TH_WAIT)) &&
+	     (spin < thread_handoff_spin);
+	     spin++) {
+		thread_unlock(thread);
+		machine_relax();
+		thread_lock(thread);
+	}
+	if (thread->state == (TH_WAIT|TH_SWAPPED))
+		ipc_sched_count(handoff_remote);
+	thread_unlock(thread);
+	splx(s);
+#endif	/* NCPUS > 1 */
+}
+
 /*
  *	Routine:	thread_handoff
  *	Purpose:
@@ -214,7 +294,7 @@ thread_handoff(
 		thread_unlock(new);
 		(void) splx(s);
 
-		counter(c_thread_handoff_misses++);
+		ipc_sched_count(handoff_misses);
 		return FALSE;
 	}
 
@@ -278,6 +358,6 @@ thread_handoff(
     after_old_thread:
 	(void) splx(s);
 
-	counter(c_thread_handoff_hits++);
+	ipc_sched_count(handoff_hits);
 	return TRUE;
 }
@@ -27,6 +27,31 @@
 #ifndef	_KERN_IPC_SCHED_H_
 #define	_KERN_IPC_SCHED_H_
 
+#include <cache.h>
+#include <mach/host_info.h>
+#include <kern/cpu_number.h>
 #include <kern/sched_prim.h>
 
+/*
+ *	Paths taken by mach_msg_trap and outcome of thread handoffs,
+ *	counted on each processor so that the RPC paths don't share
+ *	a cache line.  These are always counted, and reported by
+ *	host_info (HOST_IPC_INFO).
+ */
+struct ipc_sched_stats {
+	unsigned int	trap_block_fast;
+	unsigned int	trap_block_slow;
+	unsigned int	trap_block_exc;
+	unsigned int	trap_slow_send;
+	unsigned int	handoff_hits;
+	unsigned int	handoff_remote;
+	unsigned int	handoff_misses;
+} __cacheline_aligned;
+
+extern struct ipc_sched_stats ipc_sched_stats[NCPUS];
+
+#define	ipc_sched_count(field)	(ipc_sched_stats[cpu_number()].field++)
+
+extern void ipc_sched_info(host_ipc_info_t info);
+
 #endif	/* _KERN_IPC_SCHED_H_ */
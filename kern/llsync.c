@@ -0,0 +1,288 @@
+/* Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 2 of the license, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Grace periods are numbered by a global checkpoint identifier.  Each
+ * registered processor records the last checkpoint it acknowledged,
+ * and acknowledges the current one on its next quiescent state; when
+ * the last one does, the grace period is over.
+ *
+ * Deferred works are kept on two lists: works deferred since the
+ * current grace period started, and works that wait for the current
+ * grace period to end.  When it does, the latter are handed to the
+ * llsync thread, and the former start the next grace period.  This
+ * way, a work only runs after a whole grace period that started after
+ * it was deferred.
+ */
+
+#include <kern/assert.h>
+#include <kern/counters.h>
+#include <kern/llsync.h>
+#include <kern/lock.h>
+#include <kern/sched_prim.h>
+#include <kern/thread.h>
+#include <machine/machspl.h>
+
+struct llsync_queue
+{
+  struct llsync_work *first;
+  struct llsync_work *last;
+};
+
+decl_simple_lock_data (static, llsync_lock)
+
+/* Current checkpoint, and the last one acknowledged by each processor.  */
+unsigned int llsync_gcid;
+unsigned int llsync_cpu_gcid[NCPUS];
+
+static boolean_t llsync_cpu_registered[NCPUS];
+static unsigned int llsync_nr_registered_cpus;
+
+/* Processors yet to acknowledge the current checkpoint.  */
+static unsigned int llsync_nr_pending_cpus;
+static boolean_t llsync_gp_in_progress;
+
+static struct llsync_queue llsync_queue0;	/* wait for next period */
+static struct llsync_queue llsync_queue1;	/* wait for current period */
+static struct llsync_queue llsync_ready;	/* safe to run */
+
+/* Statistics.  */
+unsigned int llsync_nr_gps;
+unsigned int llsync_nr_works;
+
+static inline void
+llsync_queue_init (struct llsync_queue *queue)
+{
+  queue->first = NULL;
+  queue->last = NULL;
+}
+
+static inline boolean_t
+llsync_queue_empty (const struct llsync_queue *queue)
+{
+  return queue->first == NULL;
+}
+
+static inline void
+llsync_queue_push (struct llsync_queue *queue, struct llsync_work *work)
+{
+  work->next = NULL;
+  if (queue->last == NULL)
+    queue->first = work;
+  else
+    queue->last->next = work;
+  queue->last = work;
+}
+
+/* Append the works of SRC to DST, and empty SRC.  */
+static inline void
+llsync_queue_concat (struct llsync_queue *dst, struct llsync_queue *src)
+{
+  if (llsync_queue_empty (src))
+    return;
+
+  if (dst->last == NULL)
+    dst->first = src->first;
+  else
+    dst->last->next = src->first;
+  dst->last = src->last;
+  llsync_queue_init (src);
+}
+
+static void llsync_start_gp (void);
+
+/* End the current grace period.  The lock is held.  */
+static void
+llsync_finish_gp (void)
+{
+  assert (llsync_gp_in_progress);
+  assert (llsync_nr_pending_cpus == 0);
+
+  llsync_gp_in_progress = FALSE;
+  llsync_nr_gps++;
+
+  if (! llsync_queue_empty (&llsync_queue1))
+    {
+      llsync_queue_concat (&llsync_ready, &llsync_queue1);
+      thread_wakeup ((event_t) &llsync_ready);
+    }
+
+  if (! llsync_queue_empty (&llsync_queue0))
+    llsync_start_gp ();
+}
+
+/* Start a grace period for the works deferred so far.  The lock
+   is held.  */
+static void
+llsync_start_gp (void)
+{
+  assert (! llsync_gp_in_progress);
+  assert (llsync_queue_empty (&llsync_queue1));
+
+  llsync_queue_concat (&llsync_queue1, &llsync_queue0);
+  llsync_gp_in_progress = TRUE;
+  llsync_nr_pending_cpus = llsync_nr_registered_cpus;
+  __atomic_store_n (&llsync_gcid, llsync_gcid + 1, __ATOMIC_RELEASE);
+
+  if (llsync_nr_pending_cpus == 0)
+    llsync_finish_gp ();
+}
+
+/* Acknowledge the current checkpoint for CPU.  The lock is held.  */
+static void
+llsync_ack (int cpu)
+{
+  if (llsync_cpu_gcid[cpu] == llsync_gcid)
+    return;
+
+  __atomic_store_n (&llsync_cpu_gcid[cpu], llsync_gcid, __ATOMIC_RELAXED);
+
+  if (llsync_gp_in_progress && llsync_cpu_registered[cpu])
+    {
+      assert (llsync_nr_pending_cpus > 0);
+      if (--llsync_nr_pending_cpus == 0)
+	llsync_finish_gp ();
+    }
+}
+
+void
+llsync_setup (void)
+{
+  simple_lock_init (&llsync_lock);
+  llsync_queue_init (&llsync_queue0);
+  llsync_queue_init (&llsync_queue1);
+  llsync_queue_init (&llsync_ready);
+}
+
+void
+llsync_register_cpu (int cpu)
+{
+  spl_t s;
+
+  s = splsched ();
+  simple_lock (&llsync_lock);
+
+  assert (! llsync_cpu_registered[cpu]);
+
+  /* The processor holds no reference from before, so it needn't
+     take part in the current grace period.  */
+  llsync_cpu_gcid[cpu] = llsync_gcid;
+  llsync_cpu_registered[cpu] = TRUE;
+  llsync_nr_registered_cpus++;
+
+  simple_unlock (&llsync_lock);
+  splx (s);
+}
+
+void
+llsync_unregister_cpu (int cpu)
+{
+  spl_t s;
+
+  s = splsched ();
+  simple_lock (&llsync_lock);
+
+  assert (llsync_cpu_registered[cpu]);
+
+  /* Going off line is a quiescent state.  */
+  llsync_ack (cpu);
+  llsync_cpu_registered[cpu] = FALSE;
+  llsync_nr_registered_cpus--;
+
+  simple_unlock (&llsync_lock);
+  splx (s);
+}
+
+void
+llsync_commit_checkpoint (int cpu)
+{
+  spl_t s;
+
+  s = splsched ();
+  simple_lock (&llsync_lock);
+  llsync_ack (cpu);
+  simple_unlock (&llsync_lock);
+  splx (s);
+}
+
+void
+llsync_defer (struct llsync_work *work, llsync_fn_t fn)
+{
+  spl_t s;
+
+  work->fn = fn;
+
+  s = splsched ();
+  simple_lock (&llsync_lock);
+
+  llsync_queue_push (&llsync_queue0, work);
+  llsync_nr_works++;
+  if (! llsync_gp_in_progress)
+    llsync_start_gp ();
+
+  simple_unlock (&llsync_lock);
+  splx (s);
+}
+
+static void __attribute__ ((noreturn))
+llsync_thread_continue (void)
+{
+  for (;;)
+    {
+      struct llsync_queue queue;
+      struct llsync_work *work, *next;
+      spl_t s;
+
+      s = splsched ();
+      simple_lock (&llsync_lock);
+
+      if (llsync_queue_empty (&llsync_ready))
+	{
+	  assert_wait ((event_t) &llsync_ready, FALSE);
+	  simple_unlock (&llsync_lock);
+	  splx (s);
+	  counter (c_llsync_thread_block++);
+	  thread_block (llsync_thread_continue);
+	  /* NOTREACHED */
+	}
+
+      queue = llsync_ready;
+      llsync_queue_init (&llsync_ready);
+      simple_unlock (&llsync_lock);
+      splx (s);
+
+      for (work = queue.first; work != NULL; work = next)
+	{
+	  next = work->next;
+	  work->fn (work);
+	}
+    }
+}
+
+void
+llsync_thread (void)
+{
+  thread_t thread = current_thread ();
+
+  /* Reclaiming memory must not wait for memory.  */
+  thread->vm_privilege = 1;
+  stack_privilege (thread);
+  thread_set_own_priority (0);
+
+  llsync_thread_continue ();
+  /* NOTREACHED */
+}
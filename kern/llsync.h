@@ -0,0 +1,92 @@
+/* Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 2 of the license, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Lockless synchronization.
+ *
+ * Readers traverse shared data without taking any lock, between
+ * llsync_read_enter and llsync_read_exit.  Writers still serialize
+ * among themselves, publish pointers with llsync_assign_ptr, and
+ * instead of freeing what they unlink, pass it to llsync_defer.  The
+ * deferred function runs, in thread context, once every processor
+ * has gone through a quiescent state (a context switch, the idle
+ * loop, or a clock tick taken in user mode) since the call.
+ *
+ * The kernel is not preemptible, so a read-side section lasts until
+ * the thread blocks.  Read-side sections must therefore not block,
+ * and need not do anything on entry or exit.
+ */
+
+#ifndef _KERN_LLSYNC_H_
+#define _KERN_LLSYNC_H_	1
+
+#include <mach/boolean.h>
+#include <kern/cpu_number.h>
+
+struct llsync_work;
+
+typedef void (*llsync_fn_t) (struct llsync_work *);
+
+/* Deferred work, embedded in the structure to be reclaimed.  */
+struct llsync_work
+{
+  struct llsync_work *next;
+  llsync_fn_t fn;
+};
+
+#define llsync_read_enter()		((void) 0)
+#define llsync_read_exit()		((void) 0)
+
+#define llsync_assign_ptr(ptr, value) \
+  __atomic_store_n (&(ptr), (value), __ATOMIC_RELEASE)
+#define llsync_read_ptr(ptr) \
+  __atomic_load_n (&(ptr), __ATOMIC_CONSUME)
+
+extern unsigned int llsync_gcid;
+extern unsigned int llsync_cpu_gcid[NCPUS];
+
+void llsync_setup (void);
+void llsync_thread (void) __attribute__ ((noreturn));
+
+void llsync_register_cpu (int cpu);
+void llsync_unregister_cpu (int cpu);
+void llsync_commit_checkpoint (int cpu);
+
+/* Call FN on WORK once all current readers are done.  */
+void llsync_defer (struct llsync_work *work, llsync_fn_t fn);
+
+/* Report a quiescent state of the current processor.  */
+static inline void
+llsync_report_context_switch (void)
+{
+  int cpu = cpu_number ();
+
+  if (__atomic_load_n (&llsync_cpu_gcid[cpu], __ATOMIC_RELAXED)
+      != __atomic_load_n (&llsync_gcid, __ATOMIC_RELAXED))
+    llsync_commit_checkpoint (cpu);
+}
+
+/* Called on every clock tick.  A tick that interrupted user mode
+   is a quiescent state.  */
+static inline void
+llsync_report_periodic_event (boolean_t usermode)
+{
+  if (usermode)
+    llsync_report_context_switch ();
+}
+
+#endif /* _KERN_LLSYNC_H_ */
@@ -0,0 +1,277 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *
+ * A block is a list of sequences. Each sequence starts with a token, the
+ * high 4 bits of which give the number of literals, and the low 4 bits
+ * the length of the match, minus the minimum match length. A field set
+ * to 15 is followed by bytes to add to it, until one isn't 255. The
+ * literals follow, then the 16-bit little endian offset of the match.
+ * The last sequence only has literals, and the last 5 bytes of the data
+ * are always literals.
+ */
+
+#include <string.h>
+
+#include <kern/assert.h>
+#include <kern/lz4.h>
+
+#define LZ4_MIN_MATCH       4
+#define LZ4_LAST_LITERALS   5
+#define LZ4_MF_LIMIT        12  /* No match may start in the last bytes */
+#define LZ4_RUN_MASK        15
+
+static inline unsigned int
+lz4_read32(const unsigned char *ptr)
+{
+    unsigned int x;
+
+    memcpy(&x, ptr, sizeof(x));
+    return x;
+}
+
+static inline unsigned int
+lz4_hash(unsigned int x)
+{
+    return (x * 2654435761U) >> (32 - LZ4_HASH_BITS);
+}
+
+static unsigned char *
+lz4_write_length(unsigned char *op, size_t length)
+{
+    for (; length >= 255; length -= 255) {
+        *op++ = 255;
+    }
+
+    *op++ = length;
+    return op;
+}
+
+/*
+ * Append a sequence to the output, without match if match_length is 0.
+ *
+ * Return the new end of the output, or NULL if the sequence doesn't fit.
+ */
+static unsigned char *
+lz4_write_sequence(unsigned char *op, const unsigned char *op_end,
+                   const unsigned char *literals, size_t nr_literals,
+                   size_t offset, size_t match_length)
+{
+    unsigned char *token;
+    size_t max_size;
+
+    max_size = 1 + nr_literals + (nr_literals / 255) + 1
+               + 2 + (match_length / 255) + 1;
+
+    if (max_size > (size_t)(op_end - op)) {
+        return NULL;
+    }
+
+    token = op++;
+
+    if (nr_literals >= LZ4_RUN_MASK) {
+        *token = LZ4_RUN_MASK << 4;
+        op = lz4_write_length(op, nr_literals - LZ4_RUN_MASK);
+    } else {
+        *token = nr_literals << 4;
+    }
+
+    memcpy(op, literals, nr_literals);
+    op += nr_literals;
+
+    if (match_length == 0) {
+        return op;
+    }
+
+    *op++ = offset & 0xff;
+    *op++ = offset >> 8;
+    match_length -= LZ4_MIN_MATCH;
+
+    if (match_length >= LZ4_RUN_MASK) {
+        *token |= LZ4_RUN_MASK;
+        op = lz4_write_length(op, match_length - LZ4_RUN_MASK);
+    } else {
+        *token |= match_length;
+    }
+
+    return op;
+}
+
+size_t
+lz4_compress(const void *src, size_t src_size,
+             void *dest, size_t dest_size, void *work)
+{
+    const unsigned char *base, *end, *ip, *anchor, *ref;
+    const unsigned char *match_limit, *match_end;
+    unsigned char *op, *op_end;
+    unsigned short *table;
+    unsigned int seq, hash;
+    size_t length;
+
+    assert(src_size <= LZ4_MAX_INPUT_SIZE);
+
+    base = src;
+    end = base + src_size;
+    ip = base;
+    anchor = base;
+    op = dest;
+    op_end = op + dest_size;
+    table = work;
+    memset(table, 0, LZ4_WORK_SIZE);
+
+    if (src_size > LZ4_MF_LIMIT) {
+        match_limit = end - LZ4_MF_LIMIT;
+        match_end = end - LZ4_LAST_LITERALS;
+
+        while (ip < match_limit) {
+            seq = lz4_read32(ip);
+            hash = lz4_hash(seq);
+            ref = base + table[hash];
+            table[hash] = ip - base;
+
+            if ((ref >= ip) || (lz4_read32(ref) != seq)) {
+                ip++;
+                continue;
+            }
+
+            while ((ip > anchor) && (ref > base) && (ip[-1] == ref[-1])) {
+                ip--;
+                ref--;
+            }
+
+            length = LZ4_MIN_MATCH;
+
+            while (((ip + length) < match_end) && (ip[length] == ref[length])) {
+                length++;
+            }
+
+            op = lz4_write_sequence(op, op_end, anchor, ip - anchor,
+                                    ip - ref, length);
+
+            if (op == NULL) {
+                return 0;
+            }
+
+            ip += length;
+            anchor = ip;
+        }
+    }
+
+    op = lz4_write_sequence(op, op_end, anchor, end - anchor, 0, 0);
+
+    if (op == NULL) {
+        return 0;
+    }
+
+    return op - (unsigned char *)dest;
+}
+
+/*
+ * Read the additional bytes of a length field.
+ *
+ * Return FALSE if the input ends before the field does.
+ */
+static int
+lz4_read_length(const unsigned char **ipp, const unsigned char *ip_end,
+                size_t *length)
+{
+    const unsigned char *ip;
+    unsigned int byte;
+
+    ip = *ipp;
+
+    do {
+        if (ip == ip_end) {
+            return 0;
+        }
+
+        byte = *ip++;
+        *length += byte;
+    } while (byte == 255);
+
+    *ipp = ip;
+    return 1;
+}
+
+size_t
+lz4_decompress(const void *src, size_t src_size,
+               void *dest, size_t dest_size)
+{
+    const unsigned char *ip, *ip_end, *ref;
+    unsigned char *op, *op_end;
+    size_t length, offset;
+    unsigned int token;
+
+    ip = src;
+    ip_end = ip + src_size;
+    op = dest;
+    op_end = op + dest_size;
+
+    while (ip < ip_end) {
+        token = *ip++;
+        length = token >> 4;
+
+        if ((length == LZ4_RUN_MASK)
+            && !lz4_read_length(&ip, ip_end, &length)) {
+            return 0;
+        }
+
+        if ((length > (size_t)(ip_end - ip))
+            || (length > (size_t)(op_end - op))) {
+            return 0;
+        }
+
+        memcpy(op, ip, length);
+        op += length;
+        ip += length;
+
+        if (ip == ip_end) {
+            break;
+        }
+
+        if ((ip_end - ip) < 2) {
+            return 0;
+        }
+
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+
+        if ((offset == 0) || (offset > (size_t)(op - (unsigned char *)dest))) {
+            return 0;
+        }
+
+        length = token & LZ4_RUN_MASK;
+
+        if ((length == LZ4_RUN_MASK)
+            && !lz4_read_length(&ip, ip_end, &length)) {
+            return 0;
+        }
+
+        length += LZ4_MIN_MATCH;
+
+        if (length > (size_t)(op_end - op)) {
+            return 0;
+        }
+
+        /* Matches may overlap their own output */
+        for (ref = op - offset; length != 0; length--) {
+            *op++ = *ref++;
+        }
+    }
+
+    return op - (unsigned char *)dest;
+}
@@ -0,0 +1,64 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *
+ * LZ4 block compression.
+ *
+ * The output is a raw LZ4 block, without frame. The compressor is the
+ * greedy single-pass one, fast enough to run on page eviction, and
+ * restricted to small inputs such as pages, so that its hash table holds
+ * 16-bit positions.
+ */
+
+#ifndef _KERN_LZ4_H
+#define _KERN_LZ4_H
+
+#include <stddef.h>
+
+/*
+ * Maximum size of the data to compress.
+ */
+#define LZ4_MAX_INPUT_SIZE  0xffff
+
+/*
+ * Size of the work area used by the compressor.
+ */
+#define LZ4_HASH_BITS       12
+#define LZ4_WORK_SIZE       ((1 << LZ4_HASH_BITS) * sizeof(unsigned short))
+
+/*
+ * Compress src into dest.
+ *
+ * The work area must be LZ4_WORK_SIZE bytes large, and is used as
+ * scratch space. Return the size of the compressed data, or 0 if it
+ * doesn't fit in dest_size bytes.
+ */
+size_t lz4_compress(const void *src, size_t src_size,
+                    void *dest, size_t dest_size, void *work);
+
+/*
+ * Decompress src into dest.
+ *
+ * The input is validated, so that corrupted data can't make the
+ * decompressor access memory outside the given buffers. Return the size
+ * of the decompressed data, or 0 if the input is invalid or doesn't fit
+ * in dest_size bytes.
+ */
+size_t lz4_decompress(const void *src, size_t src_size,
+                      void *dest, size_t dest_size);
+
+#endif /* _KERN_LZ4_H */
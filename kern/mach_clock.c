@@ -45,6 +45,7 @@
 #include "cpu_number.h"
 #include <kern/debug.h>
 #include <kern/host.h>
+#include <kern/llsync.h>
 #include <kern/lock.h>
 #include <kern/mach_clock.h>
 #include <kern/processor.h>
@@ -179,6 +180,8 @@ void clock_interrupt(
 	    thread_quantum_update(my_cpu, thread, 1, state);
 	}
 
+	llsync_report_periodic_event(usermode);
+
 #if 	MACH_PCSAMPLE
 	/*
 	 * Take a sample of pc for the user if required.
@@ -44,6 +44,7 @@
 #include <kern/debug.h>
 #include <kern/ipc_host.h>
 #include <kern/host.h>
+#include <kern/llsync.h>
 #include <kern/lock.h>
 #include <kern/processor.h>
 #include <kern/queue.h>
@@ -93,6 +94,8 @@ void cpu_up(int cpu)
 	processor_unlock(processor);
 	splx(s);
 	pset_unlock(&default_pset);
+
+	llsync_register_cpu(cpu);
 }
 
 /*
@@ -120,6 +123,8 @@ void cpu_down(int cpu)
 	processor->state = PROCESSOR_OFF_LINE;
 	processor_unlock(processor);
 	splx(s);
+
+	llsync_unregister_cpu(cpu);
 }
 
 kern_return_t
@@ -41,6 +41,7 @@
 #include <kern/counters.h>
 #include <kern/cpu_number.h>
 #include <kern/debug.h>
+#include <kern/llsync.h>
 #include <kern/lock.h>
 #include <kern/mach_clock.h>
 #include <kern/mach_factor.h>
@@ -52,6 +53,7 @@
 #include <kern/syscall_subr.h>
 #include <kern/thread.h>
 #include <kern/thread_swap.h>
+#include <kern/trace.h>
 #include <vm/pmap.h>
 #include <vm/vm_kern.h>
 #include <vm/vm_map.h>
@@ -608,6 +610,14 @@ boolean_t thread_invoke(
 	continuation_t	continuation,
 	thread_t 	new_thread)
 {
+	/*
+	 *	The old thread is giving up the processor, so it
+	 *	can't be in a lockless read-side section.
+	 */
+	llsync_report_context_switch();
+
+	TRACE(TRACE_THREAD_INVOKE, old_thread, new_thread, 0);
+
 	/*
 	 *	Check for invoking the same thread.
 	 */
@@ -1022,6 +1032,17 @@ shift_data_t	wait_shift[32] = {
 	MACRO_END
 #endif	/* defined(PRI_SHIFT_2) */
 
+/*
+ *	inherit_priority:
+ *
+ *	Raise a computed priority to the priority the thread
+ *	inherits from gsync waiters, if any.
+ */
+#define inherit_priority(th, pri)					\
+	MACRO_BEGIN							\
+	if ((pri) > (th)->pi_priority) (pri) = (th)->pi_priority;	\
+	MACRO_END
+
 /*
  *	compute_priority:
  *
@@ -1044,14 +1065,17 @@ void compute_priority(
 	if (thread->policy == POLICY_TIMESHARE) {
 #endif	/* MACH_FIXPRI */
 	    do_priority_computation(thread, pri);
-	    if (thread->depress_priority < 0)
+	    if (thread->depress_priority < 0) {
+		inherit_priority(thread, pri);
 		set_pri(thread, pri, resched);
-	    else
+	    } else
 		thread->depress_priority = pri;
 #if	MACH_FIXPRI
 	}
 	else {
-	    set_pri(thread, thread->priority, resched);
+	    pri = thread->priority;
+	    inherit_priority(thread, pri);
+	    set_pri(thread, pri, resched);
 	}
 #endif	/* MACH_FIXPRI */
 }
@@ -1072,6 +1096,7 @@ void compute_my_priority(
 	int temp_pri;
 
 	do_priority_computation(thread,temp_pri);
+	inherit_priority(thread, temp_pri);
 	thread->sched_pri = temp_pri;
 }
 
@@ -1155,6 +1180,7 @@ void update_priority(
 #endif	/* MACH_FIXPRI */
 	    (thread->depress_priority < 0)) {
 		do_priority_computation(thread, temp_pri);
+		inherit_priority(thread, temp_pri);
 		thread->sched_pri = temp_pri;
 	}
 }
@@ -1227,6 +1253,8 @@ void thread_setrun(
 	processor_set_t	pset;
 #endif	/* NCPUS > 1 */
 
+	TRACE(TRACE_THREAD_SETRUN, th, may_preempt, 0);
+
 	/*
 	 *	Update priority if needed.
 	 */
@@ -1649,6 +1677,8 @@ void __attribute__((noreturn)) idle_thread_continue(void)
 				/* back at spl0 */
 			}
 
+			llsync_report_context_switch();
+
 			/*
 			 * machine_idle is a machine dependent function,
 			 * to conserve power.
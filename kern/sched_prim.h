@@ -101,6 +101,8 @@ extern void	thread_will_wait(
 extern void	thread_will_wait_with_timeout(
 	thread_t	thread,
 	mach_msg_timeout_t msecs);
+extern void	thread_handoff_wait(
+	thread_t	thread);
 extern boolean_t thread_handoff(
 	thread_t	old_thread,
 	continuation_t	continuation,
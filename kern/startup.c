@@ -34,9 +34,11 @@
 #include <mach/task_special_ports.h>
 #include <mach/vm_param.h>
 #include <ipc/ipc_init.h>
+#include <kern/boot_trace.h>
 #include <kern/cpu_number.h>
 #include <kern/debug.h>
 #include <kern/gsync.h>
+#include <kern/llsync.h>
 #include <kern/machine.h>
 #include <kern/mach_factor.h>
 #include <kern/mach_clock.h>
@@ -113,9 +115,12 @@ void setup_main(void)
 	}
 #endif	/* MACH_KDB */
 
+	boot_trace_begin("setup_main");
+
 	panic_init();
 
 	sched_init();
+	llsync_setup();
 	vm_mem_bootstrap();
 	rdxtree_cache_init();
 	ipc_bootstrap();
@@ -209,6 +214,8 @@ void setup_main(void)
 	startup_thread->state |= TH_RUN;
 	(void) thread_resume(startup_thread);
 
+	boot_trace_end("setup_main");
+
 	/*
 	 * Start the thread.
 	 */
@@ -243,6 +250,11 @@ void start_kernel_threads(void)
 	(void) kernel_thread(kernel_task, reaper_thread, (char *) 0);
 	(void) kernel_thread(kernel_task, swapin_thread, (char *) 0);
 	(void) kernel_thread(kernel_task, sched_thread, (char *) 0);
+	(void) kernel_thread(kernel_task, llsync_thread, (char *) 0);
+	(void) kernel_thread(kernel_task, vm_object_collapse_thread,
+			     (char *) 0);
+	(void) kernel_thread(kernel_task, vm_page_compact_thread, (char *) 0);
+	(void) kernel_thread(kernel_task, vm_page_merge_thread, (char *) 0);
 #ifndef MACH_XEN
 	(void) kernel_thread(kernel_task, intr_thread, (char *)0);
 #endif	/* MACH_XEN */
@@ -257,7 +269,11 @@ void start_kernel_threads(void)
 	 *	Allow other CPUs to run.
 	 */
 
-	if(ncpu > 1) start_other_cpus();
+	if(ncpu > 1) {
+		boot_trace_begin("start_other_cpus");
+		start_other_cpus();
+		boot_trace_end("start_other_cpus");
+	}
 #endif	/* NCPUS > 1 */
 
 	/*
@@ -265,6 +281,11 @@ void start_kernel_threads(void)
 	 */
 	device_service_create();
 
+	/*
+	 *	Run the device probes left for the other processors.
+	 */
+	machine_start_probes();
+
 	/*
 	 * 	Initialize kernel task's creation time.
 	 * When we created the kernel task in task_init, the mapped
@@ -277,7 +298,9 @@ void start_kernel_threads(void)
 	/*
 	 *	Start the user bootstrap.
 	 */
+	boot_trace_begin("bootstrap_create");
 	bootstrap_create();
+	boot_trace_end("bootstrap_create");
 
 #if	XPR_DEBUG
 	xprinit();		/* XXX */
@@ -52,6 +52,7 @@
 #include <kern/syscall_emulation.h>
 #include <kern/task_notify.user.h>
 #include <vm/vm_kern.h>		/* for kernel_map, ipc_kernel_map */
+#include <vm/vm_page.h>
 #include <machine/machspl.h>	/* for splsched */
 
 task_t	kernel_task = TASK_NULL;
@@ -165,13 +166,18 @@ task_create_kernel(
 			pset = &default_pset;
 		pset_reference(pset);
 		new_task->priority = parent_task->priority;
+		new_task->numa_policy = parent_task->numa_policy;
+		new_task->numa_node = parent_task->numa_node;
 		task_unlock(parent_task);
 	}
 	else {
 		pset = &default_pset;
 		pset_reference(pset);
 		new_task->priority = BASEPRI_USER;
+		new_task->numa_policy = VM_NUMA_POLICY_LOCAL;
+		new_task->numa_node = 0;
 	}
+	new_task->numa_next = 0;
 	pset_lock(pset);
 	pset_add_task(pset, new_task);
 	pset_unlock(pset);
@@ -1156,6 +1162,42 @@ task_set_name(
 	return KERN_SUCCESS;
 }
 
+/*
+ *	task_set_numa_policy
+ *
+ *	Set the NUMA memory policy of task TASK.
+ */
+kern_return_t
+task_set_numa_policy(
+	task_t			task,
+	vm_numa_policy_t	policy,
+	natural_t		node)
+{
+	if (task == TASK_NULL)
+		return KERN_INVALID_ARGUMENT;
+
+	switch (policy) {
+	case VM_NUMA_POLICY_LOCAL:
+	case VM_NUMA_POLICY_INTERLEAVE:
+		node = 0;
+		break;
+
+	case VM_NUMA_POLICY_PREFERRED:
+		if (node >= vm_page_nr_nodes())
+			return KERN_INVALID_ARGUMENT;
+		break;
+
+	default:
+		return KERN_INVALID_ARGUMENT;
+	}
+
+	task_lock(task);
+	task->numa_policy = policy;
+	task->numa_node = node;
+	task_unlock(task);
+	return KERN_SUCCESS;
+}
+
 /*
  *	task_collect_scan:
  *
@@ -39,6 +39,7 @@
 #include <mach/time_value.h>
 #include <mach/mach_param.h>
 #include <mach/task_info.h>
+#include <mach/vm_numa.h>
 #include <mach_debug/mach_debug_types.h>
 #include <kern/kern_types.h>
 #include <kern/lock.h>
@@ -80,6 +81,11 @@ struct task {
 	int		user_stop_count;	/* outstanding stops */
 	int		priority;		/* for new threads */
 
+	/* NUMA memory policy */
+	vm_numa_policy_t numa_policy;
+	unsigned int	numa_node;		/* preferred node */
+	unsigned int	numa_next;		/* next node to interleave */
+
 	/* Statistics */
 	time_value_t	total_user_time;
 				/* total user time for dead threads */
@@ -177,6 +183,10 @@ extern kern_return_t	task_assign_default(
 extern kern_return_t	task_set_name(
 	task_t			task,
 	kernel_debug_name_t	name);
+extern kern_return_t	task_set_numa_policy(
+	task_t			task,
+	vm_numa_policy_t	policy,
+	natural_t		node);
 extern void consider_task_collect(void);
 
 /*
@@ -43,6 +43,7 @@
 #include <kern/counters.h>
 #include <kern/debug.h>
 #include <kern/eventcount.h>
+#include <kern/gsync.h>
 #include <kern/ipc_mig.h>
 #include <kern/ipc_tt.h>
 #include <kern/processor.h>
@@ -123,6 +124,7 @@ decl_simple_lock_data(, stack_lock_data)/* splsched only */
 
 vm_offset_t stack_free_list;		/* splsched only */
 unsigned int stack_free_count = 0;	/* splsched only */
+unsigned int stack_alloc_count = 0;	/* splsched only, free or in use */
 unsigned int stack_free_limit = 1;	/* patchable */
 
 /*
@@ -201,6 +203,12 @@ kern_return_t stack_alloc(
 #if	MACH_DEBUG
 		stack_init(stack);
 #endif	/* MACH_DEBUG */
+
+		s = splsched();
+		stack_lock();
+		stack_alloc_count++;
+		stack_unlock();
+		(void) splx(s);
 	}
 
 	stack_attach(thread, stack, resume);
@@ -252,6 +260,7 @@ void stack_collect(void)
 		stack = stack_free_list;
 		stack_free_list = stack_next(stack);
 		stack_free_count--;
+		stack_alloc_count--;
 		stack_unlock();
 		(void) splx(s);
 
@@ -337,6 +346,9 @@ void thread_init(void)
 	thread_template.policy = POLICY_TIMESHARE;
 #endif	/* MACH_FIXPRI */
 	thread_template.depress_priority = -1;
+	thread_template.pi_priority = NRQS;
+	/* thread_template.pi_waiters (later) */
+	thread_template.pi_blocked = NULL;
 	thread_template.cpu_usage = 0;
 	thread_template.sched_usage = 0;
 	/* thread_template.sched_stamp (later) */
@@ -415,6 +427,7 @@ kern_return_t thread_create(
 		return KERN_RESOURCE_SHORTAGE;
 
 	*new_thread = thread_template;
+	list_init(&new_thread->pi_waiters);
 
 	record_time_stamp (&new_thread->creation_time);
 
@@ -714,6 +727,11 @@ void thread_deallocate(
 	 */
 	evc_notify_abort(thread);
 
+	/*
+	 *	Stop gsync waiters from boosting the thread.
+	 */
+	gsync_pi_thread_destroy(thread);
+
 	pcb_terminate(thread);
 	kmem_cache_free(&thread_cache, (vm_offset_t) thread);
 }
@@ -2405,7 +2423,8 @@ void stack_finalize(
 /*
  *	stack_statistics:
  *
- *	Return statistics on cached kernel stacks.
+ *	Return the number of kernel stacks, in use or cached,
+ *	and the maximum usage of the cached ones.
  *	*maxusagep must be initialized by the caller.
  */
 
@@ -2435,7 +2454,7 @@ void stack_statistics(
 		}
 	}
 
-	*totalp = stack_free_count;
+	*totalp = stack_alloc_count;
 	stack_unlock();
 	(void) splx(s);
 }
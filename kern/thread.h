@@ -43,6 +43,7 @@
 #include <mach/vm_prot.h>
 #include <kern/ast.h>
 #include <kern/cpu_number.h>
+#include <kern/list.h>
 #include <kern/mach_clock.h>
 #include <kern/queue.h>
 #include <kern/pc_sample.h>
@@ -142,6 +143,11 @@ struct thread {
 	unsigned int	sched_usage;	/* load-weighted cpu usage [sched] */
 	unsigned int	sched_stamp;	/* last time priority was updated */
 
+	/* Priority inheritance, see kern/gsync.c */
+	int		pi_priority;	/* inherited priority, NRQS if none */
+	struct list	pi_waiters;	/* gsync waiters boosting the thread */
+	struct gsync_waiter *pi_blocked; /* waiting as this PI waiter */
+
 	/* VM global variables */
 
 	vm_offset_t	recover;	/* page fault recovery (copyin/out) */
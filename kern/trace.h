@@ -0,0 +1,47 @@
+/* Copyright (C) 2026 Free Software Foundation, Inc.
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public License
+   as published by the Free Software Foundation; either
+   version 2 of the license, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public
+   License along with this program; if not, see
+   <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Kernel tracepoints.
+ *
+ * TRACE records an event, with up to three arguments, into the trace
+ * ring of the current processor, if the trace device asked for events
+ * of its type.  See <device/trace_ring.h> for the event types and the
+ * ring layout.  While its type is not recorded, a tracepoint costs a
+ * single test of trace_events, predicted not taken.
+ */
+
+#ifndef _KERN_TRACE_H_
+#define _KERN_TRACE_H_	1
+
+#include <device/trace_ring.h>
+#include <kern/macros.h>
+
+/* Mask of the recorded event types.  */
+extern unsigned int trace_events;
+
+void trace_emit (unsigned int event, unsigned long arg0, unsigned long arg1,
+		 unsigned long arg2);
+
+#define TRACE(event, arg0, arg1, arg2)					\
+MACRO_BEGIN								\
+  if (__builtin_expect (trace_events & (1U << (event)), 0))		\
+    trace_emit ((event), (unsigned long) (arg0),			\
+		(unsigned long) (arg1), (unsigned long) (arg2));	\
+MACRO_END
+
+#endif /* _KERN_TRACE_H_ */
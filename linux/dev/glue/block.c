@@ -1577,6 +1577,58 @@ out:
   return err;
 }
 
+/* Read COUNT bytes at block BN directly into the wired, page-aligned
+   range of the caller at ADDRESS.  device_read_into_map wires its pages
+   until device_read_into_unmap.  Full-block transfers are done by
+   the driver straight into the caller's pages.  */
+static io_return_t
+device_read_into (void *d, ipc_port_t reply_port,
+		  mach_msg_type_name_t reply_port_type, dev_mode_t mode,
+		  recnum_t bn, vm_offset_t address, int count,
+		  int *bytes_read)
+{
+  int amt;
+  io_return_t err;
+  vm_offset_t addr;
+  vm_size_t size;
+  struct block_data *bd = d;
+  DECL_DATA;
+
+  INIT_DATA ();
+
+  *bytes_read = 0;
+
+  if (! bd->ds->fops->read)
+    return D_INVALID_OPERATION;
+  if (count > DEVICE_READ_INTO_MAX)
+    count = DEVICE_READ_INTO_MAX;
+  count = check_limit (bd, &td.file.f_pos, bn, count);
+  if (count < 0)
+    return D_INVALID_SIZE;
+  if (count == 0)
+    return 0;
+
+  /* Map the caller's pages, and read into them.  */
+  size = round_page (count);
+  err = device_read_into_map (current_map (), address, size, &addr);
+  if (! err)
+    {
+      amt = (*bd->ds->fops->read) (&td.inode, &td.file, (char *) addr, count);
+      device_read_into_unmap (addr, size);
+      if (amt < 0)
+	err = linux_to_mach_error (amt);
+      else
+	*bytes_read = amt;
+    }
+
+  if (--bd->iocount == 0 && bd->want)
+    {
+      bd->want = 0;
+      thread_wakeup ((event_t) bd);
+    }
+  return err;
+}
+
 static io_return_t
 device_get_status (void *d, dev_flavor_t flavor, dev_status_t status,
 		   mach_msg_type_number_t *status_count)
@@ -1715,5 +1767,6 @@ struct device_emulation_ops linux_block_emulation_ops =
   NULL,
   device_no_senders,
   NULL,
-  NULL
+  NULL,
+  device_read_into
 };
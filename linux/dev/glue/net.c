@@ -261,7 +261,7 @@ dev_kfree_skb (struct sk_buff *skb, int mode)
     {
       skb_queue_tail (&skb_done_list, skb);
       save_flags (flags);
-      thread_wakeup ((event_t) & io_done_list);
+      io_done_wakeup ();
       restore_flags (flags);
       return;
     }
@@ -34,6 +34,7 @@
 #include <mach/machine.h>
 
 #include <vm/vm_page.h>
+#include <kern/boot_trace.h>
 #include <kern/kalloc.h>
 
 #include <machine/spl.h>
@@ -85,6 +86,7 @@ struct drive_info_struct
  * Forward declarations.
  */
 static void calibrate_delay (void);
+void linux_probe (void);
 
 /*
  * Amount of contiguous memory to allocate for initialization.
@@ -92,13 +94,19 @@ static void calibrate_delay (void);
 #define CONTIG_ALLOC (512 * 1024)
 
 /*
- * Initialize Linux drivers.
+ * Contiguous memory left for the probes.
+ */
+static unsigned long probe_memory_start, probe_memory_end;
+
+/*
+ * Initialize Linux drivers.  Unless DEFER_PROBES is set, probe the
+ * devices too.  Otherwise linux_probe must be called later, once
+ * the Mach clock runs.
  */
 void
-linux_init (void)
+linux_init (int defer_probes)
 {
   int addr;
-  unsigned long memory_start, memory_end;
   vm_page_t pages;
 
   /*
@@ -131,18 +139,44 @@ linux_init (void)
   /*
    * Allocate contiguous memory below 16 MB.
    */
-  memory_start = alloc_contig_mem (CONTIG_ALLOC, 16 * 1024 * 1024, 0, &pages);
-  if (memory_start == 0)
+  probe_memory_start = alloc_contig_mem (CONTIG_ALLOC, 16 * 1024 * 1024, 0,
+				       &pages);
+  if (probe_memory_start == 0)
     panic ("linux_init: alloc_contig_mem failed");
-  memory_end = memory_start + CONTIG_ALLOC;
+  probe_memory_end = probe_memory_start + CONTIG_ALLOC;
+
+  if (defer_probes)
+    {
+      /*
+       * The clock is left to Mach, which also keeps jiffies.
+       */
+      restore_IRQ ();
+      return;
+    }
+
+  linux_probe ();
+
+  restore_IRQ ();
+}
+
+/*
+ * Probe the PCI bus and the devices, and end autoconfiguration.
+ */
+void
+linux_probe (void)
+{
+  unsigned long memory_start = probe_memory_start;
+  unsigned long memory_end = probe_memory_end;
 
   /*
    * Initialize PCI bus.
    */
+  boot_trace_begin ("pci_init");
   memory_start = pci_init (memory_start, memory_end);
+  boot_trace_end ("pci_init");
 
   if (memory_start > memory_end)
-    panic ("linux_init: ran out memory");
+    panic ("linux_probe: ran out memory");
 
   /*
    * Initialize devices.
@@ -151,7 +185,9 @@ linux_init (void)
   linux_net_emulation_init ();
 #endif
 
+  boot_trace_begin ("device_setup");
   device_setup ();
+  boot_trace_end ("device_setup");
 
 #ifdef CONFIG_PCMCIA
   /* 
@@ -160,8 +196,6 @@ linux_init (void)
   pcmcia_init ();
 #endif
 
-  restore_IRQ ();
-
   linux_auto_config = 0;
 }
 
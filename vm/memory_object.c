@@ -220,7 +220,7 @@ retry_lookup:
 		vm_page_insert(data_m, object, offset);
 
 		if (was_absent)
-			vm_page_activate(data_m);
+			vm_page_refault(data_m);
 		else
 			vm_page_deactivate(data_m);
 
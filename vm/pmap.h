@@ -150,6 +150,10 @@ void pmap_clear_modify(phys_addr_t pa);
 /* Return modify bit */
 boolean_t pmap_is_modified(phys_addr_t pa);
 
+/* Collect reference bits from user mappings, a batch of about max at
+   a time; return TRUE once all physical maps were swept.  */
+boolean_t pmap_scan_references(unsigned int max);
+
 /*
  *	Sundry required routines
  */
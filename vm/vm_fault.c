@@ -41,12 +41,14 @@
 #include <kern/debug.h>
 #include <kern/thread.h>
 #include <kern/sched_prim.h>
+#include <kern/trace.h>
 #include <vm/vm_map.h>
 #include <vm/vm_object.h>
 #include <vm/vm_page.h>
 #include <vm/pmap.h>
 #include <mach/vm_statistics.h>
 #include <vm/vm_pageout.h>
+#include <vm/vm_zcache.h>
 #include <mach/vm_param.h>
 #include <mach/memory_object.h>
 #include <vm/memory_object_user.user.h>
@@ -82,6 +84,7 @@ typedef struct vm_fault_state {
 	vm_offset_t vmfp_offset;
 	struct vm_page *vmfp_first_m;
 	vm_prot_t vmfp_access;
+	unsigned int vmfp_depth;
 } vm_fault_state_t;
 
 struct kmem_cache	vm_fault_state_cache;
@@ -93,6 +96,45 @@ boolean_t	vm_fault_interruptible = TRUE;
 
 boolean_t	software_reference_bits = TRUE;
 
+/*
+ *	Threads blocked in vm_fault_page, waiting for a page being
+ *	brought in or for its pager, and the number of such waits.
+ *	User faults wait with a continuation, and don't hold a kernel
+ *	stack.  Faults taken in kernel mode, e.g. by copyin or when
+ *	wiring memory, keep theirs.
+ */
+unsigned int	vm_fault_blocked_stackless;
+unsigned int	vm_fault_blocked_stack;
+unsigned long	vm_fault_waits_stackless;
+unsigned long	vm_fault_waits_stack;
+
+static inline void
+vm_fault_wait_begin(void (*continuation)())
+{
+	if (continuation != (void (*)()) 0) {
+		__atomic_add_fetch(&vm_fault_blocked_stackless, 1,
+				   __ATOMIC_RELAXED);
+		__atomic_add_fetch(&vm_fault_waits_stackless, 1,
+				   __ATOMIC_RELAXED);
+	} else {
+		__atomic_add_fetch(&vm_fault_blocked_stack, 1,
+				   __ATOMIC_RELAXED);
+		__atomic_add_fetch(&vm_fault_waits_stack, 1,
+				   __ATOMIC_RELAXED);
+	}
+}
+
+static inline void
+vm_fault_wait_end(void (*continuation)())
+{
+	if (continuation != (void (*)()) 0)
+		__atomic_sub_fetch(&vm_fault_blocked_stackless, 1,
+				   __ATOMIC_RELAXED);
+	else
+		__atomic_sub_fetch(&vm_fault_blocked_stack, 1,
+				   __ATOMIC_RELAXED);
+}
+
 #if	MACH_KDB
 extern struct db_watchpoint *db_watchpoint_list;
 #endif	/* MACH_KDB */
@@ -108,6 +150,18 @@ void vm_fault_init(void)
 			sizeof(vm_fault_state_t), 0, NULL, 0);
 }
 
+/*
+ *	Report the threads blocked in vm_fault_page.
+ */
+void vm_fault_wait_info(
+	host_vm_fault_wait_info_t	info)
+{
+	info->blocked_stackless = vm_fault_blocked_stackless;
+	info->blocked_stack = vm_fault_blocked_stack;
+	info->waits_stackless = vm_fault_waits_stackless;
+	info->waits_stack = vm_fault_waits_stack;
+}
+
 /*
  *	Routine:	vm_fault_cleanup
  *	Purpose:
@@ -228,6 +282,7 @@ vm_fault_return_t vm_fault_page(
 	vm_object_t	copy_object;
 	boolean_t	look_for_page;
 	vm_prot_t	access_required;
+	unsigned int	depth;		/* objects walked down the chain */
 
 	if (resume) {
 		vm_fault_state_t *state =
@@ -240,6 +295,7 @@ vm_fault_return_t vm_fault_page(
 		offset = state->vmfp_offset;
 		first_m = state->vmfp_first_m;
 		access_required = state->vmfp_access;
+		depth = state->vmfp_depth;
 		goto after_thread_block;
 	}
 
@@ -324,6 +380,7 @@ vm_fault_return_t vm_fault_page(
 	offset = first_offset;
 	first_m = VM_PAGE_NULL;
 	access_required = fault_type;
+	depth = 0;
 
 	/*
 	 *	See whether this page is resident
@@ -347,6 +404,7 @@ vm_fault_return_t vm_fault_page(
 
 				PAGE_ASSERT_WAIT(m, interruptible);
 				vm_object_unlock(object);
+				vm_fault_wait_begin(continuation);
 				if (continuation != (void (*)()) 0) {
 					vm_fault_state_t *state =
 						(vm_fault_state_t *) current_thread()->ith_other;
@@ -363,6 +421,7 @@ vm_fault_return_t vm_fault_page(
 					state->vmfp_first_m = first_m;
 					state->vmfp_access =
 						access_required;
+					state->vmfp_depth = depth;
 					state->vmf_prot = *protection;
 
 					counter(c_vm_fault_page_block_busy_user++);
@@ -373,6 +432,7 @@ vm_fault_return_t vm_fault_page(
 					thread_block((void (*)()) 0);
 				}
 			    after_thread_block:
+				vm_fault_wait_end(continuation);
 				wait_result = current_thread()->wait_result;
 				vm_object_lock(object);
 				if (wait_result != THREAD_AWAKENED) {
@@ -486,6 +546,7 @@ vm_fault_return_t vm_fault_page(
 					vm_object_lock(next_object);
 					vm_object_unlock(object);
 					object = next_object;
+					depth++;
 					vm_object_paging_begin(object);
 					continue;
 				}
@@ -558,6 +619,26 @@ vm_fault_return_t vm_fault_page(
 			break;
 		}
 
+		/*
+		 *	The page may have been compressed instead of
+		 *	being paged out.  If so, bring it back.
+		 */
+
+		if (!must_be_resident && vm_zcache_lookup(object, offset)) {
+			m = vm_page_grab();
+			if (m == VM_PAGE_NULL) {
+				vm_fault_cleanup(object, first_m);
+				return(VM_FAULT_MEMORY_SHORTAGE);
+			}
+
+			assert(m->busy);
+			vm_page_lock_queues();
+			vm_page_insert(m, object, offset);
+			vm_page_unlock_queues();
+			vm_zcache_load(m);
+			break;
+		}
+
 		look_for_page =
 			(object->pager_created)
 #if	MACH_PAGEMAP
@@ -746,6 +827,7 @@ vm_fault_return_t vm_fault_page(
 				vm_object_paging_end(object);
 			vm_object_unlock(object);
 			object = next_object;
+			depth++;
 			vm_object_paging_begin(object);
 		}
 	}
@@ -929,7 +1011,8 @@ vm_fault_return_t vm_fault_page(
 		copy_object->ref_count++;
 
 		/*
-		 *	Does the page exist in the copy?
+		 *	Does the page exist in the copy?  A compressed
+		 *	page does, and needn't be pushed.
 		 */
 		copy_offset = first_offset - copy_object->shadow_offset;
 		copy_m = vm_page_lookup(copy_object, copy_offset);
@@ -947,7 +1030,7 @@ vm_fault_return_t vm_fault_page(
 				goto block_and_backoff;
 			}
 		}
-		else {
+		else if (!vm_zcache_lookup(copy_object, copy_offset)) {
 			/*
 			 *	Allocate a page for the copy
 			 */
@@ -1067,6 +1150,8 @@ vm_fault_return_t vm_fault_page(
 	*result_page = m;
 	*top_page = first_m;
 
+	vm_object_count_fault_depth(depth);
+
 	/*
 	 *	If the page can be written, assume that it will be.
 	 *	[Earlier, we restrict the permission to allow write
@@ -1081,6 +1166,7 @@ vm_fault_return_t vm_fault_page(
 
     block_and_backoff:
 	vm_fault_cleanup(object, first_m);
+	vm_fault_wait_begin(continuation);
 
 	if (continuation != (void (*)()) 0) {
 		vm_fault_state_t *state =
@@ -1101,6 +1187,7 @@ vm_fault_return_t vm_fault_page(
 		thread_block((void (*)()) 0);
 	}
     after_block_and_backoff:
+	vm_fault_wait_end(continuation);
 	if (current_thread()->wait_result == THREAD_AWAKENED)
 		return VM_FAULT_RETRY;
 	else
@@ -1187,6 +1274,8 @@ kern_return_t vm_fault(
 		goto after_vm_fault_page;
 	}
 
+	TRACE(TRACE_VM_FAULT, map, vaddr, fault_type);
+
 	if (continuation != (void (*)()) 0) {
 		/*
 		 *	We will probably need to save state.
@@ -32,6 +32,7 @@
 #ifndef	_VM_VM_FAULT_H_
 #define _VM_VM_FAULT_H_
 
+#include <mach/host_info.h>
 #include <mach/kern_return.h>
 #include <mach/vm_prot.h>
 #include <vm/vm_map.h>
@@ -56,6 +57,9 @@ extern vm_fault_return_t vm_fault_page(vm_object_t, vm_offset_t, vm_prot_t,
 				       void (*)());
 
 extern void		vm_fault_cleanup(vm_object_t, vm_page_t);
+
+/* Report the threads blocked in vm_fault_page.  */
+extern void		vm_fault_wait_info(host_vm_fault_wait_info_t);
 /*
  *	Page fault handling based on vm_map (or entries therein)
  */
@@ -35,6 +35,7 @@
  */
 
 #include <mach/machine/vm_types.h>
+#include <kern/boot_trace.h>
 #include <kern/slab.h>
 #include <kern/kalloc.h>
 #include <vm/vm_fault.h>
@@ -42,6 +43,7 @@
 #include <vm/vm_map.h>
 #include <vm/vm_page.h>
 #include <vm/vm_kern.h>
+#include <vm/vm_zcache.h>
 #include <vm/memory_object.h>
 #include <vm/memory_object_proxy.h>
 
@@ -72,7 +74,9 @@ void vm_mem_bootstrap(void)
 	vm_map_init();
 	kmem_init(start, end);
 	pmap_init();
+	boot_trace_begin("slab_init");
 	slab_init();
+	boot_trace_end("slab_init");
 	kalloc_init();
 	vm_fault_init();
 	vm_page_module_init();
@@ -82,6 +86,7 @@ void vm_mem_bootstrap(void)
 void vm_mem_init(void)
 {
 	vm_object_init();
+	vm_zcache_init();
 	memory_object_proxy_init();
 	vm_page_info_all();
 }
@@ -4220,6 +4220,13 @@ error:
 	return(result);
 }
 
+/*
+ *	Whether vm_map_fork copies the mappings of the parent into the
+ *	child, read-only, so that the child doesn't fault the pages it
+ *	shares with the parent in one by one.
+ */
+boolean_t	vm_map_fork_prefault = TRUE;
+
 /*
  *	vm_map_fork:
  *
@@ -4364,10 +4371,11 @@ vm_map_t vm_map_fork(vm_map_t old_map)
 			 *	Update the physical map
 			 */
 
-			pmap_copy(new_map->pmap, old_map->pmap,
-				new_entry->vme_start,
-				entry_size,
-				old_entry->vme_start);
+			if (vm_map_fork_prefault)
+				pmap_copy(new_map->pmap, old_map->pmap,
+					new_entry->vme_start,
+					entry_size,
+					old_entry->vme_start);
 
 			new_size += entry_size;
 			break;
@@ -4416,6 +4424,19 @@ vm_map_t vm_map_fork(vm_map_t old_map)
 						vm_map_last_entry(new_map),
 						new_entry);
 
+					/*
+					 *	Give the child the resident
+					 *	pages, read-only.  They are the
+					 *	ones both entries see until the
+					 *	first write.
+					 */
+
+					if (vm_map_fork_prefault)
+						pmap_copy(new_map->pmap,
+							old_map->pmap,
+							new_entry->vme_start,
+							entry_size,
+							old_entry->vme_start);
 
 					new_size += entry_size;
 					break;
@@ -54,6 +54,7 @@
 #include <vm/vm_object.h>
 #include <vm/vm_page.h>
 #include <vm/vm_pageout.h>
+#include <vm/vm_zcache.h>
 
 #if	MACH_KDB
 #include <ddb/db_output.h>
@@ -200,6 +201,34 @@ int		vm_object_cached_pages;
 
 decl_simple_lock_data(,vm_object_cached_pages_lock_data)
 
+/*
+ *	Shadow chain limiting.
+ *
+ *	Every fork shadows the copy-on-write objects of the parent
+ *	again, and vm_object_collapse only merges a chain from the
+ *	object it is called on, which must be the only user of the
+ *	object below.  A task forking children that exec or exit thus
+ *	leaves chains that only shrink when their top object happens
+ *	to be worked on, and page faults walk them again and again.
+ *
+ *	Objects shadowing a chain deeper than vm_object_shadow_depth_limit
+ *	are queued to the collapse thread, which calls vm_object_collapse
+ *	on each object of the chain in turn: once the children are gone,
+ *	the objects they shared have a single user and merge.
+ */
+int		vm_object_shadow_depth_limit = 8;
+
+#define	VM_OBJECT_COLLAPSE_QUEUE_SIZE	64
+
+decl_simple_lock_data(, vm_object_collapse_lock)
+vm_object_t	vm_object_collapse_queue[VM_OBJECT_COLLAPSE_QUEUE_SIZE];
+unsigned int	vm_object_collapse_count;	/* queued objects */
+
+unsigned int	vm_object_fault_depth[HOST_VM_SHADOW_DEPTHS];
+unsigned int	vm_object_collapse_queued;
+unsigned int	vm_object_collapse_dropped;
+unsigned int	vm_object_collapse_walks;
+
 /*
  *	Virtual memory objects are initialized from
  *	a template (see vm_object_allocate).
@@ -222,6 +251,7 @@ static void _vm_object_setup(
 {
 	*object = vm_object_template;
 	queue_init(&object->memq);
+	queue_init(&object->compressed_pages);
 	vm_object_lock_init(object);
 	object->size = size;
 }
@@ -270,6 +300,7 @@ void vm_object_bootstrap(void)
 
 	queue_init(&vm_object_cached_list);
 	simple_lock_init(&vm_object_cached_lock_data);
+	simple_lock_init(&vm_object_collapse_lock);
 
 	/*
 	 *	Fill in a template object, for quick initialization
@@ -281,6 +312,7 @@ void vm_object_bootstrap(void)
 	vm_object_template.copy = VM_OBJECT_NULL;
 	vm_object_template.shadow = VM_OBJECT_NULL;
 	vm_object_template.shadow_offset = (vm_offset_t) 0;
+	vm_object_template.shadow_depth = 0;
 
 	vm_object_template.pager = IP_NULL;
 	vm_object_template.paging_offset = 0;
@@ -310,6 +342,7 @@ void vm_object_bootstrap(void)
 	vm_object_template.lock_in_progress = FALSE;
 	vm_object_template.lock_restart = FALSE;
 	vm_object_template.last_alloc = (vm_offset_t) 0;
+	vm_object_template.compressed_page_count = 0;
 
 #if	MACH_PAGEMAP
 	vm_object_template.existence_info = VM_EXTERNAL_NULL;
@@ -563,6 +596,16 @@ void vm_object_terminate(
 
 	vm_object_paging_wait(object, FALSE);
 
+	/*
+	 *	Compressed pages belong to internal objects, the
+	 *	data of which die with them.
+	 */
+
+	if (object->compressed_page_count != 0)
+		vm_zcache_discard(object, 0, object->size);
+
+	assert(object->compressed_page_count == 0);
+
 	/*
 	 *	Clean or free the pages, as appropriate.
 	 *	It is possible for us to find busy/absent pages,
@@ -1371,6 +1414,7 @@ kern_return_t vm_object_copy_call(
 	assert(new_object);
 	new_object->shadow = src_object;
 	new_object->shadow_offset = src_offset;
+	new_object->shadow_depth = src_object->shadow_depth + 1;
 
 	/*
 	 *	Drop the reference for new_memory_object taken above.
@@ -1519,6 +1563,7 @@ vm_object_t vm_object_copy_delayed(
 		src_object->ref_count--;	/* remove ref. from old_copy */
 		assert(src_object->ref_count > 0);
 		old_copy->shadow = new_copy;
+		old_copy->shadow_depth = src_object->shadow_depth + 2;
 		assert(new_copy->ref_count > 0);
 		new_copy->ref_count++;
 		vm_object_unlock(old_copy);	/* done with old_copy */
@@ -1530,6 +1575,7 @@ vm_object_t vm_object_copy_delayed(
 
 	new_copy->shadow = src_object;
 	new_copy->shadow_offset = 0;
+	new_copy->shadow_depth = src_object->shadow_depth + 1;
 	new_copy->shadowed = TRUE;	/* caller must set needs_copy */
 	assert(src_object->ref_count > 0);
 	src_object->ref_count++;
@@ -1702,6 +1748,12 @@ void vm_object_shadow(
 
 	result->shadow_offset = *offset;
 
+	if (source != VM_OBJECT_NULL) {
+		result->shadow_depth = source->shadow_depth + 1;
+		if (result->shadow_depth > vm_object_shadow_depth_limit)
+			vm_object_collapse_enqueue(result);
+	}
+
 	/*
 	 *	Return the new things
 	 */
@@ -2316,6 +2368,7 @@ void vm_object_collapse(
 		 */
 		if (object == VM_OBJECT_NULL ||
 		    object->pager_created ||
+		    object->compressed_page_count != 0 ||
 		    object->paging_in_progress != 0 ||
 		    object->absent_count != 0)
 			return;
@@ -2334,12 +2387,15 @@ void vm_object_collapse(
 		 *		and no pages in the backing object are
 		 *		currently being paged out.
 		 *		The backing object is internal.
+		 *		No pages in the backing object are
+		 *		compressed, as they can't be moved.
 		 *
 		 *	XXX It may be sufficient for the backing
 		 *	XXX object to be temporary.
 		 */
 	
 		if (!backing_object->internal ||
+		    backing_object->compressed_page_count != 0 ||
 		    backing_object->paging_in_progress != 0) {
 			vm_object_unlock(backing_object);
 			return;
@@ -2507,6 +2563,7 @@ void vm_object_collapse(
 
 			object->shadow = backing_object->shadow;
 			object->shadow_offset += backing_object->shadow_offset;
+			object->shadow_depth = backing_object->shadow_depth;
 			if (object->shadow != VM_OBJECT_NULL &&
 			    object->shadow->copy != VM_OBJECT_NULL) {
 				panic("vm_object_collapse: we collapsed a copy-object!");
@@ -2602,6 +2659,7 @@ void vm_object_collapse(
 
 			vm_object_reference(object->shadow = backing_object->shadow);
 			object->shadow_offset += backing_object->shadow_offset;
+			object->shadow_depth = backing_object->shadow_depth;
 
 			/*
 			 *	Backing object might have had a copy pointer
@@ -2630,6 +2688,122 @@ void vm_object_collapse(
 	}
 }
 
+/*
+ *	Queue an object for the collapse thread, with a reference.
+ *	The object must not be locked.
+ */
+void vm_object_collapse_enqueue(
+	vm_object_t	object)
+{
+	vm_object_reference(object);
+
+	simple_lock(&vm_object_collapse_lock);
+	if (vm_object_collapse_count == VM_OBJECT_COLLAPSE_QUEUE_SIZE) {
+		vm_object_collapse_dropped++;
+		simple_unlock(&vm_object_collapse_lock);
+		vm_object_deallocate(object);
+		return;
+	}
+
+	vm_object_collapse_queue[vm_object_collapse_count++] = object;
+	vm_object_collapse_queued++;
+	if (vm_object_collapse_count == 1)
+		thread_wakeup((event_t) &vm_object_collapse_count);
+	simple_unlock(&vm_object_collapse_lock);
+}
+
+/*
+ *	Collapse what can be of the chain below object, and consume
+ *	the reference the queue held for it.
+ */
+static void vm_object_collapse_chain(
+	vm_object_t	object)
+{
+	vm_object_t	top, next;
+	unsigned int	depth;
+
+	top = object;
+	depth = 0;
+	vm_object_lock(object);
+	for (;;) {
+		vm_object_collapse(object);
+
+		/*
+		 *	Hold a reference on the next object before
+		 *	letting go of this one, which held it so far.
+		 */
+		next = object->shadow;
+		if (next == VM_OBJECT_NULL)
+			break;
+		vm_object_lock(next);
+		vm_object_reference_locked(next);
+		vm_object_unlock(next);
+		vm_object_unlock(object);
+		if (object != top)
+			vm_object_deallocate(object);
+
+		object = next;
+		depth++;
+		vm_object_lock(object);
+	}
+	vm_object_unlock(object);
+	if (object != top)
+		vm_object_deallocate(object);
+
+	/*
+	 *	The walk measured the chain, correct the bound.
+	 */
+	vm_object_lock(top);
+	if (depth < top->shadow_depth)
+		top->shadow_depth = depth;
+	vm_object_unlock(top);
+	vm_object_deallocate(top);
+
+	vm_object_collapse_walks++;
+}
+
+static void __attribute__((noreturn)) vm_object_collapse_continue(void)
+{
+	vm_object_t	object;
+
+	for (;;) {
+		simple_lock(&vm_object_collapse_lock);
+		if (vm_object_collapse_count == 0) {
+			assert_wait((event_t) &vm_object_collapse_count,
+				    FALSE);
+			simple_unlock(&vm_object_collapse_lock);
+			thread_block(vm_object_collapse_continue);
+			/* NOTREACHED */
+		}
+
+		object = vm_object_collapse_queue[--vm_object_collapse_count];
+		simple_unlock(&vm_object_collapse_lock);
+
+		vm_object_collapse_chain(object);
+	}
+}
+
+void vm_object_collapse_thread(void)
+{
+	vm_object_collapse_continue();
+	/* NOTREACHED */
+}
+
+void vm_object_shadow_info(
+	host_vm_shadow_info_t	info)
+{
+	int	i;
+
+	for (i = 0; i < HOST_VM_SHADOW_DEPTHS; i++)
+		info->fault_depth[i] = vm_object_fault_depth[i];
+	info->depth_limit = vm_object_shadow_depth_limit;
+	info->collapse_queued = vm_object_collapse_queued;
+	info->collapse_dropped = vm_object_collapse_dropped;
+	info->collapse_walks = vm_object_collapse_walks;
+	info->collapses = object_collapses;
+	info->bypasses = object_bypasses;
+}
+
 /*
  *	Routine:	vm_object_page_remove: [internal]
  *	Purpose:
@@ -2649,6 +2823,9 @@ void vm_object_page_remove(
 {
 	vm_page_t	p, next;
 
+	if (object->compressed_page_count != 0)
+		vm_zcache_discard(object, start, end);
+
 	/*
 	 *	One and two page removals are most popular.
 	 *	The factor of 16 here is somewhat arbitrary.
@@ -2744,6 +2921,7 @@ boolean_t vm_object_coalesce(
 
 	if ((prev_object->ref_count > 1) ||
 	    prev_object->pager_created ||
+	    (prev_object->compressed_page_count != 0) ||
 	    prev_object->used_for_pageout ||
 	    (prev_object->shadow != VM_OBJECT_NULL) ||
 	    (prev_object->copy != VM_OBJECT_NULL) ||
@@ -37,6 +37,7 @@
 #include <sys/types.h>
 #include <mach/kern_return.h>
 #include <mach/boolean.h>
+#include <mach/host_info.h>
 #include <mach/memory_object.h>
 #include <mach/port.h>
 #include <mach/vm_prot.h>
@@ -80,6 +81,12 @@ struct vm_object {
 						 */
 	struct vm_object	*shadow;	/* My shadow */
 	vm_offset_t		shadow_offset;	/* Offset into shadow */
+	unsigned int		shadow_depth;	/* Length of the shadow
+						 * chain below; an upper
+						 * bound, as collapsing
+						 * deeper objects doesn't
+						 * update it
+						 */
 
 	struct ipc_port		*pager;		/* Where to get data */
 	vm_offset_t		paging_offset;	/* Offset into memory object */
@@ -160,6 +167,12 @@ struct vm_object {
 						 * of their can_persist value
 						 */
 	vm_offset_t		last_alloc;	/* last allocation offset */
+	queue_head_t		compressed_pages;
+						/* Pages held in the compressed
+						 * page cache, see vm_zcache.c
+						 */
+	unsigned long		compressed_page_count;
+						/* number of compressed pages */
 #if	MACH_PAGEMAP
 	vm_external_t		existence_info;
 #endif	/* MACH_PAGEMAP */
@@ -198,6 +211,9 @@ extern void		vm_object_shadow(
 	vm_object_t	*object,	/* in/out */
 	vm_offset_t	*offset,	/* in/out */
 	vm_size_t	length);
+extern void		vm_object_collapse_enqueue(vm_object_t);
+extern void		vm_object_collapse_thread(void);
+extern void		vm_object_shadow_info(host_vm_shadow_info_t);
 extern void		vm_object_collapse(vm_object_t);
 extern vm_object_t	vm_object_lookup(struct ipc_port *);
 extern vm_object_t	vm_object_lookup_name(struct ipc_port *);
@@ -396,6 +412,15 @@ MACRO_END
 extern int	vm_object_external_count;
 extern int	vm_object_external_pages;
 
+/*
+ *	Depths of the shadow chain walks done by page faults.
+ */
+extern unsigned int	vm_object_fault_depth[HOST_VM_SHADOW_DEPTHS];
+
+#define vm_object_count_fault_depth(depth)				\
+	(vm_object_fault_depth[(depth) < HOST_VM_SHADOW_DEPTHS - 1	\
+			       ? (depth) : HOST_VM_SHADOW_DEPTHS - 1]++)
+
 /* Add a reference to a locked VM object. */
 static inline int
 vm_object_reference_locked (vm_object_t obj)
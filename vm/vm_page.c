@@ -38,6 +38,8 @@
 #include <kern/debug.h>
 #include <kern/list.h>
 #include <kern/lock.h>
+#include <kern/log2.h>
+#include <kern/mach_clock.h>
 #include <kern/macros.h>
 #include <kern/printf.h>
 #include <kern/thread.h>
@@ -47,6 +49,9 @@
 #include <vm/memory_object.h>
 #include <vm/vm_page.h>
 #include <vm/vm_pageout.h>
+#include <vm/vm_zcache.h>
+
+extern char *kernel_cmdline;
 
 #define DEBUG 0
 
@@ -204,8 +209,10 @@ struct vm_page_seg {
     struct vm_page *pages;
     struct vm_page *pages_end;
     simple_lock_data_t lock;
-    struct vm_page_free_list free_lists[VM_PAGE_NR_FREE_LISTS];
+    struct vm_page_free_list free_lists[VM_PAGE_MAX_NODES]
+                                       [VM_PAGE_NR_FREE_LISTS];
     unsigned long nr_free_pages;
+    unsigned long nr_node_free_pages[VM_PAGE_MAX_NODES];
 
     /* Free memory thresholds */
     unsigned long min_free_pages; /* Privileged allocations only */
@@ -213,12 +220,21 @@ struct vm_page_seg {
     unsigned long high_free_pages; /* Pageout daemon stops scanning,
                                       unprivileged allocations resume */
 
+    /* Shares of the low and high thresholds of each node */
+    unsigned long node_low_free_pages[VM_PAGE_MAX_NODES];
+    unsigned long node_high_free_pages[VM_PAGE_MAX_NODES];
+    unsigned int short_nodes; /* Nodes the pageout daemon scans for */
+
     /* Page cache related data */
     struct vm_page_queue active_pages;
     unsigned long nr_active_pages;
     unsigned long high_active_pages;
     struct vm_page_queue inactive_pages;
     unsigned long nr_inactive_pages;
+    unsigned long nr_node_cache_pages[VM_PAGE_MAX_NODES];
+
+    /* Index of the next page to scan for merging */
+    unsigned long merge_cursor;
 };
 
 /*
@@ -262,6 +278,65 @@ static struct vm_page_boot_seg vm_page_boot_segs[VM_PAGE_MAX_SEGS] __initdata;
  */
 static unsigned int vm_page_segs_size __read_mostly;
 
+/*
+ * NUMA nodes.
+ *
+ * Free pages are kept on per-node free lists in each segment, so that
+ * segments keep their meaning as address classes. Allocations are
+ * served from the preferred node, by default the node of the current
+ * processor, and then from the other nodes, nearest first. Processor
+ * pools only hold pages of the node of their processor : they are only
+ * filled from that node, and pages of other nodes are freed directly to
+ * their free lists.
+ *
+ * Each node also gets the share of the free memory thresholds of a
+ * segment matching its share of the pages of the segment. When the
+ * preferred node of an allocation is below its low threshold, it's
+ * marked short in the segment and the pageout daemon is started, before
+ * the allocation spills to other nodes. Once the segment as a whole has
+ * enough free pages, the daemon only evicts pages of its short nodes,
+ * until they are back above their high threshold or have no page left
+ * to evict.
+ *
+ * Machine-dependent code reports the memory ranges and processors of
+ * each node, and the distances between nodes, before vm_page_setup.
+ * Without such information, all memory belongs to node 0.
+ */
+#define VM_PAGE_MAX_NODE_RANGES 32
+
+struct vm_page_node_range {
+    phys_addr_t start;
+    phys_addr_t end;
+    unsigned int node;
+};
+
+static struct vm_page_node_range vm_page_node_ranges[VM_PAGE_MAX_NODE_RANGES]
+    __initdata;
+static unsigned int vm_page_node_ranges_size __initdata;
+
+static unsigned int vm_page_nodes_size __read_mostly = 1;
+static unsigned short vm_page_cpu_nodes[NCPUS] __read_mostly;
+
+/*
+ * Relative distances between nodes, as reported by the ACPI SLIT, 10
+ * meaning local.
+ */
+static unsigned char vm_page_node_distances[VM_PAGE_MAX_NODES]
+                                           [VM_PAGE_MAX_NODES] __read_mostly;
+
+/*
+ * Nodes in allocation order, nearest first, for each preferred node.
+ */
+static unsigned char vm_page_node_orders[VM_PAGE_MAX_NODES]
+                                        [VM_PAGE_MAX_NODES] __read_mostly;
+
+/*
+ * Statistics, by preferred node.
+ */
+unsigned long vm_page_node_local_allocs[VM_PAGE_MAX_NODES];
+unsigned long vm_page_node_remote_allocs[VM_PAGE_MAX_NODES];
+unsigned long vm_page_node_shortages[VM_PAGE_MAX_NODES];
+
 /*
  * If true, unprivileged allocations are blocked, disregarding any other
  * condition.
@@ -272,6 +347,237 @@ static unsigned int vm_page_segs_size __read_mostly;
  */
 static boolean_t vm_page_alloc_paused;
 
+/*
+ * Working set replacement, selected with the " pageout=workingset" boot
+ * option.
+ *
+ * The default policy activates all pages brought in by faults, and
+ * deactivates active pages in queue order, so that file pages read
+ * once push out pages in constant use. Instead, the working set policy :
+ *  - places pages brought in by faults on the inactive queue, unless
+ *    their refault distance shows they were evicted from the working set,
+ *  - activates inactive pages only once they are found referenced by
+ *    two passes of the page daemon,
+ *  - ages active pages by generations, and only deactivates those that
+ *    haven't been referenced for VM_PAGE_NR_GENS - 1 generations.
+ *
+ * Generations are opened by sweeps of the page tables. Before refilling
+ * the inactive queues, the page daemon has the physical maps scan a batch
+ * of VM_PAGE_SCAN_BATCH user mappings, moving their reference bits to
+ * the attributes of the pages they map, where pmap_is_referenced finds
+ * them at once. A new generation is opened each time all physical maps
+ * have been swept. An active page found referenced is moved to the
+ * youngest generation, while an unreferenced page stays in the one it
+ * was last found referenced in. If the active queue of a segment only
+ * holds pages of the young generations, a generation is opened at once,
+ * so that the oldest of them can be deactivated on the next pass.
+ *
+ * Pages record the generation modulo 256 only. As pages are deactivated
+ * as soon as the page daemon finds them old, the age of an active page
+ * very rarely reaches that.
+ *
+ * The refault distance of a page is the number of evictions between its
+ * eviction and its refault. If it's below the number of active pages,
+ * the page would have stayed resident had the inactive queue been that
+ * much larger, and it belongs to the working set. Evicted pages leave a shadow
+ * entry with the eviction count in a table indexed by object and offset.
+ * Entries are overwritten on collision and objects are reused, so the
+ * distance is only a hint.
+ *
+ * Distances are only computed for pages whose data come back from where
+ * eviction sent them, i.e. pages supplied by their pager and pages
+ * decompressed from the compressed page cache, which both call
+ * vm_page_refault. Zero filled pages have no previous eviction.
+ *
+ * The shadow table and the eviction count are protected by the page
+ * queues lock.
+ */
+#define VM_PAGE_WORKINGSET_PARAMETER " pageout=workingset"
+
+/*
+ * Number of pages per shadow entry.
+ */
+#define VM_PAGE_SHADOW_RATIO 4
+
+struct vm_page_shadow {
+    vm_object_t object;
+    vm_offset_t offset;
+    unsigned long eviction;
+};
+
+static boolean_t vm_page_workingset __read_mostly;
+static struct vm_page_shadow *vm_page_shadows __read_mostly;
+static unsigned long vm_page_shadows_mask __read_mostly;
+static unsigned long vm_page_evictions;
+
+/*
+ * Number of generations of active pages, and number of mappings scanned
+ * per batch.
+ */
+#define VM_PAGE_NR_GENS     4
+#define VM_PAGE_SCAN_BATCH  2048
+
+/*
+ * Youngest generation, protected by the page queues lock.
+ */
+static unsigned long vm_page_gen_max;
+
+/*
+ * Statistics.
+ */
+unsigned long vm_page_workingset_refaults;
+unsigned long vm_page_workingset_activations;
+unsigned long vm_page_workingset_generations;
+
+static struct vm_page_shadow *
+vm_page_shadow_get(vm_object_t object, vm_offset_t offset)
+{
+    unsigned long hash;
+
+    hash = ((unsigned long)object / sizeof(struct vm_object))
+           ^ (offset >> PAGE_SHIFT);
+    hash *= 0x9e3779b9UL;
+    hash ^= hash >> 29;
+    return &vm_page_shadows[hash & vm_page_shadows_mask];
+}
+
+/*
+ * Return the number of generations opened since the page was last found
+ * referenced while active.
+ */
+static inline unsigned int
+vm_page_gen_age(const struct vm_page *page)
+{
+    return (unsigned char)(vm_page_gen_max - page->gen);
+}
+
+/*
+ * Scan a batch of mappings for reference bits, and open a generation
+ * once all physical maps have been swept.
+ *
+ * The page queues lock must not be held.
+ */
+static void
+vm_page_workingset_age(void)
+{
+    if (!pmap_scan_references(VM_PAGE_SCAN_BATCH)) {
+        return;
+    }
+
+    vm_page_lock_queues();
+    vm_page_gen_max++;
+    vm_page_workingset_generations++;
+    vm_page_unlock_queues();
+}
+
+static void
+vm_page_workingset_evict(const struct vm_page *page)
+{
+    struct vm_page_shadow *shadow;
+
+    if (!vm_page_workingset) {
+        return;
+    }
+
+    shadow = vm_page_shadow_get(page->object, page->offset);
+    shadow->object = page->object;
+    shadow->offset = page->offset;
+    shadow->eviction = vm_page_evictions++;
+}
+
+/*
+ * Memory compaction.
+ *
+ * Contiguous allocations fail once free pages are scattered in blocks
+ * smaller than requested. Compaction frees a naturally aligned block of
+ * pages by moving the pageable pages it contains elsewhere in its
+ * segment, the same way pages are moved between segments for balancing.
+ * Their mappings are removed and lazily restored by page faults.
+ *
+ * Compaction is run synchronously on contiguous allocation failures, by
+ * the failing thread, and in the background by the compaction thread,
+ * which these failures wake up, and which frees a few more blocks of the
+ * failed size so that the next allocations succeed at once.
+ *
+ * The compaction request is protected by its own lock.
+ */
+
+/*
+ * Number of blocks the compaction thread attempts to make available.
+ */
+#define VM_PAGE_COMPACT_RESERVE 4
+
+decl_simple_lock_data(static, vm_page_compact_lock)
+static unsigned int vm_page_compact_order;      /* 0 if no request */
+static unsigned int vm_page_compact_selector;
+
+/*
+ * Statistics.
+ */
+unsigned long vm_page_compact_stalls;           /* synchronous compactions */
+unsigned long vm_page_compact_success;          /* blocks made available */
+unsigned long vm_page_compact_fail;
+unsigned long vm_page_compact_migrated;         /* pages moved */
+
+static unsigned int __init
+vm_page_node_lookup(phys_addr_t pa)
+{
+    const struct vm_page_node_range *range;
+    unsigned int i;
+
+    for (i = 0; i < vm_page_node_ranges_size; i++) {
+        range = &vm_page_node_ranges[i];
+
+        if ((pa >= range->start) && (pa < range->end)) {
+            return range->node;
+        }
+    }
+
+    return 0;
+}
+
+static inline unsigned int
+vm_page_cpu_node(void)
+{
+    return vm_page_cpu_nodes[cpu_number()];
+}
+
+/*
+ * Zero page merging.
+ *
+ * Anonymous memory often holds pages that are entirely zero, e.g. unused
+ * parts of buffers and heaps. The merging thread scans physical pages at
+ * a configurable rate, and releases the zero pages of internal objects
+ * whose missing pages are zero-filled, i.e. objects without pager and
+ * without shadow. Those pages are thus merged into the zero fill : the
+ * next access faults, and gets a new zero page if it's a write.
+ *
+ * A page belongs to a single object, so identical pages of different
+ * objects can't share a physical page. Zero pages, which are the most
+ * common duplicates, don't need any.
+ *
+ * Pages are checked while unmapped and with their object locked, so that
+ * they can't change between the check and their release. Recently
+ * referenced pages are skipped.
+ *
+ * Merging is disabled until enabled with vm_set_page_merging.
+ */
+/*
+ * Number of pages scanned between yields of the merging thread.
+ */
+#define VM_PAGE_MERGE_BATCH_SIZE 256
+
+static unsigned int vm_page_merge_scan_pages;   /* 0 if disabled */
+static unsigned int vm_page_merge_scan_interval = 1000; /* milliseconds */
+static unsigned int vm_page_merge_seg_index;
+
+/*
+ * Statistics.
+ */
+unsigned long vm_page_merge_full_scans;
+unsigned long vm_page_merge_scanned;
+unsigned long vm_page_merge_merged;
+
 static void __init
 vm_page_init_pa(struct vm_page *page, unsigned short seg_index, phys_addr_t pa)
 {
@@ -279,6 +585,7 @@ vm_page_init_pa(struct vm_page *page, unsigned short seg_index, phys_addr_t pa)
     vm_page_init(page); /* vm_resident members */
     page->type = VM_PT_RESERVED;
     page->seg_index = seg_index;
+    page->node_index = vm_page_node_lookup(pa);
     page->order = VM_PAGE_ORDER_UNLISTED;
     page->priv = NULL;
     page->phys_addr = pa;
@@ -357,13 +664,53 @@ vm_page_free_list_remove(struct vm_page_free_list *free_list,
 }
 
 static struct vm_page *
-vm_page_seg_alloc_from_buddy(struct vm_page_seg *seg, unsigned int order)
+vm_page_seg_alloc_from_node(struct vm_page_seg *seg, unsigned int order,
+                            unsigned int node)
 {
-    struct vm_page_free_list *free_list = free_list;
+    struct vm_page_free_list *free_lists, *free_list = free_list;
     struct vm_page *page, *buddy;
     unsigned int i;
 
+    free_lists = seg->free_lists[node];
+
+    for (i = order; i < VM_PAGE_NR_FREE_LISTS; i++) {
+        free_list = &free_lists[i];
+
+        if (free_list->size != 0)
+            break;
+    }
+
+    if (i == VM_PAGE_NR_FREE_LISTS)
+        return NULL;
+
+    page = list_first_entry(&free_list->blocks, struct vm_page, node);
+    vm_page_free_list_remove(free_list, page);
+    page->order = VM_PAGE_ORDER_UNLISTED;
+
+    while (i > order) {
+        i--;
+        buddy = &page[1 << i];
+        vm_page_free_list_insert(&free_lists[i], buddy);
+        buddy->order = i;
+    }
+
+    seg->nr_node_free_pages[node] -= (1 << order);
+    return page;
+}
+
+/*
+ * Allocate a block of 2^order pages from a segment, preferably from the
+ * given node, or only from it if local_only is true.
+ */
+static struct vm_page *
+vm_page_seg_alloc_from_buddy(struct vm_page_seg *seg, unsigned int order,
+                             unsigned int node, boolean_t local_only)
+{
+    struct vm_page *page;
+    unsigned int i, nr_nodes;
+
     assert(order < VM_PAGE_NR_FREE_LISTS);
+    assert(node < vm_page_nodes_size);
 
     if (vm_page_alloc_paused && current_thread()
         && !current_thread()->vm_privilege) {
@@ -378,27 +725,40 @@ vm_page_seg_alloc_from_buddy(struct vm_page_seg *seg, unsigned int order)
         }
     }
 
-    for (i = order; i < VM_PAGE_NR_FREE_LISTS; i++) {
-        free_list = &seg->free_lists[i];
+    /*
+     * Have the pageout daemon reclaim pages of the preferred node before
+     * spilling to other nodes.
+     */
+    if ((vm_page_nodes_size > 1)
+        && (seg->nr_node_free_pages[node] <= seg->node_low_free_pages[node])
+        && (seg->nr_node_cache_pages[node] != 0)) {
+        if (!(seg->short_nodes & (1U << node))) {
+            seg->short_nodes |= (1U << node);
+            vm_page_node_shortages[node]++;
+        }
 
-        if (free_list->size != 0)
-            break;
+        vm_pageout_start();
     }
 
-    if (i == VM_PAGE_NR_FREE_LISTS)
-        return NULL;
+    nr_nodes = local_only ? 1 : vm_page_nodes_size;
+    page = NULL;
 
-    page = list_first_entry(&free_list->blocks, struct vm_page, node);
-    vm_page_free_list_remove(free_list, page);
-    page->order = VM_PAGE_ORDER_UNLISTED;
+    for (i = 0; i < nr_nodes; i++) {
+        page = vm_page_seg_alloc_from_node(seg, order,
+                                           vm_page_node_orders[node][i]);
 
-    while (i > order) {
-        i--;
-        buddy = &page[1 << i];
-        vm_page_free_list_insert(&seg->free_lists[i], buddy);
-        buddy->order = i;
+        if (page != NULL)
+            break;
     }
 
+    if (page == NULL)
+        return NULL;
+
+    if (i == 0)
+        vm_page_node_local_allocs[node]++;
+    else
+        vm_page_node_remote_allocs[node]++;
+
     seg->nr_free_pages -= (1 << order);
 
     if (seg->nr_free_pages < seg->min_free_pages) {
@@ -412,9 +772,10 @@ static void
 vm_page_seg_free_to_buddy(struct vm_page_seg *seg, struct vm_page *page,
                           unsigned int order)
 {
+    struct vm_page_free_list *free_lists;
     struct vm_page *buddy;
     phys_addr_t pa, buddy_pa;
-    unsigned int nr_pages;
+    unsigned int nr_pages, node;
 
     assert(page >= seg->pages);
     assert(page < seg->pages_end);
@@ -423,6 +784,8 @@ vm_page_seg_free_to_buddy(struct vm_page_seg *seg, struct vm_page *page,
 
     nr_pages = (1 << order);
     pa = page->phys_addr;
+    node = page->node_index;
+    free_lists = seg->free_lists[node];
 
     while (order < (VM_PAGE_NR_FREE_LISTS - 1)) {
         buddy_pa = pa ^ vm_page_ptoa(1 << order);
@@ -432,19 +795,20 @@ vm_page_seg_free_to_buddy(struct vm_page_seg *seg, struct vm_page *page,
 
         buddy = &seg->pages[vm_page_atop(buddy_pa - seg->start)];
 
-        if (buddy->order != order)
+        if ((buddy->order != order) || (buddy->node_index != node))
             break;
 
-        vm_page_free_list_remove(&seg->free_lists[order], buddy);
+        vm_page_free_list_remove(&free_lists[order], buddy);
         buddy->order = VM_PAGE_ORDER_UNLISTED;
         order++;
         pa &= -vm_page_ptoa(1 << order);
         page = &seg->pages[vm_page_atop(pa - seg->start)];
     }
 
-    vm_page_free_list_insert(&seg->free_lists[order], page);
+    vm_page_free_list_insert(&free_lists[order], page);
     page->order = order;
     seg->nr_free_pages += nr_pages;
+    seg->nr_node_free_pages[node] += nr_pages;
 }
 
 static void __init
@@ -496,7 +860,8 @@ vm_page_cpu_pool_fill(struct vm_page_cpu_pool *cpu_pool,
     simple_lock(&seg->lock);
 
     for (i = 0; i < cpu_pool->transfer_size; i++) {
-        page = vm_page_seg_alloc_from_buddy(seg, 0);
+        page = vm_page_seg_alloc_from_buddy(seg, 0, vm_page_cpu_node(),
+                                            TRUE);
 
         if (page == NULL)
             break;
@@ -641,13 +1006,41 @@ vm_page_seg_compute_pageout_thresholds(struct vm_page_seg *seg)
     }
 }
 
+/*
+ * Give each node the share of the thresholds of a segment matching its
+ * share of the pages of the segment. The pages must be initialized.
+ */
+static void __init
+vm_page_seg_compute_node_thresholds(struct vm_page_seg *seg)
+{
+    unsigned long nr_pages, nr_node_pages[VM_PAGE_MAX_NODES];
+    struct vm_page *page;
+    unsigned int i;
+
+    memset(nr_node_pages, 0, sizeof(nr_node_pages));
+
+    for (page = seg->pages; page < seg->pages_end; page++)
+        nr_node_pages[page->node_index]++;
+
+    nr_pages = seg->pages_end - seg->pages;
+
+    for (i = 0; i < ARRAY_SIZE(nr_node_pages); i++) {
+        seg->node_low_free_pages[i] = (unsigned long long)seg->low_free_pages
+                                      * nr_node_pages[i] / nr_pages;
+        seg->node_high_free_pages[i] = (unsigned long long)seg->high_free_pages
+                                       * nr_node_pages[i] / nr_pages;
+    }
+
+    seg->short_nodes = 0;
+}
+
 static void __init
 vm_page_seg_init(struct vm_page_seg *seg, phys_addr_t start, phys_addr_t end,
                  struct vm_page *pages)
 {
     phys_addr_t pa;
     int pool_size;
-    unsigned int i;
+    unsigned int i, j;
 
     seg->start = start;
     seg->end = end;
@@ -660,8 +1053,13 @@ vm_page_seg_init(struct vm_page_seg *seg, phys_addr_t start, phys_addr_t end,
     seg->pages_end = pages + vm_page_atop(vm_page_seg_size(seg));
     simple_lock_init(&seg->lock);
 
-    for (i = 0; i < ARRAY_SIZE(seg->free_lists); i++)
-        vm_page_free_list_init(&seg->free_lists[i]);
+    for (i = 0; i < ARRAY_SIZE(seg->free_lists); i++) {
+        for (j = 0; j < ARRAY_SIZE(seg->free_lists[i]); j++)
+            vm_page_free_list_init(&seg->free_lists[i][j]);
+
+        seg->nr_node_free_pages[i] = 0;
+        seg->nr_node_cache_pages[i] = 0;
+    }
 
     seg->nr_free_pages = 0;
 
@@ -671,44 +1069,49 @@ vm_page_seg_init(struct vm_page_seg *seg, phys_addr_t start, phys_addr_t end,
     seg->nr_active_pages = 0;
     vm_page_queue_init(&seg->inactive_pages);
     seg->nr_inactive_pages = 0;
+    seg->merge_cursor = 0;
 
     i = vm_page_seg_index(seg);
 
     for (pa = seg->start; pa < seg->end; pa += PAGE_SIZE)
         vm_page_init_pa(&pages[vm_page_atop(pa - seg->start)], i, pa);
+
+    vm_page_seg_compute_node_thresholds(seg);
 }
 
 static struct vm_page *
 vm_page_seg_alloc(struct vm_page_seg *seg, unsigned int order,
-                  unsigned short type)
+                  unsigned short type, unsigned int node)
 {
     struct vm_page_cpu_pool *cpu_pool;
     struct vm_page *page;
-    int filled;
 
     assert(order < VM_PAGE_NR_FREE_LISTS);
 
-    if (order == 0) {
+    if ((order == 0) && (node == vm_page_cpu_node())) {
         thread_pin();
         cpu_pool = vm_page_cpu_pool_get(seg);
         simple_lock(&cpu_pool->lock);
 
-        if (cpu_pool->nr_pages == 0) {
-            filled = vm_page_cpu_pool_fill(cpu_pool, seg);
+        if ((cpu_pool->nr_pages != 0)
+            || vm_page_cpu_pool_fill(cpu_pool, seg))
+            page = vm_page_cpu_pool_pop(cpu_pool);
+        else
+            page = NULL;
 
-            if (!filled) {
-                simple_unlock(&cpu_pool->lock);
-                thread_unpin();
-                return NULL;
-            }
-        }
-
-        page = vm_page_cpu_pool_pop(cpu_pool);
         simple_unlock(&cpu_pool->lock);
         thread_unpin();
     } else {
+        page = NULL;
+    }
+
+    /*
+     * Pools only cache pages of their own node. Once that node is
+     * exhausted, allocate from the nearest nodes without caching.
+     */
+    if (page == NULL) {
         simple_lock(&seg->lock);
-        page = vm_page_seg_alloc_from_buddy(seg, order);
+        page = vm_page_seg_alloc_from_buddy(seg, order, node, FALSE);
         simple_unlock(&seg->lock);
 
         if (page == NULL)
@@ -731,7 +1134,8 @@ vm_page_seg_free(struct vm_page_seg *seg, struct vm_page *page,
 
     vm_page_set_type(page, order, VM_PT_FREE);
 
-    if (order == 0) {
+    /* Pages of other nodes go back to their free lists */
+    if ((order == 0) && (page->node_index == vm_page_cpu_node())) {
         thread_pin();
         cpu_pool = vm_page_cpu_pool_get(seg);
         simple_lock(&cpu_pool->lock);
@@ -759,11 +1163,41 @@ vm_page_seg_add_active_page(struct vm_page_seg *seg, struct vm_page *page)
     assert(!page->free && !page->active && !page->inactive);
     page->active = TRUE;
     page->reference = TRUE;
+    page->gen = vm_page_gen_max;
     vm_page_queue_push(&seg->active_pages, page);
     seg->nr_active_pages++;
+    seg->nr_node_cache_pages[page->node_index]++;
     vm_page_active_count++;
 }
 
+/*
+ * Give a referenced page pulled from the active queue a second chance.
+ */
+static void
+vm_page_seg_rotate_active_page(struct vm_page_seg *seg, struct vm_page *page)
+{
+    pmap_clear_reference(page->phys_addr);
+    vm_page_seg_add_active_page(seg, page);
+    page->reference = FALSE;
+}
+
+/*
+ * Put a page pulled from the active queue back, keeping its reference
+ * and the generation it was last found referenced in.
+ */
+static void
+vm_page_seg_requeue_active_page(struct vm_page_seg *seg, struct vm_page *page)
+{
+    boolean_t reference;
+    unsigned int gen;
+
+    reference = page->reference;
+    gen = page->gen;
+    vm_page_seg_add_active_page(seg, page);
+    page->reference = reference;
+    page->gen = gen;
+}
+
 static void
 vm_page_seg_remove_active_page(struct vm_page_seg *seg, struct vm_page *page)
 {
@@ -775,6 +1209,7 @@ vm_page_seg_remove_active_page(struct vm_page_seg *seg, struct vm_page *page)
     page->active = FALSE;
     vm_page_queue_remove(&seg->active_pages, page);
     seg->nr_active_pages--;
+    seg->nr_node_cache_pages[page->node_index]--;
     vm_page_active_count--;
 }
 
@@ -789,6 +1224,7 @@ vm_page_seg_add_inactive_page(struct vm_page_seg *seg, struct vm_page *page)
     page->inactive = TRUE;
     vm_page_queue_push(&seg->inactive_pages, page);
     seg->nr_inactive_pages++;
+    seg->nr_node_cache_pages[page->node_index]++;
     vm_page_inactive_count++;
 }
 
@@ -803,16 +1239,19 @@ vm_page_seg_remove_inactive_page(struct vm_page_seg *seg, struct vm_page *page)
     page->inactive = FALSE;
     vm_page_queue_remove(&seg->inactive_pages, page);
     seg->nr_inactive_pages--;
+    seg->nr_node_cache_pages[page->node_index]--;
     vm_page_inactive_count--;
 }
 
 /*
- * Attempt to pull an active page.
+ * Attempt to pull an active page, of one of the given nodes unless nodes
+ * is 0.
  *
  * If successful, the object containing the page is locked.
  */
 static struct vm_page *
-vm_page_seg_pull_active_page(struct vm_page_seg *seg, boolean_t external_only)
+vm_page_seg_pull_active_page(struct vm_page_seg *seg, boolean_t external_only,
+                             unsigned int nodes)
 {
     struct vm_page *page, *first;
     boolean_t locked;
@@ -831,6 +1270,12 @@ vm_page_seg_pull_active_page(struct vm_page_seg *seg, boolean_t external_only)
         }
 
         vm_page_seg_remove_active_page(seg, page);
+
+        if ((nodes != 0) && !(nodes & (1U << page->node_index))) {
+            vm_page_seg_requeue_active_page(seg, page);
+            continue;
+        }
+
         locked = vm_object_lock_try(page->object);
 
         if (!locked) {
@@ -858,7 +1303,8 @@ vm_page_seg_pull_active_page(struct vm_page_seg *seg, boolean_t external_only)
  * XXX See vm_page_seg_pull_active_page (duplicated code).
  */
 static struct vm_page *
-vm_page_seg_pull_inactive_page(struct vm_page_seg *seg, boolean_t external_only)
+vm_page_seg_pull_inactive_page(struct vm_page_seg *seg, boolean_t external_only,
+                               unsigned int nodes)
 {
     struct vm_page *page, *first;
     boolean_t locked;
@@ -877,6 +1323,12 @@ vm_page_seg_pull_inactive_page(struct vm_page_seg *seg, boolean_t external_only)
         }
 
         vm_page_seg_remove_inactive_page(seg, page);
+
+        if ((nodes != 0) && !(nodes & (1U << page->node_index))) {
+            vm_page_seg_add_inactive_page(seg, page);
+            continue;
+        }
+
         locked = vm_object_lock_try(page->object);
 
         if (!locked) {
@@ -897,25 +1349,27 @@ vm_page_seg_pull_inactive_page(struct vm_page_seg *seg, boolean_t external_only)
 }
 
 /*
- * Attempt to pull a page cache page.
+ * Attempt to pull a page cache page, of one of the given nodes unless
+ * nodes is 0.
  *
  * If successful, the object containing the page is locked.
  */
 static struct vm_page *
 vm_page_seg_pull_cache_page(struct vm_page_seg *seg,
                             boolean_t external_only,
+                            unsigned int nodes,
                             boolean_t *was_active)
 {
     struct vm_page *page;
 
-    page = vm_page_seg_pull_inactive_page(seg, external_only);
+    page = vm_page_seg_pull_inactive_page(seg, external_only, nodes);
 
     if (page != NULL) {
         *was_active = FALSE;
         return page;
     }
 
-    page = vm_page_seg_pull_active_page(seg, external_only);
+    page = vm_page_seg_pull_active_page(seg, external_only, nodes);
 
     if (page != NULL) {
         *was_active = TRUE;
@@ -942,6 +1396,29 @@ vm_page_seg_usable(const struct vm_page_seg *seg)
     return (seg->nr_free_pages >= seg->high_free_pages);
 }
 
+/*
+ * Check whether the short nodes of a segment are back above their high
+ * threshold, and forget those that are.
+ */
+static boolean_t
+vm_page_seg_nodes_usable(struct vm_page_seg *seg)
+{
+    unsigned int i;
+
+    for (i = 0; i < vm_page_nodes_size; i++) {
+        if (!(seg->short_nodes & (1U << i))) {
+            continue;
+        }
+
+        if ((seg->nr_node_free_pages[i] >= seg->node_high_free_pages[i])
+            || (seg->nr_node_cache_pages[i] == 0)) {
+            seg->short_nodes &= ~(1U << i);
+        }
+    }
+
+    return (seg->short_nodes == 0);
+}
+
 static void
 vm_page_seg_double_lock(struct vm_page_seg *seg1, struct vm_page_seg *seg2)
 {
@@ -964,53 +1441,26 @@ vm_page_seg_double_unlock(struct vm_page_seg *seg1, struct vm_page_seg *seg2)
 }
 
 /*
- * Attempt to balance a segment by moving one page to another segment.
+ * Move a page pulled from the page queues to the given free page, which
+ * takes its place in its object and the page queues.
  *
- * Return TRUE if a page was actually moved.
+ * The page queues and the object containing the page must be locked.
+ * The object is unlocked on return.
  */
-static boolean_t
-vm_page_seg_balance_page(struct vm_page_seg *seg,
-                         struct vm_page_seg *remote_seg)
+static void
+vm_page_move(struct vm_page_seg *seg, struct vm_page *src,
+             struct vm_page *dest, boolean_t was_active)
 {
-    struct vm_page *src, *dest;
     vm_object_t object;
     vm_offset_t offset;
-    boolean_t was_active;
-
-    vm_page_lock_queues();
-    simple_lock(&vm_page_queue_free_lock);
-    vm_page_seg_double_lock(seg, remote_seg);
 
-    if (vm_page_seg_usable(seg)
-        || !vm_page_seg_page_available(remote_seg)) {
-        goto error;
+    if (!was_active && !src->reference && pmap_is_referenced(src->phys_addr)) {
+        src->reference = TRUE;
     }
 
-    src = vm_page_seg_pull_cache_page(seg, FALSE, &was_active);
-
-    if (src == NULL) {
-        goto error;
-    }
-
-    assert(src->object != NULL);
-    assert(!src->fictitious && !src->private);
-    assert(src->wire_count == 0);
-    assert(src->type != VM_PT_FREE);
-    assert(src->order == VM_PAGE_ORDER_UNLISTED);
-
-    dest = vm_page_seg_alloc_from_buddy(remote_seg, 0);
-    assert(dest != NULL);
-
-    vm_page_seg_double_unlock(seg, remote_seg);
-    simple_unlock(&vm_page_queue_free_lock);
-
-    if (!was_active && !src->reference && pmap_is_referenced(src->phys_addr)) {
-        src->reference = TRUE;
-    }
-
-    object = src->object;
-    offset = src->offset;
-    vm_page_remove(src);
+    object = src->object;
+    offset = src->offset;
+    vm_page_remove(src);
 
     vm_page_remove_mappings(src);
 
@@ -1042,7 +1492,49 @@ vm_page_seg_balance_page(struct vm_page_seg *seg,
     } else {
         vm_page_deactivate(dest);
     }
+}
+
+/*
+ * Attempt to balance a segment by moving one page to another segment.
+ *
+ * Return TRUE if a page was actually moved.
+ */
+static boolean_t
+vm_page_seg_balance_page(struct vm_page_seg *seg,
+                         struct vm_page_seg *remote_seg)
+{
+    struct vm_page *src, *dest;
+    boolean_t was_active;
 
+    vm_page_lock_queues();
+    simple_lock(&vm_page_queue_free_lock);
+    vm_page_seg_double_lock(seg, remote_seg);
+
+    if (vm_page_seg_usable(seg)
+        || !vm_page_seg_page_available(remote_seg)) {
+        goto error;
+    }
+
+    src = vm_page_seg_pull_cache_page(seg, FALSE, 0, &was_active);
+
+    if (src == NULL) {
+        goto error;
+    }
+
+    assert(src->object != NULL);
+    assert(!src->fictitious && !src->private);
+    assert(src->wire_count == 0);
+    assert(src->type != VM_PT_FREE);
+    assert(src->order == VM_PAGE_ORDER_UNLISTED);
+
+    dest = vm_page_seg_alloc_from_buddy(remote_seg, 0, src->node_index,
+                                        FALSE);
+    assert(dest != NULL);
+
+    vm_page_seg_double_unlock(seg, remote_seg);
+    simple_unlock(&vm_page_queue_free_lock);
+
+    vm_page_move(seg, src, dest, was_active);
     vm_page_unlock_queues();
 
     return TRUE;
@@ -1083,6 +1575,332 @@ vm_page_seg_balance(struct vm_page_seg *seg)
     return FALSE;
 }
 
+/*
+ * Return the number of free blocks of 2^order pages in a segment, counting
+ * larger blocks as several.
+ *
+ * The segment must be locked.
+ */
+static unsigned long
+vm_page_seg_nr_free_blocks(const struct vm_page_seg *seg, unsigned int order)
+{
+    unsigned long nr_blocks;
+    unsigned int i, j;
+
+    nr_blocks = 0;
+
+    for (i = 0; i < vm_page_nodes_size; i++) {
+        for (j = order; j < VM_PAGE_NR_FREE_LISTS; j++) {
+            nr_blocks += seg->free_lists[i][j].size << (j - order);
+        }
+    }
+
+    return nr_blocks;
+}
+
+/*
+ * Return the pages cached by processors to the buddy allocator, so that
+ * they may be merged.
+ */
+static void
+vm_page_seg_drain_cpu_pools(struct vm_page_seg *seg)
+{
+    struct vm_page_cpu_pool *cpu_pool;
+    struct vm_page *page;
+    unsigned int i;
+
+    simple_lock(&vm_page_queue_free_lock);
+
+    for (i = 0; i < ARRAY_SIZE(seg->cpu_pools); i++) {
+        cpu_pool = &seg->cpu_pools[i];
+        simple_lock(&cpu_pool->lock);
+        simple_lock(&seg->lock);
+
+        while (cpu_pool->nr_pages != 0) {
+            page = vm_page_cpu_pool_pop(cpu_pool);
+            vm_page_seg_free_to_buddy(seg, page, 0);
+        }
+
+        simple_unlock(&seg->lock);
+        simple_unlock(&cpu_pool->lock);
+    }
+
+    simple_unlock(&vm_page_queue_free_lock);
+}
+
+/*
+ * Select the block of 2^order pages to compact in a segment.
+ *
+ * The selected block contains only free and pageable pages, and the
+ * fewest pageable pages, at least one. The page states are read without
+ * locking, and are checked again when moving the pages.
+ */
+static struct vm_page *
+vm_page_seg_compact_target(struct vm_page_seg *seg, unsigned int order)
+{
+    struct vm_page *block, *best;
+    unsigned long i, nr_pages, nr_moves, best_nr_moves;
+    phys_addr_t pa, size;
+
+    nr_pages = 1UL << order;
+    size = vm_page_ptoa(nr_pages);
+    best = NULL;
+    best_nr_moves = nr_pages + 1;
+
+    for (pa = P2ROUND(seg->start, size);
+         (pa + size) <= seg->end;
+         pa += size) {
+        block = &seg->pages[vm_page_atop(pa - seg->start)];
+        nr_moves = 0;
+
+        for (i = 0; i < nr_pages; i++) {
+            if (block[i].type == VM_PT_FREE) {
+                continue;
+            } else if (!vm_page_pageable(&block[i])) {
+                break;
+            }
+
+            nr_moves++;
+        }
+
+        if ((i == nr_pages) && (nr_moves != 0)
+            && (nr_moves < best_nr_moves)) {
+            best = block;
+            best_nr_moves = nr_moves;
+
+            if (nr_moves == 1) {
+                break;
+            }
+        }
+    }
+
+    return best;
+}
+
+/*
+ * Attempt to move a page out of the block of nr_pages pages starting at
+ * the given page.
+ *
+ * The free pages of the block the allocator returns on the way are kept
+ * in the given list, for the caller to release once the whole block has
+ * been emptied.
+ *
+ * Return TRUE if the page was moved, or has been freed meanwhile.
+ */
+static boolean_t
+vm_page_seg_compact_page(struct vm_page_seg *seg, struct vm_page *src,
+                         const struct vm_page *block, unsigned long nr_pages,
+                         struct list *stash)
+{
+    struct vm_page *dest;
+    boolean_t was_active;
+
+    vm_page_lock_queues();
+    simple_lock(&vm_page_queue_free_lock);
+    simple_lock(&seg->lock);
+
+    if (src->type == VM_PT_FREE) {
+        simple_unlock(&seg->lock);
+        simple_unlock(&vm_page_queue_free_lock);
+        vm_page_unlock_queues();
+        return TRUE;
+    }
+
+    if (!vm_page_pageable(src) || !vm_object_lock_try(src->object)) {
+        goto error;
+    }
+
+    if (!vm_page_can_move(src)) {
+        vm_object_unlock(src->object);
+        goto error;
+    }
+
+    was_active = src->active;
+
+    if (was_active) {
+        vm_page_seg_remove_active_page(seg, src);
+    } else {
+        vm_page_seg_remove_inactive_page(seg, src);
+    }
+
+    for (;;) {
+        dest = vm_page_seg_alloc_from_buddy(seg, 0, src->node_index,
+                                            FALSE);
+
+        if ((dest == NULL) || (dest < block) || (dest >= &block[nr_pages])) {
+            break;
+        }
+
+        list_insert_tail(stash, &dest->node);
+    }
+
+    if (dest == NULL) {
+        if (was_active) {
+            vm_page_seg_add_active_page(seg, src);
+        } else {
+            vm_page_seg_add_inactive_page(seg, src);
+        }
+
+        vm_object_unlock(src->object);
+        goto error;
+    }
+
+    simple_unlock(&seg->lock);
+    simple_unlock(&vm_page_queue_free_lock);
+
+    vm_page_move(seg, src, dest, was_active);
+    vm_page_unlock_queues();
+
+    vm_page_compact_migrated++;
+    return TRUE;
+
+error:
+    simple_unlock(&seg->lock);
+    simple_unlock(&vm_page_queue_free_lock);
+    vm_page_unlock_queues();
+    return FALSE;
+}
+
+/*
+ * Attempt to compact a segment until it has nr_blocks free blocks of
+ * 2^order pages.
+ *
+ * Return TRUE if it has.
+ */
+static boolean_t
+vm_page_seg_compact(struct vm_page_seg *seg, unsigned int order,
+                    unsigned long nr_blocks)
+{
+    struct vm_page *block, *page;
+    unsigned long i, nr_pages, nr_attempts;
+    struct list stash;
+    boolean_t moved;
+
+    nr_pages = 1UL << order;
+
+    vm_page_seg_drain_cpu_pools(seg);
+
+    for (nr_attempts = 0; ; nr_attempts++) {
+        simple_lock(&vm_page_queue_free_lock);
+        simple_lock(&seg->lock);
+
+        if (vm_page_seg_nr_free_blocks(seg, order) >= nr_blocks) {
+            simple_unlock(&seg->lock);
+            simple_unlock(&vm_page_queue_free_lock);
+            return TRUE;
+        }
+
+        /*
+         * Leave memory shortages to the pageout daemon, since moving
+         * pages temporarily consumes free pages.
+         */
+        if ((nr_attempts == nr_blocks)
+            || (seg->nr_free_pages <= (seg->low_free_pages + 2 * nr_pages))) {
+            simple_unlock(&seg->lock);
+            simple_unlock(&vm_page_queue_free_lock);
+            return FALSE;
+        }
+
+        simple_unlock(&seg->lock);
+        simple_unlock(&vm_page_queue_free_lock);
+
+        block = vm_page_seg_compact_target(seg, order);
+
+        if (block == NULL) {
+            return FALSE;
+        }
+
+        list_init(&stash);
+        moved = TRUE;
+
+        for (i = 0; moved && (i < nr_pages); i++) {
+            moved = vm_page_seg_compact_page(seg, &block[i], block, nr_pages,
+                                             &stash);
+        }
+
+        simple_lock(&vm_page_queue_free_lock);
+        simple_lock(&seg->lock);
+
+        while (!list_empty(&stash)) {
+            page = list_first_entry(&stash, struct vm_page, node);
+            list_remove(&page->node);
+            vm_page_seg_free_to_buddy(seg, page, 0);
+        }
+
+        simple_unlock(&seg->lock);
+        simple_unlock(&vm_page_queue_free_lock);
+
+        if (moved) {
+            vm_page_compact_success++;
+        } else {
+            vm_page_compact_fail++;
+            return FALSE;
+        }
+    }
+}
+
+/*
+ * Release a page if it's a zero page that can be merged into the zero fill.
+ */
+static void
+vm_page_merge_page(struct vm_page *page)
+{
+    vm_object_t object;
+
+    if ((page->type == VM_PT_FREE) || (!page->active && !page->inactive)) {
+        return;
+    }
+
+    vm_page_lock_queues();
+
+    if (!vm_page_pageable(page) || page->external) {
+        goto out;
+    }
+
+    object = page->object;
+
+    if (!vm_object_lock_try(object)) {
+        goto out;
+    }
+
+    if (!vm_page_can_move(page)
+        || page->precious
+        || !object->internal
+        || object->pager_created
+        || (object->shadow != VM_OBJECT_NULL)
+        || (object->paging_in_progress != 0)
+        || (object == kernel_object)
+        || page->reference
+        || pmap_is_referenced(page->phys_addr)
+        || !pmap_is_zero_page(page->phys_addr)) {
+        vm_object_unlock(object);
+        goto out;
+    }
+
+    vm_page_remove_mappings(page);
+
+    if (!pmap_is_zero_page(page->phys_addr)) {
+        page->busy = FALSE;
+        vm_object_unlock(object);
+        goto out;
+    }
+
+    vm_page_free(page);
+    vm_page_merge_merged++;
+    vm_page_unlock_queues();
+
+    if (vm_object_collectable(object)) {
+        vm_object_collect(object);
+    } else {
+        vm_object_unlock(object);
+    }
+
+    return;
+
+out:
+    vm_page_unlock_queues();
+}
+
 static boolean_t
 vm_page_seg_evict(struct vm_page_seg *seg, boolean_t external_only,
                   boolean_t alloc_paused)
@@ -1091,6 +1909,7 @@ vm_page_seg_evict(struct vm_page_seg *seg, boolean_t external_only,
     boolean_t reclaim, double_paging;
     vm_object_t object;
     boolean_t was_active;
+    unsigned int nodes;
 
     page = NULL;
     object = NULL;
@@ -1103,9 +1922,13 @@ restart:
     if (page != NULL) {
         vm_object_lock(page->object);
     } else {
-        page = vm_page_seg_pull_cache_page(seg, external_only, &was_active);
+        nodes = vm_page_seg_usable(seg) ? seg->short_nodes : 0;
+        page = vm_page_seg_pull_cache_page(seg, external_only, nodes,
+                                           &was_active);
 
         if (page == NULL) {
+            /* Short nodes have nothing left to evict */
+            seg->short_nodes &= ~nodes;
             goto out;
         }
     }
@@ -1118,6 +1941,28 @@ restart:
 
     object = page->object;
 
+    if (vm_page_workingset
+        && (page->reference || pmap_is_referenced(page->phys_addr))) {
+        if (was_active) {
+            vm_page_seg_rotate_active_page(seg, page);
+        } else if (page->referenced_once) {
+            vm_page_seg_rotate_active_page(seg, page);
+            vm_stat.reactivations++;
+            current_task()->reactivations++;
+        } else {
+            pmap_clear_reference(page->phys_addr);
+            page->reference = FALSE;
+            page->referenced_once = TRUE;
+            vm_page_seg_add_inactive_page(seg, page);
+        }
+
+        simple_unlock(&seg->lock);
+        vm_object_unlock(object);
+        vm_page_unlock_queues();
+        page = NULL;
+        goto restart;
+    }
+
     if (!was_active
         && (page->reference || pmap_is_referenced(page->phys_addr))) {
         vm_page_seg_add_active_page(seg, page);
@@ -1131,6 +1976,7 @@ restart:
     }
 
     vm_page_remove_mappings(page);
+    vm_page_workingset_evict(page);
 
     if (!page->dirty && !page->precious) {
         reclaim = TRUE;
@@ -1179,9 +2025,28 @@ out:
         return FALSE;
     }
 
-    if (reclaim) {
-        vm_page_free(page);
-        vm_page_unlock_queues();
+    if (reclaim) {
+        vm_page_free(page);
+        vm_page_unlock_queues();
+
+        if (vm_object_collectable(object)) {
+            vm_object_collect(object);
+        } else {
+            vm_object_unlock(object);
+        }
+
+        return TRUE;
+    }
+
+    vm_page_unlock_queues();
+
+    /*
+     * Keep the data of internal objects in memory, compressed, if
+     * possible.
+     */
+
+    if (object->internal && vm_zcache_store(page)) {
+        VM_PAGE_FREE(page);
 
         if (vm_object_collectable(object)) {
             vm_object_collect(object);
@@ -1192,8 +2057,6 @@ out:
         return TRUE;
     }
 
-    vm_page_unlock_queues();
-
     /*
      * If there is no memory object for the page, create one and hand it
      * to the default pager. First try to collapse, so we don't create
@@ -1236,22 +2099,51 @@ static void
 vm_page_seg_refill_inactive(struct vm_page_seg *seg)
 {
     struct vm_page *page;
+    unsigned long nr_scans, nr_young, nr_deactivated;
 
     simple_lock(&seg->lock);
 
     vm_page_seg_compute_high_active_page(seg);
+    nr_scans = seg->nr_active_pages;
+    nr_young = 0;
+    nr_deactivated = 0;
 
-    while (seg->nr_active_pages > seg->high_active_pages) {
-        page = vm_page_seg_pull_active_page(seg, FALSE);
+    while ((seg->nr_active_pages > seg->high_active_pages)
+           && (nr_scans != 0)) {
+        page = vm_page_seg_pull_active_page(seg, FALSE, 0);
 
         if (page == NULL) {
             break;
         }
 
+        nr_scans--;
+
+        if (vm_page_workingset
+            && (page->reference || pmap_is_referenced(page->phys_addr))) {
+            vm_page_seg_rotate_active_page(seg, page);
+            vm_object_unlock(page->object);
+            continue;
+        }
+
+        if (vm_page_workingset
+            && (vm_page_gen_age(page) < (VM_PAGE_NR_GENS - 1))) {
+            vm_page_seg_requeue_active_page(seg, page);
+            vm_object_unlock(page->object);
+            nr_young++;
+            continue;
+        }
+
         page->reference = FALSE;
+        page->referenced_once = FALSE;
         pmap_clear_reference(page->phys_addr);
         vm_page_seg_add_inactive_page(seg, page);
         vm_object_unlock(page->object);
+        nr_deactivated++;
+    }
+
+    if ((nr_deactivated == 0) && (nr_young != 0)) {
+        vm_page_gen_max++;
+        vm_page_workingset_generations++;
     }
 
     simple_unlock(&seg->lock);
@@ -1307,6 +2199,104 @@ vm_page_load_heap(unsigned int seg_index, phys_addr_t start, phys_addr_t end)
 #endif
 }
 
+void
+vm_page_load_node(unsigned int node, phys_addr_t start, phys_addr_t end)
+{
+    struct vm_page_node_range *range;
+
+    assert(start < end);
+
+    if ((node >= VM_PAGE_MAX_NODES)
+        || (vm_page_node_ranges_size == ARRAY_SIZE(vm_page_node_ranges))) {
+        printf("vm_page: node %u: ignoring memory %llx:%llx\n", node,
+               (unsigned long long)start, (unsigned long long)end);
+        return;
+    }
+
+    range = &vm_page_node_ranges[vm_page_node_ranges_size];
+    range->start = start;
+    range->end = end;
+    range->node = node;
+    vm_page_node_ranges_size++;
+
+    if (node >= vm_page_nodes_size) {
+        vm_page_nodes_size = node + 1;
+    }
+}
+
+void
+vm_page_load_cpu_node(unsigned int cpu, unsigned int node)
+{
+    assert(cpu < ARRAY_SIZE(vm_page_cpu_nodes));
+
+    if (node >= VM_PAGE_MAX_NODES) {
+        return;
+    }
+
+    vm_page_cpu_nodes[cpu] = node;
+
+    if (node >= vm_page_nodes_size) {
+        vm_page_nodes_size = node + 1;
+    }
+}
+
+void
+vm_page_load_node_distance(unsigned int from, unsigned int to,
+                           unsigned int distance)
+{
+    if ((from >= VM_PAGE_MAX_NODES) || (to >= VM_PAGE_MAX_NODES)) {
+        return;
+    }
+
+    vm_page_node_distances[from][to] = (distance > 255) ? 255 : distance;
+}
+
+/*
+ * Complete the distances between nodes, and sort nodes by distance for
+ * allocations.
+ */
+static void __init
+vm_page_setup_nodes(void)
+{
+    unsigned char *order, *distances;
+    unsigned int i, j, k, tmp;
+
+    for (i = 0; i < vm_page_nodes_size; i++) {
+        distances = vm_page_node_distances[i];
+
+        for (j = 0; j < vm_page_nodes_size; j++) {
+            if (distances[j] == 0) {
+                distances[j] = (i == j) ? 10 : 20;
+            }
+        }
+
+        order = vm_page_node_orders[i];
+
+        for (j = 0; j < vm_page_nodes_size; j++) {
+            order[j] = j;
+        }
+
+        order[0] = i;
+        order[i] = 0;
+
+        for (j = 1; j < vm_page_nodes_size; j++) {
+            for (k = j + 1; k < vm_page_nodes_size; k++) {
+                if ((distances[order[k]] < distances[order[j]])
+                    || ((distances[order[k]] == distances[order[j]])
+                        && (order[k] < order[j]))) {
+                    tmp = order[j];
+                    order[j] = order[k];
+                    order[k] = tmp;
+                }
+            }
+        }
+    }
+
+    if (vm_page_nodes_size > 1) {
+        printf("vm_page: %u NUMA nodes\n", vm_page_nodes_size);
+    }
+}
+
 int
 vm_page_ready(void)
 {
@@ -1424,6 +2414,23 @@ vm_page_setup(void)
     table = (struct vm_page *)pmap_steal_memory(table_size);
     va = (unsigned long)table;
 
+    vm_page_setup_nodes();
+
+    if (strstr(kernel_cmdline, VM_PAGE_WORKINGSET_PARAMETER) != NULL) {
+        size_t nr_shadows, shadows_size;
+
+        nr_shadows = 1UL << iorder2(nr_pages / VM_PAGE_SHADOW_RATIO);
+        shadows_size = vm_page_round(nr_shadows
+                                     * sizeof(struct vm_page_shadow));
+        vm_page_shadows = (struct vm_page_shadow *)
+                          pmap_steal_memory(shadows_size);
+        memset(vm_page_shadows, 0, shadows_size);
+        vm_page_shadows_mask = nr_shadows - 1;
+        vm_page_workingset = TRUE;
+        printf("vm_page: working set replacement, %lu shadow entries\n",
+               (unsigned long)nr_shadows);
+    }
+
     /*
      * Initialize the segments, associating them to the page table. When
      * the segments are initialized, all their pages are set allocated.
@@ -1455,6 +2462,7 @@ vm_page_setup(void)
         va += PAGE_SIZE;
     }
 
+    simple_lock_init(&vm_page_compact_lock);
     vm_page_is_ready = 1;
 }
 
@@ -1468,6 +2476,14 @@ vm_page_manage(struct vm_page *page)
     vm_page_seg_free_to_buddy(&vm_page_segs[page->seg_index], page, 0);
 }
 
+void
+vm_page_claim(struct vm_page *page)
+{
+    assert(page->type == VM_PT_RESERVED);
+
+    vm_page_set_type(page, 0, VM_PT_KERNEL);
+}
+
 struct vm_page *
 vm_page_lookup_pa(phys_addr_t pa)
 {
@@ -1556,13 +2572,17 @@ void vm_page_check(const struct vm_page *page)
 }
 
 struct vm_page *
-vm_page_alloc_pa(unsigned int order, unsigned int selector, unsigned short type)
+vm_page_alloc_pa(unsigned int order, unsigned int selector, unsigned short type,
+                 unsigned int node)
 {
     struct vm_page *page;
     unsigned int i;
 
+    if (node >= vm_page_nodes_size)
+        node = vm_page_cpu_node();
+
     for (i = vm_page_select_alloc_seg(selector); i < vm_page_segs_size; i--) {
-        page = vm_page_seg_alloc(&vm_page_segs[i], order, type);
+        page = vm_page_seg_alloc(&vm_page_segs[i], order, type, node);
 
         if (page != NULL)
             return page;
@@ -1833,6 +2853,34 @@ vm_page_activate(struct vm_page *page)
     }
 }
 
+void
+vm_page_refault(struct vm_page *page)
+{
+    struct vm_page_shadow *shadow;
+
+    if (!vm_page_workingset) {
+        vm_page_activate(page);
+        return;
+    }
+
+    shadow = vm_page_shadow_get(page->object, page->offset);
+
+    if ((shadow->object == page->object) && (shadow->offset == page->offset)) {
+        shadow->object = NULL;
+        vm_page_workingset_refaults++;
+
+        if ((vm_page_evictions - shadow->eviction)
+            <= (unsigned long)vm_page_active_count) {
+            vm_page_workingset_activations++;
+            vm_page_activate(page);
+            return;
+        }
+    }
+
+    page->referenced_once = FALSE;
+    vm_page_deactivate(page);
+}
+
 void
 vm_page_queues_remove(struct vm_page *page)
 {
@@ -1878,7 +2926,7 @@ vm_page_check_usable(void)
         seg = vm_page_seg_get(i);
 
         simple_lock(&seg->lock);
-        usable = vm_page_seg_usable(seg);
+        usable = vm_page_seg_usable(seg) && vm_page_seg_nodes_usable(seg);
         simple_unlock(&seg->lock);
 
         if (!usable) {
@@ -1952,12 +3000,310 @@ vm_page_balance(void)
     return vm_page_check_usable();
 }
 
+boolean_t
+vm_page_compact(unsigned int order, unsigned int selector)
+{
+    unsigned int i;
+
+    if (order == 0) {
+        return FALSE;
+    }
+
+    simple_lock(&vm_page_compact_lock);
+
+    if (order > vm_page_compact_order) {
+        vm_page_compact_order = order;
+    }
+
+    if (selector > vm_page_compact_selector) {
+        vm_page_compact_selector = selector;
+    }
+
+    thread_wakeup(&vm_page_compact_order);
+    simple_unlock(&vm_page_compact_lock);
+
+    vm_page_compact_stalls++;
+
+    for (i = vm_page_select_alloc_seg(selector); i < vm_page_segs_size; i--) {
+        if (vm_page_seg_compact(vm_page_seg_get(i), order, 1)) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void __attribute__((noreturn))
+vm_page_compact_continue(void)
+{
+    unsigned int i, order, selector;
+
+    for (;;) {
+        simple_lock(&vm_page_compact_lock);
+
+        if (vm_page_compact_order == 0) {
+            assert_wait(&vm_page_compact_order, FALSE);
+            simple_unlock(&vm_page_compact_lock);
+            thread_block(vm_page_compact_continue);
+            /* NOTREACHED */
+        }
+
+        order = vm_page_compact_order;
+        selector = vm_page_compact_selector;
+        vm_page_compact_order = 0;
+        vm_page_compact_selector = 0;
+        simple_unlock(&vm_page_compact_lock);
+
+        for (i = vm_page_select_alloc_seg(selector);
+             i < vm_page_segs_size;
+             i--) {
+            vm_page_seg_compact(vm_page_seg_get(i), order,
+                                VM_PAGE_COMPACT_RESERVE);
+        }
+    }
+}
+
+void
+vm_page_compact_thread(void)
+{
+    vm_page_compact_continue();
+    /* NOTREACHED */
+}
+
+#if VM_PAGE_NR_FREE_LISTS != HOST_VM_FRAG_ORDERS
+#error HOST_VM_FRAG_ORDERS invalid
+#endif /* VM_PAGE_NR_FREE_LISTS != HOST_VM_FRAG_ORDERS */
+
+#if VM_PAGE_MAX_SEGS > HOST_VM_FRAG_SEGS
+#error HOST_VM_FRAG_SEGS invalid
+#endif /* VM_PAGE_MAX_SEGS > HOST_VM_FRAG_SEGS */
+
+void
+vm_page_frag_info(host_vm_frag_info_t info)
+{
+    struct host_vm_frag_seg *seg_info;
+    struct vm_page_seg *seg;
+    unsigned long long free_pages, nr_blocks;
+    boolean_t available;
+    unsigned int i, j, k;
+
+    memset(info, 0, sizeof(*info));
+    info->nsegs = vm_page_segs_size;
+
+    for (i = 0; i < vm_page_segs_size; i++) {
+        seg = vm_page_seg_get(i);
+        seg_info = &info->seg[i];
+
+        simple_lock(&seg->lock);
+
+        for (j = 0; j < VM_PAGE_NR_FREE_LISTS; j++) {
+            for (k = 0; k < vm_page_nodes_size; k++) {
+                seg_info->free_blocks[j] += seg->free_lists[k][j].size;
+            }
+        }
+
+        seg_info->free_pages = seg->nr_free_pages;
+        simple_unlock(&seg->lock);
+
+        free_pages = seg_info->free_pages;
+        nr_blocks = 0;
+
+        for (j = 0; j < VM_PAGE_NR_FREE_LISTS; j++) {
+            nr_blocks += seg_info->free_blocks[j];
+        }
+
+        /*
+         * The fragmentation index tells whether an allocation of 2^j
+         * pages failing would be caused by a lack of memory, when close
+         * to 0, or by fragmentation, when close to 1000.
+         */
+        available = FALSE;
+
+        for (j = VM_PAGE_NR_FREE_LISTS - 1; j < VM_PAGE_NR_FREE_LISTS; j--) {
+            available |= (seg_info->free_blocks[j] != 0);
+
+            if (available) {
+                seg_info->frag_index[j] = -1;
+            } else if (nr_blocks == 0) {
+                seg_info->frag_index[j] = 0;
+            } else {
+                seg_info->frag_index[j] = 1000
+                    - (1000 + ((free_pages * 1000) >> j)) / nr_blocks;
+            }
+        }
+    }
+
+    info->compact_stalls = vm_page_compact_stalls;
+    info->compact_success = vm_page_compact_success;
+    info->compact_fail = vm_page_compact_fail;
+    info->compact_migrated = vm_page_compact_migrated;
+}
+
+unsigned int
+vm_page_nr_nodes(void)
+{
+    return vm_page_nodes_size;
+}
+
+#if VM_PAGE_MAX_NODES > HOST_VM_NUMA_NODES
+#error HOST_VM_NUMA_NODES invalid
+#endif /* VM_PAGE_MAX_NODES > HOST_VM_NUMA_NODES */
+
+void
+vm_page_numa_info(host_vm_numa_info_t info)
+{
+    struct vm_page_seg *seg;
+    unsigned int i, j;
+
+    memset(info, 0, sizeof(*info));
+    info->nnodes = vm_page_nodes_size;
+
+    for (i = 0; i < vm_page_segs_size; i++) {
+        seg = vm_page_seg_get(i);
+        simple_lock(&seg->lock);
+
+        for (j = 0; j < vm_page_nodes_size; j++) {
+            info->free_pages[j] += seg->nr_node_free_pages[j];
+        }
+
+        simple_unlock(&seg->lock);
+    }
+
+    for (i = 0; i < vm_page_nodes_size; i++) {
+        info->local_allocs[i] = vm_page_node_local_allocs[i];
+        info->remote_allocs[i] = vm_page_node_remote_allocs[i];
+
+        for (j = 0; j < vm_page_nodes_size; j++) {
+            info->distances[i][j] = vm_page_node_distances[i][j];
+        }
+    }
+}
+
+/*
+ * Scan the given number of physical pages for merging, resuming where the
+ * previous scan stopped.
+ *
+ * The kernel isn't preemptible, so yield the processor between batches.
+ */
+static void
+vm_page_merge_scan(unsigned long nr_scans)
+{
+    struct vm_page_seg *seg;
+    unsigned long nr_pages, batch;
+
+    batch = 0;
+
+    while (nr_scans != 0) {
+        seg = vm_page_seg_get(vm_page_merge_seg_index);
+        nr_pages = seg->pages_end - seg->pages;
+
+        while ((nr_scans != 0) && (seg->merge_cursor < nr_pages)) {
+            vm_page_merge_page(&seg->pages[seg->merge_cursor]);
+            seg->merge_cursor++;
+            vm_page_merge_scanned++;
+            nr_scans--;
+
+            if (++batch == VM_PAGE_MERGE_BATCH_SIZE) {
+                batch = 0;
+                thread_block(thread_no_continuation);
+            }
+        }
+
+        if (seg->merge_cursor == nr_pages) {
+            seg->merge_cursor = 0;
+            vm_page_merge_seg_index++;
+
+            if (vm_page_merge_seg_index == vm_page_segs_size) {
+                vm_page_merge_seg_index = 0;
+                vm_page_merge_full_scans++;
+            }
+        }
+    }
+}
+
+static int
+vm_page_merge_interval_ticks(unsigned int interval)
+{
+    uint64_t ticks;
+
+    ticks = ((uint64_t)interval * hz + 999) / 1000;
+    return (ticks > 0x7fffffff) ? 0x7fffffff : (int)ticks;
+}
+
+static void __attribute__((noreturn))
+vm_page_merge_continue(void)
+{
+    unsigned int scan_pages, scan_interval;
+
+    for (;;) {
+        scan_pages = vm_page_merge_scan_pages;
+        scan_interval = vm_page_merge_scan_interval;
+
+        if (scan_pages != 0) {
+            vm_page_merge_scan(scan_pages);
+        }
+
+        assert_wait(&vm_page_merge_scan_pages, FALSE);
+
+        if (scan_pages != 0) {
+            thread_set_timeout(vm_page_merge_interval_ticks(scan_interval));
+        }
+
+        thread_block(vm_page_merge_continue);
+    }
+}
+
+void
+vm_page_merge_thread(void)
+{
+    vm_page_merge_continue();
+    /* NOTREACHED */
+}
+
+void
+vm_page_merge_setup(unsigned int scan_pages, unsigned int scan_interval)
+{
+    vm_page_merge_scan_pages = scan_pages;
+    vm_page_merge_scan_interval = scan_interval;
+    thread_wakeup(&vm_page_merge_scan_pages);
+}
+
+void
+vm_page_merge_info(host_vm_merge_info_t info)
+{
+    info->scan_pages = vm_page_merge_scan_pages;
+    info->scan_interval = vm_page_merge_scan_interval;
+    info->full_scans = vm_page_merge_full_scans;
+    info->scanned = vm_page_merge_scanned;
+    info->merged = vm_page_merge_merged;
+}
+
 static boolean_t
 vm_page_evict_once(boolean_t external_only, boolean_t alloc_paused)
 {
+    struct vm_page_seg *seg;
     boolean_t evicted;
     unsigned int i;
 
+    /*
+     * Serve nodes short of pages first, as evicting from other segments
+     * doesn't help them.
+     */
+
+    for (i = vm_page_segs_size - 1; i < vm_page_segs_size; i--) {
+        seg = vm_page_seg_get(i);
+
+        if (seg->short_nodes == 0) {
+            continue;
+        }
+
+        evicted = vm_page_seg_evict(seg, external_only, alloc_paused);
+
+        if (evicted) {
+            return TRUE;
+        }
+    }
+
     /*
      * It's important here that pages are evicted from lower priority
      * segments first.
@@ -2036,6 +3382,16 @@ again:
             goto again;
         }
 
+        /*
+         * Nodes that were short of pages may have had nothing left to
+         * evict, in which case they were forgotten.
+         */
+        simple_unlock(&vm_page_queue_free_lock);
+
+        if (vm_page_check_usable()) {
+            return TRUE;
+        }
+
         /*
          * TODO Find out what could cause this and how to deal with it.
          * This will likely require an out-of-memory killer.
@@ -2053,6 +3409,10 @@ vm_page_refill_inactive(void)
 {
     unsigned int i;
 
+    if (vm_page_workingset) {
+        vm_page_workingset_age();
+    }
+
     vm_page_lock_queues();
 
     for (i = 0; i < vm_page_segs_size; i++) {
@@ -82,6 +82,7 @@ struct vm_page {
 	unsigned short type;
 	unsigned short seg_index;
 	unsigned short order;
+	unsigned short node_index;	/* NUMA node */
 	void *priv;
 
 	/*
@@ -122,9 +123,13 @@ struct vm_page {
 			dirty:1,	/* Page must be cleaned (O) */
 			precious:1,	/* Page is precious; data must be
 					 *  returned even if clean (O) */
-			overwriting:1;	/* Request to unlock has been made
+			overwriting:1,	/* Request to unlock has been made
 					 * without having data. (O)
 					 * [See vm_object_overwrite] */
+			referenced_once:1, /* found referenced once while
+					 * inactive (P) */
+			gen:8;		/* generation last found referenced
+					 * while active, modulo 256 (P) */
 
 	vm_prot_t	page_lock;	/* Uses prohibited by data manager (O) */
 	vm_prot_t	unlock_request;	/* Outstanding unlock request (O) */
@@ -325,6 +330,16 @@ extern unsigned int	vm_page_info(
 #define VM_PAGE_SEL_DIRECTMAP   2
 #define VM_PAGE_SEL_HIGHMEM     3
 
+/*
+ * Maximum number of NUMA nodes.
+ */
+#define VM_PAGE_MAX_NODES       8
+
+/*
+ * Node value requesting allocation from the node of the current processor.
+ */
+#define VM_PAGE_NODE_LOCAL      ((unsigned int)-1)
+
 /*
  * Page usage types.
  */
@@ -385,6 +400,32 @@ void vm_page_load(unsigned int seg_index, phys_addr_t start, phys_addr_t end);
 void vm_page_load_heap(unsigned int seg_index, phys_addr_t start,
                        phys_addr_t end);
 
+/*
+ * Report, at boot time, that the given physical memory range belongs to
+ * the given NUMA node.
+ *
+ * Ranges need not match segments. Memory outside any reported range
+ * belongs to node 0.
+ */
+void vm_page_load_node(unsigned int node, phys_addr_t start, phys_addr_t end);
+
+/*
+ * Report, at boot time, the NUMA node of the given processor.
+ */
+void vm_page_load_cpu_node(unsigned int cpu, unsigned int node);
+
+/*
+ * Report, at boot time, the relative distance between two NUMA nodes,
+ * 10 meaning local.
+ */
+void vm_page_load_node_distance(unsigned int from, unsigned int to,
+                                unsigned int distance);
+
+/*
+ * Return the number of NUMA nodes.
+ */
+unsigned int vm_page_nr_nodes(void);
+
 /*
  * Return true if the vm_page module is completely initialized, false
  * otherwise, in which case only vm_page_bootalloc() can be used for
@@ -422,6 +463,14 @@ void vm_page_setup(void);
  */
 void vm_page_manage(struct vm_page *page);
 
+/*
+ * Turn the given reserved page into an allocated one, as if returned by
+ * vm_page_grab, so that it can be inserted into an object.
+ *
+ * It is released like any other page once the object drops it.
+ */
+void vm_page_claim(struct vm_page *page);
+
 /*
  * Return the page descriptor for the given physical address.
  */
@@ -431,12 +480,13 @@ struct vm_page * vm_page_lookup_pa(phys_addr_t pa);
  * Allocate a block of 2^order physical pages.
  *
  * The selector is used to determine the segments from which allocation can
- * be attempted.
+ * be attempted. In each segment, the block is preferably allocated from
+ * the given NUMA node, or VM_PAGE_NODE_LOCAL.
  *
  * This function should only be used by the vm_resident module.
  */
 struct vm_page * vm_page_alloc_pa(unsigned int order, unsigned int selector,
-                                  unsigned short type);
+                                  unsigned short type, unsigned int node);
 
 /*
  * Release a block of 2^order physical pages.
@@ -503,6 +553,51 @@ void vm_page_queues_remove(struct vm_page *page);
  */
 boolean_t vm_page_balance(void);
 
+/*
+ * Compact physical memory after a failed allocation of 2^order pages,
+ * and wake up the compaction thread.
+ *
+ * The selector is used to determine the segments where compaction can
+ * be attempted.
+ *
+ * Return TRUE if a block of that size has been made available, in which
+ * case the allocation should be retried.
+ *
+ * No VM lock may be held when calling this function.
+ */
+boolean_t vm_page_compact(unsigned int order, unsigned int selector);
+
+/*
+ * Compaction thread, see vm_page_compact.
+ */
+void vm_page_compact_thread(void);
+
+/*
+ * Report the free blocks of each segment and compaction statistics.
+ */
+void vm_page_frag_info(host_vm_frag_info_t info);
+
+/*
+ * Report the free pages and allocations of each NUMA node, and the
+ * distances between nodes.
+ */
+void vm_page_numa_info(host_vm_numa_info_t info);
+
+/*
+ * Zero page merging thread, and its control.
+ *
+ * The thread scans scan_pages physical pages every scan_interval
+ * milliseconds, and releases the zero pages of anonymous memory.
+ * Scanning 0 pages disables merging.
+ */
+void vm_page_merge_thread(void);
+void vm_page_merge_setup(unsigned int scan_pages, unsigned int scan_interval);
+
+/*
+ * Report the zero page merging rate and statistics.
+ */
+void vm_page_merge_info(host_vm_merge_info_t info);
+
 /*
  * Evict physical pages.
  *
@@ -532,4 +627,16 @@ boolean_t vm_page_evict(boolean_t *should_wait);
  */
 void vm_page_refill_inactive(void);
 
+/*
+ * Queue a page whose data were just brought back in, either supplied
+ * by its pager or decompressed from the compressed page cache.
+ *
+ * With the working set policy, the page is activated if its refault
+ * distance shows it belongs to the working set, and deactivated
+ * otherwise. The default policy always activates it.
+ *
+ * The page queues must be locked.
+ */
+void vm_page_refault(struct vm_page *page);
+
 #endif	/* _VM_VM_PAGE_H_ */
@@ -37,9 +37,11 @@
 #include <string.h>
 
 #include <mach/vm_prot.h>
+#include <kern/boot_trace.h>
 #include <kern/counters.h>
 #include <kern/debug.h>
 #include <kern/list.h>
+#include <kern/llsync.h>
 #include <kern/sched_prim.h>
 #include <kern/task.h>
 #include <kern/thread.h>
@@ -214,7 +216,9 @@ void vm_page_bootstrap(
 		simple_lock_init(&bucket->lock);
 	}
 
+	boot_trace_begin("vm_page_setup");
 	vm_page_setup();
+	boot_trace_end("vm_page_setup");
 
 	virtual_space_start = round_page(virtual_space_start);
 	virtual_space_end = trunc_page(virtual_space_end);
@@ -350,7 +354,7 @@ void vm_page_insert(
 	bucket = &vm_page_buckets[vm_page_hash(object, offset)];
 	simple_lock(&bucket->lock);
 	mem->next = bucket->pages;
-	bucket->pages = mem;
+	llsync_assign_ptr(bucket->pages, mem);
 	simple_unlock(&bucket->lock);
 
 	/*
@@ -464,7 +468,7 @@ void vm_page_replace(
 	} else {
 		mem->next = VM_PAGE_NULL;
 	}
-	bucket->pages = mem;
+	llsync_assign_ptr(bucket->pages, mem);
 	simple_unlock(&bucket->lock);
 
 	/*
@@ -568,6 +572,25 @@ vm_page_t vm_page_lookup(
 
 	bucket = &vm_page_buckets[vm_page_hash(object, offset)];
 
+	/*
+	 *	Pages of this object can't be entered or removed,
+	 *	since it is locked, and page structures are never
+	 *	freed, so a match found without the bucket lock can
+	 *	be trusted.  A miss can't: a page moving to another
+	 *	bucket may lead the walk astray.
+	 */
+
+	llsync_read_enter();
+	for (mem = llsync_read_ptr(bucket->pages);
+	     mem != VM_PAGE_NULL;
+	     mem = llsync_read_ptr(mem->next)) {
+		if ((mem->object == object) && (mem->offset == offset)) {
+			llsync_read_exit();
+			return mem;
+		}
+	}
+	llsync_read_exit();
+
 	simple_lock(&bucket->lock);
 	for (mem = bucket->pages; mem != VM_PAGE_NULL; mem = mem->next) {
 		VM_PAGE_CHECK(mem);
@@ -759,6 +782,37 @@ boolean_t vm_page_convert(struct vm_page **mp)
 	return TRUE;
 }
 
+/*
+ *	vm_page_grab_node:
+ *
+ *	Return the NUMA node to allocate a page from first,
+ *	according to the memory policy of the current task.
+ */
+
+static unsigned int vm_page_grab_node(void)
+{
+	task_t		task;
+
+	if (current_thread() == THREAD_NULL)
+		return VM_PAGE_NODE_LOCAL;
+
+	task = current_task();
+
+	switch (task->numa_policy) {
+	case VM_NUMA_POLICY_PREFERRED:
+		return task->numa_node;
+
+	case VM_NUMA_POLICY_INTERLEAVE:
+		/* Threads of the task may allocate concurrently */
+		return __atomic_fetch_add(&task->numa_next, 1,
+					  __ATOMIC_RELAXED)
+		       % vm_page_nr_nodes();
+
+	default:
+		return VM_PAGE_NODE_LOCAL;
+	}
+}
+
 /*
  *	vm_page_grab:
  *
@@ -769,6 +823,9 @@ boolean_t vm_page_convert(struct vm_page **mp)
 vm_page_t vm_page_grab(void)
 {
 	vm_page_t	mem;
+	unsigned int	node;
+
+	node = vm_page_grab_node();
 
 	simple_lock(&vm_page_queue_free_lock);
 
@@ -781,7 +838,7 @@ vm_page_t vm_page_grab(void)
 	 * explicit VM calls. The strategy is then to let memory
 	 * pressure balance the physical segments with pageable pages.
 	 */
-	mem = vm_page_alloc_pa(0, VM_PAGE_SEL_DIRECTMAP, VM_PT_KERNEL);
+	mem = vm_page_alloc_pa(0, VM_PAGE_SEL_DIRECTMAP, VM_PT_KERNEL, node);
 
 	if (mem == NULL) {
 		simple_unlock(&vm_page_queue_free_lock);
@@ -859,18 +916,33 @@ vm_page_t vm_page_grab_contig(
 {
 	unsigned int i, order, nr_pages;
 	vm_page_t mem;
+	boolean_t compacted;
 
 	order = vm_page_order(size);
 	nr_pages = 1 << order;
+	compacted = FALSE;
 
-	simple_lock(&vm_page_queue_free_lock);
+	for (;;) {
+		simple_lock(&vm_page_queue_free_lock);
 
-	/* TODO Allow caller to pass type */
-	mem = vm_page_alloc_pa(order, selector, VM_PT_KERNEL);
+		/* TODO Allow caller to pass type */
+		mem = vm_page_alloc_pa(order, selector, VM_PT_KERNEL,
+				       VM_PAGE_NODE_LOCAL);
+
+		if (mem != NULL)
+			break;
 
-	if (mem == NULL) {
 		simple_unlock(&vm_page_queue_free_lock);
-		return NULL;
+
+		/*
+		 *	Free memory may merely be fragmented: move
+		 *	pages out of a block of the requested size,
+		 *	and try again once.
+		 */
+		if (compacted || !vm_page_compact(order, selector))
+			return NULL;
+
+		compacted = TRUE;
 	}
 
 	for (i = 0; i < nr_pages; i++) {
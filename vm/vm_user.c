@@ -659,3 +659,26 @@ kern_return_t vm_allocate_contiguous(
 
 	return KERN_SUCCESS;
 }
+
+/*
+ *	vm_set_page_merging sets the rate at which physical memory is
+ *	scanned for anonymous zero pages, or disables merging if pages
+ *	is 0.  No more than all physical pages are scanned per interval.
+ */
+kern_return_t vm_set_page_merging(
+	host_t			host_priv,
+	natural_t		pages,
+	natural_t		interval)
+{
+	if (host_priv == HOST_NULL)
+		return KERN_INVALID_HOST;
+
+	if ((pages != 0) && (interval == 0))
+		return KERN_INVALID_ARGUMENT;
+
+	if (pages > vm_page_table_size())
+		pages = vm_page_table_size();
+
+	vm_page_merge_setup(pages, interval);
+	return KERN_SUCCESS;
+}
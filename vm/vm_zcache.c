@@ -0,0 +1,530 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *
+ * Compressed data are stored in slab caches of a few size classes, each
+ * a fraction of the page size, so that slabs are single pages filled
+ * with no waste. Pages that don't compress to at most half their size
+ * aren't worth keeping, and are paged out.
+ *
+ * Compressed pages are indexed by object and offset in a hash table,
+ * linked to their object so that they can be discarded with it, and
+ * kept in least recently stored order. All are protected by the cache
+ * lock. The compressor work area is protected by a sleep lock, since
+ * compressed data are allocated while holding it.
+ *
+ * When the cache is full, the least recently stored pages are
+ * decompressed and paged out to make room, so that the default pager
+ * receives the coldest data once the cache overflows. The object of such
+ * a page is only locked if that can be done without waiting, since the
+ * cache lock is taken with object locks held.
+ */
+
+#include <string.h>
+
+#include <kern/assert.h>
+#include <kern/lock.h>
+#include <kern/lz4.h>
+#include <kern/macros.h>
+#include <kern/printf.h>
+#include <kern/slab.h>
+#include <machine/vm_param.h>
+#include <util/atoi.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+#include <vm/vm_pageout.h>
+#include <vm/vm_zcache.h>
+
+extern char *kernel_cmdline;
+
+#define VM_ZCACHE_PARAMETER " zcache="
+
+/*
+ * Maximum size of the cache, in percentage of physical memory.
+ */
+#define VM_ZCACHE_MAX_PERCENT 50
+
+#define VM_ZCACHE_HTABLE_SIZE 4096
+
+/*
+ * Size classes, as page size divisors.
+ */
+static const unsigned char vm_zcache_class_divisors[] = {
+    32, 16, 8, 6, 5, 4, 3, 2
+};
+
+#define VM_ZCACHE_NR_CLASSES ARRAY_SIZE(vm_zcache_class_divisors)
+
+#define VM_ZCACHE_MAX_DATA_SIZE (PAGE_SIZE / 2)
+
+struct vm_zcache_entry {
+    struct vm_zcache_entry *next;   /* hash chain */
+    queue_chain_t objq;             /* compressed pages of the object */
+    queue_chain_t lruq;             /* least recently stored first */
+    vm_object_t object;
+    vm_offset_t offset;
+    unsigned short size;            /* compressed size */
+    unsigned short class;
+    void *data;
+};
+
+static struct kmem_cache vm_zcache_entry_cache;
+static struct kmem_cache vm_zcache_data_caches[VM_ZCACHE_NR_CLASSES];
+static size_t vm_zcache_class_sizes[VM_ZCACHE_NR_CLASSES];
+
+static struct vm_zcache_entry *vm_zcache_htable[VM_ZCACHE_HTABLE_SIZE];
+static queue_head_t vm_zcache_lru;
+
+decl_simple_lock_data(static, vm_zcache_lock)
+
+static lock_data_t vm_zcache_compress_lock;
+static unsigned char vm_zcache_work[LZ4_WORK_SIZE];
+static unsigned char vm_zcache_buf[VM_ZCACHE_MAX_DATA_SIZE];
+
+/*
+ * Size limit and current size of the compressed data, in bytes.
+ */
+static unsigned long vm_zcache_max_size;
+static unsigned long vm_zcache_size;
+
+/*
+ * Statistics.
+ */
+static unsigned long vm_zcache_nr_pages;
+static unsigned long vm_zcache_stores;
+static unsigned long vm_zcache_loads;
+static unsigned long vm_zcache_rejects;
+static unsigned long vm_zcache_overflows;
+static unsigned long vm_zcache_discards;
+
+static inline unsigned long
+vm_zcache_hash(vm_object_t object, vm_offset_t offset)
+{
+    unsigned long hash;
+
+    hash = ((unsigned long)object >> 6) ^ (offset >> PAGE_SHIFT);
+    return hash & (VM_ZCACHE_HTABLE_SIZE - 1);
+}
+
+static unsigned int
+vm_zcache_select_class(size_t size)
+{
+    unsigned int i;
+
+    for (i = 0; i < VM_ZCACHE_NR_CLASSES; i++) {
+        if (size <= vm_zcache_class_sizes[i]) {
+            return i;
+        }
+    }
+
+    panic("vm_zcache: invalid size");
+}
+
+static struct vm_zcache_entry *
+vm_zcache_find(vm_object_t object, vm_offset_t offset,
+               struct vm_zcache_entry ***prevp)
+{
+    struct vm_zcache_entry *entry, **prev;
+
+    prev = &vm_zcache_htable[vm_zcache_hash(object, offset)];
+
+    for (entry = *prev; entry != NULL; entry = entry->next) {
+        if ((entry->object == object) && (entry->offset == offset)) {
+            break;
+        }
+
+        prev = &entry->next;
+    }
+
+    if (prevp != NULL) {
+        *prevp = prev;
+    }
+
+    return entry;
+}
+
+/*
+ * Remove an entry from the cache. The cache lock must be held.
+ */
+static void
+vm_zcache_remove(struct vm_zcache_entry *entry,
+                 struct vm_zcache_entry **prev)
+{
+    vm_object_t object;
+
+    object = entry->object;
+    *prev = entry->next;
+    queue_remove(&object->compressed_pages, entry,
+                 struct vm_zcache_entry *, objq);
+    queue_remove(&vm_zcache_lru, entry, struct vm_zcache_entry *, lruq);
+    assert(object->compressed_page_count != 0);
+    object->compressed_page_count--;
+    vm_zcache_size -= vm_zcache_class_sizes[entry->class];
+    vm_zcache_nr_pages--;
+}
+
+static void
+vm_zcache_free(struct vm_zcache_entry *entry)
+{
+    kmem_cache_free(&vm_zcache_data_caches[entry->class],
+                    (vm_offset_t)entry->data);
+    kmem_cache_free(&vm_zcache_entry_cache, (vm_offset_t)entry);
+}
+
+void
+vm_zcache_init(void)
+{
+    char name[KMEM_CACHE_NAME_SIZE];
+    const char *param;
+    phys_addr_t max_size;
+    int percent;
+    unsigned int i;
+
+    param = strstr(kernel_cmdline, VM_ZCACHE_PARAMETER);
+
+    if (param == NULL) {
+        return;
+    }
+
+    percent = MACH_ATOI_DEFAULT;
+    mach_atoi((const u_char *)param + strlen(VM_ZCACHE_PARAMETER),
+              &percent);
+
+    if (percent <= 0) {
+        return;
+    }
+
+    if (percent > VM_ZCACHE_MAX_PERCENT) {
+        percent = VM_ZCACHE_MAX_PERCENT;
+    }
+
+    /* Compressed data are allocated from directly mapped memory */
+    max_size = vm_page_mem_size() / 100 * percent;
+
+    if (max_size > (VM_PAGE_DIRECTMAP_LIMIT / 2)) {
+        max_size = VM_PAGE_DIRECTMAP_LIMIT / 2;
+    }
+
+    kmem_cache_init(&vm_zcache_entry_cache, "vm_zcache_entry",
+                    sizeof(struct vm_zcache_entry), 0, NULL, 0);
+
+    for (i = 0; i < VM_ZCACHE_NR_CLASSES; i++) {
+        vm_zcache_class_sizes[i] = (PAGE_SIZE / vm_zcache_class_divisors[i])
+                                   & ~(sizeof(long) - 1);
+        sprintf(name, "vm_zcache_%lu",
+                (unsigned long)vm_zcache_class_sizes[i]);
+        kmem_cache_init(&vm_zcache_data_caches[i], name,
+                        vm_zcache_class_sizes[i], 0, NULL, 0);
+    }
+
+    assert(vm_zcache_class_sizes[VM_ZCACHE_NR_CLASSES - 1]
+           == VM_ZCACHE_MAX_DATA_SIZE);
+
+    queue_init(&vm_zcache_lru);
+    simple_lock_init(&vm_zcache_lock);
+    lock_init(&vm_zcache_compress_lock, TRUE);
+    vm_zcache_max_size = max_size;
+
+    printf("vm_zcache: compressed page cache, up to %luM\n",
+           vm_zcache_max_size >> 20);
+}
+
+static void
+vm_zcache_decompress(const struct vm_zcache_entry *entry,
+                     struct vm_page *page)
+{
+    size_t size;
+
+    size = lz4_decompress(entry->data, entry->size,
+                          (void *)phystokv(page->phys_addr), PAGE_SIZE);
+
+    if (size != PAGE_SIZE) {
+        panic("vm_zcache: corrupted page");
+    }
+}
+
+/*
+ * Page out the least recently stored page to make room in the cache.
+ *
+ * No object may be locked. Return TRUE if a page was paged out.
+ */
+static boolean_t
+vm_zcache_evict(void)
+{
+    struct vm_zcache_entry *entry, **prev;
+    struct vm_page *page;
+    vm_object_t object;
+
+    page = vm_page_grab();
+
+    if (page == NULL) {
+        return FALSE;
+    }
+
+    simple_lock(&vm_zcache_lock);
+
+    if (queue_empty(&vm_zcache_lru)) {
+        simple_unlock(&vm_zcache_lock);
+        VM_PAGE_FREE(page);
+        return FALSE;
+    }
+
+    entry = (struct vm_zcache_entry *)queue_first(&vm_zcache_lru);
+    object = entry->object;
+
+    if (!vm_object_lock_try(object)) {
+        simple_unlock(&vm_zcache_lock);
+        VM_PAGE_FREE(page);
+        return FALSE;
+    }
+
+    /* The compressed pages of a dying object are about to be discarded */
+    if (!object->alive) {
+        simple_unlock(&vm_zcache_lock);
+        vm_object_unlock(object);
+        VM_PAGE_FREE(page);
+        return FALSE;
+    }
+
+    vm_zcache_find(object, entry->offset, &prev);
+    vm_zcache_remove(entry, prev);
+    vm_zcache_overflows++;
+    simple_unlock(&vm_zcache_lock);
+
+    /*
+     * Insert the page before releasing the object, so that the offset
+     * is always either resident or compressed.
+     */
+    vm_page_lock_queues();
+    vm_page_insert(page, object, entry->offset);
+    vm_page_unlock_queues();
+
+    vm_zcache_decompress(entry, page);
+    vm_zcache_free(entry);
+    page->dirty = TRUE;
+
+    if (!object->pager_initialized) {
+        vm_object_pager_create(object);
+    }
+
+    if (!object->pager_initialized) {
+        panic("vm_zcache_evict");
+    }
+
+    vm_pageout_page(page, FALSE, TRUE); /* flush it */
+    vm_object_unlock(object);
+    return TRUE;
+}
+
+boolean_t
+vm_zcache_store(struct vm_page *page)
+{
+    struct vm_zcache_entry *entry, **prev;
+    vm_object_t object;
+    void *data;
+    size_t size;
+    unsigned int class;
+
+    object = page->object;
+
+    assert(page->busy);
+    assert(object->internal);
+
+    if (vm_zcache_max_size == 0) {
+        return FALSE;
+    }
+
+    /* Only directly mapped pages can be compressed */
+    if (page->phys_addr >= VM_PAGE_DIRECTMAP_LIMIT) {
+        return FALSE;
+    }
+
+    /*
+     * Allocating and paging out may block, and the page is busy, so
+     * release the object while making room and compressing.
+     */
+
+    vm_object_paging_begin(object);
+    vm_object_unlock(object);
+
+    while (vm_zcache_size >= vm_zcache_max_size) {
+        if (!vm_zcache_evict()) {
+            break;
+        }
+    }
+
+    if (vm_zcache_size >= vm_zcache_max_size) {
+        simple_lock(&vm_zcache_lock);
+        vm_zcache_overflows++;
+        simple_unlock(&vm_zcache_lock);
+        vm_object_lock(object);
+        vm_object_paging_end(object);
+        return FALSE;
+    }
+
+    entry = (struct vm_zcache_entry *)kmem_cache_alloc(&vm_zcache_entry_cache);
+    data = NULL;
+    size = 0;
+    class = 0;
+
+    if (entry != NULL) {
+        lock_write(&vm_zcache_compress_lock);
+        size = lz4_compress((void *)phystokv(page->phys_addr), PAGE_SIZE,
+                            vm_zcache_buf, sizeof(vm_zcache_buf),
+                            vm_zcache_work);
+
+        if (size != 0) {
+            class = vm_zcache_select_class(size);
+            data = (void *)kmem_cache_alloc(&vm_zcache_data_caches[class]);
+
+            if (data != NULL) {
+                memcpy(data, vm_zcache_buf, size);
+            }
+        }
+
+        lock_done(&vm_zcache_compress_lock);
+    }
+
+    vm_object_lock(object);
+
+    if (data == NULL) {
+        if (entry != NULL) {
+            kmem_cache_free(&vm_zcache_entry_cache, (vm_offset_t)entry);
+        }
+
+        simple_lock(&vm_zcache_lock);
+        vm_zcache_rejects++;
+        simple_unlock(&vm_zcache_lock);
+        vm_object_paging_end(object);
+        return FALSE;
+    }
+
+    entry->object = object;
+    entry->offset = page->offset;
+    entry->size = size;
+    entry->class = class;
+    entry->data = data;
+
+    simple_lock(&vm_zcache_lock);
+    assert(vm_zcache_find(object, entry->offset, NULL) == NULL);
+    prev = &vm_zcache_htable[vm_zcache_hash(object, entry->offset)];
+    entry->next = *prev;
+    *prev = entry;
+    queue_enter(&object->compressed_pages, entry,
+                struct vm_zcache_entry *, objq);
+    queue_enter(&vm_zcache_lru, entry, struct vm_zcache_entry *, lruq);
+    object->compressed_page_count++;
+    vm_zcache_size += vm_zcache_class_sizes[class];
+    vm_zcache_nr_pages++;
+    vm_zcache_stores++;
+    simple_unlock(&vm_zcache_lock);
+
+    vm_object_paging_end(object);
+    return TRUE;
+}
+
+boolean_t
+vm_zcache_lookup(vm_object_t object, vm_offset_t offset)
+{
+    struct vm_zcache_entry *entry;
+
+    if (object->compressed_page_count == 0) {
+        return FALSE;
+    }
+
+    simple_lock(&vm_zcache_lock);
+    entry = vm_zcache_find(object, offset, NULL);
+    simple_unlock(&vm_zcache_lock);
+
+    return (entry != NULL);
+}
+
+void
+vm_zcache_load(struct vm_page *page)
+{
+    struct vm_zcache_entry *entry, **prev;
+
+    assert(page->busy);
+
+    simple_lock(&vm_zcache_lock);
+    entry = vm_zcache_find(page->object, page->offset, &prev);
+    assert(entry != NULL);
+    vm_zcache_remove(entry, prev);
+    vm_zcache_loads++;
+    simple_unlock(&vm_zcache_lock);
+
+    vm_zcache_decompress(entry, page);
+    vm_zcache_free(entry);
+    page->dirty = TRUE;
+
+    vm_page_lock_queues();
+    vm_page_refault(page);
+    vm_page_unlock_queues();
+}
+
+void
+vm_zcache_discard(vm_object_t object, vm_offset_t start, vm_offset_t end)
+{
+    struct vm_zcache_entry *entry, *next, *list, **prev;
+
+    if (object->compressed_page_count == 0) {
+        return;
+    }
+
+    list = NULL;
+
+    simple_lock(&vm_zcache_lock);
+
+    entry = (struct vm_zcache_entry *)queue_first(&object->compressed_pages);
+
+    while (!queue_end(&object->compressed_pages, (queue_entry_t)entry)) {
+        next = (struct vm_zcache_entry *)queue_next(&entry->objq);
+
+        if ((start <= entry->offset) && (entry->offset < end)) {
+            vm_zcache_find(object, entry->offset, &prev);
+            vm_zcache_remove(entry, prev);
+            vm_zcache_discards++;
+            entry->next = list;
+            list = entry;
+        }
+
+        entry = next;
+    }
+
+    simple_unlock(&vm_zcache_lock);
+
+    while (list != NULL) {
+        entry = list;
+        list = entry->next;
+        vm_zcache_free(entry);
+    }
+}
+
+void
+vm_zcache_info(host_vm_zcache_info_t info)
+{
+    simple_lock(&vm_zcache_lock);
+    info->max_pages = vm_zcache_max_size >> PAGE_SHIFT;
+    info->pool_pages = vm_zcache_size >> PAGE_SHIFT;
+    info->nr_pages = vm_zcache_nr_pages;
+    info->stores = vm_zcache_stores;
+    info->loads = vm_zcache_loads;
+    info->rejects = vm_zcache_rejects;
+    info->overflows = vm_zcache_overflows;
+    info->discards = vm_zcache_discards;
+    simple_unlock(&vm_zcache_lock);
+}
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2026 Free Software Foundation, Inc.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License as
+ * published by the Free Software Foundation; either version 2, or (at
+ * your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+ *
+ *
+ * Compressed page cache.
+ *
+ * Dirty pages of internal objects are compressed in memory when evicted,
+ * instead of being sent to the default pager. Faults decompress them
+ * back. The default pager only receives pages that don't compress well,
+ * and the least recently stored pages, which are paged out to make room
+ * once the cache is full.
+ *
+ * A page offset of an object is either resident, compressed, or neither,
+ * never both. Objects with compressed pages are neither collapsed nor
+ * coalesced, as if they had been paged out.
+ *
+ * The cache is disabled unless the "zcache=<percent>" boot option sets
+ * its maximum size, as a percentage of physical memory.
+ */
+
+#ifndef _VM_VM_ZCACHE_H
+#define _VM_VM_ZCACHE_H
+
+#include <mach/boolean.h>
+#include <mach/host_info.h>
+#include <vm/vm_object.h>
+#include <vm/vm_page.h>
+
+/*
+ * Initialize the compressed page cache module.
+ */
+void vm_zcache_init(void);
+
+/*
+ * Compress a page into the cache.
+ *
+ * The page must be busy, unmapped, and belong to an internal object,
+ * which must be locked. The object lock may be released and reacquired,
+ * and older compressed pages may be paged out to make room.
+ * Return TRUE if the page was compressed, in which case the caller
+ * frees it, FALSE if it must be paged out.
+ */
+boolean_t vm_zcache_store(struct vm_page *page);
+
+/*
+ * Return true if the page at the given offset of the given object is
+ * compressed.
+ *
+ * The object must be locked.
+ */
+boolean_t vm_zcache_lookup(vm_object_t object, vm_offset_t offset);
+
+/*
+ * Decompress the data of a page, and remove it from the cache.
+ *
+ * The page must be busy and inserted in its object, which must be locked,
+ * at an offset for which vm_zcache_lookup returned true. The page is
+ * marked dirty, since its data now only exist in memory, and queued
+ * according to its refault distance.
+ */
+void vm_zcache_load(struct vm_page *page);
+
+/*
+ * Discard the compressed pages of an object in the given range.
+ *
+ * The object must be locked.
+ */
+void vm_zcache_discard(vm_object_t object, vm_offset_t start,
+                       vm_offset_t end);
+
+/*
+ * Report the size and statistics of the cache.
+ */
+void vm_zcache_info(host_vm_zcache_info_t info);
+
+#endif /* _VM_VM_ZCACHE_H */